@@ -0,0 +1,158 @@
+#include "allocators.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace qgl;
+using namespace std;
+
+#ifdef QGL_COUNT_ALLOCATIONS
+static atomic<unsigned long long> allocationsCount(0);
+static atomic<unsigned long long> freesCount(0);
+static atomic<unsigned long long> bytesCount(0);
+
+static void* countedAllocation(size_t size) {
+  allocationsCount.fetch_add(1, memory_order_relaxed);
+  bytesCount.fetch_add(size, memory_order_relaxed);
+  return malloc(size > 0 ? size : 1);
+}
+
+static void countedFree(void* pointer) {
+  if (pointer == NULL)
+    return;
+  freesCount.fetch_add(1, memory_order_relaxed);
+  free(pointer);
+}
+
+void* operator new(size_t size) {
+  void* pointer = countedAllocation(size);
+  if (pointer == NULL)
+    throw bad_alloc();
+  return pointer;
+}
+
+void* operator new[](size_t size) {
+  void* pointer = countedAllocation(size);
+  if (pointer == NULL)
+    throw bad_alloc();
+  return pointer;
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept { return countedAllocation(size); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return countedAllocation(size); }
+void operator delete(void* pointer) noexcept { countedFree(pointer); }
+void operator delete[](void* pointer) noexcept { countedFree(pointer); }
+void operator delete(void* pointer, const nothrow_t&) noexcept { countedFree(pointer); }
+void operator delete[](void* pointer, const nothrow_t&) noexcept { countedFree(pointer); }
+
+bool qgl::heapCounting() {
+  return true;
+}
+
+unsigned long long qgl::heapAllocations() {
+  return allocationsCount.load(memory_order_relaxed);
+}
+
+HeapStats qgl::heapStats() {
+  HeapStats stats;
+  stats.allocations = allocationsCount.load(memory_order_relaxed);
+  stats.frees = freesCount.load(memory_order_relaxed);
+  stats.bytes = bytesCount.load(memory_order_relaxed);
+  return stats;
+}
+#else
+bool qgl::heapCounting() {
+  return false;
+}
+
+unsigned long long qgl::heapAllocations() {
+  return 0;
+}
+
+HeapStats qgl::heapStats() {
+  HeapStats stats;
+  stats.allocations = stats.frees = stats.bytes = 0;
+  return stats;
+}
+#endif
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize > 0 ? blockSize : 1), offset(0) {
+  stats.used = stats.capacity = stats.peak = 0;
+  stats.blockAllocations = 0;
+}
+
+Arena::~Arena() {
+  release();
+}
+
+void* Arena::allocate(size_t bytes, size_t alignment) {
+  if (!blocks.empty()) {
+    Block& block = blocks.back();
+    uintptr_t address = reinterpret_cast<uintptr_t>(block.data) + offset;
+    size_t padding = (alignment - address % alignment) % alignment;
+    if (offset + padding + bytes <= block.size) {
+      offset += padding + bytes;
+      stats.used += padding + bytes;
+      return block.data + offset - bytes;
+    }
+  }
+  // The end of the full block is lost until the reset
+  addBlock(bytes + alignment);
+  return allocate(bytes, alignment);
+}
+
+void Arena::reserve(size_t bytes) {
+  if (blocks.empty() || blocks.back().size - offset < bytes + DEFAULT_ALIGNMENT)
+    addBlock(bytes + DEFAULT_ALIGNMENT);
+}
+
+void Arena::addBlock(size_t bytes) {
+  Block block;
+  block.size = max(bytes, blockSize);
+  block.data = new char[block.size];
+  blocks.push_back(block);
+  offset = 0;
+  stats.capacity += block.size;
+  stats.blockAllocations++;
+}
+
+void Arena::reset() {
+  stats.peak = max(stats.peak, stats.used);
+  stats.used = 0;
+  offset = 0;
+  if (blocks.size() > 1) {
+    size_t capacity = stats.capacity;
+    release();
+    addBlock(capacity);
+  }
+}
+
+void Arena::release() {
+  stats.peak = max(stats.peak, stats.used);
+  for (unsigned int i = 0 ; i < blocks.size() ; i++)
+    delete[] blocks[i].data;
+  blocks.clear();
+  offset = 0;
+  stats.used = stats.capacity = 0;
+}
+
+FrameAllocator::FrameAllocator(size_t size) : Arena(size) {
+  // First block allocated up front, not during a frame
+  reserve(0);
+  framesNumber = 0;
+  frameStartAllocations = heapAllocations();
+  lastFrameHeapAllocations = 0;
+  heapAllocatingFrames = 0;
+}
+
+void FrameAllocator::endFrame() {
+  reset();
+  unsigned long long allocations = heapAllocations();
+  lastFrameHeapAllocations = allocations - frameStartAllocations;
+  if (lastFrameHeapAllocations > 0)
+    heapAllocatingFrames++;
+  frameStartAllocations = allocations;
+  framesNumber++;
+}
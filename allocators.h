@@ -0,0 +1,214 @@
+#ifndef ALLOCATORS_H
+#define ALLOCATORS_H
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+
+namespace qgl {
+
+// Heap allocations of the whole program through operator new. They are only
+// counted when built with QGL_COUNT_ALLOCATIONS, which replaces the global
+// operator new and delete, the counters stay at 0 otherwise.
+struct HeapStats {
+  unsigned long long allocations;
+  unsigned long long frees;
+  unsigned long long bytes; // allocated in total, not in use
+};
+
+bool heapCounting();
+unsigned long long heapAllocations();
+HeapStats heapStats();
+
+struct ArenaStats {
+  size_t used; // since the last reset
+  size_t capacity; // of the blocks
+  size_t peak; // most bytes used between two resets
+  unsigned int blockAllocations; // heap allocations made for the blocks
+};
+
+// Monotonic allocator: an allocation takes the next bytes of the current
+// block, a new block is added when it is full. Nothing is freed before reset
+// or release, which free everything in one shot.
+class Arena {
+
+  public:
+    static const size_t DEFAULT_ALIGNMENT = 16;
+
+    Arena(size_t blockSize = 64 * 1024);
+    ~Arena();
+
+    void* allocate(size_t bytes, size_t alignment = DEFAULT_ALIGNMENT);
+    template <typename T>
+    T* allocateArray(size_t count) {
+      return static_cast<T*>(allocate(count * sizeof (T), alignof (T) > DEFAULT_ALIGNMENT ? alignof (T) : DEFAULT_ALIGNMENT));
+    }
+    // Makes sure bytes can be allocated without adding a block
+    void reserve(size_t bytes);
+
+    // Forgets the allocations but keeps the memory. Several blocks are merged
+    // in one so that the next cycle of the same size allocates nothing.
+    void reset();
+    // Frees the blocks
+    void release();
+
+    const ArenaStats& getStats() const { return stats; }
+
+  private:
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    struct Block {
+      char* data;
+      size_t size;
+    };
+
+    void addBlock(size_t bytes);
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t offset; // in the last block
+    ArenaStats stats;
+
+};
+
+// Linear allocator for the transient data of one frame, reset once the frame
+// is presented. It also counts the heap allocations made during each frame,
+// which should be none once the frames are in a steady state.
+class FrameAllocator : public Arena {
+
+  public:
+    FrameAllocator(size_t size = 1024 * 1024);
+
+    // Right after glfwSwapBuffers
+    void endFrame();
+
+    unsigned int getFramesNumber() const { return framesNumber; }
+    // Heap allocations of the whole program during the last frame, with QGL_COUNT_ALLOCATIONS
+    unsigned long long getLastFrameHeapAllocations() const { return lastFrameHeapAllocations; }
+    unsigned int getHeapAllocatingFrames() const { return heapAllocatingFrames; }
+
+  private:
+    unsigned int framesNumber;
+    unsigned long long frameStartAllocations;
+    unsigned long long lastFrameHeapAllocations;
+    unsigned int heapAllocatingFrames;
+
+};
+
+// Standard allocator taking its memory from an arena, for containers of
+// temporaries. Deallocating does nothing, the memory returns with the arena
+// reset. Without arena it allocates on the heap.
+template <typename T>
+class ArenaAllocator {
+
+  public:
+    typedef T value_type;
+
+    ArenaAllocator(Arena* arena = NULL) : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.getArena()) {}
+
+    T* allocate(size_t count) {
+      if (arena != NULL)
+        return arena->allocateArray<T>(count);
+      return static_cast<T*>(::operator new(count * sizeof (T)));
+    }
+    void deallocate(T* pointer, size_t) {
+      if (arena == NULL)
+        ::operator delete(pointer);
+    }
+
+    Arena* getArena() const { return arena; }
+
+  private:
+    Arena* arena;
+
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.getArena() == b.getArena(); }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.getArena() != b.getArena(); }
+
+// Vector of temporaries in an arena
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+struct PoolStats {
+  unsigned int objects; // constructed
+  unsigned int inUse;
+  unsigned long long acquired;
+  unsigned long long reused;
+};
+
+// Fixed-size objects recycled instead of deleted. acquire returns a released
+// object as it was left, its containers keeping their capacity, and only
+// constructs new ones when none is free. Objects are stored in chunks so that
+// their addresses never change, they are destroyed with the pool. A producer
+// and a consumer thread can share a pool, acquire and release lock.
+template <typename T>
+class Pool {
+
+  public:
+    Pool(unsigned int chunkSize = 16) : chunkSize(chunkSize > 0 ? chunkSize : 1), lastChunkUsed(0) {
+      stats.objects = stats.inUse = 0;
+      stats.acquired = stats.reused = 0;
+    }
+
+    ~Pool() {
+      for (unsigned int i = 0 ; i < chunks.size() ; i++)
+        delete[] chunks[i];
+    }
+
+    T* acquire() {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      stats.acquired++;
+      stats.inUse++;
+      if (!freeObjects.empty()) {
+        T* object = freeObjects.back();
+        freeObjects.pop_back();
+        stats.reused++;
+        return object;
+      }
+      if (chunks.empty() || lastChunkUsed == chunkSize) {
+        chunks.push_back(new T[chunkSize]);
+        lastChunkUsed = 0;
+        stats.objects += chunkSize;
+        // releasing never allocates
+        freeObjects.reserve(stats.objects);
+      }
+      return &chunks.back()[lastChunkUsed++];
+    }
+
+    void release(T* object) {
+      if (object == NULL)
+        return;
+      std::lock_guard<std::mutex> lock(poolMutex);
+      stats.inUse--;
+      freeObjects.push_back(object);
+    }
+
+    PoolStats getStats() const {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      return stats;
+    }
+
+  private:
+    Pool(const Pool&);
+    Pool& operator=(const Pool&);
+
+    unsigned int chunkSize;
+    std::vector<T*> chunks;
+    unsigned int lastChunkUsed;
+    std::vector<T*> freeObjects;
+    mutable std::mutex poolMutex;
+    PoolStats stats;
+
+};
+
+}
+
+#endif // ALLOCATORS_H
@@ -0,0 +1,285 @@
+// Reproducible rendering benchmark: generates a synthetic OBJ/MTL scene, loads it,
+// renders it headless along a fixed camera orbit and writes the results as JSON.
+// Build with QGL_HEADLESS defined, together with the library sources and scenegenerator.cpp.
+// Usage: benchmark [--objects N] [--triangles M] [--materials K] [--textures L] [--seed S]
+//                  [--frames F] [--size WxH] [--folder DIR] [--shaders DIR] [--output FILE]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "scenegenerator.h"
+#include "offscreencontext.h"
+#include "framebuffer.h"
+#include "shadervariants.h"
+#include "jobsystem.h"
+#include "objloader.h"
+#include "profiler.h"
+#include "transforms.h"
+
+using namespace qgl;
+using namespace std;
+
+#ifndef QGL_HEADLESS
+
+int main() {
+  cerr << "The benchmark renders headless: build it with QGL_HEADLESS defined." << endl;
+  return 1;
+}
+
+#else
+
+typedef chrono::steady_clock Clock;
+
+static double milliseconds(Clock::time_point start, Clock::time_point end) {
+  return chrono::duration<double, milli>(end - start).count();
+}
+
+// Resident memory in kB from /proc, 0 where it is not available
+static long memoryKB(const char* field) {
+  ifstream status("/proc/self/status");
+  string line;
+  size_t length = strlen(field);
+  while (getline(status, line)) {
+    if (line.compare(0, length, field) == 0)
+      return atol(line.c_str() + length + 1);
+  }
+  return 0;
+}
+
+// Resets the peak resident memory (VmHWM) to the current one, Linux only
+static void resetPeakMemory() {
+  ofstream clearRefs("/proc/self/clear_refs");
+  if (clearRefs)
+    clearRefs << "5";
+}
+
+static double percentile(const vector<double>& sorted, double rank) {
+  if (sorted.empty())
+    return 0.0;
+  unsigned int index = (unsigned int) (rank * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+static bool sameVector(const qm::Vec3f& a, const qm::Vec3f& b) {
+  return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+// Whether drawing with b after a sets the same uniforms and textures, so that
+// materials count as changed whether or not the loader shares them
+static bool sameMaterial(const Material& a, const Material& b) {
+  return sameVector(a.ambientColor, b.ambientColor) && sameVector(a.diffuseColor, b.diffuseColor)
+         && sameVector(a.specularColor, b.specularColor) && a.d == b.d
+         && a.diffuseTexture.get() == b.diffuseTexture.get() && a.specularTexture.get() == b.specularTexture.get();
+}
+
+int main(int argc, char** argv) {
+  SceneParameters parameters;
+  parameters.objects = 64;
+  parameters.trianglesPerObject = 20000;
+  parameters.materials = 8;
+  parameters.textures = 4;
+  parameters.textureSize = 256;
+  parameters.seed = 1;
+  int frames = 300;
+  int width = 1280, height = 720;
+  string folder = ".", shaders = "shaders", output = "benchmark.json";
+
+  for (int i = 1 ; i + 1 < argc ; i += 2) {
+    string option = argv[i];
+    const char* value = argv[i + 1];
+    if (option == "--objects")
+      parameters.objects = atoi(value);
+    else if (option == "--triangles")
+      parameters.trianglesPerObject = atoi(value);
+    else if (option == "--materials")
+      parameters.materials = atoi(value);
+    else if (option == "--textures")
+      parameters.textures = atoi(value);
+    else if (option == "--seed")
+      parameters.seed = atoi(value);
+    else if (option == "--frames")
+      frames = atoi(value);
+    else if (option == "--size")
+      sscanf(value, "%dx%d", &width, &height);
+    else if (option == "--folder")
+      folder = value;
+    else if (option == "--shaders")
+      shaders = value;
+    else if (option == "--output")
+      output = value;
+    else {
+      cerr << "Unknown option " << option << endl;
+      return 1;
+    }
+  }
+
+  // Scene generation
+  Clock::time_point start = Clock::now();
+  SceneGenerator generator(parameters);
+  if (!generator.generate(folder))
+    return 1;
+  double generateTime = milliseconds(start, Clock::now());
+
+  OffscreenContext context;
+  if (!context.create(4, 0))
+    return 1;
+  glewExperimental = GL_TRUE;
+  glewInit();
+  FrameBuffer target;
+  if (!target.create(width, height))
+    return 1;
+  long memoryBeforeLoad = memoryKB("VmRSS:");
+  resetPeakMemory();
+
+  // Loading: parsing then vertex expansion and upload
+  JobSystem jobSystem;
+  start = Clock::now();
+  OBJLoader loader;
+  vector<Object> objects;
+  if (!loader.loadObjects(generator.getGeometryFile(), objects, generator.getMaterialFile()))
+    return 1;
+  Clock::time_point parsed = Clock::now();
+  unsigned long triangles = 0;
+  for (unsigned int i = 0 ; i < objects.size() ; i++) {
+    objects[i].computeVertices(false, &jobSystem);
+    objects[i].createVAO();
+    triangles += objects[i].trianglesNumber();
+  }
+  glFinish();
+  Clock::time_point uploaded = Clock::now();
+  double parseTime = milliseconds(start, parsed);
+  double uploadTime = milliseconds(parsed, uploaded);
+  long memoryAfterLoad = memoryKB("VmRSS:");
+  // Includes the copies made while loading, freed by now
+  long loadPeakMemory = memoryKB("VmHWM:");
+
+  ShaderVariants variants;
+  variants.setSources(shaders + "/customMatrices_vs.glsl", shaders + "/phong_fs.glsl");
+  const char* uniforms[] = {
+    "view", "proj", "model",
+    "lightPosition_eye[0]", "lightDiffuse[0]", "lightSpecular[0]", "lightAmbient[0]",
+    "ambientColor", "diffuseColor", "specularColor", "diffuseMap", "specularMap"
+  };
+  for (unsigned int i = 0 ; i < sizeof (uniforms) / sizeof (uniforms[0]) ; i++)
+    variants.useUniform(uniforms[i]);
+  variants.setUniformTextureIndex("diffuseMap", 0);
+  variants.setUniformTextureIndex("specularMap", 1);
+
+  qm::Vec3f lightPosition(0.f, 20.f, 0.f);
+  qm::Vec3f lightDiffuse(0.9f, 0.9f, 0.9f), lightSpecular(1.f, 1.f, 1.f), lightAmbient(0.2f, 0.2f, 0.2f);
+  float radius = generator.getSceneRadius();
+  qm::Mat4f projection = perspective(67.f, (float) width / (float) height, 0.1f, 4.f * radius);
+
+  target.bind();
+  glClearColor(0.6f, 0.6f, 0.6f, 1.0f);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_CULL_FACE);
+  glCullFace(GL_BACK);
+  glFrontFace(GL_CCW);
+
+  // Compile every variant before measuring
+  for (unsigned int i = 0 ; i < objects.size() ; i++)
+    variants.get(objects[i].shaderFeatures(1));
+
+  Profiler profiler;
+  vector<double> frameTimes;
+  unsigned long drawCalls = 0, programChanges = 0, materialChanges = 0;
+
+  for (int frame = 0 ; frame < frames ; frame++) {
+    Clock::time_point frameStart = Clock::now();
+    profiler.beginFrame();
+
+    // Fixed orbit around the scene, one turn over the run
+    float angle = 2.f * (float) M_PI * frame / frames;
+    qm::Vec3f camera(radius * cos(angle), 0.5f * radius, radius * sin(angle));
+    qm::Mat4f view = lookAt(camera, qm::Vec3f(0.f, 0.f, 0.f), qm::Vec3f(0.f, 1.f, 0.f));
+    qm::Vec3f lightEye = transformPoint(view, lightPosition);
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    ShaderProgram* program = NULL;
+    Material* material = NULL;
+    for (unsigned int i = 0 ; i < objects.size() ; i++) {
+      ShaderProgram& variant = variants.get(objects[i].shaderFeatures(1));
+      if (&variant != program) {
+        program = &variant;
+        program->use();
+        program->setUniformMat4f("view", view);
+        program->setUniformMat4f("proj", projection);
+        program->setUniformVec3f("lightPosition_eye[0]", lightEye);
+        program->setUniformVec3f("lightDiffuse[0]", lightDiffuse);
+        program->setUniformVec3f("lightSpecular[0]", lightSpecular);
+        program->setUniformVec3f("lightAmbient[0]", lightAmbient);
+        programChanges++;
+        material = NULL;
+      }
+      program->setUniformMat4f("model", objects[i].retrieveModelMatrix());
+      if (material == NULL || !sameMaterial(objects[i].getMaterial(), *material)) {
+        material = &objects[i].getMaterial();
+        program->setUniformsFromMaterial(*material);
+        materialChanges++;
+      }
+      glBindVertexArray(objects[i].getVAO());
+      glDrawArrays(GL_TRIANGLES, 0, objects[i].verticesNumber());
+      drawCalls++;
+    }
+
+    profiler.endFrame();
+    // Wait for the GPU so that the frame time includes the rasterization
+    glFinish();
+    frameTimes.push_back(milliseconds(frameStart, Clock::now()));
+  }
+
+  vector<double> sorted = frameTimes;
+  sort(sorted.begin(), sorted.end());
+  double totalTime = 0.0;
+  for (unsigned int i = 0 ; i < frameTimes.size() ; i++)
+    totalTime += frameTimes[i];
+
+  vector<ProfileScopeStats> stats = profiler.getStats();
+  double gpuAverage = 0.0, gpuP99 = 0.0;
+  for (unsigned int i = 0 ; i < stats.size() ; i++) {
+    if (stats[i].name == "frame") {
+      gpuAverage = stats[i].gpuAverage;
+      gpuP99 = stats[i].gpuP99;
+    }
+  }
+
+  ofstream file(output.c_str());
+  if (!file) {
+    cerr << "Could not write " << output << endl;
+    return 1;
+  }
+  double perFrame = frames > 0 ? 1.0 / frames : 0.0;
+  file << "{\n";
+  file << "  \"scene\": {\"objects\": " << parameters.objects << ", \"triangles_per_object\": " << parameters.trianglesPerObject;
+  file << ", \"materials\": " << parameters.materials << ", \"textures\": " << parameters.textures;
+  file << ", \"seed\": " << parameters.seed << ", \"triangles\": " << triangles << "},\n";
+  file << "  \"width\": " << width << ",\n  \"height\": " << height << ",\n  \"frames\": " << frames << ",\n";
+  file << "  \"generate_ms\": " << generateTime << ",\n";
+  file << "  \"parse_ms\": " << parseTime << ",\n";
+  file << "  \"upload_ms\": " << uploadTime << ",\n";
+  file << "  \"frame_ms\": {\"min\": " << percentile(sorted, 0.0) << ", \"p50\": " << percentile(sorted, 0.5);
+  file << ", \"p90\": " << percentile(sorted, 0.9) << ", \"p99\": " << percentile(sorted, 0.99);
+  file << ", \"max\": " << percentile(sorted, 1.0) << ", \"average\": " << (frames > 0 ? totalTime / frames : 0.0) << "},\n";
+  file << "  \"gpu_frame_ms\": {\"average\": " << gpuAverage << ", \"p99\": " << gpuP99 << "},\n";
+  file << "  \"draw_calls_per_frame\": " << drawCalls * perFrame << ",\n";
+  file << "  \"program_changes_per_frame\": " << programChanges * perFrame << ",\n";
+  file << "  \"material_changes_per_frame\": " << materialChanges * perFrame << ",\n";
+  file << "  \"memory_kb\": {\"before_load\": " << memoryBeforeLoad << ", \"after_load\": " << memoryAfterLoad;
+  file << ", \"load_peak\": " << loadPeakMemory;
+  file << ", \"peak\": " << memoryKB("VmHWM:") << "}\n";
+  file << "}\n";
+
+  cout << "Load: " << parseTime << " ms parsing, " << uploadTime << " ms upload, " << loadPeakMemory << " kB peak" << endl;
+  cout << "Results written to " << output << endl;
+  return 0;
+}
+
+#endif // QGL_HEADLESS
@@ -0,0 +1,83 @@
+// Frame capture sinks throughput, in frames per second, at 1080p and 4K.
+// Build: g++ -O2 -mssse3 -std=c++11 -I.. capturebench.cpp ../framesink.cpp ../colorconversion.cpp stb_image_write.c
+// Usage: capturebench [output folder] [frames]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "framesink.h"
+#include "colorconversion.h"
+
+using namespace qgl;
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Smooth gradients with some noise, closer to a rendered frame than pure noise
+static void fillFrame(vector<unsigned char>& pixels, int width, int height, int frame) {
+  unsigned int seed = 12345 + frame;
+  for (int y = 0 ; y < height ; y++) {
+    for (int x = 0 ; x < width ; x++) {
+      seed = seed * 1664525u + 1013904223u;
+      unsigned char* p = &pixels[3 * (y * width + x)];
+      p[0] = (unsigned char) ((x + frame) * 255 / width);
+      p[1] = (unsigned char) (y * 255 / height);
+      p[2] = (unsigned char) ((seed >> 24) & 0x1f);
+    }
+  }
+}
+
+static double framesPerSecond(FrameSink& sink, const vector<unsigned char>& pixels, int width, int height, int frames) {
+  Clock::time_point start = Clock::now();
+  for (int i = 0 ; i < frames ; i++)
+    sink.write(&pixels[0], width, height, i);
+  sink.close();
+  double seconds = chrono::duration<double>(Clock::now() - start).count();
+  return frames / seconds;
+}
+
+typedef void (*Conversion)(const unsigned char*, int, int, bool, unsigned char*, unsigned char*, unsigned char*);
+
+static double conversionsPerSecond(Conversion convert, const vector<unsigned char>& pixels, int width, int height, int frames) {
+  vector<unsigned char> planes(width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2));
+  unsigned char* y = &planes[0];
+  unsigned char* u = y + width * height;
+  unsigned char* v = u + ((width + 1) / 2) * ((height + 1) / 2);
+  Clock::time_point start = Clock::now();
+  for (int i = 0 ; i < frames ; i++)
+    convert(&pixels[0], width, height, true, y, u, v);
+  double seconds = chrono::duration<double>(Clock::now() - start).count();
+  return frames / seconds;
+}
+
+int main(int argc, char** argv) {
+  string folder = argc > 1 ? argv[1] : ".";
+  int frames = argc > 2 ? atoi(argv[2]) : 30;
+  int sizes[2][2] = { { 1920, 1080 }, { 3840, 2160 } };
+
+  printf("%-10s %-22s %12s\n", "size", "path", "frames/s");
+  for (int i = 0 ; i < 2 ; i++) {
+    int width = sizes[i][0], height = sizes[i][1];
+    vector<unsigned char> pixels(width * height * 3);
+    fillFrame(pixels, width, height, i);
+    char size[32];
+    sprintf(size, "%dx%d", width, height);
+
+    printf("%-10s %-22s %12.1f\n", size, "rgb->yuv scalar", conversionsPerSecond(rgbToYUV420Scalar, pixels, width, height, frames));
+    printf("%-10s %-22s %12.1f\n", size, "rgb->yuv", conversionsPerSecond(rgbToYUV420, pixels, width, height, frames));
+
+    // PNG frames are encoded on a single thread here: FrameCapture divides the cost by its workers
+    PNGSink png(folder);
+    printf("%-10s %-22s %12.1f\n", size, "png (1 thread)", framesPerSecond(png, pixels, width, height, frames < 10 ? frames : 10));
+
+    StreamSink y4m(folder + "/capturebench.y4m", StreamSink::Y4M);
+    printf("%-10s %-22s %12.1f\n", size, "y4m file", framesPerSecond(y4m, pixels, width, height, frames));
+
+    StreamSink raw(folder + "/capturebench.rgb", StreamSink::RAW_RGB);
+    printf("%-10s %-22s %12.1f\n", size, "raw rgb file", framesPerSecond(raw, pixels, width, height, frames));
+  }
+  return 0;
+}
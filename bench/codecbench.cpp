@@ -0,0 +1,128 @@
+// Size, encoding and decoding time of MeshCodec on a sphere with normals, texture
+// coordinates and colors, or on a binary PLY file, and the time to get the mesh from a
+// disk of the given bandwidth: encoded and decoded, or read as the raw float arrays.
+// Decodes on the given number of threads, 0 for the hardware concurrency.
+// Build together with meshcodec.cpp, plyloader.cpp, mappedfile.cpp and jobsystem.cpp.
+// Usage: codecbench [triangles in millions | file.ply] [disk MB/s] [position bits] [threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "jobsystem.h"
+#include "meshcodec.h"
+#include "plyloader.h"
+
+using namespace qgl;
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static void makeSphere(IndexedMesh& mesh, unsigned int triangles) {
+  unsigned int rings = max(2u, (unsigned int) sqrt(triangles / 4.0));
+  unsigned int segments = max(3u, triangles / (2 * rings));
+  for (unsigned int r = 0 ; r <= rings ; r++) {
+    float theta = M_PI * r / rings;
+    for (unsigned int s = 0 ; s <= segments ; s++) {
+      float phi = 2.f * M_PI * s / segments;
+      float p[3] = { sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi) };
+      for (int c = 0 ; c < 3 ; c++) {
+        mesh.positions.push_back(p[c]);
+        mesh.normals.push_back(p[c]);
+        mesh.colors.push_back(p[c] * 0.5f + 0.5f);
+      }
+      mesh.uvs.push_back((float) s / segments);
+      mesh.uvs.push_back((float) r / rings);
+    }
+  }
+  for (unsigned int r = 0 ; r < rings ; r++) {
+    for (unsigned int s = 0 ; s < segments ; s++) {
+      int a = r * (segments + 1) + s, b = a + segments + 1;
+      int quad[6] = { a, a + 1, b, a + 1, b + 1, b };
+      for (int k = 0 ; k < 6 ; k++) {
+        mesh.indices.push_back(quad[k]);
+        mesh.indices.push_back(quad[k]);
+        mesh.indices.push_back(quad[k]);
+      }
+    }
+  }
+}
+
+// As float arrays and 3 indices per triangle, like a binary PLY file
+static size_t rawSize(const IndexedMesh& mesh) {
+  return (mesh.positions.size() + mesh.normals.size() + mesh.uvs.size() + mesh.colors.size()) * sizeof (float)
+         + mesh.trianglesNumber() * 3 * sizeof (int);
+}
+
+static double seconds(Clock::time_point start) {
+  return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Largest position difference over the triangle vertices, which the codec may rotate
+static float maxPositionError(const IndexedMesh& original, const IndexedMesh& decoded) {
+  float error = 0.f;
+  for (unsigned int t = 0 ; t < original.trianglesNumber() ; t++) {
+    float best = INFINITY;
+    for (int r = 0 ; r < 3 ; r++) {
+      float rotationError = 0.f;
+      for (int k = 0 ; k < 3 ; k++) {
+        const float* a = &original.positions[original.indices[t * 9 + ((r + k) % 3) * 3] * 3];
+        const float* b = &decoded.positions[decoded.indices[t * 9 + k * 3] * 3];
+        for (int c = 0 ; c < 3 ; c++)
+          rotationError = max(rotationError, fabs(a[c] - b[c]));
+      }
+      best = min(best, rotationError);
+    }
+    error = max(error, best);
+  }
+  return error;
+}
+
+int main(int argc, char** argv) {
+  string input = argc > 1 ? argv[1] : "1";
+  double bandwidth = argc > 2 ? atof(argv[2]) : 500.0;
+  IndexedMesh mesh;
+  if (input.size() > 4 && input.substr(input.size() - 4) == ".ply") {
+    PLYLoader plyLoader;
+    if (!plyLoader.load(input, mesh))
+      return 1;
+  }
+  else
+    makeSphere(mesh, (unsigned int) (atof(input.c_str()) * 1e6));
+
+  MeshCodec meshCodec;
+  if (argc > 3)
+    meshCodec.setPositionBits(atoi(argv[3]));
+  unsigned int threads = argc > 4 ? atoi(argv[4]) : 1;
+  JobSystem jobSystem(threads);
+  if (threads != 1)
+    meshCodec.setJobSystem(&jobSystem);
+  vector<unsigned char> data;
+  Clock::time_point start = Clock::now();
+  if (!meshCodec.encode(mesh, data))
+    return 1;
+  double encodeSeconds = seconds(start);
+
+  IndexedMesh decoded;
+  const int runs = 5;
+  start = Clock::now();
+  for (int i = 0 ; i < runs ; i++)
+    meshCodec.decode(&data[0], data.size(), decoded);
+  double decodeSeconds = seconds(start) / runs;
+
+  double rawMegabytes = rawSize(mesh) / 1048576.0, encodedMegabytes = data.size() / 1048576.0;
+  printf("%u triangles, %u vertices, decoded on %u threads\n", mesh.trianglesNumber(), mesh.positionsNumber(),
+         threads != 1 ? jobSystem.getThreadsNumber() : 1);
+  printf("raw %.1f MB, encoded %.2f MB: ratio %.1f, %.2f bytes per triangle\n", rawMegabytes, encodedMegabytes,
+         rawMegabytes / encodedMegabytes, (double) data.size() / mesh.trianglesNumber());
+  printf("encode %.1f ms, decode %.1f ms (%.0f MB/s of raw mesh)\n", encodeSeconds * 1000.0, decodeSeconds * 1000.0,
+         rawSize(decoded) / 1048576.0 / decodeSeconds);
+  printf("max position error %g\n", maxPositionError(mesh, decoded));
+  printf("at %.0f MB/s: raw read %.1f ms, encoded read and decode %.1f ms\n", bandwidth,
+         rawMegabytes / bandwidth * 1000.0, (encodedMegabytes / bandwidth + decodeSeconds) * 1000.0);
+  return 0;
+}
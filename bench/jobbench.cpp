@@ -0,0 +1,147 @@
+// Job system scaling from 1 to 64 threads: a parallel for over object transforms
+// and a frame made of dependent stages chained with continuations.
+// Build: g++ -O2 -std=c++11 -pthread -I.. jobbench.cpp ../jobsystem.cpp
+// Usage: jobbench [objects in thousands] [frames]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "jobsystem.h"
+
+using namespace qgl;
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Position, rotation angle around y and scale in, column-major model matrix and visibility out
+struct Transform {
+  float position[3];
+  float angle;
+  float scale;
+  float model[16];
+  bool visible;
+};
+
+static void updateTransforms(vector<Transform>& transforms, unsigned int first, unsigned int last) {
+  for (unsigned int i = first ; i < last ; i++) {
+    Transform& t = transforms[i];
+    // a few steps of rotation so that an object is worth more than its memory traffic
+    for (int step = 0 ; step < 8 ; step++)
+      t.angle = fmod(t.angle + 0.01f, 6.2831853f);
+    float c = cos(t.angle) * t.scale, s = sin(t.angle) * t.scale;
+    float m[16] = { c, 0.f, -s, 0.f, 0.f, t.scale, 0.f, 0.f, s, 0.f, c, 0.f, t.position[0], t.position[1], t.position[2], 1.f };
+    for (int j = 0 ; j < 16 ; j++)
+      t.model[j] = m[j];
+  }
+}
+
+// Sphere of radius 1 against the planes x < 10 and z < 10
+static void cullTransforms(vector<Transform>& transforms, unsigned int first, unsigned int last) {
+  for (unsigned int i = first ; i < last ; i++) {
+    const float* m = transforms[i].model;
+    transforms[i].visible = m[12] - transforms[i].scale < 10.f && m[14] - transforms[i].scale < 10.f;
+  }
+}
+
+// One frame as a graph: update ranges, then cull ranges once they are all done,
+// then the count of visible objects
+struct Frame {
+  JobSystem* jobs;
+  vector<Transform>* transforms;
+  unsigned int grainSize;
+  JobCounter updated, culled, done;
+  unsigned int visibleNumber;
+};
+
+static void updateJob(void* data, unsigned int first, unsigned int last) {
+  Frame& frame = *static_cast<Frame*>(data);
+  updateTransforms(*frame.transforms, first, last);
+}
+
+static void cullJob(void* data, unsigned int first, unsigned int last) {
+  Frame& frame = *static_cast<Frame*>(data);
+  cullTransforms(*frame.transforms, first, last);
+}
+
+static void countJob(void* data, unsigned int, unsigned int) {
+  Frame& frame = *static_cast<Frame*>(data);
+  frame.visibleNumber = 0;
+  for (unsigned int i = 0 ; i < frame.transforms->size() ; i++)
+    frame.visibleNumber += (*frame.transforms)[i].visible ? 1 : 0;
+}
+
+// Submitted after the updates: queues the cull ranges and the count after them
+static void cullStageJob(void* data, unsigned int, unsigned int) {
+  Frame& frame = *static_cast<Frame*>(data);
+  unsigned int count = frame.transforms->size();
+  for (unsigned int first = 0 ; first < count ; first += frame.grainSize)
+    frame.jobs->submit(Job(&cullJob, &frame, first, min(first + frame.grainSize, count)), &frame.culled);
+  frame.jobs->submitAfter(frame.culled, Job(&countJob, &frame), &frame.done);
+}
+
+static unsigned int runFrame(JobSystem& jobs, vector<Transform>& transforms, unsigned int grainSize) {
+  Frame frame;
+  frame.jobs = &jobs;
+  frame.transforms = &transforms;
+  frame.grainSize = grainSize;
+  frame.visibleNumber = 0;
+  unsigned int count = transforms.size();
+  for (unsigned int first = 0 ; first < count ; first += grainSize)
+    jobs.submit(Job(&updateJob, &frame, first, min(first + grainSize, count)), &frame.updated);
+  jobs.submitAfter(frame.updated, Job(&cullStageJob, &frame), &frame.done);
+  jobs.wait(frame.done);
+  return frame.visibleNumber;
+}
+
+int main(int argc, char** argv) {
+  double thousands = argc > 1 ? atof(argv[1]) : 256.0;
+  int frames = argc > 2 ? atoi(argv[2]) : 20;
+  unsigned int count = (unsigned int) (thousands * 1000);
+
+  vector<Transform> transforms(count);
+  srand(1);
+  for (unsigned int i = 0 ; i < count ; i++) {
+    for (int j = 0 ; j < 3 ; j++)
+      transforms[i].position[j] = rand() * 20.f / RAND_MAX;
+    transforms[i].angle = 0.f;
+    transforms[i].scale = 0.5f + rand() * 1.f / RAND_MAX;
+  }
+  printf("%u objects, %d frames, %u hardware threads\n", count, frames, thread::hardware_concurrency());
+
+  unsigned int threads[7] = { 1, 2, 4, 8, 16, 32, 64 };
+  double parallelForBase = 0.0, graphBase = 0.0;
+  unsigned int expectedVisible = 0;
+  printf("%-8s %16s %8s %16s %8s %10s\n", "threads", "parallel for ms", "speedup", "job graph ms", "speedup", "stolen");
+  for (int i = 0 ; i < 7 ; i++) {
+    JobSystem jobs(threads[i]);
+    unsigned int grainSize = 1024;
+
+    Clock::time_point start = Clock::now();
+    for (int f = 0 ; f < frames ; f++)
+      jobs.parallelFor(count, grainSize, [&](unsigned int first, unsigned int last) { updateTransforms(transforms, first, last); });
+    double parallelForTime = chrono::duration<double, milli>(Clock::now() - start).count() / frames;
+
+    unsigned int visibleNumber = 0;
+    start = Clock::now();
+    for (int f = 0 ; f < frames ; f++)
+      visibleNumber = runFrame(jobs, transforms, grainSize);
+    double graphTime = chrono::duration<double, milli>(Clock::now() - start).count() / frames;
+
+    // The angles differ between runs, the positions and the visibility do not
+    if (i == 0) {
+      parallelForBase = parallelForTime;
+      graphBase = graphTime;
+      expectedVisible = visibleNumber;
+    }
+    else if (visibleNumber != expectedVisible) {
+      printf("Wrong result with %u threads: %u visible instead of %u\n", threads[i], visibleNumber, expectedVisible);
+      return 1;
+    }
+    printf("%-8u %16.3f %8.2f %16.3f %8.2f %10llu\n", threads[i], parallelForTime, parallelForBase / parallelForTime,
+           graphTime, graphBase / graphTime, jobs.getStats().stolen);
+  }
+  return 0;
+}
@@ -0,0 +1,194 @@
+// Load time of the same sphere written as OBJ, GLB and binary PLY: parsing, then the
+// vertex expansion of Object::computeVertices. The files are written to the folder first.
+// Build together with the library sources, the loaders do not need a GL context.
+// Usage: loadbench [triangles in millions] [folder]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "gltfloader.h"
+#include "jobsystem.h"
+#include "objloader.h"
+#include "plyloader.h"
+
+using namespace qgl;
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Shared vertices with normals and texture coordinates, 3 indices per triangle
+struct Sphere {
+  vector<float> positions, normals, uvs;
+  vector<unsigned int> indices;
+};
+
+static void makeSphere(Sphere& sphere, unsigned int triangles) {
+  unsigned int rings = max(2u, (unsigned int) sqrt(triangles / 4.0));
+  unsigned int segments = max(3u, triangles / (2 * rings));
+  for (unsigned int r = 0 ; r <= rings ; r++) {
+    float theta = M_PI * r / rings;
+    for (unsigned int s = 0 ; s <= segments ; s++) {
+      float phi = 2.f * M_PI * s / segments;
+      float p[3] = { sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi) };
+      sphere.positions.insert(sphere.positions.end(), p, p + 3);
+      sphere.normals.insert(sphere.normals.end(), p, p + 3);
+      sphere.uvs.push_back((float) s / segments);
+      sphere.uvs.push_back((float) r / rings);
+    }
+  }
+  for (unsigned int r = 0 ; r < rings ; r++) {
+    for (unsigned int s = 0 ; s < segments ; s++) {
+      unsigned int a = r * (segments + 1) + s, b = a + segments + 1;
+      unsigned int quad[6] = { a, a + 1, b, a + 1, b + 1, b };
+      sphere.indices.insert(sphere.indices.end(), quad, quad + 6);
+    }
+  }
+}
+
+static void writeOBJ(const Sphere& sphere, const string& filename) {
+  FILE* file = fopen(filename.c_str(), "w");
+  fprintf(file, "o sphere\n");
+  for (unsigned int i = 0 ; i < sphere.positions.size() / 3 ; i++) {
+    const float* p = &sphere.positions[i * 3];
+    const float* n = &sphere.normals[i * 3];
+    fprintf(file, "v %f %f %f\nvn %f %f %f\nvt %f %f\n", p[0], p[1], p[2], n[0], n[1], n[2], sphere.uvs[i * 2], sphere.uvs[i * 2 + 1]);
+  }
+  for (unsigned int i = 0 ; i < sphere.indices.size() ; i += 3) {
+    unsigned int a = sphere.indices[i] + 1, b = sphere.indices[i + 1] + 1, c = sphere.indices[i + 2] + 1;
+    fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c);
+  }
+  fclose(file);
+}
+
+static void writeUint32(ofstream& file, unsigned int value) {
+  file.write(reinterpret_cast<const char*>(&value), 4);
+}
+
+// One buffer with a view per attribute, on a little endian machine
+static void writeGLB(const Sphere& sphere, const string& filename) {
+  unsigned int vertices = sphere.positions.size() / 3;
+  unsigned int sizes[4] = { vertices * 12, vertices * 12, vertices * 8, (unsigned int) sphere.indices.size() * 4 };
+  unsigned int offsets[4] = { 0, sizes[0], sizes[0] + sizes[1], sizes[0] + sizes[1] + sizes[2] };
+  unsigned int binarySize = offsets[3] + sizes[3];
+  char json[2048];
+  int length = snprintf(json, sizeof (json),
+    "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+    "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":3}]}],"
+    "\"buffers\":[{\"byteLength\":%u}],\"bufferViews\":["
+    "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u},{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u},"
+    "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u},{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u}],"
+    "\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},"
+    "{\"bufferView\":1,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},"
+    "{\"bufferView\":2,\"componentType\":5126,\"count\":%u,\"type\":\"VEC2\"},"
+    "{\"bufferView\":3,\"componentType\":5125,\"count\":%u,\"type\":\"SCALAR\"}]}",
+    binarySize, offsets[0], sizes[0], offsets[1], sizes[1], offsets[2], sizes[2], offsets[3], sizes[3],
+    vertices, vertices, vertices, (unsigned int) sphere.indices.size());
+  string jsonChunk(json, length);
+  while (jsonChunk.size() % 4 != 0)
+    jsonChunk += ' ';
+
+  ofstream file(filename.c_str(), ios::binary);
+  file.write("glTF", 4);
+  writeUint32(file, 2);
+  writeUint32(file, 12 + 8 + jsonChunk.size() + 8 + binarySize);
+  writeUint32(file, jsonChunk.size());
+  writeUint32(file, 0x4e4f534a);
+  file.write(jsonChunk.data(), jsonChunk.size());
+  writeUint32(file, binarySize);
+  writeUint32(file, 0x004e4942);
+  file.write(reinterpret_cast<const char*>(&sphere.positions[0]), sizes[0]);
+  file.write(reinterpret_cast<const char*>(&sphere.normals[0]), sizes[1]);
+  file.write(reinterpret_cast<const char*>(&sphere.uvs[0]), sizes[2]);
+  file.write(reinterpret_cast<const char*>(&sphere.indices[0]), sizes[3]);
+}
+
+static void writePLY(const Sphere& sphere, const string& filename) {
+  unsigned int vertices = sphere.positions.size() / 3;
+  ofstream file(filename.c_str(), ios::binary);
+  file << "ply\nformat binary_little_endian 1.0\nelement vertex " << vertices << "\n"
+       << "property float x\nproperty float y\nproperty float z\n"
+       << "property float nx\nproperty float ny\nproperty float nz\n"
+       << "property float u\nproperty float v\n"
+       << "element face " << sphere.indices.size() / 3 << "\nproperty list uchar int vertex_indices\nend_header\n";
+  for (unsigned int i = 0 ; i < vertices ; i++) {
+    file.write(reinterpret_cast<const char*>(&sphere.positions[i * 3]), 12);
+    file.write(reinterpret_cast<const char*>(&sphere.normals[i * 3]), 12);
+    file.write(reinterpret_cast<const char*>(&sphere.uvs[i * 2]), 8);
+  }
+  for (unsigned int i = 0 ; i < sphere.indices.size() ; i += 3) {
+    file.put(3);
+    file.write(reinterpret_cast<const char*>(&sphere.indices[i]), 12);
+  }
+}
+
+static long long fileSize(const string& filename) {
+  ifstream file(filename.c_str(), ios::binary | ios::ate);
+  return file ? (long long) file.tellg() : 0;
+}
+
+static double seconds(Clock::time_point start) {
+  return chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void report(const char* format, const string& filename, double loadSeconds, double expandSeconds, unsigned int triangles) {
+  double megabytes = fileSize(filename) / 1048576.0;
+  printf("%-6s %10.1f %10.1f %10.0f %12.1f %10.1f\n", format, megabytes, loadSeconds * 1000.0,
+         megabytes / loadSeconds, expandSeconds * 1000.0, triangles / 1e6);
+}
+
+int main(int argc, char** argv) {
+  double millions = argc > 1 ? atof(argv[1]) : 1.0;
+  string folder = argc > 2 ? string(argv[2]) + "/" : "";
+
+  Sphere sphere;
+  makeSphere(sphere, (unsigned int) (millions * 1e6));
+  string objFile = folder + "loadbench.obj", glbFile = folder + "loadbench.glb", plyFile = folder + "loadbench.ply";
+  writeOBJ(sphere, objFile);
+  writeGLB(sphere, glbFile);
+  writePLY(sphere, plyFile);
+  printf("%u triangles, %u vertices\n", (unsigned int) sphere.indices.size() / 3, (unsigned int) sphere.positions.size() / 3);
+
+  JobSystem jobSystem;
+  printf("%-6s %10s %10s %10s %12s %10s\n", "format", "MB", "load ms", "MB/s", "expand ms", "Mtriangles");
+  {
+    vector<Object> objects;
+    OBJLoader objLoader;
+    Clock::time_point start = Clock::now();
+    objLoader.loadObjects(objFile, objects);
+    double loadSeconds = seconds(start);
+    start = Clock::now();
+    for (unsigned int i = 0 ; i < objects.size() ; i++)
+      objects[i].computeVertices(false, &jobSystem);
+    report("OBJ", objFile, loadSeconds, seconds(start), objects.empty() ? 0 : objects[0].trianglesNumber());
+  }
+  {
+    vector<Object> objects;
+    GLTFLoader gltfLoader;
+    Clock::time_point start = Clock::now();
+    gltfLoader.load(glbFile, objects);
+    double loadSeconds = seconds(start);
+    start = Clock::now();
+    for (unsigned int i = 0 ; i < objects.size() ; i++)
+      objects[i].computeVertices(false, &jobSystem);
+    report("GLB", glbFile, loadSeconds, seconds(start), objects.empty() ? 0 : objects[0].trianglesNumber());
+  }
+  {
+    Object object;
+    IndexedMesh mesh;
+    PLYLoader plyLoader;
+    Clock::time_point start = Clock::now();
+    plyLoader.load(plyFile, mesh);
+    object.setMesh(mesh);
+    double loadSeconds = seconds(start);
+    start = Clock::now();
+    object.computeVertices(false, &jobSystem);
+    report("PLY", plyFile, loadSeconds, seconds(start), object.trianglesNumber());
+  }
+  return 0;
+}
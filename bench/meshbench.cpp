@@ -0,0 +1,146 @@
+// Vertex expansion, normal and tangent generation throughput, in millions of triangles per second,
+// or the time and peak memory of loading the objects of an OBJ file (Linux only for the memory).
+// Build: g++ -O2 -msse2 -std=c++11 -pthread -I.. meshbench.cpp ../meshprocessor.cpp ../jobsystem.cpp ../allocators.cpp
+//        ../objloader.cpp ../object.cpp ../material.cpp ../meshlets.cpp ../transforms.cpp, with the libraries of the demo
+// Usage: meshbench [triangles in millions] [runs]
+//        meshbench file.obj [file.mtl]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "jobsystem.h"
+#include "meshprocessor.h"
+#include "objloader.h"
+
+using namespace qgl;
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Sphere of shared vertices with texture coordinates and no normals, like many OBJ exports
+static void makeSphere(IndexedMesh& mesh, unsigned int triangles) {
+  unsigned int rings = max(2u, (unsigned int) sqrt(triangles / 4.0));
+  unsigned int segments = max(3u, triangles / (2 * rings));
+  mesh.clear();
+  for (unsigned int r = 0 ; r <= rings ; r++) {
+    float theta = M_PI * r / rings;
+    for (unsigned int s = 0 ; s <= segments ; s++) {
+      float phi = 2.f * M_PI * s / segments;
+      mesh.positions.push_back(sin(theta) * cos(phi));
+      mesh.positions.push_back(cos(theta));
+      mesh.positions.push_back(sin(theta) * sin(phi));
+      mesh.uvs.push_back((float) s / segments);
+      mesh.uvs.push_back((float) r / rings);
+    }
+  }
+  for (unsigned int r = 0 ; r < rings ; r++) {
+    for (unsigned int s = 0 ; s < segments ; s++) {
+      int a = r * (segments + 1) + s, b = a + segments + 1;
+      int quad[2][3] = { { a, a + 1, b }, { a + 1, b + 1, b } };
+      for (int t = 0 ; t < 2 ; t++) {
+        for (int v = 0 ; v < 3 ; v++) {
+          mesh.indices.push_back(quad[t][v]);
+          mesh.indices.push_back(-1);
+          mesh.indices.push_back(quad[t][v]);
+        }
+      }
+    }
+  }
+}
+
+// Resident memory in kB from /proc, 0 where it is not available
+static long memoryKB(const char* field) {
+  ifstream status("/proc/self/status");
+  string line;
+  size_t length = strlen(field);
+  while (getline(status, line)) {
+    if (line.compare(0, length, field) == 0)
+      return atol(line.c_str() + length + 1);
+  }
+  return 0;
+}
+
+// Resets the peak resident memory (VmHWM) to the current one, Linux only
+static void resetPeakMemory() {
+  ofstream clearRefs("/proc/self/clear_refs");
+  if (clearRefs)
+    clearRefs << "5";
+}
+
+// Parsing and vertex expansion of every object, without GL: what the copies made
+// while loading cost, in time and in peak memory
+static int benchmarkLoad(const string& geometryFile, const string& materialFile) {
+  long memoryBefore = memoryKB("VmRSS:");
+  resetPeakMemory();
+  JobSystem jobSystem;
+  Clock::time_point start = Clock::now();
+  OBJLoader loader;
+  vector<Object> objects;
+  if (!loader.loadObjects(geometryFile, objects, materialFile))
+    return 1;
+  Clock::time_point parsed = Clock::now();
+  unsigned long triangles = 0;
+  for (unsigned int i = 0 ; i < objects.size() ; i++) {
+    objects[i].computeVertices(false, &jobSystem);
+    triangles += objects[i].trianglesNumber();
+  }
+  Clock::time_point expanded = Clock::now();
+  printf("%u objects, %lu triangles\n", (unsigned int) objects.size(), triangles);
+  printf("load %.1f ms: parse %.1f ms, vertices %.1f ms\n", chrono::duration<double, milli>(expanded - start).count(),
+         chrono::duration<double, milli>(parsed - start).count(), chrono::duration<double, milli>(expanded - parsed).count());
+  printf("memory: %ld kB before, %ld kB after, %ld kB peak\n", memoryBefore, memoryKB("VmRSS:"), memoryKB("VmHWM:"));
+  return 0;
+}
+
+static double trianglesPerSecond(const MeshProcessor& processor, const IndexedMesh& mesh, bool tangents, int runs,
+                                 vector<float>& positions, vector<float>& normals, vector<float>& uvs, vector<float>& tangentsArray) {
+  double best = 0.0;
+  for (int i = 0 ; i < runs ; i++) {
+    Clock::time_point start = Clock::now();
+    processor.computeVertices(mesh, &positions[0], &normals[0], &uvs[0], tangents ? &tangentsArray[0] : NULL);
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    best = max(best, mesh.trianglesNumber() / seconds);
+  }
+  return best;
+}
+
+int main(int argc, char** argv) {
+  string input = argc > 1 ? argv[1] : "";
+  if (input.size() > 4 && input.substr(input.size() - 4) == ".obj")
+    return benchmarkLoad(input, argc > 2 ? argv[2] : "");
+
+  double millions = argc > 1 ? atof(argv[1]) : 2.0;
+  int runs = argc > 2 ? atoi(argv[2]) : 5;
+
+  IndexedMesh mesh;
+  makeSphere(mesh, (unsigned int) (millions * 1e6));
+  unsigned int vertices = mesh.trianglesNumber() * 3;
+  vector<float> positions(vertices * 3), normals(vertices * 3), uvs(vertices * 2), tangents(vertices * 4);
+  printf("%u triangles, %u positions\n", mesh.trianglesNumber(), mesh.positionsNumber());
+
+  unsigned int threads[3] = { 1, 8, 32 };
+  printf("%-8s %-28s %14s\n", "threads", "stage", "Mtriangles/s");
+  for (int i = 0 ; i < 3 ; i++) {
+    MeshProcessor processor(threads[i]);
+    IndexedMesh withNormals = mesh;
+    withNormals.normals.push_back(0.f);
+    withNormals.normals.push_back(1.f);
+    withNormals.normals.push_back(0.f);
+    for (unsigned int j = 1 ; j < withNormals.indices.size() ; j += 3)
+      withNormals.indices[j] = 0;
+    printf("%-8u %-28s %14.1f\n", threads[i], "expand",
+           trianglesPerSecond(processor, withNormals, false, runs, positions, normals, uvs, tangents) / 1e6);
+    printf("%-8u %-28s %14.1f\n", threads[i], "expand + normals",
+           trianglesPerSecond(processor, mesh, false, runs, positions, normals, uvs, tangents) / 1e6);
+    printf("%-8u %-28s %14.1f\n", threads[i], "expand + normals + tangents",
+           trianglesPerSecond(processor, mesh, true, runs, positions, normals, uvs, tangents) / 1e6);
+  }
+  return 0;
+}
@@ -0,0 +1,160 @@
+#include "scenegenerator.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <stbi_image_write.h>
+
+using namespace qgl;
+using namespace std;
+
+SceneGenerator::SceneGenerator() {
+  parameters.objects = 16;
+  parameters.trianglesPerObject = 10000;
+  parameters.materials = 4;
+  parameters.textures = 2;
+  parameters.textureSize = 256;
+  parameters.seed = 1;
+  state = 0;
+}
+
+SceneGenerator::SceneGenerator(const SceneParameters& parameters) {
+  this->parameters = parameters;
+  state = 0;
+}
+
+// Linear congruential generator: rand() differs between C libraries
+unsigned int SceneGenerator::random() {
+  state = state * 1664525u + 1013904223u;
+  return state;
+}
+
+float SceneGenerator::randomFloat() {
+  return (random() >> 8) / 16777216.f;
+}
+
+static unsigned int gridSide(unsigned int objects) {
+  unsigned int side = (unsigned int) ceil(sqrt((double) objects));
+  return side > 0 ? side : 1;
+}
+
+float SceneGenerator::getSceneRadius() const {
+  float halfSide = gridSide(parameters.objects) * 3.f / 2.f;
+  return sqrt(2.f) * halfSide + 1.5f;
+}
+
+bool SceneGenerator::generate(const string& folder) {
+  state = parameters.seed;
+  geometryFile = folder + "/scene.obj";
+  materialFile = folder + "/scene.mtl";
+  return writeTextures(folder) && writeMaterials() && writeGeometry();
+}
+
+bool SceneGenerator::writeTextures(const string& folder) {
+  unsigned int size = parameters.textureSize;
+  vector<unsigned char> pixels(size * size * 3);
+  for (unsigned int t = 0 ; t < parameters.textures ; t++) {
+    unsigned char color[3] = { (unsigned char) (random() >> 24), (unsigned char) (random() >> 24), (unsigned char) (random() >> 24) };
+    unsigned int square = 8 << (t % 4);
+    for (unsigned int y = 0 ; y < size ; y++) {
+      for (unsigned int x = 0 ; x < size ; x++) {
+        bool dark = ((x / square) + (y / square)) % 2 == 0;
+        for (int c = 0 ; c < 3 ; c++)
+          pixels[3 * (y * size + x) + c] = dark ? color[c] / 2 : color[c];
+      }
+    }
+    char name[64];
+    sprintf(name, "/texture%u.png", t);
+    if (!stbi_write_png((folder + name).c_str(), size, size, 3, &pixels[0], 3 * size)) {
+      cerr << "Could not write the texture " << folder << name << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SceneGenerator::writeMaterials() {
+  ofstream file(materialFile.c_str());
+  if (!file) {
+    cerr << "Could not write the material file " << materialFile << endl;
+    return false;
+  }
+  for (unsigned int m = 0 ; m < parameters.materials ; m++) {
+    file << "newmtl material" << m << "\n";
+    file << "Ns 100.0\nd 1.0\nNi 1.0\n";
+    file << "Ka 0.2 0.2 0.2\n";
+    file << "Kd " << randomFloat() << " " << randomFloat() << " " << randomFloat() << "\n";
+    file << "Ks 0.5 0.5 0.5\n";
+    if (parameters.textures > 0)
+      file << "map_Kd texture" << m % parameters.textures << ".png\n";
+  }
+  return true;
+}
+
+bool SceneGenerator::writeGeometry() {
+  ofstream file(geometryFile.c_str());
+  if (!file) {
+    cerr << "Could not write the geometry file " << geometryFile << endl;
+    return false;
+  }
+  if (parameters.materials > 0)
+    file << "mtllib scene.mtl\n";
+
+  // A sphere of rows x columns quads gives 2 * rows * columns triangles
+  unsigned int quads = (parameters.trianglesPerObject + 1) / 2;
+  unsigned int columns = (unsigned int) ceil(sqrt((double) quads));
+  if (columns < 3)
+    columns = 3;
+  unsigned int rows = (quads + columns - 1) / columns;
+  if (rows < 2)
+    rows = 2;
+
+  unsigned int side = gridSide(parameters.objects);
+  unsigned int firstVertex = 1;
+  unsigned int trianglesWritten = 0;
+  char line[128];
+
+  for (unsigned int o = 0 ; o < parameters.objects ; o++) {
+    float centerX = ((o % side) - (side - 1) / 2.f) * 3.f;
+    float centerZ = ((o / side) - (side - 1) / 2.f) * 3.f;
+    file << "o object" << o << "\n";
+
+    for (unsigned int r = 0 ; r <= rows ; r++) {
+      float theta = (float) M_PI * r / rows;
+      for (unsigned int c = 0 ; c <= columns ; c++) {
+        float phi = 2.f * (float) M_PI * c / columns;
+        float nx = sin(theta) * cos(phi), ny = cos(theta), nz = sin(theta) * sin(phi);
+        // the seam column repeats the first one so that the surface stays closed
+        float radius = 1.f + 0.05f * (c == columns ? 0.f : randomFloat());
+        sprintf(line, "v %.5f %.5f %.5f\n", centerX + radius * nx, radius * ny, centerZ + radius * nz);
+        file << line;
+        sprintf(line, "vt %.5f %.5f\n", (float) c / columns, 1.f - (float) r / rows);
+        file << line;
+        sprintf(line, "vn %.5f %.5f %.5f\n", nx, ny, nz);
+        file << line;
+      }
+    }
+
+    if (parameters.materials > 0)
+      file << "usemtl material" << o % parameters.materials << "\n";
+    for (unsigned int r = 0 ; r < rows ; r++) {
+      for (unsigned int c = 0 ; c < columns ; c++) {
+        unsigned int a = firstVertex + r * (columns + 1) + c;
+        unsigned int b = a + columns + 1;
+        // counter clock-wise seen from outside
+        sprintf(line, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, a + 1, a + 1, a + 1, b, b, b);
+        file << line;
+        sprintf(line, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a + 1, a + 1, a + 1, b + 1, b + 1, b + 1, b, b, b);
+        file << line;
+        trianglesWritten += 2;
+      }
+    }
+    firstVertex += (rows + 1) * (columns + 1);
+  }
+
+  cout << "Generated " << parameters.objects << " objects, " << trianglesWritten << " triangles, ";
+  cout << parameters.materials << " materials, " << parameters.textures << " textures." << endl;
+  return true;
+}
@@ -0,0 +1,54 @@
+#ifndef SCENEGENERATOR_H
+#define SCENEGENERATOR_H
+
+#include <string>
+
+
+namespace qgl {
+
+struct SceneParameters {
+  unsigned int objects;
+  unsigned int trianglesPerObject;
+  unsigned int materials;
+  unsigned int textures;
+  unsigned int textureSize;
+  unsigned int seed;
+};
+
+// Writes a deterministic OBJ/MTL scene: the same parameters always give the
+// same files, so that benchmark results can be compared between versions.
+// Objects are displaced spheres laid out on a grid, textures are checkerboards.
+class SceneGenerator {
+
+  public:
+    SceneGenerator();
+    SceneGenerator(const SceneParameters& parameters);
+
+    SceneParameters& getParameters() { return parameters; }
+
+    // Writes folder/scene.obj, folder/scene.mtl and folder/textureN.png
+    bool generate(const std::string& folder);
+
+    std::string getGeometryFile() const { return geometryFile; }
+    std::string getMaterialFile() const { return materialFile; }
+    // Radius of a sphere containing the whole scene, centered on the origin
+    float getSceneRadius() const;
+
+  private:
+    unsigned int random();
+    float randomFloat();
+
+    bool writeMaterials();
+    bool writeTextures(const std::string& folder);
+    bool writeGeometry();
+
+    SceneParameters parameters;
+    unsigned int state;
+    std::string geometryFile;
+    std::string materialFile;
+
+};
+
+}
+
+#endif // SCENEGENERATOR_H
@@ -0,0 +1,153 @@
+#include "colorconversion.h"
+
+#ifdef __SSSE3__
+  #include <tmmintrin.h>
+#endif
+
+using namespace qgl;
+
+// Integer coefficients scaled by 256. The chroma sums stay within 16 bits
+// so that the scalar and SIMD paths give the exact same result.
+static inline unsigned char luma(int r, int g, int b) {
+  return (unsigned char) ((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+static inline unsigned char chromaU(int r, int g, int b) {
+  return (unsigned char) (((-43 * r - 85 * g + 128 * b) >> 8) + 128);
+}
+
+static inline unsigned char chromaV(int r, int g, int b) {
+  return (unsigned char) (((128 * r - 107 * g - 21 * b) >> 8) + 128);
+}
+
+static inline const unsigned char* sourceRow(const unsigned char* rgb, int width, int height, bool flipRows, int row) {
+  return rgb + 3 * width * (flipRows ? height - 1 - row : row);
+}
+
+// Converts the block [firstColumn, width) x [firstRow, lastRow), firstColumn and firstRow being even
+static void convertBlock(const unsigned char* rgb, int width, int height, bool flipRows,
+                         int firstRow, int lastRow, int firstColumn,
+                         unsigned char* y, unsigned char* u, unsigned char* v) {
+  int chromaWidth = (width + 1) / 2;
+  for (int row = firstRow ; row < lastRow ; row += 2) {
+    const unsigned char* row0 = sourceRow(rgb, width, height, flipRows, row);
+    const unsigned char* row1 = sourceRow(rgb, width, height, flipRows, row + 1 < height ? row + 1 : row);
+    for (int column = firstColumn ; column < width ; column += 2) {
+      int nextColumn = column + 1 < width ? column + 1 : column;
+      const unsigned char* p[4] = { row0 + 3 * column, row0 + 3 * nextColumn, row1 + 3 * column, row1 + 3 * nextColumn };
+
+      y[row * width + column] = luma(p[0][0], p[0][1], p[0][2]);
+      if (nextColumn != column)
+        y[row * width + nextColumn] = luma(p[1][0], p[1][1], p[1][2]);
+      if (row + 1 < height) {
+        y[(row + 1) * width + column] = luma(p[2][0], p[2][1], p[2][2]);
+        if (nextColumn != column)
+          y[(row + 1) * width + nextColumn] = luma(p[3][0], p[3][1], p[3][2]);
+      }
+
+      int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) >> 2;
+      int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) >> 2;
+      int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) >> 2;
+      u[(row / 2) * chromaWidth + column / 2] = chromaU(r, g, b);
+      v[(row / 2) * chromaWidth + column / 2] = chromaV(r, g, b);
+    }
+  }
+}
+
+void qgl::rgbToYUV420Scalar(const unsigned char* rgb, int width, int height, bool flipRows,
+                            unsigned char* y, unsigned char* u, unsigned char* v) {
+  convertBlock(rgb, width, height, flipRows, 0, height, 0, y, u, v);
+}
+
+#ifdef __SSSE3__
+
+// Loads 8 RGB24 pixels (24 bytes, no over-read) as three vectors of 16-bit channels
+static inline void loadPixels(const unsigned char* p, __m128i& r, __m128i& g, __m128i& b) {
+  __m128i lo = _mm_loadu_si128((const __m128i*) p);
+  __m128i hi = _mm_loadl_epi64((const __m128i*) (p + 16));
+  r = _mm_or_si128(
+    _mm_shuffle_epi8(lo, _mm_setr_epi8(0, -1, 3, -1, 6, -1, 9, -1, 12, -1, 15, -1, -1, -1, -1, -1)),
+    _mm_shuffle_epi8(hi, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, -1, 5, -1)));
+  g = _mm_or_si128(
+    _mm_shuffle_epi8(lo, _mm_setr_epi8(1, -1, 4, -1, 7, -1, 10, -1, 13, -1, -1, -1, -1, -1, -1, -1)),
+    _mm_shuffle_epi8(hi, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, -1, 3, -1, 6, -1)));
+  b = _mm_or_si128(
+    _mm_shuffle_epi8(lo, _mm_setr_epi8(2, -1, 5, -1, 8, -1, 11, -1, 14, -1, -1, -1, -1, -1, -1, -1)),
+    _mm_shuffle_epi8(hi, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, -1, 4, -1, 7, -1)));
+}
+
+// 8 luma values as 16-bit lanes; the weights add up to 256 so unsigned 16-bit math cannot overflow
+static inline __m128i lumaVector(__m128i r, __m128i g, __m128i b) {
+  __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(77)), _mm_mullo_epi16(g, _mm_set1_epi16(150)));
+  sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(29)));
+  sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+  return _mm_srli_epi16(sum, 8);
+}
+
+// Sums horizontal pairs of two rows: 8 pixels wide -> 4 sums in 32-bit lanes
+static inline __m128i pairSums(__m128i row0, __m128i row1) {
+  return _mm_madd_epi16(_mm_add_epi16(row0, row1), _mm_set1_epi16(1));
+}
+
+// Averages of 2x2 blocks over 16 pixels, as 8 16-bit lanes
+static inline __m128i blockAverages(__m128i a0, __m128i a1, __m128i b0, __m128i b1) {
+  __m128i two = _mm_set1_epi32(2);
+  __m128i first = _mm_srli_epi32(_mm_add_epi32(pairSums(a0, a1), two), 2);
+  __m128i second = _mm_srli_epi32(_mm_add_epi32(pairSums(b0, b1), two), 2);
+  return _mm_packs_epi32(first, second);
+}
+
+static inline __m128i chromaVector(__m128i r, __m128i g, __m128i b, short cr, short cg, short cb) {
+  __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+  sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+  return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+}
+
+void qgl::rgbToYUV420(const unsigned char* rgb, int width, int height, bool flipRows,
+                      unsigned char* y, unsigned char* u, unsigned char* v) {
+  int chromaWidth = (width + 1) / 2;
+  int simdWidth = width & ~15;
+  int simdHeight = height & ~1;
+
+  for (int row = 0 ; row < simdHeight ; row += 2) {
+    const unsigned char* row0 = sourceRow(rgb, width, height, flipRows, row);
+    const unsigned char* row1 = sourceRow(rgb, width, height, flipRows, row + 1);
+    unsigned char* y0 = y + row * width;
+    unsigned char* y1 = y0 + width;
+    unsigned char* uRow = u + (row / 2) * chromaWidth;
+    unsigned char* vRow = v + (row / 2) * chromaWidth;
+
+    for (int column = 0 ; column < simdWidth ; column += 16) {
+      __m128i ra0, ga0, ba0, rb0, gb0, bb0; // row 0, pixels 0-7 and 8-15
+      __m128i ra1, ga1, ba1, rb1, gb1, bb1; // row 1
+      loadPixels(row0 + 3 * column, ra0, ga0, ba0);
+      loadPixels(row0 + 3 * (column + 8), rb0, gb0, bb0);
+      loadPixels(row1 + 3 * column, ra1, ga1, ba1);
+      loadPixels(row1 + 3 * (column + 8), rb1, gb1, bb1);
+
+      _mm_storeu_si128((__m128i*) (y0 + column), _mm_packus_epi16(lumaVector(ra0, ga0, ba0), lumaVector(rb0, gb0, bb0)));
+      _mm_storeu_si128((__m128i*) (y1 + column), _mm_packus_epi16(lumaVector(ra1, ga1, ba1), lumaVector(rb1, gb1, bb1)));
+
+      __m128i r = blockAverages(ra0, ra1, rb0, rb1);
+      __m128i g = blockAverages(ga0, ga1, gb0, gb1);
+      __m128i b = blockAverages(ba0, ba1, bb0, bb1);
+      _mm_storel_epi64((__m128i*) (uRow + column / 2), _mm_packus_epi16(chromaVector(r, g, b, -43, -85, 128), _mm_setzero_si128()));
+      _mm_storel_epi64((__m128i*) (vRow + column / 2), _mm_packus_epi16(chromaVector(r, g, b, 128, -107, -21), _mm_setzero_si128()));
+    }
+  }
+
+  // Right border columns, then the last row when the height is odd
+  if (simdWidth < width)
+    convertBlock(rgb, width, height, flipRows, 0, simdHeight, simdWidth, y, u, v);
+  if (simdHeight < height)
+    convertBlock(rgb, width, height, flipRows, simdHeight, height, 0, y, u, v);
+}
+
+#else
+
+void qgl::rgbToYUV420(const unsigned char* rgb, int width, int height, bool flipRows,
+                      unsigned char* y, unsigned char* u, unsigned char* v) {
+  rgbToYUV420Scalar(rgb, width, height, flipRows, y, u, v);
+}
+
+#endif
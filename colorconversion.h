@@ -0,0 +1,18 @@
+#ifndef COLORCONVERSION_H
+#define COLORCONVERSION_H
+
+namespace qgl {
+
+// RGB24 to planar YUV 4:2:0, full range BT.601 (Y4M C420jpeg).
+// The planes are ((width + 1) / 2) x ((height + 1) / 2) for U and V.
+// When flipRows is set, the source rows go bottom to top as read from OpenGL.
+void rgbToYUV420(const unsigned char* rgb, int width, int height, bool flipRows,
+                 unsigned char* y, unsigned char* u, unsigned char* v);
+
+// Reference implementation, also used for the borders the SIMD path leaves
+void rgbToYUV420Scalar(const unsigned char* rgb, int width, int height, bool flipRows,
+                       unsigned char* y, unsigned char* u, unsigned char* v);
+
+}
+
+#endif // COLORCONVERSION_H
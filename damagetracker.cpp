@@ -0,0 +1,174 @@
+#include "damagetracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace qgl;
+using namespace std;
+
+DamageTracker::DamageTracker() {
+  width = height = 0;
+  // Nothing was drawn yet
+  full = true;
+  region.x0 = region.y0 = region.x1 = region.y1 = 0;
+  cameraKnown = false;
+  cameraChanged = false;
+  memset(&stats, 0, sizeof (stats));
+}
+
+void DamageTracker::resize(int width, int height) {
+  if (width == this->width && height == this->height)
+    return;
+  this->width = width;
+  this->height = height;
+  damageAll();
+}
+
+void DamageTracker::damageAll() {
+  full = true;
+}
+
+void DamageTracker::damage(int x, int y, int width, int height) {
+  Rect rect;
+  rect.x0 = x;
+  rect.y0 = y;
+  rect.x1 = x + width;
+  rect.y1 = y + height;
+  damage(rect);
+}
+
+void DamageTracker::damage(const Rect& rect) {
+  Rect clipped;
+  clipped.x0 = max(rect.x0, 0);
+  clipped.y0 = max(rect.y0, 0);
+  clipped.x1 = min(rect.x1, width);
+  clipped.y1 = min(rect.y1, height);
+  if (clipped.x0 >= clipped.x1 || clipped.y0 >= clipped.y1)
+    return;
+  if (region.x0 >= region.x1)
+    region = clipped;
+  else {
+    region.x0 = min(region.x0, clipped.x0);
+    region.y0 = min(region.y0, clipped.y0);
+    region.x1 = max(region.x1, clipped.x1);
+    region.y1 = max(region.y1, clipped.y1);
+  }
+}
+
+void DamageTracker::trackCamera(const qm::Mat4f& view, const qm::Mat4f& projection) {
+  if (cameraKnown && memcmp(view.getArray(), this->view.getArray(), 16 * sizeof (float)) == 0
+      && memcmp(projection.getArray(), this->projection.getArray(), 16 * sizeof (float)) == 0)
+    return;
+  this->view = view;
+  this->projection = projection;
+  viewProjection = projection * view;
+  cameraKnown = true;
+  // Every object moved on the screen: their rectangles are computed again
+  cameraChanged = true;
+  damageAll();
+}
+
+void DamageTracker::trackGlobal(unsigned int slot, unsigned int value) {
+  if (slot < globals.size() && globals[slot] == value)
+    return;
+  if (slot >= globals.size())
+    globals.resize(slot + 1, 0);
+  globals[slot] = value;
+  damageAll();
+}
+
+void DamageTracker::trackObject(unsigned int object, const qm::Vec3f& boundsMin, const qm::Vec3f& boundsMax,
+                                const qm::Mat4f& model, unsigned int revision) {
+  if (object >= objects.size()) {
+    TrackedObject unknown;
+    unknown.known = false;
+    unknown.revision = 0;
+    unknown.rect.x0 = unknown.rect.y0 = unknown.rect.x1 = unknown.rect.y1 = 0;
+    objects.resize(object + 1, unknown);
+  }
+  TrackedObject& tracked = objects[object];
+  bool changed = !tracked.known || tracked.revision != revision;
+  if (!changed && !cameraChanged)
+    return;
+
+  Rect rect = screenRect(boundsMin, boundsMax, model);
+  if (changed) {
+    damage(tracked.rect);
+    damage(rect);
+  }
+  tracked.known = true;
+  tracked.revision = revision;
+  tracked.rect = rect;
+}
+
+DamageTracker::Rect DamageTracker::screenRect(const qm::Vec3f& boundsMin, const qm::Vec3f& boundsMax, const qm::Mat4f& model) const {
+  Rect rect;
+  rect.x0 = rect.y0 = 0;
+  rect.x1 = width;
+  rect.y1 = height;
+  if (!cameraKnown)
+    return rect;
+
+  qm::Mat4f matrix = viewProjection * model;
+  const float* m = matrix.getArray();
+  float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+  for (int corner = 0 ; corner < 8 ; corner++) {
+    float p[3] = {
+      (corner & 1) ? boundsMax[0] : boundsMin[0],
+      (corner & 2) ? boundsMax[1] : boundsMin[1],
+      (corner & 4) ? boundsMax[2] : boundsMin[2]
+    };
+    // Column major: clip = column0 * x + column1 * y + column2 * z + column3
+    float clip[4];
+    for (int j = 0 ; j < 4 ; j++)
+      clip[j] = m[j] * p[0] + m[4 + j] * p[1] + m[8 + j] * p[2] + m[12 + j];
+    // A corner behind the camera can project anywhere
+    if (clip[3] <= 1e-6f)
+      return rect;
+    float x = (clip[0] / clip[3] * 0.5f + 0.5f) * width;
+    float y = (clip[1] / clip[3] * 0.5f + 0.5f) * height;
+    minX = min(minX, x);
+    minY = min(minY, y);
+    maxX = max(maxX, x);
+    maxY = max(maxY, y);
+  }
+  // A pixel of margin for the rasterization rules
+  rect.x0 = (int) floor(minX) - 1;
+  rect.y0 = (int) floor(minY) - 1;
+  rect.x1 = (int) ceil(maxX) + 1;
+  rect.y1 = (int) ceil(maxY) + 1;
+  return rect;
+}
+
+bool DamageTracker::isFullDamage() const {
+  return full || (region.x0 <= 0 && region.y0 <= 0 && region.x1 >= width && region.y1 >= height);
+}
+
+void DamageTracker::getRegion(int& x, int& y, int& width, int& height) const {
+  if (full) {
+    x = y = 0;
+    width = this->width;
+    height = this->height;
+    return;
+  }
+  x = region.x0;
+  y = region.y0;
+  width = max(region.x1 - region.x0, 0);
+  height = max(region.y1 - region.y0, 0);
+}
+
+void DamageTracker::frameRendered() {
+  stats.renderedFrames++;
+  if (!isFullDamage())
+    stats.partialFrames++;
+  full = false;
+  region.x0 = region.y0 = region.x1 = region.y1 = 0;
+  cameraChanged = false;
+}
+
+void DamageTracker::frameSkipped(double idleSeconds) {
+  stats.skippedFrames++;
+  stats.idleSeconds += idleSeconds;
+  cameraChanged = false;
+}
@@ -0,0 +1,86 @@
+#ifndef DAMAGETRACKER_H
+#define DAMAGETRACKER_H
+
+#include <vector>
+
+#include <vec3.h>
+#include <mat4.h>
+
+
+namespace qgl {
+
+struct DamageStats {
+  unsigned long renderedFrames;
+  unsigned long partialFrames; // rendered frames limited to a damaged region
+  unsigned long skippedFrames; // iterations without damage, nothing drawn
+  double idleSeconds; // time spent waiting for events in the skipped frames
+};
+
+// Change tracking for rendering on demand. What affects the whole frame
+// (camera, lights, settings, window size) is compared with the last rendered
+// frame and damages the whole screen; an object whose revision changed damages
+// the screen rectangles of its bounds before and after the change. Without
+// damage the last frame is still valid and does not need to be drawn again.
+class DamageTracker {
+
+  public:
+    DamageTracker();
+
+    // Full damage when the size changes
+    void resize(int width, int height);
+    void damageAll();
+    // Rectangle in pixels, origin at the bottom left like glScissor
+    void damage(int x, int y, int width, int height);
+
+    // Full damage when the camera moved; call before trackObject
+    void trackCamera(const qm::Mat4f& view, const qm::Mat4f& projection);
+    // Full damage when a value affecting the whole frame changed, like a revision of the lights
+    void trackGlobal(unsigned int slot, unsigned int value);
+    // Damages the screen rectangles of the bounds before and after a change of revision
+    void trackObject(unsigned int object, const qm::Vec3f& boundsMin, const qm::Vec3f& boundsMax,
+                     const qm::Mat4f& model, unsigned int revision);
+
+    bool isDamaged() const { return full || region.x0 < region.x1; }
+    bool isFullDamage() const;
+    void getRegion(int& x, int& y, int& width, int& height) const;
+
+    // Call once the damage is drawn
+    void frameRendered();
+    // Call instead when nothing was damaged, with the time spent waiting
+    void frameSkipped(double idleSeconds);
+
+    const DamageStats& getStats() const { return stats; }
+
+  private:
+    // Pixels [x0, x1[ x [y0, y1[, empty when x0 >= x1
+    struct Rect {
+      int x0, y0, x1, y1;
+    };
+
+    struct TrackedObject {
+      bool known;
+      unsigned int revision;
+      Rect rect; // where it was drawn
+    };
+
+    Rect screenRect(const qm::Vec3f& boundsMin, const qm::Vec3f& boundsMax, const qm::Mat4f& model) const;
+    void damage(const Rect& rect);
+
+    int width, height;
+    bool full;
+    Rect region;
+
+    bool cameraKnown;
+    bool cameraChanged;
+    qm::Mat4f view, projection, viewProjection;
+
+    std::vector<unsigned int> globals;
+    std::vector<TrackedObject> objects;
+
+    DamageStats stats;
+
+};
+
+}
+
+#endif // DAMAGETRACKER_H
@@ -0,0 +1,113 @@
+#include "dynamicresolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace qgl;
+using namespace std;
+
+const float DynamicResolution::SCALE_STEP = 0.05f;
+
+DynamicResolution::DynamicResolution(qtools::Logger* logger) : upscaleProgram(logger) {
+  withProgram = false;
+  budget = 16.0;
+  minScale = 0.5f;
+  maxScale = 1.f;
+  sharpness = 0.5f;
+  settleFrames = 4;
+  scale = 1.f;
+  averageTime = 0.0;
+  framesAtScale = 0;
+  renderWidth = renderHeight = 0;
+  memset(&stats, 0, sizeof (stats));
+  stats.minScale = scale;
+}
+
+bool DynamicResolution::create(const string& vertexShader, const string& fragmentShader) {
+  withProgram = upscaleProgram.loadShader(GL_VERTEX_SHADER, vertexShader)
+                && upscaleProgram.loadShader(GL_FRAGMENT_SHADER, fragmentShader)
+                && upscaleProgram.link();
+  if (!withProgram)
+    return false;
+  upscaleProgram.useUniform("sourceTexture");
+  upscaleProgram.useUniform("sourceScale");
+  upscaleProgram.useUniform("sharpness");
+  emptyVAO = GLVertexArray::create();
+  return true;
+}
+
+void DynamicResolution::setScaleRange(float minScale, float maxScale) {
+  this->minScale = max(quantize(minScale), SCALE_STEP);
+  this->maxScale = max(quantize(maxScale), this->minScale);
+  scale = min(max(scale, this->minScale), this->maxScale);
+  stats.minScale = min(stats.minScale, scale);
+}
+
+float DynamicResolution::quantize(float value) const {
+  return floor(value / SCALE_STEP + 0.5f) * SCALE_STEP;
+}
+
+void DynamicResolution::update(double gpuMilliseconds) {
+  stats.updates++;
+  if (gpuMilliseconds > budget)
+    stats.overBudget++;
+
+  // The first frames measured after a change were still queued at the previous scale
+  framesAtScale++;
+  unsigned int skipped = settleFrames / 2;
+  if (framesAtScale <= skipped)
+    return;
+  averageTime = framesAtScale == skipped + 1 ? gpuMilliseconds : averageTime * 0.7 + gpuMilliseconds * 0.3;
+  if (framesAtScale < settleFrames || averageTime <= 0.0)
+    return;
+
+  // The time is mostly spent on the pixels: it follows the area, the square of the scale
+  float ideal = scale * (float) sqrt(budget / averageTime);
+  float newScale = scale;
+  if (averageTime > budget)
+    newScale = min(floor(ideal / SCALE_STEP) * SCALE_STEP, scale - SCALE_STEP);
+  else if (averageTime < 0.8 * budget && ideal >= scale + SCALE_STEP)
+    newScale = scale + SCALE_STEP;
+  newScale = min(max(newScale, minScale), maxScale);
+
+  if (fabs(newScale - scale) < SCALE_STEP * 0.5f)
+    return;
+  scale = quantize(newScale);
+  framesAtScale = 0;
+  stats.changes++;
+  stats.minScale = min(stats.minScale, scale);
+}
+
+void DynamicResolution::renderSize(int windowWidth, int windowHeight, int& width, int& height) const {
+  width = max((int) (windowWidth * scale + 0.5f), 1);
+  height = max((int) (windowHeight * scale + 0.5f), 1);
+}
+
+void DynamicResolution::bind(int windowWidth, int windowHeight) {
+  target.resize(windowWidth, windowHeight);
+  target.bind();
+  renderSize(windowWidth, windowHeight, renderWidth, renderHeight);
+  glViewport(0, 0, renderWidth, renderHeight);
+}
+
+void DynamicResolution::upscale(int windowWidth, int windowHeight) {
+  if (!withProgram || (renderWidth == windowWidth && renderHeight == windowHeight)) {
+    target.blit(renderWidth, renderHeight, windowWidth, windowHeight,
+                renderWidth == windowWidth && renderHeight == windowHeight ? GL_NEAREST : GL_LINEAR);
+    return;
+  }
+
+  glDisable(GL_DEPTH_TEST);
+  upscaleProgram.use();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, target.getColorTexture());
+  upscaleProgram.setUniformTextureIndex("sourceTexture", 0);
+  upscaleProgram.setUniform2f("sourceScale", (float) renderWidth / target.getWidth(), (float) renderHeight / target.getHeight());
+  upscaleProgram.setUniform1f("sharpness", sharpness);
+  glBindVertexArray(emptyVAO);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,90 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <string>
+
+#include <logger.h>
+
+#include "framebuffer.h"
+#include "glresource.h"
+#include "shaderprogram.h"
+
+
+namespace qgl {
+
+struct DynamicResolutionStats {
+  unsigned long updates; // GPU frame times received
+  unsigned long overBudget; // of which above the budget
+  unsigned long changes; // scale changes
+  float minScale; // lowest scale used
+};
+
+// Keeps the GPU frame time within a budget by rendering the scene at a
+// fraction of the window size. The scale follows the measured GPU time:
+// down right away when over budget, up by small steps when there is enough
+// headroom, and not again before the frames rendered at the new scale are
+// measured, so that it does not oscillate. The scene is drawn in the bottom
+// left corner of a target allocated at the window size, so a scale change
+// does not reallocate it, then upscaled to the window.
+class DynamicResolution {
+
+  public:
+    DynamicResolution(qtools::Logger* logger = NULL);
+
+    // Upscale program, fullscreen_vs.glsl and upscale_fs.glsl. Without it
+    // the frame is upscaled with a bilinear blit.
+    bool create(const std::string& vertexShader, const std::string& fragmentShader);
+
+    // GPU milliseconds per frame, 16 by default
+    void setBudget(double milliseconds) { budget = milliseconds; }
+    double getBudget() const { return budget; }
+    void setScaleRange(float minScale, float maxScale);
+    // 0 for a plain bilinear filter, up to 1 for the strongest edge sharpening
+    void setSharpness(float sharpness) { this->sharpness = sharpness; }
+    // Frames measured after a change before the next one, 4 by default. The
+    // first half is ignored: they were queued before the change.
+    void setSettleFrames(unsigned int frames) { settleFrames = frames; }
+
+    // Adjusts the scale from the GPU time of the last measured frame
+    void update(double gpuMilliseconds);
+    float getScale() const { return scale; }
+    void renderSize(int windowWidth, int windowHeight, int& width, int& height) const;
+
+    // Binds the scene target, the viewport covers the render size
+    void bind(int windowWidth, int windowHeight);
+    // Upscales the scene to the framebuffer currently bound for drawing
+    void upscale(int windowWidth, int windowHeight);
+
+    const DynamicResolutionStats& getStats() const { return stats; }
+
+  private:
+    DynamicResolution(const DynamicResolution&);
+    DynamicResolution& operator=(const DynamicResolution&);
+
+    // Scales are multiples of a step, so that the render size only changes with the scale
+    static const float SCALE_STEP;
+
+    float quantize(float value) const;
+
+    FrameBuffer target;
+    ShaderProgram upscaleProgram;
+    GLVertexArray emptyVAO;
+    bool withProgram;
+
+    double budget;
+    float minScale, maxScale;
+    float sharpness;
+    unsigned int settleFrames;
+
+    float scale;
+    double averageTime; // smoothed GPU time at the current scale
+    unsigned int framesAtScale;
+    int renderWidth, renderHeight; // of the frame in the target
+
+    DynamicResolutionStats stats;
+
+};
+
+}
+
+#endif // DYNAMICRESOLUTION_H
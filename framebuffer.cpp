@@ -0,0 +1,86 @@
+#include "framebuffer.h"
+
+using namespace qgl;
+using namespace std;
+
+FrameBuffer::FrameBuffer() {
+  index = 0;
+  colorTexture = 0;
+  depthBuffer = 0;
+  width = 0;
+  height = 0;
+}
+
+FrameBuffer::~FrameBuffer() {
+  destroy();
+}
+
+bool FrameBuffer::create(int width, int height) {
+  destroy();
+  this->width = width;
+  this->height = height;
+
+  glGenTextures(1, &colorTexture);
+  glBindTexture(GL_TEXTURE_2D, colorTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenRenderbuffers(1, &depthBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &index);
+  glBindFramebuffer(GL_FRAMEBUFFER, index);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    cerr << "ERROR: incomplete framebuffer " << width << "x" << height << ", status " << status << endl;
+    destroy();
+    return false;
+  }
+  return true;
+}
+
+bool FrameBuffer::resize(int width, int height) {
+  if (index != 0 && width == this->width && height == this->height)
+    return true;
+  return create(width, height);
+}
+
+void FrameBuffer::destroy() {
+  if (index != 0)
+    glDeleteFramebuffers(1, &index);
+  if (colorTexture != 0)
+    glDeleteTextures(1, &colorTexture);
+  if (depthBuffer != 0)
+    glDeleteRenderbuffers(1, &depthBuffer);
+  index = colorTexture = depthBuffer = 0;
+}
+
+void FrameBuffer::bind() const {
+  glBindFramebuffer(GL_FRAMEBUFFER, index);
+  glViewport(0, 0, width, height);
+}
+
+void FrameBuffer::bindDefault(int width, int height) {
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, width, height);
+}
+
+void FrameBuffer::blit(int width, int height, GLenum filter) const {
+  blit(this->width, this->height, width, height, filter);
+}
+
+void FrameBuffer::blit(int sourceWidth, int sourceHeight, int width, int height, GLenum filter) const {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, index);
+  glBlitFramebuffer(0, 0, sourceWidth, sourceHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, filter);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
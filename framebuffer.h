@@ -0,0 +1,50 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "shader.h"
+
+
+namespace qgl {
+
+// Render target with an RGBA8 color texture and a 24 bits depth buffer
+class FrameBuffer {
+
+  public:
+    FrameBuffer();
+    ~FrameBuffer();
+
+    bool create(int width, int height);
+    bool resize(int width, int height);
+    void destroy();
+
+    // Binds the framebuffer and sets the viewport to its whole size
+    void bind() const;
+    static void bindDefault(int width, int height);
+    // Copies the color buffer to the framebuffer currently bound for drawing
+    void blit(int width, int height, GLenum filter = GL_NEAREST) const;
+    // Copies and scales the bottom left sourceWidth x sourceHeight pixels only
+    void blit(int sourceWidth, int sourceHeight, int width, int height, GLenum filter) const;
+
+    unsigned int getIndex() const { return index; }
+    unsigned int getColorTexture() const { return colorTexture; }
+    unsigned int getDepthBuffer() const { return depthBuffer; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // GPU memory of the color and depth buffers
+    unsigned long long getBytes() const { return (unsigned long long) width * height * (4 + 4); }
+
+  private:
+    FrameBuffer(const FrameBuffer&);
+    FrameBuffer& operator=(const FrameBuffer&);
+
+    unsigned int index;
+    unsigned int colorTexture;
+    unsigned int depthBuffer;
+    int width;
+    int height;
+
+};
+
+}
+
+#endif // FRAMEBUFFER_H
@@ -0,0 +1,260 @@
+#include "framecapture.h"
+
+#include <cstring>
+
+using namespace qgl;
+using namespace std;
+
+FrameCapture::FrameCapture() {
+  ringSize = 3;
+  workersNumber = 2;
+  maxQueuedFrames = 8;
+  blockWhenFull = false;
+  sink = NULL;
+  activeSink = NULL;
+  running = false;
+  stopping = false;
+  nextReadback = 0;
+  oldestReadback = 0;
+  pendingReadbacks = 0;
+  ringWidth = 0;
+  ringHeight = 0;
+  memset(&stats, 0, sizeof (stats));
+}
+
+FrameCapture::~FrameCapture() {
+  stop();
+}
+
+void FrameCapture::setOutputFolder(const string& folder) {
+  pngSink.setFolder(folder);
+}
+
+void FrameCapture::setRingSize(unsigned int size) {
+  ringSize = size > 0 ? size : 1;
+}
+
+void FrameCapture::setWorkersNumber(unsigned int workers) {
+  workersNumber = workers > 0 ? workers : 1;
+}
+
+void FrameCapture::setMaxQueuedFrames(unsigned int frames) {
+  maxQueuedFrames = frames > 0 ? frames : 1;
+}
+
+bool FrameCapture::start() {
+  if (running)
+    return true;
+  stopping = false;
+  activeSink = sink != NULL ? sink : &pngSink;
+  unsigned int threads = activeSink->isSequential() ? 1 : workersNumber;
+  for (unsigned int i = 0 ; i < threads ; i++)
+    workers.push_back(thread(&FrameCapture::work, this));
+  running = true;
+  return true;
+}
+
+void FrameCapture::stop() {
+  if (!running)
+    return;
+
+  // Pending readbacks still hold frames: wait for them before stopping the workers
+  collect(true);
+  {
+    lock_guard<mutex> lock(queueMutex);
+    stopping = true;
+  }
+  queueNotEmpty.notify_all();
+  queueNotFull.notify_all();
+  for (unsigned int i = 0 ; i < workers.size() ; i++)
+    workers[i].join();
+  workers.clear();
+  activeSink->close();
+
+  for (unsigned int i = 0 ; i < ring.size() ; i++)
+    glDeleteBuffers(1, &ring[i].buffer);
+  ring.clear();
+  ringWidth = ringHeight = 0;
+  nextReadback = oldestReadback = pendingReadbacks = 0;
+
+  for (unsigned int i = 0 ; i < freePixels.size() ; i++)
+    delete[] freePixels[i];
+  freePixels.clear();
+
+  running = false;
+}
+
+void FrameCapture::resize(int width, int height) {
+  collect(true);
+  for (unsigned int i = 0 ; i < ring.size() ; i++)
+    glDeleteBuffers(1, &ring[i].buffer);
+
+  {
+    lock_guard<mutex> lock(queueMutex);
+    for (unsigned int i = 0 ; i < freePixels.size() ; i++)
+      delete[] freePixels[i];
+    freePixels.clear();
+    ringWidth = width;
+    ringHeight = height;
+  }
+
+  ring.resize(ringSize);
+  for (unsigned int i = 0 ; i < ring.size() ; i++) {
+    glGenBuffers(1, &ring[i].buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, ring[i].buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 3, NULL, GL_STREAM_READ);
+    ring[i].fence = 0;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  nextReadback = oldestReadback = pendingReadbacks = 0;
+}
+
+void FrameCapture::capture(long frameNumber, int width, int height) {
+  if (!running || width <= 0 || height <= 0)
+    return;
+  if (width != ringWidth || height != ringHeight)
+    resize(width, height);
+
+  // Every buffer is still in flight: the oldest one has to be consumed now
+  if (pendingReadbacks == ring.size()) {
+    {
+      lock_guard<mutex> lock(queueMutex);
+      stats.readbackStalls++;
+    }
+    collectReadback(ring[oldestReadback], true);
+    oldestReadback = (oldestReadback + 1) % ring.size();
+    pendingReadbacks--;
+  }
+
+  Readback& readback = ring[nextReadback];
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, NULL); // asynchronous into the buffer
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  readback.frameNumber = frameNumber;
+  readback.width = width;
+  readback.height = height;
+
+  nextReadback = (nextReadback + 1) % ring.size();
+  pendingReadbacks++;
+  {
+    lock_guard<mutex> lock(queueMutex);
+    stats.captured++;
+  }
+
+  collect(false);
+}
+
+void FrameCapture::collect(bool wait) {
+  while (pendingReadbacks > 0) {
+    if (!collectReadback(ring[oldestReadback], wait))
+      break;
+    oldestReadback = (oldestReadback + 1) % ring.size();
+    pendingReadbacks--;
+  }
+}
+
+bool FrameCapture::collectReadback(Readback& readback, bool wait) {
+  GLenum status;
+  if (wait) {
+    do {
+      status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    } while (status == GL_TIMEOUT_EXPIRED);
+  }
+  else {
+    status = glClientWaitSync(readback.fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+      return false;
+  }
+  glDeleteSync(readback.fence);
+  readback.fence = 0;
+
+  unsigned int size = readback.width * readback.height * 3;
+  Frame frame;
+  frame.frameNumber = readback.frameNumber;
+  frame.width = readback.width;
+  frame.height = readback.height;
+  {
+    lock_guard<mutex> lock(queueMutex);
+    if (!freePixels.empty()) {
+      frame.pixels = freePixels.back();
+      freePixels.pop_back();
+    }
+    else
+      frame.pixels = new unsigned char[size];
+  }
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+  if (data != NULL) {
+    memcpy(frame.pixels, data, size);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (data == NULL) {
+    lock_guard<mutex> lock(queueMutex);
+    freePixels.push_back(frame.pixels);
+    stats.failed++;
+    return true;
+  }
+
+  enqueue(frame);
+  return true;
+}
+
+void FrameCapture::enqueue(const Frame& frame) {
+  unique_lock<mutex> lock(queueMutex);
+  if (queue.size() >= maxQueuedFrames) {
+    if (!blockWhenFull) {
+      stats.dropped++;
+      freePixels.push_back(frame.pixels);
+      return;
+    }
+    stats.queueStalls++;
+    while (queue.size() >= maxQueuedFrames && !stopping)
+      queueNotFull.wait(lock);
+  }
+  queue.push_back(frame);
+  stats.queued = queue.size();
+  if (stats.queued > stats.maxQueued)
+    stats.maxQueued = stats.queued;
+  lock.unlock();
+  queueNotEmpty.notify_one();
+}
+
+void FrameCapture::work() {
+  while (true) {
+    Frame frame;
+    {
+      unique_lock<mutex> lock(queueMutex);
+      while (queue.empty() && !stopping)
+        queueNotEmpty.wait(lock);
+      if (queue.empty())
+        return;
+      frame = queue.front();
+      queue.pop_front();
+      stats.queued = queue.size();
+    }
+    queueNotFull.notify_one();
+
+    bool written = activeSink->write(frame.pixels, frame.width, frame.height, frame.frameNumber);
+
+    lock_guard<mutex> lock(queueMutex);
+    if (written)
+      stats.written++;
+    else
+      stats.failed++;
+    // Buffers of an older size are not reused
+    if (frame.width == ringWidth && frame.height == ringHeight)
+      freePixels.push_back(frame.pixels);
+    else
+      delete[] frame.pixels;
+  }
+}
+
+FrameCaptureStats FrameCapture::getStats() {
+  lock_guard<mutex> lock(queueMutex);
+  return stats;
+}
@@ -0,0 +1,114 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "shader.h"
+#include "framesink.h"
+
+
+namespace qgl {
+
+struct FrameCaptureStats {
+  unsigned long captured; // readbacks issued
+  unsigned long written; // images encoded to disk
+  unsigned long failed; // images that could not be written
+  unsigned long dropped; // frames discarded because the queue was full
+  unsigned long readbackStalls; // readbacks waited for because the ring was full
+  unsigned long queueStalls; // frames waited for because the queue was full
+  unsigned int queued; // frames currently waiting for a worker
+  unsigned int maxQueued; // high-water mark of the queue
+};
+
+// Captures the framebuffer without stalling the render thread: pixels are
+// read into a ring of pixel pack buffers, mapped a few frames later once
+// their fence has signaled, then handed to a frame sink by worker threads.
+// Without a sink, frames are written as PNG files in the output folder.
+class FrameCapture {
+
+  public:
+    FrameCapture();
+    ~FrameCapture();
+
+    // Settings, applied by start()
+    void setOutputFolder(const std::string& folder);
+    // The sink is not owned; sequential sinks get a single worker
+    void setSink(FrameSink* sink) { this->sink = sink; }
+    void setRingSize(unsigned int size);
+    void setWorkersNumber(unsigned int workers);
+    void setMaxQueuedFrames(unsigned int frames);
+    // When the queue is full, wait for a worker (true) or drop the frame (false)
+    void setBlockWhenFull(bool block) { blockWhenFull = block; }
+
+    bool start();
+    void stop();
+    bool isRunning() const { return running; }
+
+    // Call once per frame, before swapping buffers
+    void capture(long frameNumber, int width, int height);
+    // Hand the finished readbacks to the workers, waiting for the pending ones if asked
+    void collect(bool wait);
+
+    FrameCaptureStats getStats();
+    const std::string& getOutputFolder() const { return pngSink.getFolder(); }
+
+  private:
+    FrameCapture(const FrameCapture&);
+    FrameCapture& operator=(const FrameCapture&);
+
+    struct Readback {
+      unsigned int buffer;
+      GLsync fence;
+      long frameNumber;
+      int width;
+      int height;
+    };
+
+    struct Frame {
+      unsigned char* pixels;
+      long frameNumber;
+      int width;
+      int height;
+    };
+
+    void resize(int width, int height);
+    bool collectReadback(Readback& readback, bool wait);
+    void enqueue(const Frame& frame);
+    void work();
+
+    FrameSink* sink;
+    PNGSink pngSink;
+    unsigned int ringSize;
+    unsigned int workersNumber;
+    unsigned int maxQueuedFrames;
+    bool blockWhenFull;
+    bool running;
+
+    std::vector<Readback> ring;
+    unsigned int nextReadback;
+    unsigned int oldestReadback;
+    unsigned int pendingReadbacks;
+    int ringWidth;
+    int ringHeight;
+
+    FrameSink* activeSink;
+    std::vector<std::thread> workers;
+    std::deque<Frame> queue;
+    std::vector<unsigned char*> freePixels;
+    std::mutex queueMutex;
+    std::condition_variable queueNotEmpty;
+    std::condition_variable queueNotFull;
+    bool stopping;
+
+    FrameCaptureStats stats;
+
+};
+
+}
+
+#endif // FRAMECAPTURE_H
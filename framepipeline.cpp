@@ -0,0 +1,110 @@
+#include "framepipeline.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace qgl;
+using namespace std;
+
+FramePipeline::FramePipeline(unsigned int framesInFlight, bool gpuTiming) {
+  this->gpuTiming = gpuTiming;
+  currentSlot = 0;
+  frameOpen = false;
+  previousEnd = 0;
+  memset(&stats, 0, sizeof (stats));
+  setFramesInFlight(framesInFlight);
+}
+
+FramePipeline::~FramePipeline() {
+  finish();
+  deleteSlots();
+}
+
+void FramePipeline::setFramesInFlight(unsigned int frames) {
+  finish();
+  deleteSlots();
+  slots.resize(min(max(frames, 1u), MAX_FRAMES_IN_FLIGHT));
+  for (unsigned int i = 0 ; i < slots.size() ; i++) {
+    slots[i].fence = 0;
+    slots[i].queries[0] = slots[i].queries[1] = 0;
+    slots[i].timed = false;
+    if (gpuTiming)
+      glGenQueries(2, slots[i].queries);
+  }
+  // The next frame takes slot 0
+  currentSlot = slots.size() - 1;
+  // The GPU idled while we waited: not a gap between two frames
+  previousEnd = 0;
+}
+
+void FramePipeline::deleteSlots() {
+  for (unsigned int i = 0 ; i < slots.size() ; i++) {
+    if (slots[i].queries[0] != 0)
+      glDeleteQueries(2, slots[i].queries);
+  }
+  slots.clear();
+}
+
+void FramePipeline::beginFrame() {
+  if (frameOpen)
+    endFrame();
+  currentSlot = (currentSlot + 1) % slots.size();
+  Slot& slot = slots[currentSlot];
+  waitSlot(slot);
+  if (gpuTiming)
+    glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+  frameOpen = true;
+}
+
+void FramePipeline::endFrame() {
+  if (!frameOpen)
+    return;
+  Slot& slot = slots[currentSlot];
+  if (gpuTiming)
+    glQueryCounter(slot.queries[1], GL_TIMESTAMP);
+  slot.timed = gpuTiming;
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frameOpen = false;
+  stats.frames++;
+}
+
+void FramePipeline::finish() {
+  if (frameOpen)
+    endFrame();
+  // Oldest frame first, so that the GPU gaps are measured in order
+  for (unsigned int i = 1 ; i <= slots.size() ; i++)
+    waitSlot(slots[(currentSlot + i) % slots.size()]);
+}
+
+void FramePipeline::waitSlot(Slot& slot) {
+  if (slot.fence == 0)
+    return;
+
+  GLenum status = glClientWaitSync(slot.fence, 0, 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    stats.throttledFrames++;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    do {
+      status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    stats.cpuWait += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  }
+  glDeleteSync(slot.fence);
+  slot.fence = 0;
+
+  // The fence follows the queries: their results are available without waiting
+  if (slot.timed) {
+    GLuint64 start = 0, end = 0;
+    glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end);
+    if (previousEnd != 0) {
+      stats.gpuTimedFrames++;
+      if (start > previousEnd)
+        stats.gpuIdle += (start - previousEnd) / 1000000.0;
+    }
+    previousEnd = end;
+    stats.gpuFrames++;
+    stats.lastGPUTime = end > start ? (end - start) / 1000000.0 : 0.0;
+    slot.timed = false;
+  }
+}
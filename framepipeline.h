@@ -0,0 +1,76 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <chrono>
+#include <vector>
+
+#include "shader.h"
+
+
+namespace qgl {
+
+// More only adds latency, and the per-frame resources are sized from it
+static const unsigned int MAX_FRAMES_IN_FLIGHT = 4;
+
+struct FramePipelineStats {
+  unsigned long frames;
+  unsigned long throttledFrames; // frames that waited for the GPU to free their slot
+  double cpuWait; // milliseconds spent in these waits
+  unsigned long gpuTimedFrames; // frames with a GPU idle measure
+  double gpuIdle; // milliseconds the GPU waited between two timed frames
+  unsigned long gpuFrames; // frames with a GPU time
+  double lastGPUTime; // milliseconds between the start and the end of the last of them
+};
+
+// Lets the CPU build the next frames while the GPU renders the previous ones.
+// Each frame in flight owns a slot; the commands of a frame end with a fence,
+// and the frame reusing the slot waits for it, so at most framesInFlight
+// frames are queued and the per-frame resources indexed by the slot (dynamic
+// buffers, readbacks) are never written while the GPU reads them. Timestamps
+// around each frame measure how long the GPU waits for the CPU.
+class FramePipeline {
+
+  public:
+    FramePipeline(unsigned int framesInFlight = 2, bool gpuTiming = true);
+    ~FramePipeline();
+
+    // Waits for the frames in flight. Clamped to 1..MAX_FRAMES_IN_FLIGHT.
+    void setFramesInFlight(unsigned int frames);
+    unsigned int getFramesInFlight() const { return slots.size(); }
+
+    // Call before the first command writing the resources of the slot
+    void beginFrame();
+    // Call after the last command of the frame, before swapping buffers
+    void endFrame();
+    // Waits for the GPU to finish every frame in flight
+    void finish();
+
+    unsigned int getSlot() const { return currentSlot; }
+    const FramePipelineStats& getStats() const { return stats; }
+
+  private:
+    FramePipeline(const FramePipeline&);
+    FramePipeline& operator=(const FramePipeline&);
+
+    struct Slot {
+      GLsync fence;
+      unsigned int queries[2]; // GPU timestamps of the frame start and end
+      bool timed;
+    };
+
+    void waitSlot(Slot& slot);
+    void deleteSlots();
+
+    bool gpuTiming;
+    std::vector<Slot> slots;
+    unsigned int currentSlot;
+    bool frameOpen;
+    GLuint64 previousEnd; // GPU end of the last frame read back, 0 before the first
+
+    FramePipelineStats stats;
+
+};
+
+}
+
+#endif // FRAMEPIPELINE_H
@@ -0,0 +1,132 @@
+#include "framesink.h"
+#include "colorconversion.h"
+
+#include <cstring>
+#include <iostream>
+#include <stbi_image_write.h>
+
+#ifdef _WIN32
+  #define popen _popen
+  #define pclose _pclose
+#endif
+
+using namespace qgl;
+using namespace std;
+
+PNGSink::PNGSink() {}
+
+PNGSink::PNGSink(const string& folder) {
+  setFolder(folder);
+}
+
+void PNGSink::setFolder(const string& folder) {
+  this->folder = folder;
+  if (!this->folder.empty()) {
+    char last = this->folder[this->folder.size() - 1];
+    if (last != '/' && last != '\\')
+      this->folder += "/";
+  }
+}
+
+bool PNGSink::write(const unsigned char* pixels, int width, int height, long frameNumber) {
+  char name[64];
+  sprintf(name, "frame-%ld.png", frameNumber);
+  string filename = folder + name;
+  // Write from the last row with a negative stride to flip the image
+  const unsigned char* lastRow = pixels + (width * 3 * (height - 1));
+  if (!stbi_write_png(filename.c_str(), width, height, 3, lastRow, -3 * width)) {
+    cerr << "ERROR: could not write screenshot file " << filename << endl;
+    return false;
+  }
+  return true;
+}
+
+StreamSink::StreamSink(const string& target, Format format, bool pipe, int framesPerSecond) {
+  this->target = target;
+  this->format = format;
+  this->pipe = pipe;
+  this->framesPerSecond = framesPerSecond > 0 ? framesPerSecond : 30;
+  stream = NULL;
+  failed = false;
+  width = height = 0;
+  framesWritten = 0;
+  bytesWritten = 0;
+}
+
+StreamSink::~StreamSink() {
+  close();
+}
+
+bool StreamSink::open(int width, int height) {
+  if (pipe)
+    stream = popen(target.c_str(), "w");
+  else
+    stream = fopen(target.c_str(), "wb");
+  if (stream == NULL) {
+    cerr << "ERROR: could not open the capture stream " << target << endl;
+    failed = true;
+    return false;
+  }
+  // Frames are large: use a bigger buffer than the default one
+  setvbuf(stream, NULL, _IOFBF, 1 << 20);
+
+  this->width = width;
+  this->height = height;
+  if (format == Y4M) {
+    char header[128];
+    int size = sprintf(header, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, framesPerSecond);
+    planes.resize(width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2));
+    return writeBytes((const unsigned char*) header, size);
+  }
+  planes.resize(width * height * 3);
+  return true;
+}
+
+bool StreamSink::writeBytes(const unsigned char* data, size_t size) {
+  if (fwrite(data, 1, size, stream) != size) {
+    cerr << "ERROR: could not write to the capture stream " << target << endl;
+    failed = true;
+    return false;
+  }
+  bytesWritten += size;
+  return true;
+}
+
+bool StreamSink::write(const unsigned char* pixels, int width, int height, long frameNumber) {
+  if (failed)
+    return false;
+  if (stream == NULL && !open(width, height))
+    return false;
+  if (width != this->width || height != this->height) {
+    cerr << "ERROR: frame " << frameNumber << " size differs from the capture stream size" << endl;
+    return false;
+  }
+
+  if (format == Y4M) {
+    unsigned char* y = &planes[0];
+    unsigned char* u = y + width * height;
+    unsigned char* v = u + ((width + 1) / 2) * ((height + 1) / 2);
+    rgbToYUV420(pixels, width, height, true, y, u, v);
+    if (!writeBytes((const unsigned char*) "FRAME\n", 6) || !writeBytes(y, planes.size()))
+      return false;
+  }
+  else {
+    size_t rowSize = width * 3;
+    for (int row = 0 ; row < height ; row++)
+      memcpy(&planes[row * rowSize], pixels + (height - 1 - row) * rowSize, rowSize);
+    if (!writeBytes(&planes[0], planes.size()))
+      return false;
+  }
+  framesWritten++;
+  return true;
+}
+
+void StreamSink::close() {
+  if (stream == NULL)
+    return;
+  if (pipe)
+    pclose(stream);
+  else
+    fclose(stream);
+  stream = NULL;
+}
@@ -0,0 +1,87 @@
+#ifndef FRAMESINK_H
+#define FRAMESINK_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+namespace qgl {
+
+// Destination of captured frames. The pixels are RGB24 with rows going
+// bottom to top, as read from OpenGL.
+class FrameSink {
+
+  public:
+    virtual ~FrameSink() {}
+
+    virtual bool write(const unsigned char* pixels, int width, int height, long frameNumber) = 0;
+    virtual void close() {}
+    // Whether the frames must be written one at a time and in order
+    virtual bool isSequential() const { return false; }
+
+};
+
+// One PNG file per frame, frames can be encoded in parallel
+class PNGSink : public FrameSink {
+
+  public:
+    PNGSink();
+    PNGSink(const std::string& folder);
+
+    void setFolder(const std::string& folder);
+    const std::string& getFolder() const { return folder; }
+
+    bool write(const unsigned char* pixels, int width, int height, long frameNumber);
+
+  private:
+    std::string folder;
+
+};
+
+// All the frames in a single stream, either a file or the standard input
+// of an encoder process (e.g. "ffmpeg -f yuv4mpegpipe -i - video.mp4").
+// Frames must all have the size of the first one.
+class StreamSink : public FrameSink {
+
+  public:
+    enum Format {
+      Y4M, // YUV 4:2:0 planes in a YUV4MPEG2 container
+      RAW_RGB // RGB24, rows top to bottom, no header
+    };
+
+    StreamSink(const std::string& target, Format format, bool pipe = false, int framesPerSecond = 30);
+    ~StreamSink();
+
+    bool write(const unsigned char* pixels, int width, int height, long frameNumber);
+    void close();
+    bool isSequential() const { return true; }
+
+    unsigned long getFramesWritten() const { return framesWritten; }
+    unsigned long long getBytesWritten() const { return bytesWritten; }
+
+  private:
+    StreamSink(const StreamSink&);
+    StreamSink& operator=(const StreamSink&);
+
+    bool open(int width, int height);
+    bool writeBytes(const unsigned char* data, size_t size);
+
+    std::string target;
+    Format format;
+    bool pipe;
+    int framesPerSecond;
+
+    FILE* stream;
+    bool failed;
+    int width;
+    int height;
+    std::vector<unsigned char> planes;
+    unsigned long framesWritten;
+    unsigned long long bytesWritten;
+
+};
+
+}
+
+#endif // FRAMESINK_H
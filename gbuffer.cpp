@@ -0,0 +1,148 @@
+#include "gbuffer.h"
+
+#include <algorithm>
+
+using namespace qgl;
+using namespace std;
+
+static void createTarget(unsigned int texture, GLint internalFormat, GLenum format, GLenum type, int width, int height) {
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+  // Targets are read texel per texel
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+static bool checkFramebuffer(int width, int height) {
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    cerr << "ERROR: incomplete G-buffer " << width << "x" << height << ", status " << status << endl;
+    return false;
+  }
+  return true;
+}
+
+GBuffer::GBuffer() {
+  geometryFramebuffer = 0;
+  lightingFramebuffer = 0;
+  for (int i = 0 ; i < TARGETS_NUMBER ; i++)
+    textures[i] = 0;
+  depthTexture = 0;
+  emptyVAO = 0;
+  width = 0;
+  height = 0;
+  viewportWidth = 0;
+  viewportHeight = 0;
+}
+
+GBuffer::~GBuffer() {
+  destroy();
+}
+
+bool GBuffer::create(int width, int height) {
+  destroy();
+  this->width = viewportWidth = width;
+  this->height = viewportHeight = height;
+
+  glGenTextures(TARGETS_NUMBER, textures);
+  createTarget(textures[ALBEDO], GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+  createTarget(textures[SPECULAR], GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+  createTarget(textures[NORMAL], GL_RG16F, GL_RG, GL_FLOAT, width, height);
+  createTarget(textures[LIGHT], GL_RGBA16F, GL_RGBA, GL_FLOAT, width, height);
+  glGenTextures(1, &depthTexture);
+  createTarget(depthTexture, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, width, height);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers(1, &geometryFramebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, geometryFramebuffer);
+  for (int i = 0 ; i < TARGETS_NUMBER ; i++)
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, textures[i], 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+  bool complete = checkFramebuffer(width, height);
+
+  // The lighting pass samples the other targets and the depth, they must not be attached
+  glGenFramebuffers(1, &lightingFramebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, lightingFramebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[LIGHT], 0);
+  complete = complete && checkFramebuffer(width, height);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  glGenVertexArrays(1, &emptyVAO);
+
+  if (!complete) {
+    destroy();
+    return false;
+  }
+  return true;
+}
+
+bool GBuffer::resize(int width, int height) {
+  if (geometryFramebuffer != 0 && width == this->width && height == this->height)
+    return true;
+  return create(width, height);
+}
+
+void GBuffer::setViewport(int width, int height) {
+  viewportWidth = min(width, this->width);
+  viewportHeight = min(height, this->height);
+}
+
+void GBuffer::destroy() {
+  if (geometryFramebuffer != 0)
+    glDeleteFramebuffers(1, &geometryFramebuffer);
+  if (lightingFramebuffer != 0)
+    glDeleteFramebuffers(1, &lightingFramebuffer);
+  if (textures[0] != 0)
+    glDeleteTextures(TARGETS_NUMBER, textures);
+  if (depthTexture != 0)
+    glDeleteTextures(1, &depthTexture);
+  if (emptyVAO != 0)
+    glDeleteVertexArrays(1, &emptyVAO);
+  geometryFramebuffer = lightingFramebuffer = depthTexture = emptyVAO = 0;
+  for (int i = 0 ; i < TARGETS_NUMBER ; i++)
+    textures[i] = 0;
+}
+
+void GBuffer::bindGeometryPass(float red, float green, float blue) const {
+  static const GLenum drawBuffers[TARGETS_NUMBER] = {
+    GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3
+  };
+  glBindFramebuffer(GL_FRAMEBUFFER, geometryFramebuffer);
+  glViewport(0, 0, viewportWidth, viewportHeight);
+  glDrawBuffers(TARGETS_NUMBER, drawBuffers);
+
+  float zero[4] = { 0.f, 0.f, 0.f, 0.f };
+  float background[4] = { red, green, blue, 1.f };
+  glClearBufferfv(GL_COLOR, ALBEDO, zero);
+  glClearBufferfv(GL_COLOR, SPECULAR, zero);
+  glClearBufferfv(GL_COLOR, NORMAL, zero);
+  glClearBufferfv(GL_COLOR, LIGHT, background);
+  glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void GBuffer::bindLightingPass() const {
+  glBindFramebuffer(GL_FRAMEBUFFER, lightingFramebuffer);
+  glViewport(0, 0, viewportWidth, viewportHeight);
+}
+
+void GBuffer::bindTextures(int firstUnit) const {
+  unsigned int sampled[4] = { textures[ALBEDO], textures[SPECULAR], textures[NORMAL], depthTexture };
+  for (int i = 0 ; i < 4 ; i++) {
+    glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+    glBindTexture(GL_TEXTURE_2D, sampled[i]);
+  }
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void GBuffer::drawFullScreen() const {
+  glBindVertexArray(emptyVAO);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void GBuffer::blit(int width, int height) const {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, lightingFramebuffer);
+  glBlitFramebuffer(0, 0, viewportWidth, viewportHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
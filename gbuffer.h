@@ -0,0 +1,73 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include "shader.h"
+
+
+namespace qgl {
+
+// Render targets of deferred shading. The geometry pass writes the surface
+// attributes and the ambient term, the lighting pass then adds the lights to
+// the accumulation target from the attributes only:
+//  - albedo    RGBA8   diffuse color, alpha set when the surface has normals
+//  - specular  RGBA8   specular color
+//  - normal    RG16F   octahedron encoded eye space normal
+//  - light     RGBA16F light accumulation
+//  - depth     DEPTH24 eye space positions are reconstructed from it
+// The passes can cover only the bottom left corner of the targets, so that a
+// lower rendering resolution does not reallocate them.
+class GBuffer {
+
+  public:
+    enum Target { ALBEDO, SPECULAR, NORMAL, LIGHT, TARGETS_NUMBER };
+
+    GBuffer();
+    ~GBuffer();
+
+    bool create(int width, int height);
+    bool resize(int width, int height);
+    void destroy();
+
+    // Size of the region the passes draw, the whole targets after create
+    void setViewport(int width, int height);
+
+    // Binds the geometry pass framebuffer and clears it, the light
+    // accumulation target is cleared to the background color. The viewport
+    // covers the region, see setViewport.
+    void bindGeometryPass(float red, float green, float blue) const;
+    // Binds the framebuffer with only the light accumulation target
+    void bindLightingPass() const;
+    // Binds albedo, specular, normal and depth to four texture units starting at firstUnit
+    void bindTextures(int firstUnit) const;
+    // Draws a triangle covering the whole viewport, for fullscreen_vs.glsl
+    void drawFullScreen() const;
+    // Copies the light accumulation of the region to the framebuffer currently bound for drawing
+    void blit(int width, int height) const;
+
+    unsigned int getTexture(Target target) const { return textures[target]; }
+    unsigned int getDepthTexture() const { return depthTexture; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // GPU memory of the targets
+    unsigned long long getBytes() const { return (unsigned long long) width * height * (4 + 4 + 4 + 8 + 4); }
+
+  private:
+    GBuffer(const GBuffer&);
+    GBuffer& operator=(const GBuffer&);
+
+    unsigned int geometryFramebuffer;
+    unsigned int lightingFramebuffer;
+    unsigned int textures[TARGETS_NUMBER];
+    unsigned int depthTexture;
+    // Empty vertex array for attribute-less full screen draws
+    unsigned int emptyVAO;
+    int width;
+    int height;
+    int viewportWidth;
+    int viewportHeight;
+
+};
+
+}
+
+#endif // GBUFFER_H
@@ -0,0 +1,78 @@
+#ifndef GLRESOURCE_H
+#define GLRESOURCE_H
+
+#include <GL/glew.h>
+
+
+namespace qgl {
+
+// Owner of an OpenGL object name, deleted with its owner. It can be moved
+// but not copied, so a name is never deleted twice or shared by accident.
+// Converts to GLuint for the GL calls, 0 when empty.
+template <typename Traits>
+class GLHandle {
+
+  public:
+    GLHandle() : name(0) {}
+    explicit GLHandle(GLuint name) : name(name) {}
+    GLHandle(GLHandle&& other) : name(other.name) { other.name = 0; }
+    ~GLHandle() { reset(); }
+
+    GLHandle& operator=(GLHandle&& other) {
+      if (this != &other) {
+        reset(other.name);
+        other.name = 0;
+      }
+      return *this;
+    }
+
+    // New name from glGen*, needs a current context
+    static GLHandle create() { return GLHandle(Traits::create()); }
+
+    GLuint get() const { return name; }
+    operator GLuint() const { return name; }
+
+    // Deletes the owned name and takes newName
+    void reset(GLuint newName = 0) {
+      if (name != 0 && name != newName)
+        Traits::destroy(name);
+      name = newName;
+    }
+
+    // Gives up the ownership without deleting
+    GLuint release() {
+      GLuint released = name;
+      name = 0;
+      return released;
+    }
+
+  private:
+    GLHandle(const GLHandle&);
+    GLHandle& operator=(const GLHandle&);
+
+    GLuint name;
+
+};
+
+struct BufferTraits {
+  static GLuint create() { GLuint name = 0; glGenBuffers(1, &name); return name; }
+  static void destroy(GLuint name) { glDeleteBuffers(1, &name); }
+};
+
+struct VertexArrayTraits {
+  static GLuint create() { GLuint name = 0; glGenVertexArrays(1, &name); return name; }
+  static void destroy(GLuint name) { glDeleteVertexArrays(1, &name); }
+};
+
+struct TextureTraits {
+  static GLuint create() { GLuint name = 0; glGenTextures(1, &name); return name; }
+  static void destroy(GLuint name) { glDeleteTextures(1, &name); }
+};
+
+typedef GLHandle<BufferTraits> GLBuffer;
+typedef GLHandle<VertexArrayTraits> GLVertexArray;
+typedef GLHandle<TextureTraits> GLTexture;
+
+}
+
+#endif // GLRESOURCE_H
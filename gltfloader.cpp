@@ -0,0 +1,879 @@
+#include "gltfloader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+
+#include "mappedfile.h"
+
+using namespace qgl;
+using namespace std;
+
+namespace {
+
+// JSON document tree: object members are the items, named by keys
+struct JSONValue {
+  enum Type { JSON_NULL, JSON_BOOLEAN, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+  JSONValue() : type(JSON_NULL), number(0.0) {}
+
+  // NULL when missing
+  const JSONValue* get(const char* key) const {
+    for (unsigned int i = 0 ; i < keys.size() ; i++)
+      if (keys[i] == key)
+        return &items[i];
+    return NULL;
+  }
+  unsigned int size() const { return type == JSON_ARRAY ? items.size() : 0; }
+
+  Type type;
+  double number; // 0 or 1 for the booleans
+  std::string text;
+  std::vector<JSONValue> items;
+  std::vector<std::string> keys;
+};
+
+double numberOf(const JSONValue* value, double fallback) {
+  return value != NULL && (value->type == JSONValue::JSON_NUMBER || value->type == JSONValue::JSON_BOOLEAN) ? value->number : fallback;
+}
+
+// Index into a top level array, -1 when missing
+int indexOf(const JSONValue* value) {
+  return value != NULL && value->type == JSONValue::JSON_NUMBER && value->number >= 0.0 ? (int) value->number : -1;
+}
+
+const JSONValue* itemOf(const JSONValue& root, const char* array, int index) {
+  const JSONValue* items = root.get(array);
+  if (items == NULL || index < 0 || (unsigned int) index >= items->size())
+    return NULL;
+  return &items->items[index];
+}
+
+class JSONParser {
+
+  public:
+    JSONParser(const char* begin, const char* end) : c(begin), end(end) {}
+
+    bool parse(JSONValue& value) {
+      if (!parseValue(value, 0))
+        return false;
+      skipSpaces();
+      return c == end || *c == '\0';
+    }
+
+  private:
+    // Nesting limit, the parser is recursive
+    static const int MAX_DEPTH = 64;
+
+    void skipSpaces() {
+      while (c < end && (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r'))
+        c++;
+    }
+
+    bool match(const char* word) {
+      size_t length = strlen(word);
+      if ((size_t) (end - c) < length || strncmp(c, word, length) != 0)
+        return false;
+      c += length;
+      return true;
+    }
+
+    static void appendUTF8(string& text, unsigned int code) {
+      if (code < 0x80)
+        text += (char) code;
+      else if (code < 0x800) {
+        text += (char) (0xc0 | (code >> 6));
+        text += (char) (0x80 | (code & 0x3f));
+      }
+      else if (code < 0x10000) {
+        text += (char) (0xe0 | (code >> 12));
+        text += (char) (0x80 | ((code >> 6) & 0x3f));
+        text += (char) (0x80 | (code & 0x3f));
+      }
+      else {
+        text += (char) (0xf0 | (code >> 18));
+        text += (char) (0x80 | ((code >> 12) & 0x3f));
+        text += (char) (0x80 | ((code >> 6) & 0x3f));
+        text += (char) (0x80 | (code & 0x3f));
+      }
+    }
+
+    bool parseHex(unsigned int& code) {
+      if (end - c < 4)
+        return false;
+      code = 0;
+      for (int i = 0 ; i < 4 ; i++, c++) {
+        char h = *c;
+        code <<= 4;
+        if (h >= '0' && h <= '9')
+          code |= h - '0';
+        else if (h >= 'a' && h <= 'f')
+          code |= h - 'a' + 10;
+        else if (h >= 'A' && h <= 'F')
+          code |= h - 'A' + 10;
+        else
+          return false;
+      }
+      return true;
+    }
+
+    bool parseString(string& text) {
+      // Past the opening quote
+      c++;
+      text.clear();
+      while (c < end && *c != '"') {
+        if (*c != '\\') {
+          text += *c++;
+          continue;
+        }
+        if (++c == end)
+          return false;
+        char escaped = *c++;
+        switch (escaped) {
+          case 'b': text += '\b'; break;
+          case 'f': text += '\f'; break;
+          case 'n': text += '\n'; break;
+          case 'r': text += '\r'; break;
+          case 't': text += '\t'; break;
+          case 'u': {
+            unsigned int code;
+            if (!parseHex(code))
+              return false;
+            // Surrogate pair
+            if (code >= 0xd800 && code < 0xdc00 && match("\\u")) {
+              unsigned int low;
+              if (!parseHex(low))
+                return false;
+              code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            }
+            appendUTF8(text, code);
+            break;
+          }
+          default: text += escaped;
+        }
+      }
+      if (c == end)
+        return false;
+      c++;
+      return true;
+    }
+
+    bool parseValue(JSONValue& value, int depth) {
+      skipSpaces();
+      if (c == end || depth > MAX_DEPTH)
+        return false;
+      if (*c == '{') {
+        value.type = JSONValue::JSON_OBJECT;
+        c++;
+        skipSpaces();
+        if (c < end && *c == '}') {
+          c++;
+          return true;
+        }
+        while (true) {
+          skipSpaces();
+          if (c == end || *c != '"')
+            return false;
+          value.keys.push_back(string());
+          if (!parseString(value.keys.back()))
+            return false;
+          skipSpaces();
+          if (c == end || *c++ != ':')
+            return false;
+          value.items.push_back(JSONValue());
+          if (!parseValue(value.items.back(), depth + 1))
+            return false;
+          skipSpaces();
+          if (c == end)
+            return false;
+          if (*c == '}') {
+            c++;
+            return true;
+          }
+          if (*c++ != ',')
+            return false;
+        }
+      }
+      if (*c == '[') {
+        value.type = JSONValue::JSON_ARRAY;
+        c++;
+        skipSpaces();
+        if (c < end && *c == ']') {
+          c++;
+          return true;
+        }
+        while (true) {
+          value.items.push_back(JSONValue());
+          if (!parseValue(value.items.back(), depth + 1))
+            return false;
+          skipSpaces();
+          if (c == end)
+            return false;
+          if (*c == ']') {
+            c++;
+            return true;
+          }
+          if (*c++ != ',')
+            return false;
+        }
+      }
+      if (*c == '"') {
+        value.type = JSONValue::JSON_STRING;
+        return parseString(value.text);
+      }
+      if (match("true")) {
+        value.type = JSONValue::JSON_BOOLEAN;
+        value.number = 1.0;
+        return true;
+      }
+      if (match("false")) {
+        value.type = JSONValue::JSON_BOOLEAN;
+        value.number = 0.0;
+        return true;
+      }
+      if (match("null")) {
+        value.type = JSONValue::JSON_NULL;
+        return true;
+      }
+      // strtod needs a terminated string: numbers are copied first
+      char number[64];
+      unsigned int length = 0;
+      while (c + length < end && length < sizeof (number) - 1 && c[length] != '\0' && strchr("+-0123456789.eE", c[length]) != NULL)
+        length++;
+      if (length == 0)
+        return false;
+      memcpy(number, c, length);
+      number[length] = '\0';
+      char* numberEnd;
+      value.type = JSONValue::JSON_NUMBER;
+      value.number = strtod(number, &numberEnd);
+      c += length;
+      return numberEnd == number + length;
+    }
+
+    const char* c;
+    const char* end;
+
+};
+
+bool decodeBase64(const char* text, size_t length, vector<unsigned char>& bytes) {
+  bytes.clear();
+  bytes.reserve(length / 4 * 3);
+  unsigned int bits = 0;
+  int bitsNumber = 0;
+  for (size_t i = 0 ; i < length && text[i] != '=' ; i++) {
+    char ch = text[i];
+    int value;
+    if (ch >= 'A' && ch <= 'Z')
+      value = ch - 'A';
+    else if (ch >= 'a' && ch <= 'z')
+      value = ch - 'a' + 26;
+    else if (ch >= '0' && ch <= '9')
+      value = ch - '0' + 52;
+    else if (ch == '+' || ch == '-')
+      value = 62;
+    else if (ch == '/' || ch == '_')
+      value = 63;
+    else if (ch == '\n' || ch == '\r' || ch == ' ')
+      continue;
+    else
+      return false;
+    bits = (bits << 6) | value;
+    bitsNumber += 6;
+    if (bitsNumber >= 8) {
+      bitsNumber -= 8;
+      bytes.push_back((unsigned char) (bits >> bitsNumber));
+    }
+  }
+  return true;
+}
+
+// Relative file names are percent encoded
+string decodeURI(const string& uri) {
+  string decoded;
+  for (unsigned int i = 0 ; i < uri.size() ; i++) {
+    if (uri[i] == '%' && i + 2 < uri.size()) {
+      decoded += (char) strtol(uri.substr(i + 1, 2).c_str(), NULL, 16);
+      i += 2;
+    }
+    else
+      decoded += uri[i];
+  }
+  return decoded;
+}
+
+uint32_t readUint32(const unsigned char* data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+struct BufferData {
+  const unsigned char* data;
+  unsigned long long size;
+};
+
+// Everything a primitive can reference
+struct Document {
+  string folder;
+  JSONValue root;
+  vector<BufferData> buffers;
+  // Owners of the buffer data
+  vector<shared_ptr<MappedFile> > files;
+  vector<vector<unsigned char> > decoded;
+  vector<shared_ptr<Material> > materials;
+  shared_ptr<Material> defaultMaterial;
+  bool keepPixels;
+};
+
+// Data of a URI: embedded in base64, or a file next to the glTF one
+bool loadURI(Document& document, const string& uri, unsigned int buffer, BufferData& data) {
+  if (uri.compare(0, 5, "data:") == 0) {
+    size_t comma = uri.find(',');
+    if (comma == string::npos || uri.find(";base64") > comma
+        || !decodeBase64(uri.c_str() + comma + 1, uri.size() - comma - 1, document.decoded[buffer])) {
+      cerr << "ERROR: glTF data URI is not in base64" << endl;
+      return false;
+    }
+    data.data = document.decoded[buffer].empty() ? NULL : &document.decoded[buffer][0];
+    data.size = document.decoded[buffer].size();
+    return true;
+  }
+  shared_ptr<MappedFile> file = make_shared<MappedFile>();
+  if (!file->open(document.folder + decodeURI(uri)))
+    return false;
+  document.files.push_back(file);
+  data.data = file->getData();
+  data.size = file->getSize();
+  return true;
+}
+
+// Typed view on the elements of an accessor
+struct Accessor {
+  const unsigned char* data;
+  unsigned int count;
+  unsigned int components;
+  unsigned int componentType;
+  unsigned int stride;
+  bool normalized;
+};
+
+unsigned int componentSize(unsigned int componentType) {
+  switch (componentType) {
+    case 5120: case 5121: return 1; // BYTE, UNSIGNED_BYTE
+    case 5122: case 5123: return 2; // SHORT, UNSIGNED_SHORT
+    case 5125: case 5126: return 4; // UNSIGNED_INT, FLOAT
+    default: return 0;
+  }
+}
+
+unsigned int typeComponents(const string& type) {
+  if (type == "SCALAR")
+    return 1;
+  if (type == "VEC2")
+    return 2;
+  if (type == "VEC3")
+    return 3;
+  if (type == "VEC4")
+    return 4;
+  if (type == "MAT4")
+    return 16;
+  return 0;
+}
+
+bool getAccessor(const Document& document, int index, Accessor& accessor) {
+  const JSONValue* json = itemOf(document.root, "accessors", index);
+  if (json == NULL)
+    return false;
+  const JSONValue* type = json->get("type");
+  accessor.count = (unsigned int) numberOf(json->get("count"), 0.0);
+  accessor.componentType = (unsigned int) numberOf(json->get("componentType"), 0.0);
+  accessor.components = type != NULL ? typeComponents(type->text) : 0;
+  accessor.normalized = numberOf(json->get("normalized"), 0.0) != 0.0;
+  unsigned int elementSize = accessor.components * componentSize(accessor.componentType);
+  if (elementSize == 0 || accessor.count == 0) {
+    cerr << "ERROR: glTF accessor " << index << " has an unknown type" << endl;
+    return false;
+  }
+  if (json->get("sparse") != NULL)
+    cerr << "WARNING: sparse glTF accessors are not supported, accessor " << index << " is read without its substitutions" << endl;
+
+  const JSONValue* view = itemOf(document.root, "bufferViews", indexOf(json->get("bufferView")));
+  int buffer = view != NULL ? indexOf(view->get("buffer")) : -1;
+  if (buffer < 0 || (unsigned int) buffer >= document.buffers.size() || document.buffers[buffer].data == NULL) {
+    cerr << "ERROR: glTF accessor " << index << " has no data" << endl;
+    return false;
+  }
+  accessor.stride = (unsigned int) numberOf(view->get("byteStride"), 0.0);
+  if (accessor.stride == 0)
+    accessor.stride = elementSize;
+  unsigned long long offset = (unsigned long long) numberOf(view->get("byteOffset"), 0.0)
+                              + (unsigned long long) numberOf(json->get("byteOffset"), 0.0);
+  unsigned long long viewEnd = (unsigned long long) numberOf(view->get("byteOffset"), 0.0)
+                               + (unsigned long long) numberOf(view->get("byteLength"), 0.0);
+  unsigned long long last = offset + (unsigned long long) accessor.stride * (accessor.count - 1) + elementSize;
+  if (last > viewEnd || viewEnd > document.buffers[buffer].size) {
+    cerr << "ERROR: glTF accessor " << index << " goes past its buffer" << endl;
+    return false;
+  }
+  accessor.data = document.buffers[buffer].data + offset;
+  return true;
+}
+
+float readComponent(const unsigned char* data, unsigned int componentType, bool normalized) {
+  switch (componentType) {
+    case 5120: { int8_t v; memcpy(&v, data, 1); return normalized ? max(v / 127.f, -1.f) : v; }
+    case 5121: return normalized ? data[0] / 255.f : data[0];
+    case 5122: { int16_t v; memcpy(&v, data, 2); return normalized ? max(v / 32767.f, -1.f) : v; }
+    case 5123: { uint16_t v; memcpy(&v, data, 2); return normalized ? v / 65535.f : v; }
+    case 5125: { uint32_t v; memcpy(&v, data, 4); return (float) v; }
+    case 5126: { float v; memcpy(&v, data, 4); return v; }
+    default: return 0.f;
+  }
+}
+
+// components floats per element, missing ones are 0
+void readFloats(const Accessor& accessor, unsigned int components, vector<float>& values) {
+  values.resize((size_t) accessor.count * components);
+  // Tightly packed floats: the layout of the vertex arrays
+  if (accessor.componentType == 5126 && accessor.components == components && accessor.stride == components * sizeof (float)) {
+    memcpy(&values[0], accessor.data, values.size() * sizeof (float));
+    return;
+  }
+  unsigned int size = componentSize(accessor.componentType);
+  for (unsigned int i = 0 ; i < accessor.count ; i++) {
+    const unsigned char* element = accessor.data + (size_t) i * accessor.stride;
+    for (unsigned int j = 0 ; j < components ; j++)
+      values[(size_t) i * components + j] = j < accessor.components ? readComponent(element + j * size, accessor.componentType, accessor.normalized) : 0.f;
+  }
+}
+
+bool readIndices(const Accessor& accessor, vector<unsigned int>& indices) {
+  if (accessor.components != 1 || (accessor.componentType != 5121 && accessor.componentType != 5123 && accessor.componentType != 5125))
+    return false;
+  indices.resize(accessor.count);
+  if (accessor.componentType == 5125 && accessor.stride == sizeof (uint32_t)) {
+    memcpy(&indices[0], accessor.data, indices.size() * sizeof (uint32_t));
+    return true;
+  }
+  for (unsigned int i = 0 ; i < accessor.count ; i++)
+    indices[i] = (unsigned int) readComponent(accessor.data + (size_t) i * accessor.stride, accessor.componentType, false);
+  return true;
+}
+
+// Image of a texture, from a buffer view or a URI, uploaded as the diffuse map
+void loadTexture(Document& document, int textureIndex, Material& material) {
+  const JSONValue* texture = itemOf(document.root, "textures", textureIndex);
+  const JSONValue* image = texture != NULL ? itemOf(document.root, "images", indexOf(texture->get("source"))) : NULL;
+  if (image == NULL)
+    return;
+
+  const unsigned char* encoded = NULL;
+  unsigned long long size = 0;
+  vector<unsigned char> decoded;
+  const JSONValue* uri = image->get("uri");
+  const JSONValue* view = itemOf(document.root, "bufferViews", indexOf(image->get("bufferView")));
+  if (view != NULL) {
+    int buffer = indexOf(view->get("buffer"));
+    unsigned long long offset = (unsigned long long) numberOf(view->get("byteOffset"), 0.0);
+    size = (unsigned long long) numberOf(view->get("byteLength"), 0.0);
+    if (buffer >= 0 && (unsigned int) buffer < document.buffers.size() && document.buffers[buffer].data != NULL
+        && offset + size <= document.buffers[buffer].size)
+      encoded = document.buffers[buffer].data + offset;
+  }
+  else if (uri != NULL && uri->text.compare(0, 5, "data:") == 0) {
+    size_t comma = uri->text.find(',');
+    if (comma != string::npos && decodeBase64(uri->text.c_str() + comma + 1, uri->text.size() - comma - 1, decoded) && !decoded.empty()) {
+      encoded = &decoded[0];
+      size = decoded.size();
+    }
+  }
+  else if (uri != NULL) {
+    // Read by the usual texture path
+    material.diffuseMap = document.folder + decodeURI(uri->text);
+    material.loadTextures();
+    return;
+  }
+  if (encoded == NULL) {
+    cerr << "ERROR: could not read the glTF image of texture " << textureIndex << endl;
+    return;
+  }
+
+  int width, height, n;
+  unsigned char* pixels = stbi_load_from_memory(encoded, (int) size, &width, &height, &n, 4);
+  if (pixels == NULL) {
+    cerr << "ERROR: could not decode the glTF image of texture " << textureIndex << endl;
+    return;
+  }
+  material.setDiffuseTextureData(width, height, pixels, GL_RGBA);
+  stbi_image_free(pixels);
+}
+
+// Metallic roughness to the Phong attributes of Material
+shared_ptr<Material> createMaterial(Document& document, const JSONValue& json) {
+  float baseColor[4] = { 1.f, 1.f, 1.f, 1.f };
+  float metallic = 1.f, roughness = 1.f;
+  const JSONValue* pbr = json.get("pbrMetallicRoughness");
+  if (pbr != NULL) {
+    const JSONValue* factor = pbr->get("baseColorFactor");
+    for (unsigned int i = 0 ; factor != NULL && i < 4 && i < factor->size() ; i++)
+      baseColor[i] = (float) factor->items[i].number;
+    metallic = (float) numberOf(pbr->get("metallicFactor"), 1.0);
+    roughness = (float) numberOf(pbr->get("roughnessFactor"), 1.0);
+  }
+
+  shared_ptr<Material> material = make_shared<Material>();
+  material->setKeepPixels(document.keepPixels);
+  material->diffuseColor.init(baseColor[0], baseColor[1], baseColor[2]);
+  material->ambientColor.init(baseColor[0], baseColor[1], baseColor[2]);
+  // Dielectrics reflect 4% of the light, metals their color, less the rougher they are
+  float specular[3];
+  for (int i = 0 ; i < 3 ; i++)
+    specular[i] = (0.04f + (baseColor[i] - 0.04f) * metallic) * (1.f - roughness);
+  material->specularColor.init(specular[0], specular[1], specular[2]);
+  material->d = baseColor[3];
+
+  const JSONValue* baseColorTexture = pbr != NULL ? pbr->get("baseColorTexture") : NULL;
+  if (baseColorTexture != NULL)
+    loadTexture(document, indexOf(baseColorTexture->get("index")), *material);
+  material->markChanged();
+  return material;
+}
+
+// Translation, rotation quaternion (x, y, z, w) and scale
+struct NodeTransform {
+  float translation[3];
+  float rotation[4];
+  float scale[3];
+};
+
+void rotateVector(const float* q, const float* v, float* result) {
+  // v + 2w (q x v) + 2 q x (q x v)
+  float t[3] = { 2.f * (q[1] * v[2] - q[2] * v[1]), 2.f * (q[2] * v[0] - q[0] * v[2]), 2.f * (q[0] * v[1] - q[1] * v[0]) };
+  result[0] = v[0] + q[3] * t[0] + q[1] * t[2] - q[2] * t[1];
+  result[1] = v[1] + q[3] * t[1] + q[2] * t[0] - q[0] * t[2];
+  result[2] = v[2] + q[3] * t[2] + q[0] * t[1] - q[1] * t[0];
+}
+
+void multiplyQuaternions(const float* a, const float* b, float* result) {
+  float r[4] = {
+    a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1],
+    a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0],
+    a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3],
+    a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2]
+  };
+  memcpy(result, r, sizeof (r));
+}
+
+// Column-major matrix without shear
+void decomposeMatrix(const float* m, NodeTransform& transform) {
+  for (int i = 0 ; i < 3 ; i++) {
+    transform.translation[i] = m[12 + i];
+    transform.scale[i] = sqrt(m[i * 4] * m[i * 4] + m[i * 4 + 1] * m[i * 4 + 1] + m[i * 4 + 2] * m[i * 4 + 2]);
+  }
+  float r[9];
+  for (int column = 0 ; column < 3 ; column++)
+    for (int row = 0 ; row < 3 ; row++)
+      r[column * 3 + row] = transform.scale[column] > 0.f ? m[column * 4 + row] / transform.scale[column] : 0.f;
+  // Rotation matrix to quaternion, from its largest component
+  float* q = transform.rotation;
+  float trace = r[0] + r[4] + r[8];
+  if (trace > 0.f) {
+    float s = 0.5f / sqrt(trace + 1.f);
+    q[3] = 0.25f / s;
+    q[0] = (r[5] - r[7]) * s;
+    q[1] = (r[6] - r[2]) * s;
+    q[2] = (r[1] - r[3]) * s;
+  }
+  else if (r[0] > r[4] && r[0] > r[8]) {
+    float s = 2.f * sqrt(1.f + r[0] - r[4] - r[8]);
+    q[3] = (r[5] - r[7]) / s;
+    q[0] = 0.25f * s;
+    q[1] = (r[3] + r[1]) / s;
+    q[2] = (r[6] + r[2]) / s;
+  }
+  else if (r[4] > r[8]) {
+    float s = 2.f * sqrt(1.f + r[4] - r[0] - r[8]);
+    q[3] = (r[6] - r[2]) / s;
+    q[0] = (r[3] + r[1]) / s;
+    q[1] = 0.25f * s;
+    q[2] = (r[7] + r[5]) / s;
+  }
+  else {
+    float s = 2.f * sqrt(1.f + r[8] - r[0] - r[4]);
+    q[3] = (r[1] - r[3]) / s;
+    q[0] = (r[6] + r[2]) / s;
+    q[1] = (r[7] + r[5]) / s;
+    q[2] = 0.25f * s;
+  }
+}
+
+// The node transform after its parent one. Exact unless a parent has a non
+// uniform scale and a child a rotation, which would need a shear.
+NodeTransform combine(const NodeTransform& parent, const JSONValue& node) {
+  NodeTransform local = { { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f, 1.f }, { 1.f, 1.f, 1.f } };
+  const JSONValue* matrix = node.get("matrix");
+  if (matrix != NULL && matrix->size() == 16) {
+    float m[16];
+    for (int i = 0 ; i < 16 ; i++)
+      m[i] = (float) matrix->items[i].number;
+    decomposeMatrix(m, local);
+  }
+  else {
+    const JSONValue* translation = node.get("translation");
+    const JSONValue* rotation = node.get("rotation");
+    const JSONValue* scale = node.get("scale");
+    for (unsigned int i = 0 ; translation != NULL && i < 3 && i < translation->size() ; i++)
+      local.translation[i] = (float) translation->items[i].number;
+    for (unsigned int i = 0 ; rotation != NULL && i < 4 && i < rotation->size() ; i++)
+      local.rotation[i] = (float) rotation->items[i].number;
+    for (unsigned int i = 0 ; scale != NULL && i < 3 && i < scale->size() ; i++)
+      local.scale[i] = (float) scale->items[i].number;
+  }
+
+  NodeTransform world;
+  float scaled[3];
+  for (int i = 0 ; i < 3 ; i++) {
+    scaled[i] = parent.scale[i] * local.translation[i];
+    world.scale[i] = parent.scale[i] * local.scale[i];
+  }
+  rotateVector(parent.rotation, scaled, world.translation);
+  for (int i = 0 ; i < 3 ; i++)
+    world.translation[i] += parent.translation[i];
+  multiplyQuaternions(parent.rotation, local.rotation, world.rotation);
+  return world;
+}
+
+void applyTransform(const NodeTransform& transform, Object& object) {
+  qm::Vec3f position(transform.translation[0], transform.translation[1], transform.translation[2]);
+  object.setPosition(position);
+  object.setScale(transform.scale[0], transform.scale[1], transform.scale[2]);
+  // Angle in degrees and axis
+  const float* q = transform.rotation;
+  float length = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+  float w = length > 0.f ? min(max(q[3] / length, -1.f), 1.f) : 1.f;
+  float sine = sqrt(1.f - w * w);
+  if (sine < 1e-6f)
+    object.setRotation(0.f, 0.f, 1.f, 0.f);
+  else
+    object.setRotation((float) (2.0 * acos(w) * 180.0 / M_PI), q[0] / length / sine, q[1] / length / sine, q[2] / length / sine);
+}
+
+// One object per triangle primitive
+void addPrimitive(Document& document, const JSONValue& primitive, const NodeTransform& transform, vector<Object>& objects) {
+  if (numberOf(primitive.get("mode"), 4.0) != 4.0) {
+    cerr << "WARNING: only glTF triangle primitives are loaded" << endl;
+    return;
+  }
+  const JSONValue* attributes = primitive.get("attributes");
+  Accessor positionsAccessor;
+  if (attributes == NULL || !getAccessor(document, indexOf(attributes->get("POSITION")), positionsAccessor))
+    return;
+
+  vector<float> positions, normals, uvs, colors;
+  readFloats(positionsAccessor, 3, positions);
+  unsigned int verticesNumber = positionsAccessor.count;
+  Accessor accessor;
+  if (attributes->get("NORMAL") != NULL && getAccessor(document, indexOf(attributes->get("NORMAL")), accessor)
+      && accessor.count == verticesNumber)
+    readFloats(accessor, 3, normals);
+  if (attributes->get("TEXCOORD_0") != NULL && getAccessor(document, indexOf(attributes->get("TEXCOORD_0")), accessor)
+      && accessor.count == verticesNumber) {
+    readFloats(accessor, 2, uvs);
+    // glTF textures start at the top, the shaders flip v for OBJ ones that start at the bottom
+    for (unsigned int i = 1 ; i < uvs.size() ; i += 2)
+      uvs[i] = 1.f - uvs[i];
+  }
+  if (attributes->get("COLOR_0") != NULL && getAccessor(document, indexOf(attributes->get("COLOR_0")), accessor)
+      && accessor.count == verticesNumber)
+    readFloats(accessor, 3, colors);
+
+  vector<unsigned int> indices;
+  const JSONValue* indicesJSON = primitive.get("indices");
+  if (indicesJSON != NULL) {
+    if (!getAccessor(document, indexOf(indicesJSON), accessor) || !readIndices(accessor, indices)) {
+      cerr << "ERROR: could not read the glTF indices" << endl;
+      return;
+    }
+    for (unsigned int i = 0 ; i < indices.size() ; i++) {
+      if (indices[i] >= verticesNumber) {
+        cerr << "ERROR: glTF index " << indices[i] << " out of " << verticesNumber << " vertices" << endl;
+        return;
+      }
+    }
+  }
+
+  objects.emplace_back();
+  Object& object = objects.back();
+  if (indicesJSON == NULL && !normals.empty()) {
+    // A triangle list with normals already has the layout of the vertex arrays
+    unsigned int vertices = verticesNumber / 3 * 3;
+    positions.resize(vertices * 3);
+    normals.resize(vertices * 3);
+    uvs.resize(uvs.empty() ? 0 : vertices * 2);
+    colors.resize(colors.empty() ? 0 : vertices * 3);
+    object.setVertices(positions, normals, uvs, colors);
+  }
+  else {
+    if (indicesJSON == NULL) {
+      indices.resize(verticesNumber);
+      for (unsigned int i = 0 ; i < verticesNumber ; i++)
+        indices[i] = i;
+    }
+    IndexedMesh mesh;
+    mesh.positions.swap(positions);
+    mesh.normals.swap(normals);
+    mesh.uvs.swap(uvs);
+    mesh.colors.swap(colors);
+    unsigned int trianglesNumber = indices.size() / 3;
+    mesh.indices.resize(trianglesNumber * 9);
+    for (unsigned int i = 0 ; i < trianglesNumber * 3 ; i++) {
+      int index = indices[i];
+      mesh.indices[i * 3] = index;
+      mesh.indices[i * 3 + 1] = mesh.hasNormals() ? index : -1;
+      mesh.indices[i * 3 + 2] = mesh.hasUVs() ? index : -1;
+    }
+    object.setMesh(mesh);
+  }
+
+  int material = indexOf(primitive.get("material"));
+  if (material >= 0 && (unsigned int) material < document.materials.size())
+    object.setMaterial(document.materials[material]);
+  else {
+    if (!document.defaultMaterial) {
+      document.defaultMaterial = make_shared<Material>();
+      document.defaultMaterial->diffuseColor.init(1.f, 1.f, 1.f);
+    }
+    object.setMaterial(document.defaultMaterial);
+  }
+  applyTransform(transform, object);
+}
+
+void addNode(Document& document, int index, const NodeTransform& parent, int depth, vector<Object>& objects) {
+  const JSONValue* node = itemOf(document.root, "nodes", index);
+  // The depth limit also stops cycles
+  if (node == NULL || depth > 64)
+    return;
+  NodeTransform transform = combine(parent, *node);
+  const JSONValue* mesh = itemOf(document.root, "meshes", indexOf(node->get("mesh")));
+  const JSONValue* primitives = mesh != NULL ? mesh->get("primitives") : NULL;
+  for (unsigned int i = 0 ; primitives != NULL && i < primitives->size() ; i++)
+    addPrimitive(document, primitives->items[i], transform, objects);
+  const JSONValue* children = node->get("children");
+  for (unsigned int i = 0 ; children != NULL && i < children->size() ; i++)
+    addNode(document, indexOf(&children->items[i]), transform, depth + 1, objects);
+}
+
+}
+
+GLTFLoader::GLTFLoader() {
+  keepPixels = false;
+}
+
+bool GLTFLoader::load(const string& filename, vector<Object>& objects) {
+  MappedFile file;
+  if (!file.open(filename))
+    return false;
+  const unsigned char* data = file.getData();
+  unsigned long long size = file.getSize();
+
+  Document document;
+  document.keepPixels = keepPixels;
+  size_t slash = filename.find_last_of("/\\");
+  document.folder = slash != string::npos ? filename.substr(0, slash + 1) : "";
+
+  // Binary glTF: a header, a JSON chunk and an optional binary chunk
+  const char* json = (const char*) data;
+  const char* jsonEnd = json + size;
+  BufferData binaryChunk = { NULL, 0 };
+  if (size >= 12 && memcmp(data, "glTF", 4) == 0) {
+    if (readUint32(data + 4) != 2 || size < 20 || readUint32(data + 16) != 0x4e4f534a) {
+      cerr << "ERROR: " << filename << " is not a glTF 2.0 binary file" << endl;
+      return false;
+    }
+    unsigned long long jsonLength = readUint32(data + 12);
+    if (20 + jsonLength > size) {
+      cerr << "ERROR: " << filename << " is truncated" << endl;
+      return false;
+    }
+    json = (const char*) data + 20;
+    jsonEnd = json + jsonLength;
+    // Chunks are aligned on 4 bytes
+    unsigned long long binary = 20 + ((jsonLength + 3) & ~3ull);
+    if (binary + 8 <= size && readUint32(data + binary + 4) == 0x004e4942) {
+      binaryChunk.data = data + binary + 8;
+      binaryChunk.size = min((unsigned long long) readUint32(data + binary), size - binary - 8);
+    }
+  }
+
+  JSONParser parser(json, jsonEnd);
+  if (!parser.parse(document.root) || document.root.type != JSONValue::JSON_OBJECT) {
+    cerr << "ERROR: " << filename << " is not valid glTF JSON" << endl;
+    return false;
+  }
+  const JSONValue* asset = document.root.get("asset");
+  const JSONValue* version = asset != NULL ? asset->get("version") : NULL;
+  if (version == NULL || version->text.compare(0, 1, "2") != 0) {
+    cerr << "ERROR: " << filename << " is not a glTF 2.0 file" << endl;
+    return false;
+  }
+
+  const JSONValue* buffers = document.root.get("buffers");
+  unsigned int buffersNumber = buffers != NULL ? buffers->size() : 0;
+  document.buffers.resize(buffersNumber);
+  document.decoded.resize(buffersNumber);
+  for (unsigned int i = 0 ; i < buffersNumber ; i++) {
+    BufferData& buffer = document.buffers[i];
+    buffer.data = NULL;
+    buffer.size = 0;
+    const JSONValue* uri = buffers->items[i].get("uri");
+    // The first buffer of a binary file without uri is the binary chunk, used in place
+    if (uri == NULL && i == 0)
+      buffer = binaryChunk;
+    else if (uri != NULL && !loadURI(document, uri->text, i, buffer))
+      return false;
+    unsigned long long byteLength = (unsigned long long) numberOf(buffers->items[i].get("byteLength"), 0.0);
+    if (buffer.data != NULL && buffer.size < byteLength) {
+      cerr << "ERROR: buffer " << i << " of " << filename << " is truncated" << endl;
+      return false;
+    }
+  }
+
+  const JSONValue* materials = document.root.get("materials");
+  for (unsigned int i = 0 ; materials != NULL && i < materials->size() ; i++)
+    document.materials.push_back(createMaterial(document, materials->items[i]));
+
+  // Roots of the default scene, or the nodes no other one has as child
+  vector<int> roots;
+  const JSONValue* scene = itemOf(document.root, "scenes", max(indexOf(document.root.get("scene")), 0));
+  const JSONValue* nodes = document.root.get("nodes");
+  unsigned int nodesNumber = nodes != NULL ? nodes->size() : 0;
+  if (scene != NULL && scene->get("nodes") != NULL) {
+    const JSONValue* sceneNodes = scene->get("nodes");
+    for (unsigned int i = 0 ; i < sceneNodes->size() ; i++)
+      roots.push_back(indexOf(&sceneNodes->items[i]));
+  }
+  else {
+    vector<bool> isChild(nodesNumber, false);
+    for (unsigned int i = 0 ; i < nodesNumber ; i++) {
+      const JSONValue* children = nodes->items[i].get("children");
+      for (unsigned int j = 0 ; children != NULL && j < children->size() ; j++) {
+        int child = indexOf(&children->items[j]);
+        if (child >= 0 && (unsigned int) child < nodesNumber)
+          isChild[child] = true;
+      }
+    }
+    for (unsigned int i = 0 ; i < nodesNumber ; i++)
+      if (!isChild[i])
+        roots.push_back(i);
+  }
+
+  unsigned int firstObject = objects.size();
+  NodeTransform identity = { { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f, 1.f }, { 1.f, 1.f, 1.f } };
+  for (unsigned int i = 0 ; i < roots.size() ; i++)
+    addNode(document, roots[i], identity, 0, objects);
+  cout << "Loaded " << objects.size() - firstObject << " objects from " << filename << endl;
+  return objects.size() > firstObject;
+}
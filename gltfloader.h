@@ -0,0 +1,41 @@
+#ifndef GLTFLOADER_H
+#define GLTFLOADER_H
+
+#include <string>
+#include <vector>
+
+#include "object.h"
+
+
+namespace qgl {
+
+// glTF 2.0 scenes, as .gltf with external or embedded buffers, or as .glb.
+// Each triangle primitive of a mesh drawn by a node gives an Object, with
+// the transform of the node combined with its parents. Materials are shared
+// by their primitives: the metallic roughness base color becomes the diffuse
+// color and its texture, decoded from the file or from a buffer view, the
+// diffuse map. Buffers are mapped, the binary chunk of a .glb in place, and
+// tightly packed float accessors are copied to the vertex arrays in one block.
+// Primitives with indices are expanded by Object::computeVertices like OBJ
+// meshes; triangle lists with normals are taken as they are.
+class GLTFLoader {
+
+  public:
+    GLTFLoader();
+
+    // Materials keep the pixels of the images decoded from the file or from a
+    // buffer, so that their textures can be released and loaded again, see
+    // Material::setKeepPixels. Off by default.
+    void setKeepPixels(bool keep) { keepPixels = keep; }
+
+    // Appends the objects of the default scene. Textures are uploaded: needs a GL context.
+    bool load(const std::string& filename, std::vector<Object>& objects);
+
+  private:
+    bool keepPixels;
+
+};
+
+}
+
+#endif // GLTFLOADER_H
@@ -0,0 +1,156 @@
+#include "jobsystem.h"
+
+using namespace qgl;
+using namespace std;
+
+// Queue of the current thread when it is a worker of that system
+static thread_local const JobSystem* workerSystem = NULL;
+static thread_local unsigned int workerQueue = 0;
+
+JobSystem::JobSystem(unsigned int threadsNumber) : queuedJobs(0), stopping(false), executed(0), stolen(0) {
+  if (threadsNumber == 0)
+    threadsNumber = thread::hardware_concurrency();
+  threadsNumber = max(threadsNumber, 1u);
+  for (unsigned int i = 0 ; i < threadsNumber ; i++)
+    queues.push_back(new WorkQueue());
+  for (unsigned int i = 1 ; i < threadsNumber ; i++)
+    workers.push_back(thread(&JobSystem::work, this, i));
+}
+
+JobSystem::~JobSystem() {
+  {
+    lock_guard<mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  sleepCondition.notify_all();
+  for (unsigned int i = 0 ; i < workers.size() ; i++)
+    workers[i].join();
+  for (unsigned int i = 0 ; i < queues.size() ; i++)
+    delete queues[i];
+}
+
+unsigned int JobSystem::currentQueue() const {
+  return workerSystem == this ? workerQueue : 0;
+}
+
+void JobSystem::submit(const Job& job, JobCounter* counter) {
+  Job counted = job;
+  counted.counter = counter;
+  if (counter != NULL)
+    counter->pending++;
+  push(counted);
+}
+
+void JobSystem::submitAfter(JobCounter& dependency, const Job& job, JobCounter* counter) {
+  Job counted = job;
+  counted.counter = counter;
+  if (counter != NULL)
+    counter->pending++;
+  {
+    lock_guard<mutex> lock(dependency.continuationsMutex);
+    if (dependency.pending.load() != 0) {
+      dependency.continuations.push_back(counted);
+      return;
+    }
+  }
+  push(counted);
+}
+
+void JobSystem::push(const Job& job) {
+  // Counted first so that the count never misses a queued job
+  queuedJobs++;
+  WorkQueue& queue = *queues[currentQueue()];
+  {
+    lock_guard<mutex> lock(queue.queueMutex);
+    queue.jobs.push_back(job);
+  }
+  // Taking the lock orders the notification after a worker checking the count
+  {
+    lock_guard<mutex> lock(sleepMutex);
+  }
+  sleepCondition.notify_one();
+}
+
+bool JobSystem::takeJob(unsigned int index, Job& job) {
+  if (queuedJobs.load() == 0)
+    return false;
+  {
+    WorkQueue& queue = *queues[index];
+    lock_guard<mutex> lock(queue.queueMutex);
+    if (!queue.jobs.empty()) {
+      job = queue.jobs.back();
+      queue.jobs.pop_back();
+      queuedJobs--;
+      return true;
+    }
+  }
+  for (unsigned int i = 1 ; i < queues.size() ; i++) {
+    WorkQueue& victim = *queues[(index + i) % queues.size()];
+    lock_guard<mutex> lock(victim.queueMutex);
+    if (!victim.jobs.empty()) {
+      job = victim.jobs.front();
+      victim.jobs.pop_front();
+      queuedJobs--;
+      stolen++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void JobSystem::execute(const Job& job) {
+  job.function(job.data, job.first, job.last);
+  executed++;
+  finish(job.counter);
+}
+
+void JobSystem::finish(JobCounter* counter) {
+  if (counter == NULL)
+    return;
+  vector<Job> continuations;
+  {
+    // Held while decrementing: a waiter seeing 0 may destroy the counter once it is released
+    lock_guard<mutex> lock(counter->continuationsMutex);
+    if (--counter->pending == 0)
+      continuations.swap(counter->continuations);
+  }
+  for (unsigned int i = 0 ; i < continuations.size() ; i++)
+    push(continuations[i]);
+}
+
+void JobSystem::wait(JobCounter& counter) {
+  unsigned int index = currentQueue();
+  Job job;
+  while (counter.pending.load() != 0) {
+    if (takeJob(index, job))
+      execute(job);
+    else
+      this_thread::yield();
+  }
+  // The thread finishing the last job may still hold the counter
+  lock_guard<mutex> lock(counter.continuationsMutex);
+}
+
+void JobSystem::work(unsigned int index) {
+  workerSystem = this;
+  workerQueue = index;
+  Job job;
+  while (true) {
+    if (takeJob(index, job)) {
+      execute(job);
+      continue;
+    }
+    unique_lock<mutex> lock(sleepMutex);
+    while (!stopping && queuedJobs.load() == 0)
+      sleepCondition.wait(lock);
+    if (stopping)
+      return;
+  }
+}
+
+JobSystemStats JobSystem::getStats() const {
+  JobSystemStats stats;
+  stats.executed = executed.load();
+  stats.stolen = stolen.load();
+  return stats;
+}
@@ -0,0 +1,139 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace qgl {
+
+class JobCounter;
+
+// Function called with a range of items. The data must live until the job ran.
+struct Job {
+  typedef void (*Function)(void* data, unsigned int first, unsigned int last);
+
+  Job() : function(NULL), data(NULL), first(0), last(0), counter(NULL) {}
+  Job(Function function, void* data, unsigned int first = 0, unsigned int last = 0)
+    : function(function), data(data), first(first), last(last), counter(NULL) {}
+
+  Function function;
+  void* data;
+  unsigned int first;
+  unsigned int last;
+  JobCounter* counter; // set by the job system
+};
+
+// Jobs of a group that are not done yet. Submitting a job with a counter
+// increments it, finishing the job decrements it; the continuations are
+// submitted when it drops to 0. A counter can be reused once it is done.
+class JobCounter {
+
+  public:
+    JobCounter() : pending(0) {}
+
+    bool isDone() const { return pending.load() == 0; }
+
+  private:
+    JobCounter(const JobCounter&);
+    JobCounter& operator=(const JobCounter&);
+
+    friend class JobSystem;
+
+    std::atomic<unsigned int> pending;
+    std::mutex continuationsMutex;
+    std::vector<Job> continuations;
+
+};
+
+struct JobSystemStats {
+  unsigned long long executed;
+  unsigned long long stolen; // taken from the queue of another thread
+};
+
+// Job scheduler with a queue per worker thread. A thread pushes and pops its
+// own jobs at the back, the most recent first while their data is in cache,
+// and steals from the front of the other queues when its own is empty. The
+// threads that are not workers share queue 0. Waiting on a counter runs jobs
+// instead of blocking, so jobs can wait for jobs they submitted.
+class JobSystem {
+
+  public:
+    // The thread creating the system counts as one: threadsNumber - 1 workers
+    // are started, 0 uses the hardware concurrency.
+    JobSystem(unsigned int threadsNumber = 0);
+    // Jobs still queued are dropped: wait for them before
+    ~JobSystem();
+
+    unsigned int getThreadsNumber() const { return queues.size(); }
+
+    void submit(const Job& job, JobCounter* counter = NULL);
+    // job is submitted when dependency drops to 0, right away if it is done.
+    // counter counts the job from now on.
+    void submitAfter(JobCounter& dependency, const Job& job, JobCounter* counter = NULL);
+    // Runs jobs until counter drops to 0
+    void wait(JobCounter& counter);
+
+    // Calls function(first, last) on ranges of at most grainSize items and
+    // returns when they are all done. 0 splits in a few ranges per thread.
+    template <typename Function>
+    void parallelFor(unsigned int count, unsigned int grainSize, const Function& function) {
+      if (grainSize == 0)
+        grainSize = std::max(count / (getThreadsNumber() * 4), 1u);
+      if (count <= grainSize || getThreadsNumber() == 1) {
+        if (count > 0)
+          function(0, count);
+        return;
+      }
+      JobCounter counter;
+      // The first range is kept for this thread
+      for (unsigned int first = grainSize ; first < count ; first += grainSize)
+        submit(Job(&runRange<Function>, (void*) &function, first, std::min(first + grainSize, count)), &counter);
+      function(0, grainSize);
+      wait(counter);
+    }
+
+    JobSystemStats getStats() const;
+
+  private:
+    JobSystem(const JobSystem&);
+    JobSystem& operator=(const JobSystem&);
+
+    struct WorkQueue {
+      std::mutex queueMutex;
+      std::deque<Job> jobs;
+    };
+
+    template <typename Function>
+    static void runRange(void* data, unsigned int first, unsigned int last) {
+      (*static_cast<const Function*>(data))(first, last);
+    }
+
+    void work(unsigned int index);
+    unsigned int currentQueue() const;
+    void push(const Job& job);
+    bool takeJob(unsigned int index, Job& job);
+    void execute(const Job& job);
+    void finish(JobCounter* counter);
+
+    std::vector<WorkQueue*> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned int> queuedJobs;
+    std::atomic<bool> stopping;
+    // Idle workers sleep until a job is queued
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+
+    std::atomic<unsigned long long> executed;
+    std::atomic<unsigned long long> stolen;
+
+};
+
+}
+
+#endif // JOBSYSTEM_H
@@ -0,0 +1,285 @@
+#include "lightmanager.h"
+
+#include <cmath>
+
+#ifdef __SSE__
+  #include <xmmintrin.h>
+#endif
+
+#include "transforms.h"
+
+using namespace qgl;
+using namespace std;
+
+// Light data texels (RGBA32F) per light: eye position and radius, diffuse, specular
+static const unsigned int LIGHT_TEXELS = 3;
+
+LightManager::LightManager() {
+  tilesX = 16;
+  tilesY = 9;
+  slices = 24;
+  maxLightsPerCluster = 128;
+  fovY = aspect = near = far = 0.f;
+  width = height = 0;
+  boundsValid = false;
+  paddedTiles = 0;
+  dropped = 0;
+  frameAllocator = NULL;
+  pipeline = NULL;
+  currentSlot = 0;
+  revision = 0;
+}
+
+LightManager::~LightManager() {
+  for (unsigned int i = 0 ; i < slotBuffers.size() ; i++) {
+    glDeleteBuffers(3, slotBuffers[i].buffers);
+    glDeleteTextures(3, slotBuffers[i].textures);
+  }
+}
+
+void LightManager::setGrid(unsigned int tilesX, unsigned int tilesY, unsigned int slices) {
+  this->tilesX = tilesX;
+  this->tilesY = tilesY;
+  this->slices = slices;
+  boundsValid = false;
+}
+
+unsigned int LightManager::addLight(const PointLight& light) {
+  lights.push_back(light);
+  revision++;
+  return lights.size() - 1;
+}
+
+unsigned int LightManager::getRevision() const {
+  // Mixed rather than summed, so that removing a changed light is still a change
+  unsigned int mixed = revision;
+  for (unsigned int i = 0 ; i < lights.size() ; i++)
+    mixed = mixed * 31 + lights[i].getRevision();
+  return mixed;
+}
+
+void LightManager::computeClusterBounds() {
+  paddedTiles = (tilesX * tilesY + 3) & ~3u;
+  unsigned int size = paddedTiles * slices;
+  // Padding clusters are empty boxes that no sphere can reach
+  minX.assign(size, 1e30f);
+  minY.assign(size, 1e30f);
+  minZ.assign(size, 1e30f);
+  maxX.assign(size, -1e30f);
+  maxY.assign(size, -1e30f);
+  maxZ.assign(size, -1e30f);
+
+  float tanY = tan(fovY * ONE_DEG_IN_RAD / 2.0);
+  float tanX = tanY * aspect;
+  for (unsigned int z = 0 ; z < slices ; z++) {
+    float depth0 = near * pow(far / near, (float) z / slices);
+    float depth1 = near * pow(far / near, (float) (z + 1) / slices);
+    for (unsigned int y = 0 ; y < tilesY ; y++) {
+      float ndcY0 = -1.f + 2.f * y / tilesY;
+      float ndcY1 = -1.f + 2.f * (y + 1) / tilesY;
+      for (unsigned int x = 0 ; x < tilesX ; x++) {
+        float ndcX0 = -1.f + 2.f * x / tilesX;
+        float ndcX1 = -1.f + 2.f * (x + 1) / tilesX;
+        // The tile is a pyramid section: its box holds the corners at both depths
+        float xs[4] = { ndcX0 * tanX * depth0, ndcX1 * tanX * depth0, ndcX0 * tanX * depth1, ndcX1 * tanX * depth1 };
+        float ys[4] = { ndcY0 * tanY * depth0, ndcY1 * tanY * depth0, ndcY0 * tanY * depth1, ndcY1 * tanY * depth1 };
+        unsigned int cluster = z * paddedTiles + y * tilesX + x;
+        minX[cluster] = min(min(xs[0], xs[1]), min(xs[2], xs[3]));
+        maxX[cluster] = max(max(xs[0], xs[1]), max(xs[2], xs[3]));
+        minY[cluster] = min(min(ys[0], ys[1]), min(ys[2], ys[3]));
+        maxY[cluster] = max(max(ys[0], ys[1]), max(ys[2], ys[3]));
+        minZ[cluster] = -depth1;
+        maxZ[cluster] = -depth0;
+      }
+    }
+  }
+  boundsValid = true;
+}
+
+void LightManager::update(const qm::Mat4f& view, float fovY, float aspect, float near, float far, int width, int height) {
+  if (!boundsValid || fovY != this->fovY || aspect != this->aspect || near != this->near || far != this->far) {
+    this->fovY = fovY;
+    this->aspect = aspect;
+    this->near = near;
+    this->far = far;
+    computeClusterBounds();
+  }
+  this->width = width;
+  this->height = height;
+
+  ArenaVector<float> lightData(lights.size() * LIGHT_TEXELS * 4, 0.f, ArenaAllocator<float>(frameAllocator));
+  ambient = qm::Vec3f(0.f, 0.f, 0.f);
+  for (unsigned int i = 0 ; i < lights.size() ; i++) {
+    qm::Vec3f position = transformPoint(view, lights[i].getPosition());
+    const qm::Vec3f& diffuse = lights[i].getDiffuseColor();
+    const qm::Vec3f& specular = lights[i].getSpecularColor();
+    float* data = &lightData[i * LIGHT_TEXELS * 4];
+    data[0] = position[0]; data[1] = position[1]; data[2] = position[2]; data[3] = lights[i].getRadius();
+    data[4] = diffuse[0]; data[5] = diffuse[1]; data[6] = diffuse[2]; data[7] = 0.f;
+    data[8] = specular[0]; data[9] = specular[1]; data[10] = specular[2]; data[11] = 0.f;
+    // Ambient light reaches every fragment, it is not clustered
+    ambient += lights[i].getAmbientColor();
+  }
+
+  assignLights(lightData);
+  upload(lightData);
+}
+
+void LightManager::assignLights(const ArenaVector<float>& lightData) {
+  unsigned int tiles = tilesX * tilesY;
+  ArenaVector<unsigned int> counts(tiles * slices, 0, ArenaAllocator<unsigned int>(frameAllocator));
+  pairs.clear();
+  dropped = 0;
+
+  float logRatio = log(far / near);
+  for (unsigned int i = 0 ; i < lights.size() ; i++) {
+    const float* data = &lightData[i * LIGHT_TEXELS * 4];
+    float radius = data[3];
+    float depth = -data[2];
+    if (depth + radius < near || depth - radius > far)
+      continue;
+
+    // Only the slices overlapping the sphere depth range are tested
+    float nearest = max(depth - radius, near);
+    float farthest = min(depth + radius, far);
+    int firstSlice = (int) floor(log(nearest / near) / logRatio * slices);
+    int lastSlice = (int) floor(log(farthest / near) / logRatio * slices);
+    firstSlice = max(firstSlice, 0);
+    lastSlice = min(lastSlice, (int) slices - 1);
+
+#ifdef __SSE__
+    __m128 centerX = _mm_set1_ps(data[0]);
+    __m128 centerY = _mm_set1_ps(data[1]);
+    __m128 centerZ = _mm_set1_ps(data[2]);
+    __m128 radius2 = _mm_set1_ps(radius * radius);
+    __m128 zero = _mm_setzero_ps();
+#endif
+
+    for (int z = firstSlice ; z <= lastSlice ; z++) {
+      unsigned int first = z * paddedTiles;
+      for (unsigned int tile = 0 ; tile < paddedTiles ; tile += 4) {
+        unsigned int cluster = first + tile;
+        int hits;
+#ifdef __SSE__
+        // Squared distance from the sphere center to 4 boxes at once
+        __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[cluster]), centerX), _mm_sub_ps(centerX, _mm_loadu_ps(&maxX[cluster]))), zero);
+        __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[cluster]), centerY), _mm_sub_ps(centerY, _mm_loadu_ps(&maxY[cluster]))), zero);
+        __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[cluster]), centerZ), _mm_sub_ps(centerZ, _mm_loadu_ps(&maxZ[cluster]))), zero);
+        __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        hits = _mm_movemask_ps(_mm_cmple_ps(distance2, radius2));
+#else
+        hits = 0;
+        for (int j = 0 ; j < 4 ; j++) {
+          float dx = max(max(minX[cluster + j] - data[0], data[0] - maxX[cluster + j]), 0.f);
+          float dy = max(max(minY[cluster + j] - data[1], data[1] - maxY[cluster + j]), 0.f);
+          float dz = max(max(minZ[cluster + j] - data[2], data[2] - maxZ[cluster + j]), 0.f);
+          if (dx * dx + dy * dy + dz * dz <= radius * radius)
+            hits |= 1 << j;
+        }
+#endif
+        for (int j = 0 ; hits != 0 ; j++, hits >>= 1) {
+          if ((hits & 1) == 0)
+            continue;
+          unsigned int compact = z * tiles + tile + j;
+          if (counts[compact] >= maxLightsPerCluster) {
+            dropped++;
+            continue;
+          }
+          counts[compact]++;
+          pairs.push_back(compact);
+          pairs.push_back(i);
+        }
+      }
+    }
+  }
+
+  // Counting sort of the intersections by cluster
+  clusters.resize(2 * tiles * slices);
+  unsigned int offset = 0;
+  for (unsigned int c = 0 ; c < counts.size() ; c++) {
+    clusters[2 * c] = offset;
+    clusters[2 * c + 1] = 0;
+    offset += counts[c];
+  }
+  indices.resize(offset);
+  for (unsigned int p = 0 ; p < pairs.size() ; p += 2) {
+    unsigned int cluster = pairs[p];
+    indices[clusters[2 * cluster] + clusters[2 * cluster + 1]++] = pairs[p + 1];
+  }
+}
+
+void LightManager::upload(const ArenaVector<float>& lightData) {
+  unsigned int slotsNumber = pipeline != NULL ? pipeline->getFramesInFlight() : 1;
+  while (slotBuffers.size() < slotsNumber) {
+    SlotBuffers slot;
+    glGenBuffers(3, slot.buffers);
+    glGenTextures(3, slot.textures);
+    slot.capacities[0] = slot.capacities[1] = slot.capacities[2] = 0;
+    slotBuffers.push_back(slot);
+  }
+  currentSlot = pipeline != NULL ? pipeline->getSlot() : 0;
+  SlotBuffers& slot = slotBuffers[currentSlot];
+
+  // Empty buffers are not allowed as texture buffers: upload at least one element
+  float noLight[4] = { 0.f, 0.f, 0.f, 0.f };
+  unsigned int noIndex = 0;
+  const void* data[3];
+  unsigned int bytes[3];
+  data[0] = lightData.empty() ? (const void*) noLight : (const void*) &lightData[0];
+  bytes[0] = lightData.empty() ? sizeof (noLight) : lightData.size() * sizeof (float);
+  data[1] = &clusters[0];
+  bytes[1] = clusters.size() * sizeof (unsigned int);
+  data[2] = indices.empty() ? &noIndex : &indices[0];
+  bytes[2] = indices.empty() ? sizeof (noIndex) : indices.size() * sizeof (unsigned int);
+  GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+
+  for (int i = 0 ; i < 3 ; i++) {
+    glBindBuffer(GL_TEXTURE_BUFFER, slot.buffers[i]);
+    if (pipeline != NULL && bytes[i] <= slot.capacities[i]) {
+      glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes[i], data[i]);
+      continue;
+    }
+    // Without a pipeline the buffer is respecified every frame so that the driver can orphan the old storage
+    glBufferData(GL_TEXTURE_BUFFER, bytes[i], data[i], GL_STREAM_DRAW);
+    slot.capacities[i] = bytes[i];
+    glBindTexture(GL_TEXTURE_BUFFER, slot.textures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[i], slot.buffers[i]);
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+static const char* const LIGHT_UNIFORMS[] = {
+  "lightData", "clusterData", "lightIndices", "clusterGrid", "clusterTileSize",
+  "clusterDepthScale", "clusterDepthBias", "ambientLight"
+};
+static const unsigned int LIGHT_UNIFORMS_NUMBER = sizeof (LIGHT_UNIFORMS) / sizeof (LIGHT_UNIFORMS[0]);
+
+void LightManager::useUniforms(ShaderVariants& variants) {
+  for (unsigned int i = 0 ; i < LIGHT_UNIFORMS_NUMBER ; i++)
+    variants.useUniform(LIGHT_UNIFORMS[i]);
+}
+
+void LightManager::useUniforms(ShaderProgram& program) {
+  for (unsigned int i = 0 ; i < LIGHT_UNIFORMS_NUMBER ; i++)
+    program.useUniform(LIGHT_UNIFORMS[i]);
+}
+
+void LightManager::setUniforms(ShaderProgram& program, int firstUnit) {
+  for (int i = 0 ; i < 3 ; i++) {
+    glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+    glBindTexture(GL_TEXTURE_BUFFER, slotBuffers.empty() ? 0 : slotBuffers[currentSlot].textures[i]);
+  }
+  glActiveTexture(GL_TEXTURE0);
+  program.setUniformTextureIndex("lightData", firstUnit);
+  program.setUniformTextureIndex("clusterData", firstUnit + 1);
+  program.setUniformTextureIndex("lightIndices", firstUnit + 2);
+
+  // slice = log(depth) * scale + bias
+  float logRatio = log(far / near);
+  program.setUniform3i("clusterGrid", tilesX, tilesY, slices);
+  program.setUniform2f("clusterTileSize", (float) width / tilesX, (float) height / tilesY);
+  program.setUniform1f("clusterDepthScale", slices / logRatio);
+  program.setUniform1f("clusterDepthBias", -(slices * log(near)) / logRatio);
+  program.setUniformVec3f("ambientLight", ambient);
+}
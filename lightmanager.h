@@ -0,0 +1,103 @@
+#ifndef LIGHTMANAGER_H
+#define LIGHTMANAGER_H
+
+#include <vector>
+
+#include <vec3.h>
+#include <mat4.h>
+
+#include "allocators.h"
+#include "framepipeline.h"
+#include "pointlight.h"
+#include "shadervariants.h"
+
+
+namespace qgl {
+
+// Clustered forward lighting: the view frustum is split into tiles in screen
+// space and exponential slices in depth ("froxels"), and every cluster lists
+// the point lights whose sphere of influence reaches it. The lists are built
+// on the CPU and read by the clustered shader through texture buffers, so
+// each fragment only loops over the lights of its cluster.
+class LightManager {
+
+  public:
+    LightManager();
+    ~LightManager();
+
+    void setGrid(unsigned int tilesX, unsigned int tilesY, unsigned int slices);
+    void setMaxLightsPerCluster(unsigned int lights) { maxLightsPerCluster = lights; }
+
+    unsigned int addLight(const PointLight& light);
+    PointLight& getLight(unsigned int i) { return lights[i]; }
+    unsigned int lightsNumber() const { return lights.size(); }
+    void clear() { lights.clear(); revision++; }
+    // Changes when lights are added or removed, or changed with their setters
+    unsigned int getRevision() const;
+
+    // Builds the clusters for a view and uploads them; the cluster bounds are
+    // only recomputed when the projection changes. fovY is in degrees.
+    void update(const qm::Mat4f& view, float fovY, float aspect, float near, float far, int width, int height);
+    // Temporaries of update taken from the frame allocator rather than the heap
+    void setFrameAllocator(FrameAllocator* allocator) { frameAllocator = allocator; }
+    // One set of light buffers per frame in flight, updated in place instead
+    // of orphaned: the pipeline fences guarantee the GPU is done with them
+    void setFramePipeline(const FramePipeline* pipeline) { this->pipeline = pipeline; }
+
+    // Uniforms read by clustered_phong_fs.glsl and deferred_lighting_fs.glsl
+    static void useUniforms(ShaderVariants& variants);
+    static void useUniforms(ShaderProgram& program);
+    // Binds the light buffers to three texture units starting at firstUnit
+    void setUniforms(ShaderProgram& program, int firstUnit);
+
+    const qm::Vec3f& getAmbient() const { return ambient; }
+    unsigned int clustersNumber() const { return tilesX * tilesY * slices; }
+    unsigned int lightIndicesNumber() const { return indices.size(); }
+    unsigned int droppedLights() const { return dropped; }
+
+  private:
+    LightManager(const LightManager&);
+    LightManager& operator=(const LightManager&);
+
+    void computeClusterBounds();
+    void assignLights(const ArenaVector<float>& lightData);
+    void upload(const ArenaVector<float>& lightData);
+
+    // Light, cluster and index buffers, and the texture buffers reading them
+    struct SlotBuffers {
+      unsigned int buffers[3];
+      unsigned int textures[3];
+      unsigned int capacities[3]; // bytes
+    };
+
+    std::vector<PointLight> lights;
+    qm::Vec3f ambient;
+    unsigned int revision;
+
+    unsigned int tilesX, tilesY, slices;
+    unsigned int maxLightsPerCluster;
+
+    // Projection the bounds were computed for
+    float fovY, aspect, near, far;
+    int width, height;
+    bool boundsValid;
+
+    // Cluster view space bounds, structure of arrays padded to 4 clusters per slice
+    unsigned int paddedTiles;
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+    std::vector<unsigned int> clusters; // offset and count per cluster
+    std::vector<unsigned int> indices;
+    std::vector<unsigned int> pairs; // cluster and light per intersection
+    unsigned int dropped;
+    FrameAllocator* frameAllocator;
+    const FramePipeline* pipeline;
+
+    std::vector<SlotBuffers> slotBuffers;
+    unsigned int currentSlot;
+
+};
+
+}
+
+#endif // LIGHTMANAGER_H
@@ -1,9 +1,13 @@
 
 #include "shaderprogram.h"
+#include "shadervariants.h"
 #include <GLFW/glfw3.h>
 #include <logger.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstring>
 #include <iomanip>
 #include <stdlib.h>
 
@@ -14,13 +18,34 @@
 #include <quat.h>
 #include <stbi_image_write.h>
 
+#include "allocators.h"
 #include "pointlight.h"
 #include "object.h"
 #include "objloader.h"
+#include "gltfloader.h"
+#include "plyloader.h"
+#include "stlloader.h"
+#include "meshcodec.h"
+#include "lightmanager.h"
+#include "meshlets.h"
+#include "pagedmesh.h"
+#include "progressiveloader.h"
+#include "uploadworker.h"
+#include "framecapture.h"
+#include "framebuffer.h"
+#include "framepipeline.h"
+#include "damagetracker.h"
+#include "dynamicresolution.h"
+#include "gbuffer.h"
+#include "jobsystem.h"
+#include "occlusionculler.h"
+#include "softwareocclusion.h"
+#include "offscreencontext.h"
+#include "profiler.h"
+#include "residencymanager.h"
+#include "transforms.h"
 
 
-#define ONE_DEG_IN_RAD (2.0 * M_PI) / 360.0 // 0.017444444
-
 using namespace std;
 
 
@@ -63,6 +88,8 @@ Logger logger;
 
 int windowWidth = 640;
 int windowHeight = 480;
+// The window content was lost (uncovered, restored) and has to be drawn again
+bool windowExposed = true;
 
 
 void glfwErrorCallback(int error, const char* description) {
@@ -82,6 +109,10 @@ void glfwWindowSizeCallback(GLFWwindow* window, int width, int height) {
   /* update any perspective matrices used here */
 }
 
+void glfwWindowRefreshCallback(GLFWwindow* window) {
+  windowExposed = true;
+}
+
 void logGLParams() {
   GLenum params[] = {
     GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS,
@@ -135,7 +166,7 @@ void logGLParams() {
   logger.flush();
 }
 
-void updateFPSCounter(GLFWwindow* window) {
+void updateFPSCounter(GLFWwindow* window, float resolutionScale = 1.f, const ResidencyStats* residency = NULL) {
   static double previousSeconds = glfwGetTime();
   static int frameCount;
   double currentSeconds = glfwGetTime();
@@ -144,7 +175,11 @@ void updateFPSCounter(GLFWwindow* window) {
     previousSeconds = currentSeconds;
     double fps = (double) frameCount / elapsedSeconds;
     char tmp[128];
-    sprintf(tmp, "OpenGL - FPS: %.2f", fps);
+    int length = sprintf(tmp, "OpenGL - FPS: %.2f", fps);
+    if (resolutionScale < 1.f)
+      length += sprintf(tmp + length, " - resolution %.0f%%", resolutionScale * 100.f);
+    if (residency != NULL && residency->budget > 0)
+      sprintf(tmp + length, " - GPU memory %llu / %llu MB", residency->usedBytes >> 20, residency->budget >> 20);
     glfwSetWindowTitle(window, tmp);
     frameCount = 0;
   }
@@ -190,9 +225,7 @@ GLFWwindow* createWindow() {
   return window;
 }
 
-void initGLContext(GLFWwindow* window) {
-  // OpenGL context
-  glfwMakeContextCurrent(window);
+void initGLExtensions() {
   const GLubyte* renderer = glGetString(GL_RENDERER);
   const GLubyte* version = glGetString(GL_VERSION);
   logger << "Renderer: " << renderer << "\n";
@@ -205,55 +238,184 @@ void initGLContext(GLFWwindow* window) {
   glewInit();
 }
 
-qm::Mat4f lookAt(const qm::Vec3f& cameraPos, const qm::Vec3f& targetPos, qm::Vec3f& up, qm::Vec3f& forward, qm::Vec3f& right) {
-  qm::Mat4f translationMatrix = qm::Mat4f::translationMatrix(-cameraPos);
-
-  forward = targetPos - cameraPos;
-  forward.normalize();
-  right = qm::Vec3f::crossProduct(forward, up);
-  right.normalize();
-  up = qm::Vec3f::crossProduct(right, forward);
-  up.normalize();
-
-   qm::Mat4f rotationMatrix(
-    right[0], up[0], -forward[0], 0.0f,
-    right[1], up[1], -forward[1], 0.0f,
-    right[2], up[2], -forward[2], 0.0f,
-    0.0f, 0.0f, 0.0f, 1.0f
-  );
+void initGLContext(GLFWwindow* window) {
+  // OpenGL context
+  glfwMakeContextCurrent(window);
+  initGLExtensions();
+}
 
-  return rotationMatrix * translationMatrix;
+// No window means headless rendering: there are no keys to read
+bool keyPressed(GLFWwindow* window, int key) {
+  return window != NULL && glfwGetKey(window, key) == GLFW_PRESS;
 }
 
-qm::Mat4f lookAt(const qm::Vec3f& cameraPos, const qm::Vec3f& targetPos, const qm::Vec3f& cameraUp) {
-  qm::Vec3f forward, right, up = cameraUp;
-  return lookAt(cameraPos, targetPos, up, forward, right);
+// True only on the frame the key goes down, for toggles
+bool keyToggled(GLFWwindow* window, int key, bool& keyDown) {
+  bool pressed = keyPressed(window, key);
+  bool toggled = pressed && !keyDown;
+  keyDown = pressed;
+  return toggled;
 }
 
+// Draws the meshlets kept by the last cull when the object has some
+void drawObject(Object& object, const MeshletMesh* meshlets) {
+  // still being uploaded
+  if (object.getVAO() == 0)
+    return;
+  if (meshlets != NULL) {
+    meshlets->draw();
+    return;
+  }
+  glBindVertexArray(object.getVAO());
+  glDrawArrays(GL_TRIANGLES, 0, object.verticesNumber()); // number of vertices
+}
 
-qm::Mat4f perspective(float fovY, float aspect, float near, float far) {
-  float fovRad = fovY * ONE_DEG_IN_RAD;
-  float range = tan(fovRad / 2.0f) * near;
-  float sx = (2.0f * near) / (range * aspect + range * aspect);
-  float sy = near / range;
-  float sz = -(far + near) / (far - near);
-  float pz = -(2.0f * far * near) / (far - near);
-  qm::Mat4f matrix = qm::Mat4f::zeroMatrix();
-  matrix[0] = sx;
-  matrix[5] = sy;
-  matrix[10] = sz;
-  matrix[14] = pz;
-  matrix[11] = -1.0f;
-
-  return matrix;
+// Issues the occlusion queries of the objects on the depth buffer currently bound
+void queryOcclusion(OcclusionCuller& culler, vector<Object>& objects, const vector<char>& visible, qm::Mat4f& view, qm::Mat4f& proj, Profiler& profiler) {
+  if (!culler.isEnabled())
+    return;
+  profiler.begin("occlusion");
+  culler.beginQueries(view, proj);
+  for (unsigned int i = 0 ; i < objects.size() ; i++)
+    if (visible[i])
+      culler.query(i, objects[i].retrieveModelMatrix(), objects[i].getBoundsMin(), objects[i].getBoundsMax(), 0.1f);
+  culler.endQueries();
+  profiler.end();
 }
 
+// glTF scene, or binary PLY, STL or encoded mesh in a grey material, from the extension.
+// Encoded meshes are decoded on the threads of jobSystem, glTF materials keep
+// their pixels when the residency manager may release their textures.
+bool loadModel(const string& filename, vector<Object>& objects, JobSystem* jobSystem, bool keepPixels) {
+  string extension = filename.substr(filename.find_last_of('.') + 1);
+  transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+  if (extension == "gltf" || extension == "glb") {
+    GLTFLoader gltfLoader;
+    gltfLoader.setKeepPixels(keepPixels);
+    return gltfLoader.load(filename, objects);
+  }
+  Object object;
+  if (extension == "ply") {
+    IndexedMesh mesh;
+    PLYLoader plyLoader;
+    if (!plyLoader.load(filename, mesh))
+      return false;
+    object.setMesh(mesh);
+  }
+  else if (extension == "qmesh") {
+    IndexedMesh mesh;
+    MeshCodec meshCodec;
+    meshCodec.setJobSystem(jobSystem);
+    if (!meshCodec.load(filename, mesh))
+      return false;
+    object.setMesh(mesh);
+  }
+  else if (extension == "stl") {
+    vector<float> positions, normals, uvs, colors;
+    STLLoader stlLoader;
+    if (!stlLoader.load(filename, positions, normals))
+      return false;
+    object.setVertices(positions, normals, uvs, colors);
+  }
+  else {
+    cerr << "ERROR: " << filename << " is not a glTF, PLY, STL or .qmesh file" << endl;
+    return false;
+  }
+  Material material;
+  material.diffuseColor.init(0.8f, 0.8f, 0.8f);
+  material.specularColor.init(0.2f, 0.2f, 0.2f);
+  object.setMaterial(move(material));
+  objects.push_back(move(object));
+  return true;
+}
 
-int main() {
-  initGLWF();
-  GLFWwindow* window = createWindow();
-  //glfwSetKeyCallback(window, keyCallback);
-  initGLContext(window);
+// Does not need GLFW, which cannot be initialized on a headless machine
+double getSeconds() {
+  static chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  // Headless mode: --headless WIDTHxHEIGHT [--frames N] [--capture]
+  // Capture every frame into a single Y4M video, relative to the videos folder: --capture-video FILE
+  // Out-of-core mesh built by tools/pagemesh: --paged FILE [--budget MB]
+  // Draw the model while it loads: --progressive
+  // Create the buffers in a loader thread with a shared context: --async-upload
+  // Frames the CPU can build ahead of the GPU, 1 to 4: --frames-in-flight N
+  // Only redraw what changed, sleeping while the scene is still: --on-demand
+  // Scale the rendering resolution to keep the GPU time of a frame within a budget: --dynamic-resolution MS
+  // Draw a glTF scene or a binary PLY or STL scan instead of the dragon: --model FILE
+  // Evict the least recently drawn buffers and textures above a GPU memory budget: --gpu-budget MB
+  bool headless = false;
+  long headlessFrames = 1;
+  bool captureFrames = false;
+  string videoFile;
+  string pagedFile;
+  unsigned long long pagedBudget = 256;
+  bool progressiveLoading = false;
+  bool asyncUpload = false;
+  unsigned int framesInFlight = 2;
+  bool renderOnDemand = false;
+  double resolutionBudget = 0.0;
+  string modelFile;
+  unsigned long long gpuBudget = 0;
+  for (int i = 1 ; i < argc ; i++) {
+    if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+      headless = sscanf(argv[++i], "%dx%d", &windowWidth, &windowHeight) == 2;
+    }
+    else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      headlessFrames = atol(argv[++i]);
+    else if (strcmp(argv[i], "--capture") == 0)
+      captureFrames = true;
+    else if (strcmp(argv[i], "--capture-video") == 0 && i + 1 < argc)
+      videoFile = argv[++i];
+    else if (strcmp(argv[i], "--paged") == 0 && i + 1 < argc)
+      pagedFile = argv[++i];
+    else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+      pagedBudget = atol(argv[++i]);
+    else if (strcmp(argv[i], "--progressive") == 0)
+      progressiveLoading = true;
+    else if (strcmp(argv[i], "--async-upload") == 0)
+      asyncUpload = true;
+    else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+      framesInFlight = min(max(atoi(argv[++i]), 1), (int) MAX_FRAMES_IN_FLIGHT);
+    else if (strcmp(argv[i], "--on-demand") == 0)
+      renderOnDemand = true;
+    else if (strcmp(argv[i], "--dynamic-resolution") == 0 && i + 1 < argc)
+      resolutionBudget = atof(argv[++i]);
+    else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc)
+      modelFile = argv[++i];
+    else if (strcmp(argv[i], "--gpu-budget") == 0 && i + 1 < argc)
+      gpuBudget = atol(argv[++i]);
+  }
+
+  GLFWwindow* window = NULL;
+#ifdef QGL_HEADLESS
+  OffscreenContext offscreenContext;
+#endif
+  FrameBuffer offscreenTarget;
+  if (headless) {
+#ifdef QGL_HEADLESS
+    logger.start(GL_LOG_FILE);
+    if (!offscreenContext.create(4, 0, &logger))
+      exit(0);
+    initGLExtensions();
+    // Everything is rendered into this framebuffer instead of a window
+    if (!offscreenTarget.create(windowWidth, windowHeight))
+      exit(0);
+    offscreenTarget.bind();
+#else
+    cerr << "Headless rendering needs a build with QGL_HEADLESS defined." << endl;
+    exit(0);
+#endif
+  }
+  else {
+    initGLWF();
+    window = createWindow();
+    //glfwSetKeyCallback(window, keyCallback);
+    glfwSetWindowRefreshCallback(window, glfwWindowRefreshCallback);
+    initGLContext(window);
+  }
 
   float camSpeed = 1.0f; // 1 unit per second
   float camYawSpeed = 30.0f; // 10 degrees per second
@@ -334,47 +496,114 @@ int main() {
   dragon.getMaterial().diffuseColor = qm::Vec3f(0.627, 0.105, 0.049);
 */
 
-  // Shader program
-  ShaderProgram dragonShaderProgram(&logger);
-  dragonShaderProgram.loadShader(GL_VERTEX_SHADER, SHADERS + "customMatrixes_vs.glsl");
-  dragonShaderProgram.loadShader(GL_FRAGMENT_SHADER, SHADERS + "phong_fs.glsl");
-  dragonShaderProgram.link();
-  dragonShaderProgram.printAll();
+  // Shader variants, specialized per object features
+  unsigned int lightsNumber = 1;
+  qm::Vec3f lightPosEye = transformPoint(viewMatrix, lightPos);
+  ShaderVariants dragonShaders(&logger);
+  dragonShaders.setSources(SHADERS + "customMatrixes_vs.glsl", SHADERS + "phong_fs.glsl");
 
   // Use uniforms
-  dragonShaderProgram.useUniform("view");
-  dragonShaderProgram.useUniform("proj");
-  dragonShaderProgram.useUniform("model");
-
-  dragonShaderProgram.useUniform("lightPosition_world");
-  dragonShaderProgram.useUniform("lightDiffuse");
-  dragonShaderProgram.useUniform("lightSpecular");
-  dragonShaderProgram.useUniform("lightAmbient");
-
-  dragonShaderProgram.useUniform("ambientColor");
-  dragonShaderProgram.useUniform("diffuseColor");
-  dragonShaderProgram.useUniform("specularColor");
-
-  dragonShaderProgram.useUniform("useDiffuseMap");
-  dragonShaderProgram.useUniform("useSpecularMap");
-  dragonShaderProgram.useUniform("diffuseMap");
-  dragonShaderProgram.useUniform("specularMap");
-
-  // Init uniform values
-  dragonShaderProgram.use();
-
-  dragonShaderProgram.setUniformMat4f("view", viewMatrix);
-  dragonShaderProgram.setUniformMat4f("proj", projectionMatrix);
-
-  dragonShaderProgram.setUniformVec3f("lightPosition_world", lightPos);
-  dragonShaderProgram.setUniformVec3f("lightDiffuse", lightDiffuse);
-  dragonShaderProgram.setUniformVec3f("lightSpecular", lightSpecular);
-  dragonShaderProgram.setUniformVec3f("lightAmbient", lightAmbient);
-
-  dragonShaderProgram.setUniform1i("useDiffuseMap", 1);
-  dragonShaderProgram.setUniform1i("useSpecularMap", 1);
-  dragonShaderProgram.setUniformTextureIndex("diffuseMap", 0);
-  dragonShaderProgram.setUniformTextureIndex("specularMap", 1);
+  dragonShaders.useUniform("view");
+  dragonShaders.useUniform("proj");
+  dragonShaders.useUniform("model");
+
+  dragonShaders.useUniform("lightPosition_eye[0]");
+  dragonShaders.useUniform("lightDiffuse[0]");
+  dragonShaders.useUniform("lightSpecular[0]");
+  dragonShaders.useUniform("lightAmbient[0]");
+
+  dragonShaders.useUniform("ambientColor");
+  dragonShaders.useUniform("diffuseColor");
+  dragonShaders.useUniform("specularColor");
+
+  dragonShaders.useUniform("diffuseMap");
+  dragonShaders.useUniform("specularMap");
+  dragonShaders.setUniformTextureIndex("diffuseMap", 0);
+  dragonShaders.setUniformTextureIndex("specularMap", 1);
+
+  // Clustered forward lighting: many small lights, L switches it on and off
+  bool clusteredLighting = false;
+  bool clusteredKeyDown = false;
+  LightManager lightManager;
+  lightManager.setGrid(16, 9, 24);
+  PointLight mainLight = light;
+  mainLight.setRadius(100.f);
+  lightManager.addLight(mainLight);
+  srand(42);
+  for (unsigned int i = 0 ; i < 128 ; i++) {
+    qm::Vec3f position(rand() * 10.f / RAND_MAX - 5.f, rand() * 2.f / RAND_MAX, rand() * 10.f / RAND_MAX - 5.f);
+    qm::Vec3f colour(rand() / (float) RAND_MAX, rand() / (float) RAND_MAX, rand() / (float) RAND_MAX);
+    PointLight smallLight(position, colour, colour, qm::Vec3f(0.f, 0.f, 0.f));
+    smallLight.setRadius(0.5f + rand() * 1.5f / RAND_MAX);
+    lightManager.addLight(smallLight);
+  }
+  ShaderVariants clusteredShaders(&logger);
+  clusteredShaders.setSources(SHADERS + "customMatrixes_vs.glsl", SHADERS + "clustered_phong_fs.glsl");
+  clusteredShaders.useUniform("view");
+  clusteredShaders.useUniform("proj");
+  clusteredShaders.useUniform("model");
+  clusteredShaders.useUniform("ambientColor");
+  clusteredShaders.useUniform("diffuseColor");
+  clusteredShaders.useUniform("specularColor");
+  clusteredShaders.useUniform("diffuseMap");
+  clusteredShaders.useUniform("specularMap");
+  clusteredShaders.setUniformTextureIndex("diffuseMap", 0);
+  clusteredShaders.setUniformTextureIndex("specularMap", 1);
+  LightManager::useUniforms(clusteredShaders);
+
+  // Deferred shading with the same lights, G switches between forward and deferred
+  bool deferredShading = false;
+  bool deferredKeyDown = false;
+  GBuffer gBuffer;
+  ShaderVariants gBufferShaders(&logger);
+  gBufferShaders.setSources(SHADERS + "customMatrixes_vs.glsl", SHADERS + "gbuffer_fs.glsl");
+  gBufferShaders.useUniform("view");
+  gBufferShaders.useUniform("proj");
+  gBufferShaders.useUniform("model");
+  gBufferShaders.useUniform("ambientLight");
+  gBufferShaders.useUniform("ambientColor");
+  gBufferShaders.useUniform("diffuseColor");
+  gBufferShaders.useUniform("specularColor");
+  gBufferShaders.useUniform("diffuseMap");
+  gBufferShaders.useUniform("specularMap");
+  gBufferShaders.setUniformTextureIndex("diffuseMap", 0);
+  gBufferShaders.setUniformTextureIndex("specularMap", 1);
+  ShaderProgram deferredLighting(&logger);
+  deferredLighting.loadShader(GL_VERTEX_SHADER, SHADERS + "fullscreen_vs.glsl");
+  deferredLighting.loadShader(GL_FRAGMENT_SHADER, SHADERS + "deferred_lighting_fs.glsl");
+  deferredLighting.link();
+  deferredLighting.useUniform("albedoTexture");
+  deferredLighting.useUniform("specularTexture");
+  deferredLighting.useUniform("normalTexture");
+  deferredLighting.useUniform("depthTexture");
+  deferredLighting.useUniform("projectionParameters");
+  LightManager::useUniforms(deferredLighting);
+
+  // Depth pre-pass: fragments are then shaded once with a GL_EQUAL depth test, Z toggles it
+  bool depthPrePass = true;
+  bool depthPrePassKeyDown = false;
+  ShaderProgram depthProgram(&logger);
+  depthProgram.loadShader(GL_VERTEX_SHADER, SHADERS + "depth_vs.glsl");
+  depthProgram.loadShader(GL_FRAGMENT_SHADER, SHADERS + "depth_fs.glsl");
+  depthProgram.link();
+  depthProgram.useUniform("view");
+  depthProgram.useUniform("proj");
+  depthProgram.useUniform("model");
+
+  // Occlusion queries on the object bounding boxes, O toggles them
+  bool occlusionKeyDown = false;
+  OcclusionCuller occlusionCuller(&logger);
+  occlusionCuller.create(SHADERS + "box_vs.glsl", SHADERS + "depth_fs.glsl");
+
+  // Dynamic resolution: the scene is rendered at a lower resolution when the GPU is over budget,
+  // then upscaled with an edge aware sharpening. Batch renders keep the full resolution.
+  bool dynamicResolution = resolutionBudget > 0.0 && !headless;
+  DynamicResolution resolutionScaler(&logger);
+  if (dynamicResolution) {
+    resolutionScaler.create(SHADERS + "fullscreen_vs.glsl", SHADERS + "upscale_fs.glsl");
+    resolutionScaler.setBudget(resolutionBudget);
+  }
+  unsigned long gpuFramesMeasured = 0;
 
   /*
   int viewLocation = glGetUniformLocation(dragonShaderProgram.getIndex(), "view");
@@ -411,14 +640,97 @@ int main() {
   shaderProgram1.link();*/
 
 
+  // CPU and GPU timings of the frame phases, P dumps the current frame
+  Profiler profiler;
+
+  // Transient data of a frame, reset once it is presented
+  FrameAllocator frameAllocator;
+  lightManager.setFrameAllocator(&frameAllocator);
+
+  // The CPU builds the next frames while the GPU renders, the light buffers have one copy per frame in flight
+  FramePipeline framePipeline(framesInFlight);
+  lightManager.setFramePipeline(&framePipeline);
+
+  // Without a started worker the uploads happen right away
+  UploadWorker uploadWorker(&logger);
+  if (asyncUpload && !headless)
+    uploadWorker.start(window);
+#ifdef QGL_HEADLESS
+  if (asyncUpload && headless)
+    uploadWorker.start(offscreenContext);
+#endif
+
+  // Loading, transform updates, culling and draw list building run as jobs
+  JobSystem jobSystem;
+
   // Test
+  profiler.begin("load");
   OBJLoader objLoader;
   vector<Object> dragonObjects;
-  objLoader.loadObjects(MODELS + "obj\\newDragon\\dragon_objects1.obj", dragonObjects, MODELS + "obj\\newDragon\\dragon.mtl");
+  // The progressive loader parses in the background and the parts appear as they are uploaded
+  ProgressiveLoader progressiveLoader;
+  double loadStartSeconds = getSeconds();
+  bool firstChunkDrawn = false;
+  if (!modelFile.empty()) {
+    progressiveLoading = false;
+    loadModel(modelFile, dragonObjects, &jobSystem, gpuBudget > 0);
+  }
+  else if (progressiveLoading)
+    progressiveLoader.start(MODELS + "obj\\newDragon\\dragon_objects1.obj", MODELS + "obj\\newDragon\\dragon.mtl");
+  else
+    objLoader.loadObjects(MODELS + "obj\\newDragon\\dragon_objects1.obj", dragonObjects, MODELS + "obj\\newDragon\\dragon.mtl");
+  // One job per object, each one splitting its vertices in more jobs
+  jobSystem.parallelFor(dragonObjects.size(), 1, [&](unsigned int first, unsigned int last) {
+    for (unsigned int i = first ; i < last ; i++)
+      dragonObjects[i].computeVertices(false, &jobSystem);
+  });
+  // The residency manager only sees the objects once the worker is done with them
+  vector<bool> objectUploaded(dragonObjects.size());
+  for (unsigned int i = 0 ; i < dragonObjects.size() ; i++)
+    objectUploaded[i] = uploadWorker.upload(&dragonObjects[i]);
+  occlusionCuller.resize(dragonObjects.size());
+  profiler.end();
+
+  // CPU occlusion culling with the largest objects as occluders, H toggles it
+  bool softwareCulling = true;
+  bool softwareCullingKeyDown = false;
+  SoftwareOcclusion softwareOcclusion;
+  softwareOcclusion.setJobSystem(&jobSystem);
+  vector<pair<float, unsigned int> > objectSizes;
   for (unsigned int i = 0 ; i < dragonObjects.size() ; i++) {
-    dragonObjects[i].computeVertices();
-    dragonObjects[i].createVAO();
+    qm::Vec3f diagonal = dragonObjects[i].getBoundsMax() - dragonObjects[i].getBoundsMin();
+    objectSizes.push_back(make_pair(diagonal[0] * diagonal[0] + diagonal[1] * diagonal[1] + diagonal[2] * diagonal[2], i));
   }
+  sort(objectSizes.rbegin(), objectSizes.rend());
+  vector<unsigned int> occluders;
+  for (unsigned int i = 0 ; i < objectSizes.size() && i < 8 ; i++)
+    occluders.push_back(objectSizes[i].second);
+  // Draw list written by the jobs, the GL thread only reads it
+  vector<char> objectVisible(dragonObjects.size(), 1);
+  vector<unsigned int> objectFeatures(dragonObjects.size(), 0);
+
+  // Big meshes are split into meshlets culled against the frustum and by facing, M toggles it
+  bool meshletCulling = true;
+  bool meshletKeyDown = false;
+  vector<MeshletMesh*> objectMeshlets(dragonObjects.size(), (MeshletMesh*) NULL);
+  for (unsigned int i = 0 ; i < dragonObjects.size() ; i++) {
+    if (dragonObjects[i].trianglesNumber() < 4 * MeshletMesh::MAX_TRIANGLES)
+      continue;
+    objectMeshlets[i] = new MeshletMesh();
+    objectMeshlets[i]->build(dragonObjects[i]);
+    objectMeshlets[i]->createVAO();
+  }
+
+  // Mesh streamed from the disk, only the visible pages that fit in the budget are in memory
+  PagedMesh pagedMesh;
+  bool withPagedMesh = !pagedFile.empty() && pagedMesh.open(pagedFile);
+  pagedMesh.setMemoryBudget(pagedBudget << 20);
+  pagedMesh.setFrameAllocator(&frameAllocator);
+  pagedMesh.setFramesInFlight(framePipeline.getFramesInFlight());
+  qm::Mat4f staticModelMatrix = qm::Mat4f::identityMatrix();
+  Material pagedMaterial;
+  pagedMaterial.diffuseColor.init(0.5f, 0.5f, 0.5f);
+  pagedMaterial.specularColor.init(0.2f, 0.2f, 0.2f);
 
   glClearColor(0.6f, 0.6f, 0.6f, 1.0f);
   glEnable(GL_DEPTH_TEST);
@@ -426,70 +738,129 @@ int main() {
   glCullFace(GL_BACK); // cull back face
   glFrontFace(GL_CCW); // GL_CCW for counter clock-wise
 
-  bool saveToImages = false;
+  bool captureToVideo = !videoFile.empty();
+  bool saveToImages = captureFrames || captureToVideo;
   long frameNumber = 0;
 
+  // Frames are read back asynchronously and encoded by worker threads
+  FrameCapture frameCapture;
+  frameCapture.setOutputFolder(OUTPUT_FOLDER);
+  // A readback is mapped once the frames in flight after it are queued
+  frameCapture.setRingSize(framePipeline.getFramesInFlight() + 1);
+  // Stream the frames into a single Y4M video instead of one PNG per frame
+  StreamSink videoSink(VIDEOS_FOLDER + "/" + videoFile, StreamSink::Y4M);
+  if (captureToVideo)
+    frameCapture.setSink(&videoSink);
+  // Videos and batch renders need every frame: wait for the encoders rather than drop one
+  frameCapture.setBlockWhenFull(captureToVideo || (headless && captureFrames));
+  frameCapture.start();
+
+  // Render on demand: frames are only drawn when something changed, N toggles the animation.
+  // Forward shaded frames without occlusion queries are drawn in a persistent target, so that
+  // only the damaged region is drawn again and then copied to the window.
+  renderOnDemand = renderOnDemand && !headless;
+  bool animateObjects = !renderOnDemand;
+  bool animateKeyDown = false;
+  DamageTracker damageTracker;
+  FrameBuffer sceneTarget;
+  const double IDLE_TIMEOUT = 0.5;
+
+  // GPU memory by category; above the budget, objects and textures not drawn lately are evicted
+  ResidencyManager residency;
+  residency.setBudget(gpuBudget << 20);
+  residency.setFramesInFlight(framePipeline.getFramesInFlight());
+  // -1 while uploading
+  vector<int> objectResidency(dragonObjects.size(), -1);
+  for (unsigned int i = 0 ; i < dragonObjects.size() ; i++)
+    if (objectUploaded[i])
+      objectResidency[i] = residency.addObject(dragonObjects[i], objectMeshlets[i]);
+  vector<Object*> collectedObjects;
+  unsigned int gBufferResidency = residency.track(RESOURCE_RENDER_TARGETS, 0);
+  unsigned int sceneTargetResidency = residency.track(RESOURCE_RENDER_TARGETS, 0);
+  unsigned int pagedMeshResidency = residency.track(RESOURCE_STREAMED, 0);
+
   // Main loop
-  while (!glfwWindowShouldClose(window)) {
-    updateFPSCounter(window);
-    frameNumber++;
+  while (headless ? frameNumber < headlessFrames : !glfwWindowShouldClose(window)) {
+    profiler.beginFrame();
+    collectedObjects.clear();
+    if (uploadWorker.collect(&collectedObjects) > 0)
+      damageTracker.damageAll();
+    for (unsigned int i = 0 ; i < collectedObjects.size() ; i++) {
+      unsigned int object = collectedObjects[i] - &dragonObjects[0];
+      objectResidency[object] = residency.addObject(dragonObjects[object], objectMeshlets[object]);
+    }
 
     // add a timer for doing animation
-    static double previousSeconds = glfwGetTime();
-    double currentSeconds = glfwGetTime();
+    static double previousSeconds = getSeconds();
+    double currentSeconds = getSeconds();
     double elapsedSeconds = currentSeconds - previousSeconds;
     previousSeconds = currentSeconds;
+    // batch renders must not depend on the rendering speed
+    if (headless)
+      elapsedSeconds = 1.0 / 30.0;
 
 
     // control keys
     bool cameraMoved = false;
-    if (glfwGetKey(window, GLFW_KEY_A)) {
+    if (keyPressed(window, GLFW_KEY_A)) {
       cameraPosition[0] -= camSpeed * elapsedSeconds;
       viewTarget[0] -= camSpeed * elapsedSeconds;
       cameraMoved = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_R)) {
+    if (keyPressed(window, GLFW_KEY_R)) {
       saveToImages = !saveToImages;
     }
-    if (glfwGetKey(window, GLFW_KEY_D)) {
+    if (keyPressed(window, GLFW_KEY_P)) {
+      profiler.requestFrameDump();
+    }
+    if (keyToggled(window, GLFW_KEY_L, clusteredKeyDown))
+      clusteredLighting = !clusteredLighting;
+    if (keyToggled(window, GLFW_KEY_G, deferredKeyDown))
+      deferredShading = !deferredShading;
+    if (keyToggled(window, GLFW_KEY_Z, depthPrePassKeyDown))
+      depthPrePass = !depthPrePass;
+    if (keyToggled(window, GLFW_KEY_O, occlusionKeyDown))
+      occlusionCuller.setEnabled(!occlusionCuller.isEnabled());
+    if (keyToggled(window, GLFW_KEY_H, softwareCullingKeyDown))
+      softwareCulling = !softwareCulling;
+    if (keyToggled(window, GLFW_KEY_M, meshletKeyDown))
+      meshletCulling = !meshletCulling;
+    if (keyToggled(window, GLFW_KEY_N, animateKeyDown))
+      animateObjects = !animateObjects;
+    if (keyPressed(window, GLFW_KEY_D)) {
       cameraPosition[0] += camSpeed * elapsedSeconds;
       viewTarget[0] += camSpeed * elapsedSeconds;
       cameraMoved = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_PAGE_UP)) {
+    if (keyPressed(window, GLFW_KEY_PAGE_UP)) {
       cameraPosition[1] += camSpeed * elapsedSeconds;
       viewTarget[1] += camSpeed * elapsedSeconds;
       cameraMoved = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_PAGE_DOWN)) {
+    if (keyPressed(window, GLFW_KEY_PAGE_DOWN)) {
       cameraPosition[1] -= camSpeed * elapsedSeconds;
       viewTarget[1] -= camSpeed * elapsedSeconds;
       cameraMoved = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_W)) {
+    if (keyPressed(window, GLFW_KEY_W)) {
       cameraPosition[2] -= camSpeed * elapsedSeconds;
       viewTarget[2] -= camSpeed * elapsedSeconds;
       cameraMoved = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_S)) {
+    if (keyPressed(window, GLFW_KEY_S)) {
       cameraPosition[2] += camSpeed * elapsedSeconds;
       viewTarget[2] += camSpeed * elapsedSeconds;
       cameraMoved = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_LEFT)) {
+    if (keyPressed(window, GLFW_KEY_LEFT)) {
       camYaw += camYawSpeed * elapsedSeconds;
       cameraMoved = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_RIGHT)) {
+    if (keyPressed(window, GLFW_KEY_RIGHT)) {
       camYaw -= camYawSpeed * elapsedSeconds;
       cameraMoved = true;
     }
 
-    //glUseProgram(dragonShaderProgram.getIndex());
-    dragonShaderProgram.use();
-    dragonShaderProgram.setUniformMat4f("proj", projectionMatrix);
-    //glUniformMatrix4fv(projLocation, 1, GL_FALSE, projectionMatrix.getArray());
-
     // update view matrix
     if (cameraMoved) {
       qm::Mat4f viewMatrix2 = lookAt(cameraPosition, viewTarget, up, forward, right);
@@ -499,14 +870,12 @@ int main() {
       //qm::Quat quat2(camYaw, forward[0], forward[1], forward[2]);
       //qm::Mat4f rotationMatrix2 = quat2.toMatrix();
       //viewMatrix2 = rotationMatrix2 * viewMatrix2;
-      dragonShaderProgram.setUniformMat4f("view", viewMatrix2);
+      viewMatrix = viewMatrix2;
+      // the light is transformed once per view change instead of in every fragment
+      lightPosEye = transformPoint(viewMatrix, lightPos);
       //glUniformMatrix4fv(viewLocation, 1, GL_FALSE, viewMatrix2.getArray());
     }
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glViewport(0, 0, windowWidth, windowHeight);
-
-
     // Dragon
 
     //objectAngle += objectSpeed * elapsedSeconds;
@@ -522,19 +891,280 @@ int main() {
     //objectMatrix = objectRotationMatrix;
 
 
+    profiler.begin("update");
+    jobSystem.parallelFor(dragonObjects.size(), 0, [&](unsigned int first, unsigned int last) {
+      for (unsigned int i = first ; i < last ; i++) {
+        if (animateObjects)
+          dragonObjects[i].rotate(objectSpeed * elapsedSeconds, 0.f, 1.f, 0.f);
+        dragonObjects[i].retrieveModelMatrix();
+      }
+    });
+    profiler.end();
+
+    // nothing changed since the last frame: wait for an event instead of drawing it again
+    bool partialRedraw = renderOnDemand && !deferredShading && !occlusionCuller.isEnabled() && !dynamicResolution;
+    if (renderOnDemand) {
+      damageTracker.resize(windowWidth, windowHeight);
+      damageTracker.trackCamera(viewMatrix, projectionMatrix);
+      damageTracker.trackGlobal(0, lightManager.getRevision());
+      unsigned int settings = clusteredLighting | deferredShading << 1 | depthPrePass << 2 | occlusionCuller.isEnabled() << 3
+                            | softwareCulling << 4 | meshletCulling << 5;
+      damageTracker.trackGlobal(1, settings);
+      for (unsigned int i = 0 ; i < dragonObjects.size() ; i++)
+        damageTracker.trackObject(i, dragonObjects[i].getBoundsMin(), dragonObjects[i].getBoundsMax(),
+                                  dragonObjects[i].retrieveModelMatrix(), dragonObjects[i].getRevision());
+      // streamed geometry shows up without any change of the scene
+      bool loading = uploadWorker.pendingUploads() > 0 || (progressiveLoading && !progressiveLoader.isFinished())
+                     || (withPagedMesh && pagedMesh.getStats().pendingPages > 0);
+      if (loading || windowExposed)
+        damageTracker.damageAll();
+      windowExposed = false;
+
+      if (!damageTracker.isDamaged()) {
+        profiler.discardFrame();
+        double idleStart = getSeconds();
+        glfwWaitEventsTimeout(IDLE_TIMEOUT);
+        previousSeconds = getSeconds();
+        damageTracker.frameSkipped(previousSeconds - idleStart);
+        continue;
+      }
+    }
+    if (!headless)
+      updateFPSCounter(window, resolutionScaler.getScale(), &residency.getStats());
+    frameNumber++;
+
+    // rasterized on worker threads while the lights are updated and the GPU finishes the previous frame
+    if (softwareCulling) {
+      softwareOcclusion.clear();
+      for (unsigned int i = 0 ; i < occluders.size() ; i++) {
+        Object& occluder = dragonObjects[occluders[i]];
+        softwareOcclusion.addOccluder(occluder.getPositions(), occluder.verticesNumber(), occluder.retrieveModelMatrix());
+      }
+      for (unsigned int i = 0 ; i < dragonObjects.size() ; i++)
+        softwareOcclusion.addObject(dragonObjects[i].getBoundsMin(), dragonObjects[i].getBoundsMax(), dragonObjects[i].retrieveModelMatrix());
+      softwareOcclusion.start(projectionMatrix * viewMatrix);
+    }
+
+    // the CPU work above overlaps the GPU rendering of the previous frames,
+    // the commands below wait for a free frame slot
+    profiler.begin("throttle");
+    framePipeline.beginFrame();
+    profiler.end();
+    // the GPU time of the frames that just finished sets the resolution of this one
+    int renderWidth = windowWidth, renderHeight = windowHeight;
+    if (dynamicResolution) {
+      const FramePipelineStats& pipelineStats = framePipeline.getStats();
+      if (pipelineStats.gpuFrames != gpuFramesMeasured) {
+        gpuFramesMeasured = pipelineStats.gpuFrames;
+        resolutionScaler.update(pipelineStats.lastGPUTime);
+      }
+      resolutionScaler.bind(windowWidth, windowHeight);
+      resolutionScaler.renderSize(windowWidth, windowHeight, renderWidth, renderHeight);
+    }
+    if (partialRedraw) {
+      sceneTarget.resize(windowWidth, windowHeight);
+      sceneTarget.bind();
+      // the clear and the draws only touch the damaged pixels
+      int damageX, damageY, damageWidth, damageHeight;
+      damageTracker.getRegion(damageX, damageY, damageWidth, damageHeight);
+      glEnable(GL_SCISSOR_TEST);
+      glScissor(damageX, damageY, damageWidth, damageHeight);
+    }
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glViewport(0, 0, renderWidth, renderHeight);
+
+    if (clusteredLighting || deferredShading) {
+      profiler.begin("lights");
+      lightManager.update(viewMatrix, 67.f, (float) windowWidth / (float) windowHeight, 0.1f, 100.f, renderWidth, renderHeight);
+      profiler.end();
+    }
+
+    // the geometry pass of deferred shading only writes the surface attributes
+    if (deferredShading) {
+      // allocated at the window size, a resolution change only moves the viewport
+      gBuffer.resize(windowWidth, windowHeight);
+      gBuffer.setViewport(renderWidth, renderHeight);
+      gBuffer.bindGeometryPass(0.6f, 0.6f, 0.6f);
+    }
+    qm::Vec3f ambientLight = lightManager.getAmbient();
+
+    if (softwareCulling) {
+      profiler.begin("culling");
+      softwareOcclusion.wait();
+      profiler.end();
+    }
+    profiler.begin("draw list");
+    unsigned int featuresLights = deferredShading || clusteredLighting ? 0 : lightsNumber;
+    jobSystem.parallelFor(dragonObjects.size(), 0, [&](unsigned int first, unsigned int last) {
+      for (unsigned int i = first ; i < last ; i++) {
+        objectVisible[i] = !softwareCulling || softwareOcclusion.isVisible(i);
+        objectFeatures[i] = dragonObjects[i].shaderFeatures(featuresLights);
+        if (objectVisible[i] && meshletCulling && objectMeshlets[i] != NULL)
+          objectMeshlets[i]->cull(dragonObjects[i].retrieveModelMatrix(), viewMatrix, projectionMatrix);
+      }
+    });
+    // evicted objects come back before they are drawn
     for (unsigned int i = 0 ; i < dragonObjects.size() ; i++) {
-      dragonObjects[i].rotate(objectSpeed * elapsedSeconds, 0.f, 1.f, 0.f);
-      dragonShaderProgram.setUniformMat4f("model", dragonObjects[i].retrieveModelMatrix());
-      dragonShaderProgram.setUniformsFromMaterial(dragonObjects[i].getMaterial());
+      if (objectVisible[i] && objectResidency[i] >= 0 && residency.useObject(objectResidency[i])) {
+        objectFeatures[i] = dragonObjects[i].shaderFeatures(featuresLights);
+        if (meshletCulling && objectMeshlets[i] != NULL)
+          objectMeshlets[i]->cull(dragonObjects[i].retrieveModelMatrix(), viewMatrix, projectionMatrix);
+      }
+    }
+    profiler.end();
+
+    // objects hidden last frame are skipped by every pass of this frame
+    occlusionCuller.beginFrame();
+    if (depthPrePass) {
+      profiler.begin("depth");
+      glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+      depthProgram.use();
+      depthProgram.setUniformMat4f("view", viewMatrix);
+      depthProgram.setUniformMat4f("proj", projectionMatrix);
+      for (unsigned int i = 0 ; i < dragonObjects.size() ; i++) {
+        if (!objectVisible[i])
+          continue;
+        occlusionCuller.beginConditionalRender(i);
+        depthProgram.setUniformMat4f("model", dragonObjects[i].retrieveModelMatrix());
+        drawObject(dragonObjects[i], meshletCulling ? objectMeshlets[i] : NULL);
+        occlusionCuller.endConditionalRender(i);
+      }
+      glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+      profiler.end();
+    }
+
+    if (depthPrePass) {
+      // the boxes are tested against the complete depth of the frame
+      queryOcclusion(occlusionCuller, dragonObjects, objectVisible, viewMatrix, projectionMatrix, profiler);
+      glDepthFunc(GL_EQUAL);
+      glDepthMask(GL_FALSE);
+    }
+
+    profiler.begin(deferredShading ? "geometry" : "draw");
+    ShaderProgram* program = NULL;
+    for (unsigned int i = 0 ; i < dragonObjects.size() ; i++) {
+      if (!objectVisible[i])
+        continue;
+      ShaderProgram* variant;
+      if (deferredShading)
+        variant = &gBufferShaders.get(objectFeatures[i]);
+      else if (clusteredLighting)
+        variant = &clusteredShaders.get(objectFeatures[i]);
+      else
+        variant = &dragonShaders.get(objectFeatures[i]);
+      if (variant != program) {
+        program = variant;
+        program->use();
+        program->setUniformMat4f("view", viewMatrix);
+        program->setUniformMat4f("proj", projectionMatrix);
+        if (deferredShading) {
+          program->setUniformVec3f("ambientLight", ambientLight);
+        }
+        else if (clusteredLighting) {
+          // units 0 and 1 are the material maps
+          lightManager.setUniforms(*program, 2);
+        }
+        else {
+          program->setUniformVec3f("lightPosition_eye[0]", lightPosEye);
+          program->setUniformVec3f("lightDiffuse[0]", lightDiffuse);
+          program->setUniformVec3f("lightSpecular[0]", lightSpecular);
+          program->setUniformVec3f("lightAmbient[0]", lightAmbient);
+        }
+      }
+      program->setUniformMat4f("model", dragonObjects[i].retrieveModelMatrix());
+      program->setUniformsFromMaterial(dragonObjects[i].getMaterial());
       //cout << dragonObjects[i].getMaterial().diffuseColor << endl;
       //glUniformMatrix4fv(modelLocation, 1, GL_FALSE, dragonObjects[i].retrieveModelMatrix().getArray());
-      glBindVertexArray(dragonObjects[i].getVAO());
-      glDrawArrays(GL_TRIANGLES, 0, dragonObjects[i].verticesNumber()); // number of vertices
+      occlusionCuller.beginConditionalRender(i);
+      drawObject(dragonObjects[i], meshletCulling ? objectMeshlets[i] : NULL);
+      occlusionCuller.endConditionalRender(i);
+    }
+    profiler.end();
+
+    if (depthPrePass) {
+      glDepthFunc(GL_LESS);
+      glDepthMask(GL_TRUE);
+    }
+    else {
+      queryOcclusion(occlusionCuller, dragonObjects, objectVisible, viewMatrix, projectionMatrix, profiler);
+    }
+
+    // at most a few chunks per frame so that loading does not stall the frames
+    if (progressiveLoading && !deferredShading) {
+      profiler.begin("progressive");
+      if (progressiveLoader.uploadPending(8) > 0 && !firstChunkDrawn) {
+        firstChunkDrawn = true;
+        logger << "First triangles drawn after " << getSeconds() - loadStartSeconds << " s";
+        logger.flush();
+      }
+      program = NULL;
+      for (unsigned int i = 0 ; i < progressiveLoader.partsNumber() ; i++) {
+        ShaderProgram* variant = &dragonShaders.get(progressiveLoader.shaderFeatures(i, lightsNumber));
+        if (variant != program) {
+          program = variant;
+          program->use();
+          program->setUniformMat4f("view", viewMatrix);
+          program->setUniformMat4f("proj", projectionMatrix);
+          program->setUniformMat4f("model", staticModelMatrix);
+          program->setUniformVec3f("lightPosition_eye[0]", lightPosEye);
+          program->setUniformVec3f("lightDiffuse[0]", lightDiffuse);
+          program->setUniformVec3f("lightSpecular[0]", lightSpecular);
+          program->setUniformVec3f("lightAmbient[0]", lightAmbient);
+        }
+        program->setUniformsFromMaterial(progressiveLoader.getMaterial(i));
+        progressiveLoader.draw(i);
+      }
+      profiler.end();
+    }
+
+    // not in the pre-pass depth, and only forward shaded
+    if (withPagedMesh && !deferredShading) {
+      profiler.begin("paged mesh");
+      pagedMesh.update(staticModelMatrix, viewMatrix, projectionMatrix);
+      pagedMesh.uploadLoaded();
+      program = &dragonShaders.get(FEATURE_NORMALS | lightsFeature(lightsNumber));
+      program->use();
+      program->setUniformMat4f("view", viewMatrix);
+      program->setUniformMat4f("proj", projectionMatrix);
+      program->setUniformMat4f("model", staticModelMatrix);
+      program->setUniformVec3f("lightPosition_eye[0]", lightPosEye);
+      program->setUniformVec3f("lightDiffuse[0]", lightDiffuse);
+      program->setUniformVec3f("lightSpecular[0]", lightSpecular);
+      program->setUniformVec3f("lightAmbient[0]", lightAmbient);
+      program->setUniformsFromMaterial(pagedMaterial);
+      pagedMesh.draw();
+      profiler.end();
+    }
+
+    // lighting pass: one full screen triangle adds the lights of each pixel cluster
+    if (deferredShading) {
+      profiler.begin("lighting");
+      gBuffer.bindLightingPass();
+      glDisable(GL_DEPTH_TEST);
+      glEnable(GL_BLEND);
+      glBlendFunc(GL_ONE, GL_ONE);
+      deferredLighting.use();
+      gBuffer.bindTextures(0);
+      deferredLighting.setUniformTextureIndex("albedoTexture", 0);
+      deferredLighting.setUniformTextureIndex("specularTexture", 1);
+      deferredLighting.setUniformTextureIndex("normalTexture", 2);
+      deferredLighting.setUniformTextureIndex("depthTexture", 3);
+      deferredLighting.setUniform4f("projectionParameters", 1.f / projectionMatrix[0], 1.f / projectionMatrix[5],
+                                    projectionMatrix[10], projectionMatrix[14]);
+      lightManager.setUniforms(deferredLighting, 4);
+      gBuffer.drawFullScreen();
+      glDisable(GL_BLEND);
+      glEnable(GL_DEPTH_TEST);
+
+      if (dynamicResolution)
+        resolutionScaler.bind(windowWidth, windowHeight);
+      else
+        FrameBuffer::bindDefault(windowWidth, windowHeight);
+      gBuffer.blit(renderWidth, renderHeight);
+      profiler.end();
     }
 
     dragon.rotate(objectSpeed * elapsedSeconds, 0.f, 1.f, 0.f);
-    dragonShaderProgram.setUniformsFromMaterial(dragon.getMaterial());
-    dragonShaderProgram.setUniformMat4f("model", dragon.retrieveModelMatrix());
     //glUniformMatrix4fv(modelLocation, 1, GL_FALSE, dragon.retrieveModelMatrix().getArray());
 
 
@@ -542,26 +1172,103 @@ int main() {
     glDrawArrays(GL_TRIANGLES, 0, dragon.verticesNumber()); // number of vertices
 */
 
-    if (saveToImages) {
-      unsigned char* buffer = (unsigned char*)malloc (windowWidth * windowHeight * 3);
-      glReadPixels (0, 0, windowWidth, windowHeight, GL_RGB, GL_UNSIGNED_BYTE, buffer);
-      char name[1024];
-      sprintf (name, "C:\\Users\\Quentin\\Documents\\Workspace\\OpenGLTest\\output\\frame-%ld.png", frameNumber);
-      unsigned char* last_row = buffer + (windowWidth * 3 * (windowHeight - 1));
-      if (!stbi_write_png (
-        name, windowWidth, windowHeight, 3, last_row, -3 * windowWidth)) {
-        fprintf (stderr, "ERROR: could not write screenshot file %s\n", name);
-      }
-      free (buffer);
+    if (partialRedraw) {
+      glDisable(GL_SCISSOR_TEST);
+      FrameBuffer::bindDefault(windowWidth, windowHeight);
+      sceneTarget.blit(windowWidth, windowHeight);
+    }
+    if (dynamicResolution) {
+      profiler.begin("upscale");
+      FrameBuffer::bindDefault(windowWidth, windowHeight);
+      resolutionScaler.upscale(windowWidth, windowHeight);
+      profiler.end();
     }
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    profiler.begin("capture");
+    if (saveToImages)
+      frameCapture.capture(frameNumber, windowWidth, windowHeight);
+    else
+      frameCapture.collect(false);
+    profiler.end();
+    framePipeline.endFrame();
+
+    if (!headless) {
+      profiler.begin("present");
+      glfwSwapBuffers(window);
+      profiler.end();
+      glfwPollEvents();
+    }
+    profiler.endFrame();
+    damageTracker.frameRendered();
+    frameAllocator.endFrame();
+    residency.update(gBufferResidency, gBuffer.getBytes());
+    residency.update(sceneTargetResidency, sceneTarget.getBytes());
+    if (withPagedMesh)
+      residency.update(pagedMeshResidency, pagedMesh.getStats().residentBytes);
+    residency.enforceBudget();
+    residency.endFrame();
   }
 
 
   // Termination
-  glfwDestroyWindow(window);
-  glfwTerminate();
+  framePipeline.finish();
+  if (renderOnDemand) {
+    const DamageStats& damageStats = damageTracker.getStats();
+    logger << "Rendered frames: " << damageStats.renderedFrames << ", partial: " << damageStats.partialFrames;
+    logger << ", skipped: " << damageStats.skippedFrames << ", idle: " << damageStats.idleSeconds << " s";
+    logger.flush();
+  }
+  const FramePipelineStats& pipelineStats = framePipeline.getStats();
+  logger << "Frames in flight: " << framePipeline.getFramesInFlight() << ", throttled frames: " << pipelineStats.throttledFrames;
+  logger << " of " << pipelineStats.frames << ", CPU wait per frame: " << pipelineStats.cpuWait / max(pipelineStats.frames, 1ul) << " ms";
+  if (pipelineStats.gpuTimedFrames > 0)
+    logger << ", GPU idle per frame: " << pipelineStats.gpuIdle / pipelineStats.gpuTimedFrames << " ms";
+  logger.flush();
+  if (dynamicResolution) {
+    const DynamicResolutionStats& resolutionStats = resolutionScaler.getStats();
+    logger << "Resolution scale: " << resolutionScaler.getScale() << ", lowest: " << resolutionStats.minScale;
+    logger << ", changes: " << resolutionStats.changes << ", frames over the " << resolutionScaler.getBudget() << " ms budget: ";
+    logger << resolutionStats.overBudget << " of " << resolutionStats.updates;
+    logger.flush();
+  }
+  frameCapture.stop();
+  FrameCaptureStats captureStats = frameCapture.getStats();
+  logger << "Captured frames: " << captureStats.captured << ", written: " << captureStats.written;
+  logger << ", dropped: " << captureStats.dropped << ", failed: " << captureStats.failed;
+  logger << ", readback stalls: " << captureStats.readbackStalls << ", queue stalls: " << captureStats.queueStalls;
+  logger << ", max queued: " << captureStats.maxQueued;
+  logger.flush();
+  profiler.printStats(cout);
+  logger << "Frame allocator peak: " << frameAllocator.getStats().peak / 1024 << " kB";
+  if (heapCounting())
+    logger << ", frames with heap allocations: " << frameAllocator.getHeapAllocatingFrames() << " of " << frameAllocator.getFramesNumber();
+  logger.flush();
+  if (withPagedMesh) {
+    const PagedMeshStats& pagedStats = pagedMesh.getStats();
+    logger << "Paged mesh pages: " << pagedStats.pages << ", resident: " << pagedStats.residentPages;
+    logger << ", loaded: " << pagedStats.loadedPages << ", evicted: " << pagedStats.evictedPages;
+    logger << ", buffer pool hits: " << pagedStats.poolHits << ", misses: " << pagedStats.poolMisses;
+    logger.flush();
+  }
+  const ResidencyStats& residencyStats = residency.getStats();
+  logger << "GPU memory: " << (residencyStats.usedBytes >> 20) << " MB (buffers " << (residencyStats.categoryBytes[RESOURCE_VERTEX_BUFFERS] >> 20);
+  logger << ", textures " << (residencyStats.categoryBytes[RESOURCE_TEXTURES] >> 20) << ", targets " << (residencyStats.categoryBytes[RESOURCE_RENDER_TARGETS] >> 20);
+  logger << ", streamed " << (residencyStats.categoryBytes[RESOURCE_STREAMED] >> 20) << ")";
+  if (residencyStats.budget > 0) {
+    logger << " of " << (residencyStats.budget >> 20) << " MB, evictions: " << residencyStats.evictions;
+    logger << ", halvings: " << residencyStats.reductions << ", restores: " << residencyStats.restores;
+    logger << ", frames over budget: " << residencyStats.overBudgetFrames;
+  }
+  logger.flush();
+  pagedMesh.close();
+  progressiveLoader.stop();
+  uploadWorker.stop();
+  profiler.exportChromeTrace(OUTPUT_FOLDER + "/trace.json");
+  for (unsigned int i = 0 ; i < objectMeshlets.size() ; i++)
+    delete objectMeshlets[i];
+  if (!headless) {
+    glfwDestroyWindow(window);
+    glfwTerminate();
+  }
   exit(1);
 }
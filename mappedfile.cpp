@@ -0,0 +1,105 @@
+#include "mappedfile.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+using namespace qgl;
+using namespace std;
+
+MappedFile::MappedFile() {
+  data = NULL;
+  size = 0;
+#ifdef _WIN32
+  file = INVALID_HANDLE_VALUE;
+  mapping = NULL;
+#else
+  file = -1;
+#endif
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const string& filename) {
+  close();
+  file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    cerr << "ERROR: could not open " << filename << endl;
+    return false;
+  }
+  LARGE_INTEGER fileSize;
+  GetFileSizeEx(file, &fileSize);
+  size = fileSize.QuadPart;
+  // Empty files cannot be mapped
+  if (size > 0) {
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping != NULL)
+      data = (const unsigned char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  }
+  if (data == NULL) {
+    cerr << "ERROR: could not map " << filename << endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::close() {
+  if (data != NULL)
+    UnmapViewOfFile(data);
+  if (mapping != NULL)
+    CloseHandle(mapping);
+  if (file != INVALID_HANDLE_VALUE)
+    CloseHandle(file);
+  data = NULL;
+  mapping = NULL;
+  file = INVALID_HANDLE_VALUE;
+  size = 0;
+}
+
+#else
+
+bool MappedFile::open(const string& filename) {
+  close();
+  file = ::open(filename.c_str(), O_RDONLY);
+  if (file < 0) {
+    cerr << "ERROR: could not open " << filename << endl;
+    return false;
+  }
+  struct stat status;
+  if (fstat(file, &status) == 0 && status.st_size > 0) {
+    size = status.st_size;
+    void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (mapped != MAP_FAILED)
+      data = (const unsigned char*) mapped;
+  }
+  if (data == NULL) {
+    cerr << "ERROR: could not map " << filename << endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::close() {
+  if (data != NULL)
+    munmap((void*) data, size);
+  if (file >= 0)
+    ::close(file);
+  data = NULL;
+  file = -1;
+  size = 0;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+
+
+namespace qgl {
+
+// Read-only memory mapping of a whole file: pages are only read from the disk
+// when touched and can be dropped by the system under memory pressure, so
+// files much larger than the RAM can be accessed like an array.
+class MappedFile {
+
+  public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string& filename);
+    void close();
+
+    bool isOpen() const { return data != NULL; }
+    const unsigned char* getData() const { return data; }
+    unsigned long long getSize() const { return size; }
+
+  private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const unsigned char* data;
+    unsigned long long size;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int file;
+#endif
+
+};
+
+}
+
+#endif // MAPPEDFILE_H
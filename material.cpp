@@ -1,74 +1,145 @@
 #include "material.h"
 
+#include <algorithm>
+
 using namespace qgl;
 using namespace std;
 
+namespace {
+
+void uploadTexture(GLuint texture, int width, int height, const unsigned char* data, GLenum format) {
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(
+    GL_TEXTURE_2D, 0, GL_RGBA,
+    width, height,
+    0, format, GL_UNSIGNED_BYTE,
+    data
+  );
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+// Reads the image of the file into the texture, false when it cannot be read
+bool loadTexture(const string& file, GLTexture& texture, int& width, int& height) {
+  if (texture == 0)
+    texture = GLTexture::create();
+
+  int n;
+  int forceChannels = 4;
+  unsigned char* textureData = stbi_load(file.c_str(), &width, &height, &n, forceChannels);
+  if (!textureData) {
+    cerr << "Cannot load the texture " << file << endl;
+    width = height = 0;
+    return false;
+  }
+  uploadTexture(texture, width, height, textureData, GL_RGBA);
+  stbi_image_free(textureData);
+  return true;
+}
+
+// Replaces the texture by one of half its size, filtered by the blit: a
+// bilinear sample between 4 texels is their average
+bool halveTexture(GLTexture& texture, int& width, int& height, int minSize) {
+  if (texture == 0 || max(width, height) <= minSize)
+    return false;
+  int halfWidth = max(width / 2, 1), halfHeight = max(height / 2, 1);
+  GLTexture half = GLTexture::create();
+  uploadTexture(half, halfWidth, halfHeight, NULL, GL_RGBA);
+
+  GLint readFramebuffer, drawFramebuffer;
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+  GLboolean scissorTest = glIsEnabled(GL_SCISSOR_TEST);
+  glDisable(GL_SCISSOR_TEST);
+  GLuint framebuffers[2];
+  glGenFramebuffers(2, framebuffers);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+  glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, half, 0);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, halfWidth, halfHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+  glDeleteFramebuffers(2, framebuffers);
+  if (scissorTest)
+    glEnable(GL_SCISSOR_TEST);
+
+  texture = move(half);
+  width = halfWidth;
+  height = halfHeight;
+  return true;
+}
+
+}
+
 void Material::loadTextures() {
   if (!diffuseMap.empty()) {
+    loadTexture(diffuseMap, diffuseTexture, diffuseWidth, diffuseHeight);
+    diffuseReloadable = true;
+  }
+  else if (!diffusePixels.empty()) {
     if (diffuseTexture == 0)
-      glGenTextures(1, &diffuseTexture);
-
-    int width, height, n;
-    int forceChannels = 4;
-    delete diffuseTextureData;
-    diffuseTextureData = stbi_load(diffuseMap.c_str(), &width, &height, &n, forceChannels);
-    if (!diffuseTextureData)
-      cerr << "Cannot load the texture " << diffuseMap << endl;
-    else {
-      glBindTexture(GL_TEXTURE_2D, diffuseTexture);
-      glTexImage2D(
-        GL_TEXTURE_2D, 0, GL_RGBA,
-        width, height,
-        0, GL_RGBA, GL_UNSIGNED_BYTE,
-        diffuseTextureData
-      );
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    }
+      diffuseTexture = GLTexture::create();
+    diffuseWidth = diffusePixelsWidth;
+    diffuseHeight = diffusePixelsHeight;
+    uploadTexture(diffuseTexture, diffuseWidth, diffuseHeight, &diffusePixels[0], diffusePixelsFormat);
   }
 
-  if (!specularMap.empty()) {
-    if (specularTexture == 0)
-      glGenTextures(1, &specularTexture);
-
-    int width, height, n;
-    int forceChannels = 4;
-    delete specularTextureData;
-    specularTextureData = stbi_load(specularMap.c_str(), &width, &height, &n, forceChannels);
-    if (!specularTextureData)
-      cerr << "Cannot load the texture " << specularMap << endl;
-    else {
-      glBindTexture(GL_TEXTURE_2D, specularTexture);
-      glTexImage2D(
-        GL_TEXTURE_2D, 0, GL_RGBA,
-        width, height,
-        0, GL_RGBA, GL_UNSIGNED_BYTE,
-        specularTextureData
-      );
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    }
-  }
+  if (!specularMap.empty())
+    loadTexture(specularMap, specularTexture, specularWidth, specularHeight);
+
+  textureLevel = 0;
+  fullTextureBytes = getTextureBytes();
+  markChanged();
 }
 
 void Material::setDiffuseTextureData(int width, int height, unsigned char* data, GLenum format) {
   if (diffuseTexture == 0)
-    glGenTextures(1, &diffuseTexture);
+    diffuseTexture = GLTexture::create();
   if (data != NULL) {
-    glBindTexture(GL_TEXTURE_2D, diffuseTexture);
-    glTexImage2D(
-      GL_TEXTURE_2D, 0, GL_RGBA,
-      width, height,
-      0, format, GL_UNSIGNED_BYTE,
-      data
-    );
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    if (keepPixels) {
+      int channels = format == GL_RGBA ? 4 : format == GL_RGB ? 3 : format == GL_RG ? 2 : 1;
+      diffusePixels.assign(data, data + (size_t) width * height * channels);
+      diffusePixelsFormat = format;
+      diffusePixelsWidth = width;
+      diffusePixelsHeight = height;
+    }
+    else
+      vector<unsigned char>().swap(diffusePixels);
+    diffuseReloadable = keepPixels;
+    diffuseWidth = width;
+    diffuseHeight = height;
+    uploadTexture(diffuseTexture, width, height, data, format);
   }
+  textureLevel = 0;
+  fullTextureBytes = getTextureBytes();
+  markChanged();
+}
+
+void Material::releaseTextures() {
+  diffuseTexture.reset();
+  specularTexture.reset();
+  markChanged();
+}
+
+bool Material::halveTextures(int minSize) {
+  bool diffuseHalved = halveTexture(diffuseTexture, diffuseWidth, diffuseHeight, minSize);
+  bool specularHalved = halveTexture(specularTexture, specularWidth, specularHeight, minSize);
+  if (!diffuseHalved && !specularHalved)
+    return false;
+  textureLevel++;
+  markChanged();
+  return true;
+}
+
+unsigned long long Material::getTextureBytes() const {
+  // RGBA8 without mips
+  unsigned long long bytes = 0;
+  if (diffuseTexture != 0)
+    bytes += (unsigned long long) diffuseWidth * diffuseHeight * 4;
+  if (specularTexture != 0)
+    bytes += (unsigned long long) specularWidth * specularHeight * 4;
+  return bytes;
 }
@@ -2,28 +2,28 @@
 #define MATERIAL_H
 
 #include <string>
+#include <vector>
 
 #include <vec3.h>
 #include <stb_image.h>
 
+#include "glresource.h"
 #include "shader.h"
+#include "shaderfeatures.h"
 
 
 namespace qgl {
 
+// Owns its textures: it can be moved but not copied, objects share a
+// material through a shared_ptr.
 class Material {
 
   public:
-    Material() {
-      diffuseTextureData = NULL;
-      specularTextureData = NULL;
+    Material() : keepPixels(false), revision(0) {
       clear();
     }
-
-    ~Material() {
-      delete diffuseTextureData;
-      delete specularTextureData;
-    }
+    Material(Material&& other) = default;
+    Material& operator=(Material&& other) = default;
 
     inline void clear() {
       d = 1.f;
@@ -38,17 +38,55 @@ class Material {
       diffuseMap.clear();
       specularMap.clear();
 
-      specularTexture = 0;
-      diffuseTexture = 0;
-
-      delete diffuseTextureData;
-      delete specularTextureData;
-      diffuseTextureData = NULL;
-      specularTextureData = NULL;
+      specularTexture.reset();
+      diffuseTexture.reset();
+      diffusePixels.clear();
+      diffusePixelsFormat = GL_RGBA;
+      diffusePixelsWidth = diffusePixelsHeight = 0;
+      diffuseReloadable = true;
+      diffuseWidth = diffuseHeight = 0;
+      specularWidth = specularHeight = 0;
+      textureLevel = 0;
+      fullTextureBytes = 0;
+      revision++;
     }
 
+    // The images are freed once uploaded
     void loadTextures();
+    // The pixels are only copied when kept, see setKeepPixels
     void setDiffuseTextureData(int width, int height, unsigned char* data, GLenum format);
+    // Copies the pixels given to setDiffuseTextureData so that loadTextures can
+    // upload them again: without it, such a texture cannot be released or halved.
+    // Off by default, the residency manager only needs it under a budget.
+    void setKeepPixels(bool keep) { keepPixels = keep; }
+
+    // Residency, see ResidencyManager. The textures can be released, or halved on
+    // the GPU as if their largest mip was dropped; loadTextures brings them back
+    // to their full size from their files or from the copy of their pixels.
+    // False when a texture has neither.
+    bool canReloadTextures() const { return diffuseReloadable; }
+    void releaseTextures();
+    // Halves the textures larger than minSize, false when there is none
+    bool halveTextures(int minSize);
+    // Times the textures were halved since they were loaded
+    unsigned int getTextureLevel() const { return textureLevel; }
+    // GPU memory of the textures now, and at their full size
+    unsigned long long getTextureBytes() const;
+    unsigned long long getFullTextureBytes() const { return fullTextureBytes; }
+
+    // Call after changing the attributes so that the objects using it are redrawn
+    void markChanged() { revision++; }
+    unsigned int getRevision() const { return revision; }
+
+    // Texture features used by the material, see ShaderFeature
+    inline unsigned int shaderFeatures() const {
+      unsigned int features = 0;
+      if (diffuseTexture != 0)
+        features |= FEATURE_DIFFUSE_MAP;
+      if (specularTexture != 0)
+        features |= FEATURE_SPECULAR_MAP;
+      return features;
+    }
 
     // Attributes
     float d, ns, ni, km;
@@ -58,12 +96,29 @@ class Material {
     qm::Vec3f specularColor;
 
     std::string diffuseMap;
-    GLuint diffuseTexture;
-    unsigned char* diffuseTextureData;
+    GLTexture diffuseTexture;
 
     std::string specularMap;
-    GLuint specularTexture;
-    unsigned char* specularTextureData;
+    GLTexture specularTexture;
+
+  private:
+    Material(const Material&);
+    Material& operator=(const Material&);
+
+    // Pixels given to setDiffuseTextureData, when kept
+    bool keepPixels;
+    std::vector<unsigned char> diffusePixels;
+    GLenum diffusePixelsFormat;
+    int diffusePixelsWidth, diffusePixelsHeight;
+    bool diffuseReloadable; // from its file or its pixels
+
+    // Sizes of the textures on the GPU
+    int diffuseWidth, diffuseHeight;
+    int specularWidth, specularHeight;
+    unsigned int textureLevel;
+    unsigned long long fullTextureBytes;
+
+    unsigned int revision;
 
 };
 
@@ -0,0 +1,908 @@
+#include "meshcodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+#include "mappedfile.h"
+
+using namespace qgl;
+using namespace std;
+
+namespace {
+
+const unsigned char MAGIC[4] = { 'Q', 'M', 'S', 'H' };
+const unsigned int VERSION = 1;
+// Larger counts are taken for a corrupted file rather than allocated
+const unsigned long long MAX_COUNT = 1ull << 28;
+
+// How the triangle vertices reference the normals or the texture coordinates
+enum IndexMode { INDICES_NONE, INDICES_SAME, INDICES_SEPARATE };
+
+// Little endian serialization, as the vertex data is written by the machine
+class Writer {
+
+  public:
+    Writer(vector<unsigned char>& data) : data(data) {}
+
+    void byte(unsigned char value) { data.push_back(value); }
+    void bytes(const unsigned char* values, size_t size) { data.insert(data.end(), values, values + size); }
+    void varint(unsigned long long value) {
+      while (value >= 0x80) {
+        data.push_back((unsigned char) (value | 0x80));
+        value >>= 7;
+      }
+      data.push_back((unsigned char) value);
+    }
+    void float32(float value) {
+      unsigned char raw[4];
+      memcpy(raw, &value, 4);
+      bytes(raw, 4);
+    }
+
+  private:
+    vector<unsigned char>& data;
+
+};
+
+// Reads stop at the end: valid() tells whether everything read was there
+class Reader {
+
+  public:
+    Reader(const unsigned char* data, size_t size) : position(data), end(data + size), failed(false) {}
+
+    bool valid() const { return !failed; }
+    unsigned char byte() {
+      if (position == end) {
+        failed = true;
+        return 0;
+      }
+      return *position++;
+    }
+    const unsigned char* bytes(size_t size) {
+      if ((size_t) (end - position) < size) {
+        failed = true;
+        return NULL;
+      }
+      const unsigned char* values = position;
+      position += size;
+      return values;
+    }
+    unsigned long long varint() {
+      unsigned long long value = 0;
+      for (int shift = 0 ; shift < 64 ; shift += 7) {
+        unsigned char b = byte();
+        value |= (unsigned long long) (b & 0x7f) << shift;
+        if (!(b & 0x80))
+          return value;
+      }
+      failed = true;
+      return 0;
+    }
+    float float32() {
+      const unsigned char* raw = bytes(4);
+      float value = 0.f;
+      if (raw != NULL)
+        memcpy(&value, raw, 4);
+      return value;
+    }
+
+  private:
+    const unsigned char* position;
+    const unsigned char* end;
+    bool failed;
+
+};
+
+void writeVarint(vector<unsigned char>& data, unsigned long long value) {
+  Writer(data).varint(value);
+}
+
+// Byte streams: order 0 rANS with 4 interleaved states, see "Interleaved entropy coders", F. Giesen.
+// Streams too small or too random to gain anything are stored as they are.
+const unsigned int RANS_SCALE_BITS = 12;
+const uint32_t RANS_SCALE = 1u << RANS_SCALE_BITS;
+const uint32_t RANS_LOW = 1u << 23;
+const size_t MIN_ENTROPY_SIZE = 64;
+
+// Frequencies summing to RANS_SCALE, at least 1 for each symbol present
+void normalizeFrequencies(const unsigned long long* counts, unsigned long long total, uint32_t* frequencies) {
+  int sum = 0;
+  for (int s = 0 ; s < 256 ; s++) {
+    frequencies[s] = counts[s] == 0 ? 0 : max((uint32_t) (counts[s] * RANS_SCALE / total), 1u);
+    sum += frequencies[s];
+  }
+  int difference = (int) RANS_SCALE - sum;
+  int largest = max_element(frequencies, frequencies + 256) - frequencies;
+  if (difference > 0)
+    frequencies[largest] += difference;
+  // Taken from the most frequent symbols first, never below 1
+  while (difference < 0) {
+    for (int s = 0 ; s < 256 && difference < 0 ; s++) {
+      if (frequencies[s] > 1 && frequencies[s] * 2 >= frequencies[largest]) {
+        frequencies[s]--;
+        difference++;
+      }
+    }
+    largest = max_element(frequencies, frequencies + 256) - frequencies;
+  }
+}
+
+void encodeStream(const vector<unsigned char>& symbols, Writer& writer) {
+  writer.varint(symbols.size());
+  if (symbols.size() >= MIN_ENTROPY_SIZE) {
+    unsigned long long counts[256] = { 0 };
+    for (size_t i = 0 ; i < symbols.size() ; i++)
+      counts[symbols[i]]++;
+    uint32_t frequencies[256], starts[256];
+    normalizeFrequencies(counts, symbols.size(), frequencies);
+    uint32_t start = 0;
+    for (int s = 0 ; s < 256 ; s++) {
+      starts[s] = start;
+      start += frequencies[s];
+    }
+
+    // Written backwards, a symbol costs at most 12 bits
+    vector<unsigned char> buffer(symbols.size() * 2 + 16);
+    unsigned char* end = &buffer[0] + buffer.size();
+    unsigned char* p = end;
+    uint32_t states[4] = { RANS_LOW, RANS_LOW, RANS_LOW, RANS_LOW };
+    for (size_t i = symbols.size() ; i-- > 0 ; ) {
+      uint32_t& x = states[i & 3];
+      uint32_t frequency = frequencies[symbols[i]];
+      uint32_t xMax = ((RANS_LOW >> RANS_SCALE_BITS) << 8) * frequency;
+      while (x >= xMax) {
+        *--p = (unsigned char) x;
+        x >>= 8;
+      }
+      x = ((x / frequency) << RANS_SCALE_BITS) + (x % frequency) + starts[symbols[i]];
+    }
+    for (int j = 3 ; j >= 0 ; j--) {
+      *--p = (unsigned char) (states[j] >> 24);
+      *--p = (unsigned char) (states[j] >> 16);
+      *--p = (unsigned char) (states[j] >> 8);
+      *--p = (unsigned char) states[j];
+    }
+
+    vector<unsigned char> table;
+    unsigned char present[32] = { 0 };
+    for (int s = 0 ; s < 256 ; s++) {
+      if (frequencies[s] > 0) {
+        present[s >> 3] |= 1 << (s & 7);
+        writeVarint(table, frequencies[s] - 1);
+      }
+    }
+    size_t encodedSize = end - p;
+    if (sizeof (present) + table.size() + encodedSize + 4 < symbols.size()) {
+      writer.byte(1);
+      writer.bytes(present, sizeof (present));
+      writer.bytes(&table[0], table.size());
+      writer.varint(encodedSize);
+      writer.bytes(p, encodedSize);
+      return;
+    }
+  }
+  writer.byte(0);
+  if (!symbols.empty())
+    writer.bytes(&symbols[0], symbols.size());
+}
+
+// Decoding slot: the symbol in the low byte, its frequency minus 1 in the
+// next 12 bits and the position of the slot in the symbol range in the top 12
+inline unsigned char decodeSymbol(uint32_t& x, const uint32_t* slots) {
+  uint32_t slot = slots[x & (RANS_SCALE - 1)];
+  x = ((slot >> 8) & 0xfff) * (x >> RANS_SCALE_BITS) + (x >> RANS_SCALE_BITS) + (slot >> 20);
+  return (unsigned char) slot;
+}
+
+// Without checking the end: a symbol reads at most 2 bytes, the next 2 are read in any case
+inline unsigned char decodeSymbol(uint32_t& x, const uint32_t* slots, const unsigned char*& p) {
+  unsigned char symbol = decodeSymbol(x, slots);
+  // Branchless: the number of bytes is as random as the data
+  uint32_t bytes = (x < RANS_LOW) + (x < (RANS_LOW >> 8));
+  uint32_t next = (p[0] << 8) | p[1];
+  x = (x << (bytes * 8)) | (next >> (16 - bytes * 8));
+  p += bytes;
+  return symbol;
+}
+
+bool decodeStream(Reader& reader, size_t maxSize, vector<unsigned char>& symbols) {
+  unsigned long long size = reader.varint();
+  unsigned char mode = reader.byte();
+  if (!reader.valid() || size > maxSize)
+    return false;
+  symbols.resize(size);
+  if (mode == 0) {
+    const unsigned char* raw = reader.bytes(size);
+    if (raw != NULL && size > 0)
+      memcpy(&symbols[0], raw, size);
+    return raw != NULL;
+  }
+
+  const unsigned char* present = reader.bytes(32);
+  if (present == NULL || mode != 1)
+    return false;
+  uint32_t frequencies[256], starts[256];
+  uint32_t start = 0;
+  for (int s = 0 ; s < 256 ; s++) {
+    frequencies[s] = (present[s >> 3] >> (s & 7)) & 1 ? (uint32_t) reader.varint() + 1 : 0;
+    starts[s] = start;
+    start += frequencies[s];
+    if (start > RANS_SCALE)
+      return false;
+  }
+  if (start != RANS_SCALE)
+    return false;
+  vector<uint32_t> slots(RANS_SCALE);
+  for (uint32_t s = 0 ; s < 256 ; s++)
+    for (uint32_t k = 0 ; k < frequencies[s] ; k++)
+      slots[starts[s] + k] = s | ((frequencies[s] - 1) << 8) | (k << 20);
+
+  unsigned long long encodedSize = reader.varint();
+  const unsigned char* p = reader.valid() ? reader.bytes(encodedSize) : NULL;
+  if (p == NULL || encodedSize < 16)
+    return false;
+  const unsigned char* end = p + encodedSize;
+  uint32_t states[4];
+  for (int j = 0 ; j < 4 ; j++, p += 4)
+    states[j] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+
+  // The states stay in registers, 4 symbols at a time while 8 bytes are left
+  uint32_t x0 = states[0], x1 = states[1], x2 = states[2], x3 = states[3];
+  unsigned char* output = size > 0 ? &symbols[0] : NULL;
+  size_t i = 0;
+  for ( ; i + 4 <= size && end - p >= 8 ; i += 4) {
+    output[i] = decodeSymbol(x0, &slots[0], p);
+    output[i + 1] = decodeSymbol(x1, &slots[0], p);
+    output[i + 2] = decodeSymbol(x2, &slots[0], p);
+    output[i + 3] = decodeSymbol(x3, &slots[0], p);
+  }
+  states[0] = x0;
+  states[1] = x1;
+  states[2] = x2;
+  states[3] = x3;
+  // Near the end, checked
+  for ( ; i < size ; i++) {
+    uint32_t& x = states[i & 3];
+    output[i] = decodeSymbol(x, &slots[0]);
+    while (x < RANS_LOW) {
+      if (p == end)
+        return false;
+      x = (x << 8) | *p++;
+    }
+  }
+  return true;
+}
+
+// Moves reader past a stream without decoding it, size is its number of symbols
+bool skipStream(Reader& reader, size_t maxSize, size_t& size) {
+  unsigned long long symbols = reader.varint();
+  unsigned char mode = reader.byte();
+  if (!reader.valid() || symbols > maxSize || mode > 1)
+    return false;
+  size = symbols;
+  if (mode == 0) {
+    reader.bytes(symbols);
+    return reader.valid();
+  }
+  const unsigned char* present = reader.bytes(32);
+  if (present == NULL)
+    return false;
+  for (int s = 0 ; s < 256 ; s++)
+    if ((present[s >> 3] >> (s & 7)) & 1)
+      reader.varint();
+  unsigned long long encodedSize = reader.varint();
+  if (reader.valid())
+    reader.bytes(encodedSize);
+  return reader.valid();
+}
+
+// Quantized component: differences with the previous vertex, zigzag coded so
+// that small negative ones stay small, in a low and a high byte plane
+void encodeComponent(const vector<uint16_t>& values, Writer& writer) {
+  vector<unsigned char> low(values.size()), high(values.size());
+  uint16_t previous = 0;
+  for (size_t i = 0 ; i < values.size() ; i++) {
+    uint16_t delta = (uint16_t) (values[i] - previous);
+    previous = values[i];
+    uint16_t zigzag = (uint16_t) ((delta << 1) ^ -(delta >> 15));
+    low[i] = (unsigned char) zigzag;
+    high[i] = (unsigned char) (zigzag >> 8);
+  }
+  encodeStream(low, writer);
+  encodeStream(high, writer);
+}
+
+// Prefix sum of the differences, then value * scale + offset to output[i * stride]
+void decodeComponent(const unsigned char* low, const unsigned char* high, size_t count, float scale, float offset,
+                     float* output, unsigned int stride) {
+  size_t i = 0;
+  uint16_t previous = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128 scales = _mm_set1_ps(scale);
+  const __m128 offsets = _mm_set1_ps(offset);
+  __m128i carry = zero;
+  float values[8];
+  for ( ; i + 8 <= count ; i += 8) {
+    __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(low + i)),
+                                  _mm_loadl_epi64(reinterpret_cast<const __m128i*>(high + i)));
+    // (v >> 1) ^ -(v & 1)
+    v = _mm_xor_si128(_mm_srli_epi16(v, 1), _mm_sub_epi16(zero, _mm_and_si128(v, one)));
+    // Prefix sum of the 8 lanes, plus the last value of the previous ones
+    v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+    v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi16(v, carry);
+    carry = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+    carry = _mm_unpackhi_epi64(carry, carry);
+    __m128 first = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scales), offsets);
+    __m128 second = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scales), offsets);
+    if (stride == 1) {
+      _mm_storeu_ps(output + i, first);
+      _mm_storeu_ps(output + i + 4, second);
+      continue;
+    }
+    _mm_storeu_ps(values, first);
+    _mm_storeu_ps(values + 4, second);
+    float* destination = output + i * stride;
+    for (int j = 0 ; j < 8 ; j++)
+      destination[j * stride] = values[j];
+  }
+  previous = (uint16_t) _mm_cvtsi128_si32(carry);
+#endif
+  for ( ; i < count ; i++) {
+    uint16_t zigzag = low[i] | (high[i] << 8);
+    previous += (uint16_t) ((zigzag >> 1) ^ (uint16_t) -(zigzag & 1));
+    output[i * stride] = previous * scale + offset;
+  }
+}
+
+bool decodeComponent(Reader& reader, size_t count, float scale, float offset, float* output, unsigned int stride,
+                     vector<unsigned char>& low, vector<unsigned char>& high) {
+  if (!decodeStream(reader, count, low) || !decodeStream(reader, count, high) || low.size() != count || high.size() != count)
+    return false;
+  if (count > 0)
+    decodeComponent(&low[0], &high[0], count, scale, offset, output, stride);
+  return true;
+}
+
+// Recent edges and vertices shared by the triangle encoder and decoder
+struct TriangleFIFO {
+  // Codes 0 to 14 name an edge, 15 a triangle without a known edge
+  static const unsigned int EDGES = 15;
+  // Vertex codes: 0 the next new vertex, 1 to 14 a recent one, 15 an explicit index
+  static const unsigned int VERTICES = 14;
+
+  TriangleFIFO() : edgeHead(0), vertexHead(0), next(0) {
+    memset(edges, 0xff, sizeof (edges));
+    memset(vertices, 0xff, sizeof (vertices));
+  }
+
+  // Most recent first, -1 when not there
+  int findEdge(unsigned int a, unsigned int b) const {
+    for (unsigned int k = 0 ; k < EDGES ; k++) {
+      const unsigned int* edge = edges[(edgeHead - 1 - k) & 15];
+      if (edge[0] == a && edge[1] == b)
+        return k;
+    }
+    return -1;
+  }
+  const unsigned int* getEdge(unsigned int k) const { return edges[(edgeHead - 1 - k) & 15]; }
+  void pushEdge(unsigned int a, unsigned int b) {
+    edges[edgeHead & 15][0] = a;
+    edges[edgeHead & 15][1] = b;
+    edgeHead++;
+  }
+
+  int findVertex(unsigned int v) const {
+    for (unsigned int k = 0 ; k < VERTICES ; k++)
+      if (vertices[(vertexHead - 1 - k) & 15] == v)
+        return k;
+    return -1;
+  }
+  unsigned int getVertex(unsigned int k) const { return vertices[(vertexHead - 1 - k) & 15]; }
+  void pushVertex(unsigned int v) { vertices[vertexHead++ & 15] = v; }
+
+  unsigned int edges[16][2];
+  unsigned int edgeHead;
+  unsigned int vertices[16];
+  unsigned int vertexHead;
+  unsigned int next; // index of the next vertex used for the first time
+};
+
+// Vertex code of the encoder: new vertices get the next index
+unsigned int encodeVertex(TriangleFIFO& fifo, unsigned int vertex, vector<int>& remap,
+                          vector<unsigned int>& order, vector<unsigned char>& extra) {
+  if (remap[vertex] < 0) {
+    remap[vertex] = fifo.next++;
+    order.push_back(vertex);
+    fifo.pushVertex(remap[vertex]);
+    return 0;
+  }
+  int k = fifo.findVertex(remap[vertex]);
+  if (k >= 0)
+    return 1 + k;
+  writeVarint(extra, fifo.next - 1 - remap[vertex]);
+  fifo.pushVertex(remap[vertex]);
+  return 15;
+}
+
+bool decodeVertex(TriangleFIFO& fifo, unsigned int code, Reader& extra, unsigned int verticesNumber, unsigned int& vertex) {
+  if (code == 0) {
+    vertex = fifo.next++;
+    fifo.pushVertex(vertex);
+    return vertex < verticesNumber;
+  }
+  if (code < 15) {
+    vertex = fifo.getVertex(code - 1);
+    return vertex < verticesNumber;
+  }
+  unsigned long long distance = extra.varint();
+  if (!extra.valid() || distance >= fifo.next)
+    return false;
+  vertex = fifo.next - 1 - (unsigned int) distance;
+  fifo.pushVertex(vertex);
+  return true;
+}
+
+// Normal or uv indices of the triangle vertices: the same as the position ones, or their own
+IndexMode indexMode(const IndexedMesh& mesh, unsigned int attribute, size_t attributesNumber, bool& valid) {
+  if (attributesNumber == 0)
+    return INDICES_NONE;
+  bool same = true;
+  for (size_t i = 0 ; i < mesh.indices.size() ; i += 3) {
+    int index = mesh.indices[i + attribute];
+    if (index < -1 || index >= (int) attributesNumber)
+      valid = false;
+    same = same && index == mesh.indices[i];
+  }
+  return same ? INDICES_SAME : INDICES_SEPARATE;
+}
+
+// Maximum of a quantized component
+float quantizationRange(unsigned int bits) {
+  return (float) ((1u << bits) - 1);
+}
+
+// Components of the vertices in order, quantized over their bounds, which are written first
+void quantizeBounded(const vector<float>& values, unsigned int components, const vector<unsigned int>& order,
+                     unsigned int bits, Writer& writer, vector<vector<uint16_t> >& quantized) {
+  quantized.assign(components, vector<uint16_t>(order.size()));
+  for (unsigned int c = 0 ; c < components ; c++) {
+    float minimum = 0.f, maximum = 0.f;
+    for (size_t i = 0 ; i < order.size() ; i++) {
+      float value = values[order[i] * components + c];
+      if (i == 0 || value < minimum)
+        minimum = value;
+      if (i == 0 || value > maximum)
+        maximum = value;
+    }
+    float scale = (maximum - minimum) / quantizationRange(bits);
+    writer.float32(minimum);
+    writer.float32(scale);
+    for (size_t i = 0 ; i < order.size() ; i++) {
+      float value = values[order[i] * components + c];
+      quantized[c][i] = scale > 0.f ? (uint16_t) min((value - minimum) / scale + 0.5f, quantizationRange(bits)) : 0;
+    }
+  }
+}
+
+// Octahedral mapping of the unit sphere on [-1, 1]^2, quantized
+void quantizeNormals(const vector<float>& normals, const vector<unsigned int>& order, unsigned int bits,
+                     vector<vector<uint16_t> >& quantized) {
+  quantized.assign(2, vector<uint16_t>(order.size()));
+  float range = quantizationRange(bits);
+  for (size_t i = 0 ; i < order.size() ; i++) {
+    const float* n = &normals[order[i] * 3];
+    float length = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+    float x = length > 0.f ? n[0] / length : 0.f;
+    float y = length > 0.f ? n[1] / length : 0.f;
+    if (n[2] < 0.f) {
+      float folded = (1.f - fabs(y)) * (x >= 0.f ? 1.f : -1.f);
+      y = (1.f - fabs(x)) * (y >= 0.f ? 1.f : -1.f);
+      x = folded;
+    }
+    quantized[0][i] = (uint16_t) ((x * 0.5f + 0.5f) * range + 0.5f);
+    quantized[1][i] = (uint16_t) ((y * 0.5f + 0.5f) * range + 0.5f);
+  }
+}
+
+// z from the octahedral x and y already in the normals, then normalized
+void unfoldNormals(float* normals, size_t count) {
+  for (size_t i = 0 ; i < count ; i++) {
+    float* n = normals + i * 3;
+    n[2] = 1.f - fabs(n[0]) - fabs(n[1]);
+    float t = max(-n[2], 0.f);
+    n[0] += n[0] >= 0.f ? -t : t;
+    n[1] += n[1] >= 0.f ? -t : t;
+    float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length > 0.f) {
+      n[0] /= length;
+      n[1] /= length;
+      n[2] /= length;
+    }
+  }
+}
+
+// A quantized component: where its streams start and where its values go
+struct ComponentStream {
+  Reader reader;
+  size_t count;
+  float scale;
+  float offset;
+  vector<float>* values;
+  unsigned int component;
+  unsigned int stride;
+};
+
+// Records the component and moves reader past its streams, which must hold count values
+bool scanComponent(Reader& reader, size_t count, float scale, float offset, vector<float>& values, unsigned int component,
+                   unsigned int stride, vector<ComponentStream>& components) {
+  ComponentStream stream = { reader, count, scale, offset, &values, component, stride };
+  components.push_back(stream);
+  size_t low = 0, high = 0;
+  return skipStream(reader, count, low) && low == count && skipStream(reader, count, high) && high == count;
+}
+
+bool decodeComponent(ComponentStream& stream) {
+  vector<unsigned char> low, high;
+  float* output = stream.values->empty() ? NULL : &(*stream.values)[0] + stream.component;
+  return decodeComponent(stream.reader, stream.count, stream.scale, stream.offset, output, stream.stride, low, high);
+}
+
+// The triangle streams, then the separate normal and uv indices if any
+bool decodeTriangles(Reader& reader, size_t trianglesNumber, unsigned long long positionsNumber, const IndexMode* modes,
+                     const unsigned long long* attributesNumbers, vector<int>& indices) {
+  vector<unsigned char> codes, extra;
+  if (!decodeStream(reader, trianglesNumber * 2, codes) || !decodeStream(reader, trianglesNumber * 3 * 10, extra)
+      || codes.size() < trianglesNumber)
+    return false;
+  indices.resize(trianglesNumber * 9);
+  TriangleFIFO fifo;
+  Reader extraReader(extra.empty() ? NULL : &extra[0], extra.size());
+  size_t code = 0;
+  bool valid = true;
+  for (size_t t = 0 ; t < trianglesNumber && valid ; t++) {
+    unsigned int n[3];
+    if (code >= codes.size()) {
+      valid = false;
+      break;
+    }
+    unsigned char first = codes[code++];
+    if ((first >> 4) != 15) {
+      const unsigned int* edge = fifo.getEdge(first >> 4);
+      n[0] = edge[0];
+      n[1] = edge[1];
+      valid = n[0] < positionsNumber && n[1] < positionsNumber
+              && decodeVertex(fifo, first & 15, extraReader, positionsNumber, n[2]);
+    }
+    else {
+      unsigned char second = code < codes.size() ? codes[code++] : 0xff;
+      valid = code <= codes.size()
+              && decodeVertex(fifo, second >> 4, extraReader, positionsNumber, n[0])
+              && decodeVertex(fifo, second & 15, extraReader, positionsNumber, n[1])
+              && decodeVertex(fifo, first & 15, extraReader, positionsNumber, n[2]);
+      fifo.pushEdge(n[1], n[0]);
+    }
+    fifo.pushEdge(n[2], n[1]);
+    fifo.pushEdge(n[0], n[2]);
+    for (int k = 0 ; k < 3 ; k++) {
+      indices[t * 9 + k * 3] = n[k];
+      indices[t * 9 + k * 3 + 1] = modes[0] == INDICES_SAME ? (int) n[k] : -1;
+      indices[t * 9 + k * 3 + 2] = modes[1] == INDICES_SAME ? (int) n[k] : -1;
+    }
+  }
+  if (!valid || fifo.next != positionsNumber)
+    return false;
+
+  for (int a = 0 ; a < 2 && valid ; a++) {
+    if (modes[a] != INDICES_SEPARATE)
+      continue;
+    vector<unsigned char> stream;
+    valid = decodeStream(reader, trianglesNumber * 3 * 10, stream);
+    Reader streamReader(stream.empty() ? NULL : &stream[0], stream.size());
+    long long previous = 0;
+    for (size_t i = 0 ; i < trianglesNumber * 3 && valid ; i++) {
+      unsigned long long zigzag = streamReader.varint();
+      previous += (long long) (zigzag >> 1) ^ -(long long) (zigzag & 1);
+      valid = streamReader.valid() && previous >= 0 && previous <= (long long) attributesNumbers[a];
+      indices[i * 3 + 1 + a] = (int) previous - 1;
+    }
+  }
+  return valid;
+}
+
+}
+
+MeshCodec::MeshCodec() {
+  jobs = NULL;
+  positionBits = 16;
+  normalBits = 12;
+  uvBits = 16;
+}
+
+void MeshCodec::setPositionBits(unsigned int bits) {
+  positionBits = min(max(bits, 1u), 16u);
+}
+
+void MeshCodec::setNormalBits(unsigned int bits) {
+  normalBits = min(max(bits, 2u), 16u);
+}
+
+void MeshCodec::setUVBits(unsigned int bits) {
+  uvBits = min(max(bits, 1u), 16u);
+}
+
+bool MeshCodec::encode(const IndexedMesh& mesh, vector<unsigned char>& data) const {
+  unsigned int trianglesNumber = mesh.trianglesNumber();
+  unsigned int positionsNumber = mesh.positionsNumber();
+  bool valid = trianglesNumber > 0;
+  for (size_t i = 0 ; i < mesh.indices.size() ; i += 3)
+    valid = valid && mesh.indices[i] >= 0 && mesh.indices[i] < (int) positionsNumber;
+  IndexMode normalMode = indexMode(mesh, 1, mesh.normals.size() / 3, valid);
+  IndexMode uvMode = indexMode(mesh, 2, mesh.uvs.size() / 2, valid);
+  bool withColors = mesh.hasColors() && mesh.colors.size() == mesh.positions.size();
+  if (!valid) {
+    cerr << "ERROR: the mesh to encode has no triangles or invalid indices" << endl;
+    return false;
+  }
+
+  // Triangles, the positions renumbered by first use on the way
+  TriangleFIFO fifo;
+  vector<int> positionRemap(positionsNumber, -1);
+  vector<unsigned int> positionOrder;
+  vector<unsigned char> codes, extra;
+  vector<unsigned char> rotations(trianglesNumber);
+  codes.reserve(trianglesNumber);
+  for (unsigned int t = 0 ; t < trianglesNumber ; t++) {
+    const int* triangle = &mesh.indices[t * 9];
+    int edge = -1;
+    unsigned int rotation = 0;
+    for (unsigned int r = 0 ; r < 3 && edge != 0 ; r++) {
+      int a = positionRemap[triangle[r * 3]], b = positionRemap[triangle[((r + 1) % 3) * 3]];
+      if (a < 0 || b < 0)
+        continue;
+      int k = fifo.findEdge(a, b);
+      if (k >= 0 && (edge < 0 || k < edge)) {
+        edge = k;
+        rotation = r;
+      }
+    }
+    rotations[t] = rotation;
+    unsigned int vertices[3];
+    for (int k = 0 ; k < 3 ; k++)
+      vertices[k] = triangle[((rotation + k) % 3) * 3];
+
+    if (edge >= 0)
+      codes.push_back((unsigned char) ((edge << 4) | encodeVertex(fifo, vertices[2], positionRemap, positionOrder, extra)));
+    else {
+      unsigned int a = encodeVertex(fifo, vertices[0], positionRemap, positionOrder, extra);
+      unsigned int b = encodeVertex(fifo, vertices[1], positionRemap, positionOrder, extra);
+      unsigned int c = encodeVertex(fifo, vertices[2], positionRemap, positionOrder, extra);
+      codes.push_back((unsigned char) (0xf0 | c));
+      codes.push_back((unsigned char) ((a << 4) | b));
+    }
+
+    unsigned int n[3] = { (unsigned int) positionRemap[vertices[0]], (unsigned int) positionRemap[vertices[1]], (unsigned int) positionRemap[vertices[2]] };
+    if (edge < 0)
+      fifo.pushEdge(n[1], n[0]);
+    fifo.pushEdge(n[2], n[1]);
+    fifo.pushEdge(n[0], n[2]);
+  }
+
+  // Separate normal and uv indices, renumbered by first use as well, plus one so that -1 is 0
+  vector<unsigned char> cornerStreams[2];
+  vector<unsigned int> cornerOrders[2];
+  IndexMode modes[2] = { normalMode, uvMode };
+  size_t attributesNumbers[2] = { mesh.normals.size() / 3, mesh.uvs.size() / 2 };
+  for (int a = 0 ; a < 2 ; a++) {
+    if (modes[a] == INDICES_SAME)
+      cornerOrders[a] = positionOrder;
+    if (modes[a] != INDICES_SEPARATE)
+      continue;
+    vector<int> remap(attributesNumbers[a], -1);
+    long long previous = 0;
+    for (unsigned int t = 0 ; t < trianglesNumber ; t++) {
+      for (unsigned int k = 0 ; k < 3 ; k++) {
+        int index = mesh.indices[t * 9 + ((rotations[t] + k) % 3) * 3 + 1 + a];
+        long long value = 0;
+        if (index >= 0) {
+          if (remap[index] < 0) {
+            remap[index] = cornerOrders[a].size();
+            cornerOrders[a].push_back(index);
+          }
+          value = remap[index] + 1;
+        }
+        long long delta = value - previous;
+        previous = value;
+        writeVarint(cornerStreams[a], ((unsigned long long) delta << 1) ^ (unsigned long long) (delta >> 63));
+      }
+    }
+  }
+
+  data.clear();
+  Writer writer(data);
+  writer.bytes(MAGIC, 4);
+  writer.varint(VERSION);
+  writer.byte((unsigned char) (normalMode | (uvMode << 2) | (withColors ? 16 : 0)));
+  writer.varint(positionOrder.size());
+  writer.varint(cornerOrders[0].size());
+  writer.varint(cornerOrders[1].size());
+  writer.varint(trianglesNumber);
+  writer.byte(positionBits);
+  writer.byte(normalBits);
+  writer.byte(uvBits);
+
+  encodeStream(codes, writer);
+  encodeStream(extra, writer);
+  for (int a = 0 ; a < 2 ; a++)
+    if (modes[a] == INDICES_SEPARATE)
+      encodeStream(cornerStreams[a], writer);
+
+  vector<vector<uint16_t> > quantized;
+  quantizeBounded(mesh.positions, 3, positionOrder, positionBits, writer, quantized);
+  for (int c = 0 ; c < 3 ; c++)
+    encodeComponent(quantized[c], writer);
+  if (normalMode != INDICES_NONE) {
+    quantizeNormals(mesh.normals, cornerOrders[0], normalBits, quantized);
+    for (int c = 0 ; c < 2 ; c++)
+      encodeComponent(quantized[c], writer);
+  }
+  if (uvMode != INDICES_NONE) {
+    quantizeBounded(mesh.uvs, 2, cornerOrders[1], uvBits, writer, quantized);
+    for (int c = 0 ; c < 2 ; c++)
+      encodeComponent(quantized[c], writer);
+  }
+  if (withColors) {
+    quantized.assign(3, vector<uint16_t>(positionOrder.size()));
+    for (size_t i = 0 ; i < positionOrder.size() ; i++)
+      for (int c = 0 ; c < 3 ; c++)
+        quantized[c][i] = (uint16_t) (min(max(mesh.colors[positionOrder[i] * 3 + c], 0.f), 1.f) * 255.f + 0.5f);
+    for (int c = 0 ; c < 3 ; c++)
+      encodeComponent(quantized[c], writer);
+  }
+  return true;
+}
+
+bool MeshCodec::decode(const unsigned char* data, size_t size, IndexedMesh& mesh) const {
+  mesh.clear();
+  Reader reader(data, size);
+  const unsigned char* magic = reader.bytes(4);
+  if (magic == NULL || memcmp(magic, MAGIC, 4) != 0 || reader.varint() != VERSION) {
+    cerr << "ERROR: not an encoded mesh of version " << VERSION << endl;
+    return false;
+  }
+  unsigned char flags = reader.byte();
+  IndexMode normalMode = (IndexMode) (flags & 3);
+  IndexMode uvMode = (IndexMode) ((flags >> 2) & 3);
+  bool withColors = (flags & 16) != 0;
+  unsigned long long positionsNumber = reader.varint();
+  unsigned long long normalsNumber = reader.varint();
+  unsigned long long uvsNumber = reader.varint();
+  unsigned long long trianglesNumber = reader.varint();
+  unsigned int positionBits = reader.byte(), normalBits = reader.byte(), uvBits = reader.byte();
+  if (!reader.valid() || positionsNumber > MAX_COUNT || normalsNumber > MAX_COUNT || uvsNumber > MAX_COUNT
+      || trianglesNumber > MAX_COUNT || positionBits > 16 || normalBits > 16 || uvBits > 16
+      || normalMode > INDICES_SEPARATE || uvMode > INDICES_SEPARATE) {
+    cerr << "ERROR: corrupted encoded mesh header" << endl;
+    return false;
+  }
+  if (normalMode == INDICES_SAME)
+    normalsNumber = positionsNumber;
+  if (uvMode == INDICES_SAME)
+    uvsNumber = positionsNumber;
+
+  // The streams are located first, then decoded in parallel: the triangles in
+  // one job, each vertex component in another
+  IndexMode modes[2] = { normalMode, uvMode };
+  unsigned long long attributesNumbers[2] = { normalsNumber, uvsNumber };
+  Reader trianglesReader = reader;
+  size_t codesSize = 0, streamSize = 0;
+  bool valid = skipStream(reader, trianglesNumber * 2, codesSize) && codesSize >= trianglesNumber
+               && skipStream(reader, trianglesNumber * 3 * 10, streamSize);
+  for (int a = 0 ; a < 2 && valid ; a++)
+    valid = modes[a] != INDICES_SEPARATE || skipStream(reader, trianglesNumber * 3 * 10, streamSize);
+  if (!valid) {
+    cerr << "ERROR: corrupted encoded mesh triangles" << endl;
+    return false;
+  }
+
+  vector<ComponentStream> components;
+  float bounds[6];
+  for (int c = 0 ; c < 6 ; c++)
+    bounds[c] = reader.float32();
+  for (int c = 0 ; c < 3 && valid ; c++)
+    valid = reader.valid() && scanComponent(reader, positionsNumber, bounds[c * 2 + 1], bounds[c * 2], mesh.positions, c, 3,
+                                            components);
+  if (normalMode != INDICES_NONE) {
+    float scale = 2.f / quantizationRange(normalBits);
+    for (int c = 0 ; c < 2 && valid ; c++)
+      valid = scanComponent(reader, normalsNumber, scale, -1.f, mesh.normals, c, 3, components);
+  }
+  if (uvMode != INDICES_NONE && valid) {
+    for (int c = 0 ; c < 4 ; c++)
+      bounds[c] = reader.float32();
+    for (int c = 0 ; c < 2 && valid ; c++)
+      valid = reader.valid() && scanComponent(reader, uvsNumber, bounds[c * 2 + 1], bounds[c * 2], mesh.uvs, c, 2, components);
+  }
+  if (withColors) {
+    for (int c = 0 ; c < 3 && valid ; c++)
+      valid = scanComponent(reader, positionsNumber, 1.f / 255.f, 0.f, mesh.colors, c, 3, components);
+  }
+  if (!valid) {
+    cerr << "ERROR: corrupted encoded mesh" << endl;
+    return false;
+  }
+
+  mesh.positions.resize(positionsNumber * 3);
+  if (normalMode != INDICES_NONE)
+    mesh.normals.resize(normalsNumber * 3);
+  if (uvMode != INDICES_NONE)
+    mesh.uvs.resize(uvsNumber * 2);
+  if (withColors)
+    mesh.colors.resize(positionsNumber * 3);
+  // Not a vector<bool>: the jobs write next to each other
+  vector<unsigned char> decoded(components.size() + 1, 0);
+  auto decodeStreams = [&](unsigned int first, unsigned int last) {
+    for (unsigned int i = first ; i < last ; i++)
+      decoded[i] = i == 0 ? decodeTriangles(trianglesReader, trianglesNumber, positionsNumber, modes, attributesNumbers, mesh.indices)
+                          : decodeComponent(components[i - 1]);
+  };
+  if (jobs != NULL)
+    jobs->parallelFor(decoded.size(), 1, decodeStreams);
+  else
+    decodeStreams(0, decoded.size());
+  valid = find(decoded.begin(), decoded.end(), 0) == decoded.end();
+  if (!valid) {
+    cerr << "ERROR: corrupted encoded mesh" << endl;
+    mesh.clear();
+    return false;
+  }
+
+  if (normalMode != INDICES_NONE && normalsNumber > 0) {
+    auto unfold = [&mesh](unsigned int first, unsigned int last) {
+      unfoldNormals(&mesh.normals[0] + first * 3, last - first);
+    };
+    if (jobs != NULL)
+      jobs->parallelFor(normalsNumber, 0, unfold);
+    else
+      unfold(0, normalsNumber);
+  }
+  return true;
+}
+
+bool MeshCodec::save(const IndexedMesh& mesh, const string& filename) const {
+  vector<unsigned char> data;
+  if (!encode(mesh, data))
+    return false;
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (file == NULL) {
+    cerr << "ERROR: could not open " << filename << endl;
+    return false;
+  }
+  bool written = fwrite(&data[0], 1, data.size(), file) == data.size();
+  written = fclose(file) == 0 && written;
+  if (!written)
+    cerr << "ERROR: could not write " << filename << endl;
+  return written;
+}
+
+bool MeshCodec::load(const string& filename, IndexedMesh& mesh) const {
+  MappedFile file;
+  if (!file.open(filename))
+    return false;
+  if (!decode(file.getData(), file.getSize(), mesh)) {
+    cerr << "ERROR: could not decode " << filename << endl;
+    return false;
+  }
+  return true;
+}
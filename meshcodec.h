@@ -0,0 +1,55 @@
+#ifndef MESHCODEC_H
+#define MESHCODEC_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "jobsystem.h"
+#include "meshprocessor.h"
+
+
+namespace qgl {
+
+// Compact encoding of indexed meshes for the disk:
+// - vertices are renumbered in the order the triangles first use them, the
+//   vertices no triangle uses are dropped;
+// - positions and texture coordinates are quantized over their bounds,
+//   normals in the octahedral mapping and colors to 8 bits;
+// - each component is stored as the difference with the previous vertex;
+// - triangles are coded against a FIFO of the edges of the previous ones:
+//   a triangle sharing an edge costs one byte, mostly of a few bits;
+// - every stream is then entropy coded by bytes with rANS.
+// Decoding undoes the differences and the quantization with SSE2. With a job
+// system, the triangles and each vertex component are decoded in parallel.
+class MeshCodec {
+
+  public:
+    MeshCodec();
+
+    // Decodes on these threads, NULL (the default) on the calling thread only
+    void setJobSystem(JobSystem* jobSystem) { jobs = jobSystem; }
+
+    // Bits per quantized component, up to 16
+    void setPositionBits(unsigned int bits);
+    void setNormalBits(unsigned int bits);
+    void setUVBits(unsigned int bits);
+
+    bool encode(const IndexedMesh& mesh, std::vector<unsigned char>& data) const;
+    bool decode(const unsigned char* data, size_t size, IndexedMesh& mesh) const;
+
+    bool save(const IndexedMesh& mesh, const std::string& filename) const;
+    // The file is mapped and decoded in place
+    bool load(const std::string& filename, IndexedMesh& mesh) const;
+
+  private:
+    JobSystem* jobs;
+    unsigned int positionBits;
+    unsigned int normalBits;
+    unsigned int uvBits;
+
+};
+
+}
+
+#endif // MESHCODEC_H
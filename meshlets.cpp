@@ -0,0 +1,308 @@
+#include "meshlets.h"
+
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "transforms.h"
+
+using namespace qgl;
+using namespace std;
+
+namespace {
+
+// Vertex attributes compared bit for bit
+struct VertexKey {
+  float values[11];
+
+  bool operator==(const VertexKey& other) const {
+    return memcmp(values, other.values, sizeof (values)) == 0;
+  }
+};
+
+struct VertexKeyHash {
+  size_t operator()(const VertexKey& key) const {
+    // FNV-1a over the bytes
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(key.values);
+    size_t hash = 2166136261u;
+    for (unsigned int i = 0 ; i < sizeof (key.values) ; i++)
+      hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+  }
+};
+
+}
+
+MeshletMesh::MeshletMesh() {
+  visibleNumber = 0;
+  visibleTrianglesNumber = 0;
+  positionsVBO = normalsVBO = uvsVBO = colorsVBO = indicesIBO = 0;
+  VAO = 0;
+}
+
+MeshletMesh::~MeshletMesh() {
+  destroy();
+}
+
+bool MeshletMesh::build(const Object& object) {
+  const float* objectPositions = object.getPositions();
+  const float* objectNormals = object.getNormals();
+  const float* objectUVs = object.getUVs();
+  const float* objectColors = object.getColors();
+  unsigned int objectVertices = object.verticesNumber();
+  if (objectPositions == NULL || objectVertices < 3)
+    return false;
+
+  positions.clear();
+  normals.clear();
+  uvs.clear();
+  colors.clear();
+  indices.clear();
+  meshlets.clear();
+
+  // Indexed vertices
+  vector<unsigned int> vertexIndices(objectVertices);
+  unordered_map<VertexKey, unsigned int, VertexKeyHash> uniqueVertices;
+  uniqueVertices.reserve(objectVertices);
+  for (unsigned int v = 0 ; v < objectVertices ; v++) {
+    VertexKey key;
+    memset(key.values, 0, sizeof (key.values));
+    memcpy(key.values, objectPositions + v * 3, 3 * sizeof (float));
+    if (objectNormals != NULL)
+      memcpy(key.values + 3, objectNormals + v * 3, 3 * sizeof (float));
+    if (objectUVs != NULL)
+      memcpy(key.values + 6, objectUVs + v * 2, 2 * sizeof (float));
+    if (objectColors != NULL)
+      memcpy(key.values + 8, objectColors + v * 3, 3 * sizeof (float));
+
+    unordered_map<VertexKey, unsigned int, VertexKeyHash>::iterator it = uniqueVertices.find(key);
+    if (it != uniqueVertices.end()) {
+      vertexIndices[v] = it->second;
+      continue;
+    }
+    unsigned int index = positions.size() / 3;
+    uniqueVertices.insert(make_pair(key, index));
+    vertexIndices[v] = index;
+    positions.insert(positions.end(), key.values, key.values + 3);
+    if (objectNormals != NULL)
+      normals.insert(normals.end(), key.values + 3, key.values + 6);
+    if (objectUVs != NULL)
+      uvs.insert(uvs.end(), key.values + 6, key.values + 8);
+    if (objectColors != NULL)
+      colors.insert(colors.end(), key.values + 8, key.values + 11);
+  }
+
+  // Greedy meshlets: triangles are added in order until a limit is reached
+  vector<bool> inMeshlet(positions.size() / 3, false);
+  vector<unsigned int> meshletVertices;
+  unsigned int firstTriangle = 0;
+  unsigned int trianglesNumber = objectVertices / 3;
+  for (unsigned int t = 0 ; t < trianglesNumber ; t++) {
+    unsigned int newVertices = 0;
+    for (int i = 0 ; i < 3 ; i++)
+      if (!inMeshlet[vertexIndices[t * 3 + i]])
+        newVertices++;
+    if (meshletVertices.size() + newVertices > MAX_VERTICES || t - firstTriangle >= MAX_TRIANGLES) {
+      addMeshlet(firstTriangle, t - firstTriangle, meshletVertices.size());
+      for (unsigned int i = 0 ; i < meshletVertices.size() ; i++)
+        inMeshlet[meshletVertices[i]] = false;
+      meshletVertices.clear();
+      firstTriangle = t;
+    }
+    for (int i = 0 ; i < 3 ; i++) {
+      unsigned int vertex = vertexIndices[t * 3 + i];
+      if (!inMeshlet[vertex]) {
+        inMeshlet[vertex] = true;
+        meshletVertices.push_back(vertex);
+      }
+      indices.push_back(vertex);
+    }
+  }
+  if (trianglesNumber > firstTriangle)
+    addMeshlet(firstTriangle, trianglesNumber - firstTriangle, meshletVertices.size());
+  return true;
+}
+
+void MeshletMesh::addMeshlet(unsigned int firstTriangle, unsigned int trianglesNumber, unsigned int verticesNumber) {
+  Meshlet meshlet;
+  meshlet.firstIndex = firstTriangle * 3;
+  meshlet.trianglesNumber = trianglesNumber;
+  meshlet.verticesNumber = verticesNumber;
+
+  // Sphere around the bounding box center
+  float boundsMin[3], boundsMax[3];
+  for (unsigned int i = 0 ; i < trianglesNumber * 3 ; i++) {
+    const float* p = &positions[indices[meshlet.firstIndex + i] * 3];
+    for (int j = 0 ; j < 3 ; j++) {
+      boundsMin[j] = (i == 0 || p[j] < boundsMin[j]) ? p[j] : boundsMin[j];
+      boundsMax[j] = (i == 0 || p[j] > boundsMax[j]) ? p[j] : boundsMax[j];
+    }
+  }
+  float radius2 = 0.f;
+  for (int j = 0 ; j < 3 ; j++)
+    meshlet.center[j] = (boundsMin[j] + boundsMax[j]) * 0.5f;
+  for (unsigned int i = 0 ; i < trianglesNumber * 3 ; i++) {
+    const float* p = &positions[indices[meshlet.firstIndex + i] * 3];
+    float dx = p[0] - meshlet.center[0], dy = p[1] - meshlet.center[1], dz = p[2] - meshlet.center[2];
+    radius2 = max(radius2, dx * dx + dy * dy + dz * dz);
+  }
+  meshlet.radius = sqrt(radius2);
+
+  // Normal cone from the face normals, which decide the facing
+  vector<float> faceNormals(trianglesNumber * 3, 0.f);
+  float axis[3] = { 0.f, 0.f, 0.f };
+  for (unsigned int t = 0 ; t < trianglesNumber ; t++) {
+    const float* p0 = &positions[indices[meshlet.firstIndex + t * 3] * 3];
+    const float* p1 = &positions[indices[meshlet.firstIndex + t * 3 + 1] * 3];
+    const float* p2 = &positions[indices[meshlet.firstIndex + t * 3 + 2] * 3];
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    float* n = &faceNormals[t * 3];
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length == 0.f)
+      continue;
+    for (int j = 0 ; j < 3 ; j++) {
+      n[j] /= length;
+      axis[j] += n[j];
+    }
+  }
+  float axisLength = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  float coneCos = 1.f;
+  if (axisLength > 0.f) {
+    for (int j = 0 ; j < 3 ; j++)
+      axis[j] /= axisLength;
+    for (unsigned int t = 0 ; t < trianglesNumber ; t++) {
+      const float* n = &faceNormals[t * 3];
+      if (n[0] != 0.f || n[1] != 0.f || n[2] != 0.f)
+        coneCos = min(coneCos, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+    }
+  }
+  else {
+    coneCos = -1.f;
+  }
+  for (int j = 0 ; j < 3 ; j++)
+    meshlet.coneAxis[j] = axis[j];
+  meshlet.coneCos = coneCos;
+  meshlet.coneSin = sqrt(max(1.f - coneCos * coneCos, 0.f));
+  meshlets.push_back(meshlet);
+}
+
+void MeshletMesh::createVAO() {
+  destroy();
+  glGenVertexArrays(1, &VAO);
+  glBindVertexArray(VAO);
+
+  glGenBuffers(1, &positionsVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, positionsVBO);
+  glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof (float), &positions[0], GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+  glEnableVertexAttribArray(0);
+  // Same attribute locations as Object, for the same shaders
+  if (!normals.empty()) {
+    glGenBuffers(1, &normalsVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
+    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof (float), &normals[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(1);
+  }
+  if (!uvs.empty()) {
+    unsigned int location = normals.empty() ? 1 : 2;
+    glGenBuffers(1, &uvsVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
+    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof (float), &uvs[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(location, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(location);
+  }
+  if (!colors.empty()) {
+    glGenBuffers(1, &colorsVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, colorsVBO);
+    glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof (float), &colors[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(4);
+  }
+
+  glGenBuffers(1, &indicesIBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indicesIBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof (unsigned int), &indices[0], GL_STATIC_DRAW);
+  glBindVertexArray(0);
+}
+
+void MeshletMesh::destroy() {
+  if (VAO != 0)
+    glDeleteVertexArrays(1, &VAO);
+  unsigned int buffers[5] = { positionsVBO, normalsVBO, uvsVBO, colorsVBO, indicesIBO };
+  for (int i = 0 ; i < 5 ; i++)
+    if (buffers[i] != 0)
+      glDeleteBuffers(1, &buffers[i]);
+  positionsVBO = normalsVBO = uvsVBO = colorsVBO = indicesIBO = 0;
+  VAO = 0;
+}
+
+unsigned long long MeshletMesh::bufferBytes() const {
+  if (VAO == 0)
+    return 0;
+  return (positions.size() + normals.size() + uvs.size() + colors.size()) * sizeof (float) + indices.size() * sizeof (unsigned int);
+}
+
+unsigned int MeshletMesh::cull(const qm::Mat4f& model, const qm::Mat4f& view, const qm::Mat4f& proj) {
+  // Tests in object space: the planes are normalized there and the camera brought there
+  qm::Mat4f modelView = view * model;
+  float planes[6][4];
+  frustumPlanes(proj * modelView, planes);
+  qm::Vec3f camera = inverseTransformPoint(modelView, qm::Vec3f(0.f, 0.f, 0.f));
+
+  drawCounts.clear();
+  drawOffsets.clear();
+  visibleNumber = 0;
+  visibleTrianglesNumber = 0;
+  unsigned int nextIndex = 0;
+  for (unsigned int m = 0 ; m < meshlets.size() ; m++) {
+    const Meshlet& meshlet = meshlets[m];
+
+    bool outside = false;
+    for (int p = 0 ; p < 6 && !outside ; p++)
+      outside = planes[p][0] * meshlet.center[0] + planes[p][1] * meshlet.center[1]
+              + planes[p][2] * meshlet.center[2] + planes[p][3] < -meshlet.radius;
+    if (outside)
+      continue;
+
+    // Back facing when the directions from the camera to the sphere, within
+    // asin(radius / distance) of the center direction, and the normals, within
+    // the cone angle of the axis, are all less than 90 degrees apart
+    float toCenter[3] = { meshlet.center[0] - camera[0], meshlet.center[1] - camera[1], meshlet.center[2] - camera[2] };
+    float distance = sqrt(toCenter[0] * toCenter[0] + toCenter[1] * toCenter[1] + toCenter[2] * toCenter[2]);
+    if (meshlet.coneCos > 0.f && distance > meshlet.radius) {
+      float sphereSin = meshlet.radius / distance;
+      float sphereCos = sqrt(1.f - sphereSin * sphereSin);
+      // cos(coneAngle + sphereAngle) > 0: the two angles sum under 90 degrees
+      if (meshlet.coneCos * sphereCos - meshlet.coneSin * sphereSin > 0.f) {
+        float axisDot = (toCenter[0] * meshlet.coneAxis[0] + toCenter[1] * meshlet.coneAxis[1] + toCenter[2] * meshlet.coneAxis[2]) / distance;
+        // dot > sin(coneAngle + sphereAngle)
+        if (axisDot > meshlet.coneSin * sphereCos + meshlet.coneCos * sphereSin)
+          continue;
+      }
+    }
+
+    visibleNumber++;
+    visibleTrianglesNumber += meshlet.trianglesNumber;
+    if (!drawCounts.empty() && meshlet.firstIndex == nextIndex) {
+      drawCounts.back() += meshlet.trianglesNumber * 3;
+    }
+    else {
+      drawCounts.push_back(meshlet.trianglesNumber * 3);
+      drawOffsets.push_back(reinterpret_cast<const GLvoid*>(meshlet.firstIndex * sizeof (unsigned int)));
+    }
+    nextIndex = meshlet.firstIndex + meshlet.trianglesNumber * 3;
+  }
+  return visibleNumber;
+}
+
+void MeshletMesh::draw() const {
+  if (drawCounts.empty())
+    return;
+  glBindVertexArray(VAO);
+  glMultiDrawElements(GL_TRIANGLES, &drawCounts[0], GL_UNSIGNED_INT, &drawOffsets[0], drawCounts.size());
+}
@@ -0,0 +1,92 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <vector>
+
+#include <vec3.h>
+#include <mat4.h>
+
+#include "object.h"
+
+
+namespace qgl {
+
+// Cluster of neighbouring triangles, culled as a whole
+struct Meshlet {
+  unsigned int firstIndex; // in the index buffer, 3 indices per triangle
+  unsigned int trianglesNumber;
+  unsigned int verticesNumber;
+  // Bounding sphere in object space
+  float center[3];
+  float radius;
+  // Every face normal is within the cone angle of the axis; the meshlet
+  // cannot be backface culled when the angle reaches 90 degrees
+  float coneAxis[3];
+  float coneSin, coneCos;
+};
+
+// Splits the triangles of an object into meshlets of at most 64 unique
+// vertices and 124 triangles, built greedily in the mesh order so that they
+// stay compact. The vertices of the object are deduplicated into an indexed
+// vertex buffer with the attribute layout of Object. Every frame, meshlets
+// outside the frustum or whose faces all point away from the camera are
+// dropped and the survivors are drawn with a single glMultiDrawElements.
+class MeshletMesh {
+
+  public:
+    static const unsigned int MAX_VERTICES = 64;
+    static const unsigned int MAX_TRIANGLES = 124;
+
+    MeshletMesh();
+    ~MeshletMesh();
+
+    // Needs the vertices of the object (Object::computeVertices)
+    bool build(const Object& object);
+    void createVAO();
+    void destroy();
+    // Size of the buffers of createVAO, 0 when they are not created
+    unsigned long long bufferBytes() const;
+
+    // Selects the meshlets to draw for this model and camera, returns their number
+    unsigned int cull(const qm::Mat4f& model, const qm::Mat4f& view, const qm::Mat4f& proj);
+    // Draws the meshlets selected by the last cull
+    void draw() const;
+
+    const std::vector<Meshlet>& getMeshlets() const { return meshlets; }
+    unsigned int meshletsNumber() const { return meshlets.size(); }
+    unsigned int verticesNumber() const { return positions.size() / 3; }
+    unsigned int trianglesNumber() const { return indices.size() / 3; }
+    unsigned int visibleMeshlets() const { return visibleNumber; }
+    unsigned int visibleTriangles() const { return visibleTrianglesNumber; }
+
+  private:
+    MeshletMesh(const MeshletMesh&);
+    MeshletMesh& operator=(const MeshletMesh&);
+
+    void addMeshlet(unsigned int firstTriangle, unsigned int trianglesNumber, unsigned int verticesNumber);
+
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> uvs;
+    std::vector<float> colors;
+    std::vector<unsigned int> indices;
+    std::vector<Meshlet> meshlets;
+
+    // Draw ranges of the survivors, adjacent meshlets are merged
+    std::vector<GLsizei> drawCounts;
+    std::vector<const GLvoid*> drawOffsets;
+    unsigned int visibleNumber;
+    unsigned int visibleTrianglesNumber;
+
+    unsigned int positionsVBO;
+    unsigned int normalsVBO;
+    unsigned int uvsVBO;
+    unsigned int colorsVBO;
+    unsigned int indicesIBO;
+    unsigned int VAO;
+
+};
+
+}
+
+#endif // MESHLETS_H
@@ -0,0 +1,344 @@
+#include "meshpager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "mappedfile.h"
+
+using namespace qgl;
+using namespace std;
+
+namespace {
+
+// Triangle bucketed in a grid cell, with 0-based vertex indices
+struct FaceRecord {
+  uint32_t cell;
+  uint32_t positions[3];
+  uint32_t normals[3];
+};
+
+static const uint32_t NO_NORMAL = 0xFFFFFFFF;
+static const unsigned int LINE_SIZE = 1 << 16;
+// Triangles buffered per cell before being written to the paged file
+static const unsigned int CELL_BUFFER_TRIANGLES = 64;
+static const unsigned int TRIANGLE_FLOATS = 3 * PAGED_MESH_VERTEX_FLOATS;
+
+// OBJ index, 1-based or negative from the end, to a 0-based index
+long long objIndex(long long index, unsigned long long count) {
+  return index < 0 ? (long long) count + index : index - 1;
+}
+
+// Reads the position and normal indices of the vertices of a face line,
+// returns false on a malformed face
+bool parseFace(const char* line, unsigned long long positionsCount, unsigned long long normalsCount,
+               vector<uint32_t>& positions, vector<uint32_t>& normals) {
+  positions.clear();
+  normals.clear();
+  const char* c = line + 2;
+  while (true) {
+    while (*c == ' ' || *c == '\t')
+      c++;
+    if (*c == '\0' || *c == '\n' || *c == '\r')
+      break;
+    char* end;
+    long long position = objIndex(strtoll(c, &end, 10), positionsCount);
+    if (end == c || position < 0 || (unsigned long long) position >= positionsCount)
+      return false;
+    c = end;
+    long long normal = -1;
+    if (*c == '/') {
+      c++;
+      // texture coordinates are not paged
+      strtoll(c, &end, 10);
+      c = end;
+      if (*c == '/') {
+        c++;
+        normal = objIndex(strtoll(c, &end, 10), normalsCount);
+        if (end == c || normal < 0 || (unsigned long long) normal >= normalsCount)
+          normal = -1;
+        c = end;
+      }
+    }
+    while (*c != '\0' && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r')
+      c++;
+    positions.push_back((uint32_t) position);
+    normals.push_back(normal < 0 ? NO_NORMAL : (uint32_t) normal);
+  }
+  return positions.size() >= 3;
+}
+
+void faceNormal(const float* p0, const float* p1, const float* p2, float* normal) {
+  float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+  float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+  normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+  normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+  normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+  float length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+  if (length > 0.f)
+    for (int i = 0 ; i < 3 ; i++)
+      normal[i] /= length;
+}
+
+}
+
+MeshPager::MeshPager() {
+  maxTrianglesPerPage = 1 << 16;
+  trianglesPerCell = 1 << 16;
+  positionsNumber = normalsNumber = trianglesNumber = 0;
+  gridResolution = 1;
+  pagesNumber = 0;
+  for (int i = 0 ; i < 3 ; i++)
+    boundsMin[i] = boundsMax[i] = 0.f;
+}
+
+bool MeshPager::build(const string& objFile, const string& pagedFile) {
+  size_t separator = pagedFile.find_last_of("/\\");
+  string folder = temporaryFolder;
+  if (folder.empty()) {
+    folder = separator == string::npos ? "" : pagedFile.substr(0, separator + 1);
+  }
+  else if (folder[folder.size() - 1] != '/' && folder[folder.size() - 1] != '\\') {
+    folder += "/";
+  }
+  // Named after the output file, so that other files of the folder are never overwritten
+  string prefix = folder + (separator == string::npos ? pagedFile : pagedFile.substr(separator + 1));
+  string positionsFile = prefix + ".positions.tmp";
+  string normalsFile = prefix + ".normals.tmp";
+  string facesFile = prefix + ".faces.tmp";
+
+  bool success = readVertices(objFile, positionsFile, normalsFile)
+              && bucketFaces(objFile, positionsFile, facesFile)
+              && writePages(positionsFile, normalsFile, facesFile, pagedFile);
+  remove(positionsFile.c_str());
+  remove(normalsFile.c_str());
+  remove(facesFile.c_str());
+  return success;
+}
+
+bool MeshPager::readVertices(const string& objFile, const string& positionsFile, const string& normalsFile) {
+  FILE* input = fopen(objFile.c_str(), "r");
+  FILE* positions = fopen(positionsFile.c_str(), "wb");
+  FILE* normals = fopen(normalsFile.c_str(), "wb");
+  if (input == NULL || positions == NULL || normals == NULL) {
+    cerr << "ERROR: could not open " << objFile << " or the temporary files" << endl;
+    if (input != NULL) fclose(input);
+    if (positions != NULL) fclose(positions);
+    if (normals != NULL) fclose(normals);
+    return false;
+  }
+
+  positionsNumber = normalsNumber = trianglesNumber = 0;
+  vector<char> line(LINE_SIZE);
+  vector<uint32_t> facePositions, faceNormals;
+  while (fgets(&line[0], LINE_SIZE, input) != NULL) {
+    const char* c = &line[0];
+    if (c[0] == 'v' && (c[1] == ' ' || c[1] == 'n')) {
+      bool normal = c[1] == 'n';
+      char* end = (char*) c + 2;
+      float v[3];
+      for (int i = 0 ; i < 3 ; i++)
+        v[i] = strtof(end, &end);
+      if (normal) {
+        fwrite(v, sizeof (float), 3, normals);
+        normalsNumber++;
+      }
+      else {
+        for (int i = 0 ; i < 3 ; i++) {
+          boundsMin[i] = (positionsNumber == 0 || v[i] < boundsMin[i]) ? v[i] : boundsMin[i];
+          boundsMax[i] = (positionsNumber == 0 || v[i] > boundsMax[i]) ? v[i] : boundsMax[i];
+        }
+        fwrite(v, sizeof (float), 3, positions);
+        positionsNumber++;
+      }
+    }
+    else if (c[0] == 'f' && c[1] == ' ') {
+      // Counted with the same parser as the bucketing pass
+      if (parseFace(c, positionsNumber, normalsNumber, facePositions, faceNormals))
+        trianglesNumber += facePositions.size() - 2;
+    }
+  }
+  fclose(input);
+  fclose(positions);
+  fclose(normals);
+
+  if (positionsNumber >= NO_NORMAL || normalsNumber >= NO_NORMAL) {
+    cerr << "ERROR: " << objFile << " has too many vertices" << endl;
+    return false;
+  }
+  if (trianglesNumber == 0) {
+    cerr << "ERROR: " << objFile << " has no faces" << endl;
+    return false;
+  }
+  double cells = (double) trianglesNumber / max(trianglesPerCell, 1u);
+  gridResolution = min(max((unsigned int) ceil(cbrt(cells)), 1u), 64u);
+  return true;
+}
+
+unsigned int MeshPager::cellOf(const float* p0, const float* p1, const float* p2) const {
+  unsigned int cell[3];
+  for (int i = 0 ; i < 3 ; i++) {
+    float extent = boundsMax[i] - boundsMin[i];
+    float centroid = (p0[i] + p1[i] + p2[i]) / 3.f;
+    float t = extent > 0.f ? (centroid - boundsMin[i]) / extent : 0.f;
+    cell[i] = min((unsigned int) max(t * gridResolution, 0.f), gridResolution - 1);
+  }
+  return (cell[2] * gridResolution + cell[1]) * gridResolution + cell[0];
+}
+
+bool MeshPager::bucketFaces(const string& objFile, const string& positionsFile, const string& facesFile) {
+  MappedFile positions;
+  if (!positions.open(positionsFile))
+    return false;
+  const float* positionsData = (const float*) positions.getData();
+
+  FILE* input = fopen(objFile.c_str(), "r");
+  FILE* faces = fopen(facesFile.c_str(), "wb");
+  if (input == NULL || faces == NULL) {
+    cerr << "ERROR: could not open " << objFile << " or " << facesFile << endl;
+    if (input != NULL) fclose(input);
+    if (faces != NULL) fclose(faces);
+    return false;
+  }
+
+  cellTriangles.assign(gridResolution * gridResolution * gridResolution, 0);
+  // Indices are relative to the vertices read so far
+  unsigned long long positionsCount = 0, normalsCount = 0;
+  vector<char> line(LINE_SIZE);
+  vector<uint32_t> facePositions, faceNormals;
+  while (fgets(&line[0], LINE_SIZE, input) != NULL) {
+    const char* c = &line[0];
+    if (c[0] == 'v' && c[1] == ' ') {
+      positionsCount++;
+    }
+    else if (c[0] == 'v' && c[1] == 'n') {
+      normalsCount++;
+    }
+    else if (c[0] == 'f' && c[1] == ' ' && parseFace(c, positionsCount, normalsCount, facePositions, faceNormals)) {
+      // Polygons as triangle fans
+      for (unsigned int i = 1 ; i + 1 < facePositions.size() ; i++) {
+        FaceRecord record;
+        unsigned int corners[3] = { 0, i, i + 1 };
+        for (int j = 0 ; j < 3 ; j++) {
+          record.positions[j] = facePositions[corners[j]];
+          record.normals[j] = faceNormals[corners[j]];
+        }
+        record.cell = cellOf(positionsData + record.positions[0] * 3ull, positionsData + record.positions[1] * 3ull,
+                             positionsData + record.positions[2] * 3ull);
+        cellTriangles[record.cell]++;
+        fwrite(&record, sizeof (record), 1, faces);
+      }
+    }
+  }
+  fclose(input);
+  fclose(faces);
+  return true;
+}
+
+bool MeshPager::writePages(const string& positionsFile, const string& normalsFile, const string& facesFile,
+                           const string& pagedFile) {
+  MappedFile positions, normals;
+  if (!positions.open(positionsFile) || (normalsNumber > 0 && !normals.open(normalsFile)))
+    return false;
+  const float* positionsData = (const float*) positions.getData();
+  const float* normalsData = (const float*) normals.getData();
+
+  // Page table: the pages of a cell are consecutive, so are their data
+  unsigned int cellsNumber = cellTriangles.size();
+  vector<unsigned int> cellFirstPage(cellsNumber, 0);
+  vector<PagedMeshPage> pages;
+  for (unsigned int c = 0 ; c < cellsNumber ; c++) {
+    cellFirstPage[c] = pages.size();
+    for (uint64_t first = 0 ; first < cellTriangles[c] ; first += maxTrianglesPerPage) {
+      PagedMeshPage page;
+      memset(&page, 0, sizeof (page));
+      page.trianglesNumber = (uint32_t) min<uint64_t>(maxTrianglesPerPage, cellTriangles[c] - first);
+      pages.push_back(page);
+    }
+  }
+  pagesNumber = pages.size();
+  uint64_t offset = sizeof (PagedMeshHeader) + pages.size() * sizeof (PagedMeshPage);
+  for (unsigned int p = 0 ; p < pages.size() ; p++) {
+    pages[p].offset = offset;
+    offset += (uint64_t) pages[p].trianglesNumber * TRIANGLE_FLOATS * sizeof (float);
+  }
+
+  ofstream output(pagedFile.c_str(), ios::binary | ios::trunc);
+  ifstream faces(facesFile.c_str(), ios::binary);
+  if (!output || !faces) {
+    cerr << "ERROR: could not open " << pagedFile << " or " << facesFile << endl;
+    return false;
+  }
+
+  // Scatter the triangles to their cell through small write buffers
+  vector<uint64_t> cellWritten(cellsNumber, 0);
+  vector<uint64_t> cellFlushed(cellsNumber, 0);
+  vector<vector<float> > cellBuffers(cellsNumber);
+  vector<FaceRecord> records(4096);
+  while (faces) {
+    faces.read((char*) &records[0], records.size() * sizeof (FaceRecord));
+    unsigned int recordsNumber = faces.gcount() / sizeof (FaceRecord);
+    for (unsigned int r = 0 ; r < recordsNumber ; r++) {
+      const FaceRecord& record = records[r];
+      unsigned int cell = record.cell;
+      vector<float>& buffer = cellBuffers[cell];
+      if (buffer.capacity() == 0)
+        buffer.reserve(CELL_BUFFER_TRIANGLES * TRIANGLE_FLOATS);
+
+      const float* p[3];
+      for (int j = 0 ; j < 3 ; j++)
+        p[j] = positionsData + record.positions[j] * 3ull;
+      float flatNormal[3];
+      faceNormal(p[0], p[1], p[2], flatNormal);
+
+      PagedMeshPage& page = pages[cellFirstPage[cell] + cellWritten[cell] / maxTrianglesPerPage];
+      bool firstOfPage = cellWritten[cell] % maxTrianglesPerPage == 0;
+      for (int j = 0 ; j < 3 ; j++) {
+        const float* n = record.normals[j] == NO_NORMAL ? flatNormal : normalsData + record.normals[j] * 3ull;
+        buffer.insert(buffer.end(), p[j], p[j] + 3);
+        buffer.insert(buffer.end(), n, n + 3);
+        for (int k = 0 ; k < 3 ; k++) {
+          page.boundsMin[k] = (firstOfPage && j == 0) || p[j][k] < page.boundsMin[k] ? p[j][k] : page.boundsMin[k];
+          page.boundsMax[k] = (firstOfPage && j == 0) || p[j][k] > page.boundsMax[k] ? p[j][k] : page.boundsMax[k];
+        }
+      }
+      cellWritten[cell]++;
+
+      if (buffer.size() == CELL_BUFFER_TRIANGLES * TRIANGLE_FLOATS) {
+        output.seekp(pages[cellFirstPage[cell]].offset + cellFlushed[cell] * sizeof (float));
+        output.write((const char*) &buffer[0], buffer.size() * sizeof (float));
+        cellFlushed[cell] += buffer.size();
+        buffer.clear();
+      }
+    }
+  }
+  for (unsigned int c = 0 ; c < cellsNumber ; c++) {
+    if (cellBuffers[c].empty())
+      continue;
+    output.seekp(pages[cellFirstPage[c]].offset + cellFlushed[c] * sizeof (float));
+    output.write((const char*) &cellBuffers[c][0], cellBuffers[c].size() * sizeof (float));
+  }
+
+  PagedMeshHeader header;
+  memset(&header, 0, sizeof (header));
+  memcpy(header.magic, "QGLPAGES", 8);
+  header.version = PAGED_MESH_VERSION;
+  header.pagesNumber = pages.size();
+  header.vertexFloats = PAGED_MESH_VERTEX_FLOATS;
+  for (int i = 0 ; i < 3 ; i++) {
+    header.boundsMin[i] = boundsMin[i];
+    header.boundsMax[i] = boundsMax[i];
+  }
+  output.seekp(0);
+  output.write((const char*) &header, sizeof (header));
+  output.write((const char*) &pages[0], pages.size() * sizeof (PagedMeshPage));
+  if (!output) {
+    cerr << "ERROR: could not write " << pagedFile << endl;
+    return false;
+  }
+  return true;
+}
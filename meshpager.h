@@ -0,0 +1,83 @@
+#ifndef MESHPAGER_H
+#define MESHPAGER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+namespace qgl {
+
+// Paged mesh file: a header, the page table, then the pages. Each page is a
+// triangle soup of interleaved vertices (position and normal, 6 floats).
+struct PagedMeshHeader {
+  char magic[8]; // "QGLPAGES"
+  uint32_t version;
+  uint32_t pagesNumber;
+  uint32_t vertexFloats;
+  uint32_t reserved;
+  float boundsMin[3];
+  float boundsMax[3];
+};
+
+struct PagedMeshPage {
+  uint64_t offset; // from the beginning of the file
+  uint32_t trianglesNumber;
+  uint32_t reserved;
+  float boundsMin[3];
+  float boundsMax[3];
+};
+
+static const uint32_t PAGED_MESH_VERSION = 1;
+static const uint32_t PAGED_MESH_VERTEX_FLOATS = 6;
+
+// Offline partitioning of an OBJ mesh into spatial pages, without ever
+// holding the mesh in memory: vertices are first written to temporary files
+// that are memory mapped, triangles are then bucketed in a uniform grid sized
+// for the triangles count and written cell by cell. Crowded cells are split
+// into several pages of at most maxTrianglesPerPage triangles. Faces without
+// normals get their face normal.
+class MeshPager {
+
+  public:
+    MeshPager();
+
+    // At least 1
+    void setMaxTrianglesPerPage(unsigned int triangles) { maxTrianglesPerPage = triangles > 0 ? triangles : 1; }
+    // Average triangles per grid cell, sets the grid resolution
+    void setTrianglesPerCell(unsigned int triangles) { trianglesPerCell = triangles > 0 ? triangles : 1; }
+    // Where the temporary files go, the output folder by default. They are named
+    // after the output file.
+    void setTemporaryFolder(const std::string& folder) { temporaryFolder = folder; }
+
+    bool build(const std::string& objFile, const std::string& pagedFile);
+
+    unsigned long long getTrianglesNumber() const { return trianglesNumber; }
+    unsigned int getPagesNumber() const { return pagesNumber; }
+    unsigned int getGridResolution() const { return gridResolution; }
+
+  private:
+    bool readVertices(const std::string& objFile, const std::string& positionsFile, const std::string& normalsFile);
+    bool bucketFaces(const std::string& objFile, const std::string& positionsFile, const std::string& facesFile);
+    bool writePages(const std::string& positionsFile, const std::string& normalsFile, const std::string& facesFile,
+                    const std::string& pagedFile);
+    unsigned int cellOf(const float* p0, const float* p1, const float* p2) const;
+
+    unsigned int maxTrianglesPerPage;
+    unsigned int trianglesPerCell;
+    std::string temporaryFolder;
+
+    unsigned long long positionsNumber;
+    unsigned long long normalsNumber;
+    unsigned long long trianglesNumber;
+    float boundsMin[3];
+    float boundsMax[3];
+    unsigned int gridResolution;
+    std::vector<uint64_t> cellTriangles;
+    unsigned int pagesNumber;
+
+};
+
+}
+
+#endif // MESHPAGER_H
@@ -0,0 +1,359 @@
+#include "meshprocessor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE__
+  #include <xmmintrin.h>
+#endif
+
+using namespace qgl;
+using namespace std;
+
+// Smaller ranges are not worth a job
+static const unsigned int MIN_ITEMS_PER_JOB = 4096;
+
+static inline void subtract(const float* a, const float* b, float* result) {
+  result[0] = a[0] - b[0];
+  result[1] = a[1] - b[1];
+  result[2] = a[2] - b[2];
+}
+
+static inline void cross(const float* a, const float* b, float* result) {
+  result[0] = a[1] * b[2] - a[2] * b[1];
+  result[1] = a[2] * b[0] - a[0] * b[2];
+  result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline float dot(const float* a, const float* b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void normalize(float* v) {
+  float length = sqrt(dot(v, v));
+  if (length > 0.f) {
+    v[0] /= length;
+    v[1] /= length;
+    v[2] /= length;
+  }
+}
+
+// Angle of the triangle p at its vertex v
+static inline float cornerAngle(const float* const* p, int v) {
+  float a[3], b[3];
+  subtract(p[(v + 1) % 3], p[v], a);
+  subtract(p[(v + 2) % 3], p[v], b);
+  float lengths = sqrt(dot(a, a) * dot(b, b));
+  return lengths > 0.f ? acos(max(-1.f, min(1.f, dot(a, b) / lengths))) : 0.f;
+}
+
+// Sums the tangents and bitangents of the triangles of the corners, weighted by the
+// corner angles, see faceTangents
+static inline void sumTangentVectors(const float* vectors, const float* angles, const unsigned int* corners,
+                                     unsigned int count, float* result) {
+#ifdef __SSE__
+  __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+  for (unsigned int i = 0 ; i < count ; i++) {
+    const float* v = vectors + (corners[i] / 3) * 8;
+    __m128 angle = _mm_set1_ps(angles[corners[i]]);
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(v), angle));
+    sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(v + 4), angle));
+  }
+  _mm_storeu_ps(result, sum0);
+  _mm_storeu_ps(result + 4, sum1);
+#else
+  memset(result, 0, 8 * sizeof (float));
+  for (unsigned int i = 0 ; i < count ; i++) {
+    const float* v = vectors + (corners[i] / 3) * 8;
+    float angle = angles[corners[i]];
+    for (unsigned int j = 0 ; j < 8 ; j++)
+      result[j] += v[j] * angle;
+  }
+#endif
+}
+
+// Gram-Schmidt of the summed tangent against the vertex normal, w from the bitangent
+static inline void writeTangent(const float* normal, const float* sums, float* tangent) {
+  float d = dot(normal, sums);
+  for (int j = 0 ; j < 3 ; j++)
+    tangent[j] = sums[j] - normal[j] * d;
+  if (dot(tangent, tangent) < 1e-20f) {
+    // no texture space here, any direction orthogonal to the normal
+    float axis[3] = { 0.f, 0.f, 0.f };
+    axis[fabs(normal[0]) < 0.9f ? 0 : 1] = 1.f;
+    cross(normal, axis, tangent);
+  }
+  normalize(tangent);
+  float bitangent[3];
+  cross(normal, tangent, bitangent);
+  tangent[3] = dot(bitangent, sums + 4) < 0.f ? -1.f : 1.f;
+}
+
+// Sums the vectors of size 4 (or 8) at vectors + 4 * index of the given indices
+static inline void sumVectors(const float* vectors, const unsigned int* indices, unsigned int count,
+                              unsigned int divisor, unsigned int size, float* result) {
+#ifdef __SSE__
+  __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+  for (unsigned int i = 0 ; i < count ; i++) {
+    const float* v = vectors + (indices[i] / divisor) * size;
+    sum0 = _mm_add_ps(sum0, _mm_loadu_ps(v));
+    if (size == 8)
+      sum1 = _mm_add_ps(sum1, _mm_loadu_ps(v + 4));
+  }
+  _mm_storeu_ps(result, sum0);
+  if (size == 8)
+    _mm_storeu_ps(result + 4, sum1);
+#else
+  memset(result, 0, size * sizeof (float));
+  for (unsigned int i = 0 ; i < count ; i++) {
+    const float* v = vectors + (indices[i] / divisor) * size;
+    for (unsigned int j = 0 ; j < size ; j++)
+      result[j] += v[j];
+  }
+#endif
+}
+
+MeshProcessor::MeshProcessor(unsigned int threadsNumber) {
+  jobs = ownedJobs = NULL;
+  setThreadsNumber(threadsNumber);
+}
+
+MeshProcessor::MeshProcessor(JobSystem& jobSystem) {
+  jobs = &jobSystem;
+  ownedJobs = NULL;
+}
+
+MeshProcessor::~MeshProcessor() {
+  delete ownedJobs;
+}
+
+void MeshProcessor::setThreadsNumber(unsigned int threadsNumber) {
+  delete ownedJobs;
+  jobs = ownedJobs = new JobSystem(threadsNumber);
+}
+
+void MeshProcessor::computeVertices(const IndexedMesh& mesh, float* positions, float* normals, float* uvs,
+                                    float* tangents) const {
+  if (mesh.trianglesNumber() == 0)
+    return;
+  unsigned int trianglesNumber = mesh.trianglesNumber();
+  unsigned int positionsNumber = mesh.positionsNumber();
+  bool generateNormals = normals != NULL && !mesh.hasNormals();
+  bool generateTangents = tangents != NULL && normals != NULL && mesh.hasUVs();
+
+  // One block for all the temporaries: corner lists, then the vectors of each step
+  size_t scratchBytes = 0;
+  if (generateNormals || generateTangents)
+    scratchBytes += ((size_t) positionsNumber * 2 + 1 + (size_t) trianglesNumber * 3) * sizeof (unsigned int)
+                    + (size_t) trianglesNumber * 3 * sizeof (float);
+  if (generateNormals)
+    scratchBytes += ((size_t) trianglesNumber * 12 + (size_t) positionsNumber * 4) * sizeof (float);
+  if (generateTangents)
+    scratchBytes += (size_t) trianglesNumber * 8 * sizeof (float);
+  Arena scratch(scratchBytes + 8 * Arena::DEFAULT_ALIGNMENT);
+
+  Work work(&scratch);
+  work.mesh = &mesh;
+  work.positions = positions;
+  work.normals = normals;
+  work.uvs = mesh.hasUVs() ? uvs : NULL;
+  work.tangents = tangents;
+  parallel(&MeshProcessor::expand, work, trianglesNumber);
+
+  if (generateNormals || generateTangents) {
+    buildCorners(work);
+    work.cornerAngles.resize(trianglesNumber * 3);
+    parallel(&MeshProcessor::computeCornerAngles, work, trianglesNumber);
+  }
+
+  if (generateNormals) {
+    work.cornerVectors.resize(trianglesNumber * 3 * 4);
+    parallel(&MeshProcessor::weightFaceNormals, work, trianglesNumber);
+    work.positionVectors.resize(positionsNumber * 4);
+    parallel(&MeshProcessor::sumNormals, work, positionsNumber);
+    parallel(&MeshProcessor::writeNormals, work, trianglesNumber);
+  }
+
+  if (generateTangents) {
+    work.cornerVectors.resize(trianglesNumber * 8);
+    parallel(&MeshProcessor::faceTangents, work, trianglesNumber);
+    parallel(&MeshProcessor::sumTangents, work, positionsNumber);
+  }
+}
+
+void MeshProcessor::parallel(Step step, Work& work, unsigned int count) const {
+  // A few ranges per thread so that the faster ones steal from the others
+  unsigned int grainSize = max(count / (jobs->getThreadsNumber() * 4), MIN_ITEMS_PER_JOB);
+  jobs->parallelFor(count, grainSize, [this, step, &work](unsigned int first, unsigned int last) {
+    (this->*step)(work, first, last);
+  });
+}
+
+// Counting sort of the triangle vertices by position
+void MeshProcessor::buildCorners(Work& work) const {
+  const vector<int>& indices = work.mesh->indices;
+  unsigned int cornersNumber = indices.size() / 3;
+  work.cornerOffsets.assign(work.mesh->positionsNumber() + 1, 0);
+  for (unsigned int c = 0 ; c < cornersNumber ; c++)
+    work.cornerOffsets[indices[c * 3] + 1]++;
+  for (unsigned int p = 0 ; p + 1 < work.cornerOffsets.size() ; p++)
+    work.cornerOffsets[p + 1] += work.cornerOffsets[p];
+  work.corners.resize(cornersNumber);
+  ArenaVector<unsigned int> next(work.cornerOffsets.begin(), work.cornerOffsets.end() - 1, work.cornerOffsets.get_allocator());
+  for (unsigned int c = 0 ; c < cornersNumber ; c++)
+    work.corners[next[indices[c * 3]]++] = c;
+}
+
+void MeshProcessor::expand(Work& work, unsigned int first, unsigned int last) const {
+  const IndexedMesh& mesh = *work.mesh;
+  bool copyNormals = work.normals != NULL && mesh.hasNormals();
+  for (unsigned int t = first ; t < last ; t++) {
+    const int* indices = &mesh.indices[t * 9];
+    bool faceNormalDone = false;
+    float faceNormal[3];
+    for (int v = 0 ; v < 3 ; v++) {
+      unsigned int corner = t * 3 + v;
+      memcpy(work.positions + corner * 3, &mesh.positions[indices[v * 3] * 3], 3 * sizeof (float));
+      if (copyNormals) {
+        if (indices[v * 3 + 1] >= 0) {
+          memcpy(work.normals + corner * 3, &mesh.normals[indices[v * 3 + 1] * 3], 3 * sizeof (float));
+        }
+        else {
+          if (!faceNormalDone) {
+            float e1[3], e2[3];
+            subtract(&mesh.positions[indices[3] * 3], &mesh.positions[indices[0] * 3], e1);
+            subtract(&mesh.positions[indices[6] * 3], &mesh.positions[indices[0] * 3], e2);
+            cross(e1, e2, faceNormal);
+            normalize(faceNormal);
+            faceNormalDone = true;
+          }
+          memcpy(work.normals + corner * 3, faceNormal, 3 * sizeof (float));
+        }
+      }
+      if (work.uvs != NULL) {
+        if (indices[v * 3 + 2] >= 0) {
+          memcpy(work.uvs + corner * 2, &mesh.uvs[indices[v * 3 + 2] * 2], 2 * sizeof (float));
+        }
+        else {
+          work.uvs[corner * 2] = 0.f;
+          work.uvs[corner * 2 + 1] = 0.f;
+        }
+      }
+    }
+  }
+}
+
+void MeshProcessor::computeCornerAngles(Work& work, unsigned int first, unsigned int last) const {
+  const IndexedMesh& mesh = *work.mesh;
+  for (unsigned int t = first ; t < last ; t++) {
+    const float* p[3];
+    for (int v = 0 ; v < 3 ; v++)
+      p[v] = &mesh.positions[mesh.indices[t * 9 + v * 3] * 3];
+    for (int v = 0 ; v < 3 ; v++)
+      work.cornerAngles[t * 3 + v] = cornerAngle(p, v);
+  }
+}
+
+// The cross product length is twice the triangle area
+void MeshProcessor::weightFaceNormals(Work& work, unsigned int first, unsigned int last) const {
+  const IndexedMesh& mesh = *work.mesh;
+  for (unsigned int t = first ; t < last ; t++) {
+    const float* p[3];
+    for (int v = 0 ; v < 3 ; v++)
+      p[v] = &mesh.positions[mesh.indices[t * 9 + v * 3] * 3];
+    float e1[3], e2[3], normal[3];
+    subtract(p[1], p[0], e1);
+    subtract(p[2], p[0], e2);
+    cross(e1, e2, normal);
+    for (int v = 0 ; v < 3 ; v++) {
+      float angle = work.cornerAngles[t * 3 + v];
+      float* corner = &work.cornerVectors[(t * 3 + v) * 4];
+      corner[0] = normal[0] * angle;
+      corner[1] = normal[1] * angle;
+      corner[2] = normal[2] * angle;
+      corner[3] = 0.f;
+    }
+  }
+}
+
+void MeshProcessor::sumNormals(Work& work, unsigned int first, unsigned int last) const {
+  for (unsigned int p = first ; p < last ; p++) {
+    float* normal = &work.positionVectors[p * 4];
+    unsigned int begin = work.cornerOffsets[p];
+    sumVectors(&work.cornerVectors[0], &work.corners[0] + begin, work.cornerOffsets[p + 1] - begin, 1, 4, normal);
+    normalize(normal);
+  }
+}
+
+void MeshProcessor::writeNormals(Work& work, unsigned int first, unsigned int last) const {
+  const vector<int>& indices = work.mesh->indices;
+  for (unsigned int c = first * 3 ; c < last * 3 ; c++)
+    memcpy(work.normals + c * 3, &work.positionVectors[indices[c * 3] * 4], 3 * sizeof (float));
+}
+
+// Texture space directions of each triangle, in 8 floats: tangent, handedness of
+// the uvs (-1 when mirrored), bitangent and 0
+void MeshProcessor::faceTangents(Work& work, unsigned int first, unsigned int last) const {
+  const IndexedMesh& mesh = *work.mesh;
+  for (unsigned int t = first ; t < last ; t++) {
+    const int* indices = &mesh.indices[t * 9];
+    float* directions = &work.cornerVectors[t * 8];
+    memset(directions, 0, 8 * sizeof (float));
+    directions[3] = 1.f;
+    if (indices[2] < 0 || indices[5] < 0 || indices[8] < 0)
+      continue;
+    const float* p0 = &mesh.positions[indices[0] * 3];
+    const float* uv0 = &mesh.uvs[indices[2] * 2];
+    const float* uv1 = &mesh.uvs[indices[5] * 2];
+    const float* uv2 = &mesh.uvs[indices[8] * 2];
+    float e1[3], e2[3];
+    subtract(&mesh.positions[indices[3] * 3], p0, e1);
+    subtract(&mesh.positions[indices[6] * 3], p0, e2);
+    float du1 = uv1[0] - uv0[0], dv1 = uv1[1] - uv0[1];
+    float du2 = uv2[0] - uv0[0], dv2 = uv2[1] - uv0[1];
+    float determinant = du1 * dv2 - du2 * dv1;
+    if (fabs(determinant) < 1e-12f)
+      continue;
+    float r = 1.f / determinant;
+    for (int j = 0 ; j < 3 ; j++) {
+      directions[j] = (e1[j] * dv2 - e2[j] * dv1) * r;
+      directions[4 + j] = (e2[j] * du1 - e1[j] * du2) * r;
+    }
+    if (determinant < 0.f)
+      directions[3] = -1.f;
+  }
+}
+
+// The corners of each position are sorted by uv and handedness, then each run sharing
+// both is summed and written to every one of its corners. A uv seam splits the sum, as
+// it splits the vertex, and so does a mirrored island even where its uvs meet the other.
+void MeshProcessor::sumTangents(Work& work, unsigned int first, unsigned int last) const {
+  const int* indices = &work.mesh->indices[0];
+  const float* vectors = &work.cornerVectors[0];
+  auto before = [indices, vectors](unsigned int a, unsigned int b) {
+    if (indices[a * 3 + 2] != indices[b * 3 + 2])
+      return indices[a * 3 + 2] < indices[b * 3 + 2];
+    return vectors[(a / 3) * 8 + 3] < vectors[(b / 3) * 8 + 3];
+  };
+  for (unsigned int p = first ; p < last ; p++) {
+    unsigned int* begin = &work.corners[0] + work.cornerOffsets[p];
+    unsigned int* end = &work.corners[0] + work.cornerOffsets[p + 1];
+    // Most positions are inside an island: their corners are a single run already
+    unsigned int* unsorted = begin + 1;
+    while (unsorted < end && !before(*begin, *unsorted) && !before(*unsorted, *begin))
+      unsorted++;
+    if (unsorted < end)
+      sort(begin, end, before);
+    for (unsigned int* run = begin ; run < end ; ) {
+      unsigned int* runEnd = run + 1;
+      while (runEnd < end && !before(*run, *runEnd))
+        runEnd++;
+      float sums[8];
+      sumTangentVectors(vectors, &work.cornerAngles[0], run, runEnd - run, sums);
+      for (unsigned int* corner = run ; corner < runEnd ; corner++)
+        writeTangent(work.normals + *corner * 3, sums, work.tangents + *corner * 4);
+      run = runEnd;
+    }
+  }
+}
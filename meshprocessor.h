@@ -0,0 +1,109 @@
+#ifndef MESHPROCESSOR_H
+#define MESHPROCESSOR_H
+
+#include <cstddef>
+#include <vector>
+
+#include "allocators.h"
+#include "jobsystem.h"
+
+
+namespace qgl {
+
+// Mesh as read from the file: shared positions, normals and texture
+// coordinates, and for each triangle vertex the index of each one. Colors,
+// when the file has some, follow the positions.
+struct IndexedMesh {
+  std::vector<float> positions; // 3 floats each
+  std::vector<float> normals; // 3 floats each
+  std::vector<float> uvs; // 2 floats each
+  std::vector<float> colors; // 3 floats per position, or none
+  // 9 per triangle: position, normal and uv index of each vertex, -1 when missing
+  std::vector<int> indices;
+
+  unsigned int trianglesNumber() const { return indices.size() / 9; }
+  unsigned int positionsNumber() const { return positions.size() / 3; }
+  bool hasNormals() const { return !normals.empty(); }
+  bool hasUVs() const { return !uvs.empty(); }
+  bool hasColors() const { return !colors.empty(); }
+  void clear() {
+    positions.clear();
+    normals.clear();
+    uvs.clear();
+    colors.clear();
+    indices.clear();
+  }
+};
+
+// Expands indexed meshes into vertex arrays with jobs, each one taking a
+// range of triangles. Meshes without normals get smooth normals,
+// the sum of the face normals around each position weighted by the triangle
+// area and the corner angle. Tangents for normal mapping are summed the same
+// way over the triangle vertices sharing the position and the uv, so that
+// mirrored islands meeting at a seam do not cancel, and orthogonalized
+// against the vertex normal, their w is the handedness of the texture space.
+// The sums around each position use SSE.
+class MeshProcessor {
+
+  public:
+    // Runs on its own job system, 0 threads uses the hardware concurrency
+    MeshProcessor(unsigned int threadsNumber = 0);
+    // Runs on a shared job system, from one of its jobs as well
+    MeshProcessor(JobSystem& jobSystem);
+    ~MeshProcessor();
+
+    void setThreadsNumber(unsigned int threadsNumber);
+    unsigned int getThreadsNumber() const { return jobs->getThreadsNumber(); }
+
+    // Arrays of 3, 3, 2 and 4 floats per triangle vertex. Normals are read from the mesh
+    // or generated, uvs are only written when the mesh has some, tangents when not NULL
+    // and the mesh has uvs. Missing normal or uv indices give the face normal and (0, 0).
+    void computeVertices(const IndexedMesh& mesh, float* positions, float* normals, float* uvs,
+                         float* tangents = NULL) const;
+
+  private:
+    MeshProcessor(const MeshProcessor&);
+    MeshProcessor& operator=(const MeshProcessor&);
+
+    // Inputs and outputs of the steps, shared by the threads. The arrays are
+    // taken from one arena released when the vertices are computed.
+    struct Work {
+      Work(Arena* scratch) : cornerOffsets(scratch), corners(scratch), cornerAngles(scratch), cornerVectors(scratch),
+                             positionVectors(scratch) {}
+
+      const IndexedMesh* mesh;
+      float* positions;
+      float* normals;
+      float* uvs;
+      float* tangents;
+      // Triangle vertices around each position: corners[cornerOffsets[p]] to corners[cornerOffsets[p + 1]]
+      ArenaVector<unsigned int> cornerOffsets;
+      ArenaVector<unsigned int> corners;
+      // Angle of each triangle vertex, the weight of the normals and tangents it adds
+      ArenaVector<float> cornerAngles;
+      // 4 floats per triangle vertex, then per position. The tangents and bitangents
+      // take 8 floats per triangle, summed per position and uv.
+      ArenaVector<float> cornerVectors;
+      ArenaVector<float> positionVectors;
+    };
+    typedef void (MeshProcessor::*Step)(Work&, unsigned int, unsigned int) const;
+
+    void parallel(Step step, Work& work, unsigned int count) const;
+    void buildCorners(Work& work) const;
+    void computeCornerAngles(Work& work, unsigned int first, unsigned int last) const;
+
+    void expand(Work& work, unsigned int first, unsigned int last) const;
+    void weightFaceNormals(Work& work, unsigned int first, unsigned int last) const;
+    void sumNormals(Work& work, unsigned int first, unsigned int last) const;
+    void writeNormals(Work& work, unsigned int first, unsigned int last) const;
+    void faceTangents(Work& work, unsigned int first, unsigned int last) const;
+    void sumTangents(Work& work, unsigned int first, unsigned int last) const;
+
+    JobSystem* jobs;
+    JobSystem* ownedJobs;
+
+};
+
+}
+
+#endif // MESHPROCESSOR_H
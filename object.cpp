@@ -1,30 +1,23 @@
 #include "object.h"
+
+#include <cstring>
+
 #include "objloader.h"
 
 using namespace qgl;
 using namespace std;
 
-Object::Object() {
-  positions = NULL;
-  normals = NULL;
-  uvs = NULL;
+Object::Object() : material(make_shared<Material>()) {
   withNormals = false;
   withUVs = false;
-  positionsVBO = 0;
-  normalsVBO = 0;
-  uvsVBO = 0;
-  VAO = 0;
+  withTangents = false;
+  withColors = false;
   modelMatrixChanged = true;
+  revision = 0;
   rotation.init(0.f, 0.f, 1.0f, 0.f);
   scale = qm::Vec3f(1.f, 1.f, 1.f);
 }
 
-Object::~Object() {
-  delete[] positions;
-  delete[] normals;
-  delete[] uvs;
-}
-
 bool Object::loadOBJ(const string& geometryFile, const string& materialFile) {
   OBJLoader objLoader;
   bool loadMaterial = materialFile.compare("") != 0;
@@ -47,71 +40,224 @@ bool Object::loadOBJ(const string& geometryFile, const string& materialFile) {
 }
 
 void Object::setMesh(q3ds::Mesh& newMesh) {
-  mesh = newMesh;
+  mesh.clear();
+  swap(mesh, newMesh);
+  indexedMesh.clear();
   withNormals = mesh.normalsNumber() > 0;
   withUVs = mesh.uvsNumber() > 0;
+  withColors = false;
+  revision++;
+}
+
+void Object::setMesh(IndexedMesh& newMesh) {
+  indexedMesh.clear();
+  swap(indexedMesh, newMesh);
+  mesh.clear();
+  withNormals = true;
+  withUVs = indexedMesh.hasUVs();
+  withColors = indexedMesh.hasColors();
+  revision++;
 }
 
-void Object::setMaterial(Material& newMaterial) {
+void Object::setVertices(vector<float>& newPositions, vector<float>& newNormals,
+                         vector<float>& newUVs, vector<float>& newColors) {
+  mesh.clear();
+  indexedMesh.clear();
+  positions.swap(newPositions);
+  normals.swap(newNormals);
+  uvs.swap(newUVs);
+  colors.swap(newColors);
+  vector<float>().swap(tangents);
+  withNormals = !normals.empty();
+  withUVs = !uvs.empty();
+  withTangents = false;
+  withColors = !colors.empty();
+  computeBounds();
+  revision++;
+}
+
+void Object::setMaterial(const shared_ptr<Material>& newMaterial) {
   material = newMaterial;
+  revision++;
+}
+
+void Object::setMaterial(Material&& newMaterial) {
+  material = make_shared<Material>(move(newMaterial));
+  revision++;
+}
+
+unsigned int Object::shaderFeatures(unsigned int lightsNumber) const {
+  unsigned int features = lightsFeature(lightsNumber);
+  if (withNormals)
+    features |= FEATURE_NORMALS;
+  // Texture maps cannot be sampled without texture coordinates
+  if (withUVs)
+    features |= FEATURE_UVS | material->shaderFeatures();
+  if (withColors)
+    features |= FEATURE_COLORS;
+  return features;
 }
 
-void Object::computeVertices() {
-  cout << "Compute object vertices" << endl;
+void Object::computeVertices(bool withTangents, JobSystem* jobSystem) {
+  // Vertices given directly, nothing to expand
+  if (indexedMesh.trianglesNumber() == 0 && mesh.trianglesNumber() == 0 && !positions.empty())
+    return;
 
-  delete[] positions;
-  delete[] normals;
-  delete[] uvs;
+  this->withTangents = withTangents && withUVs && indexedMesh.trianglesNumber() > 0;
 
-  positions = new float[mesh.trianglesNumber() * 3 * 3];
+  // Released rather than cleared, a smaller mesh would keep the old capacity
+  vector<float>().swap(positions);
+  vector<float>().swap(normals);
+  vector<float>().swap(uvs);
+  vector<float>().swap(tangents);
+  vector<float>().swap(colors);
+  positions.resize(trianglesNumber() * 3 * 3);
   if (withNormals)
-    normals = new float[mesh.trianglesNumber() * 3 * 3];
+    normals.resize(trianglesNumber() * 3 * 3);
   if (withUVs)
-    uvs = new float[mesh.trianglesNumber() * 3 * 2];
+    uvs.resize(trianglesNumber() * 3 * 2);
+  if (this->withTangents)
+    tangents.resize(trianglesNumber() * 3 * 4);
+
+  float* positionsData = positions.empty() ? NULL : &positions[0];
+  float* normalsData = normals.empty() ? NULL : &normals[0];
+  float* uvsData = uvs.empty() ? NULL : &uvs[0];
+  float* tangentsData = tangents.empty() ? NULL : &tangents[0];
+  if (indexedMesh.trianglesNumber() > 0) {
+    // Split in triangle ranges over the cores, without starting threads for each object
+    if (jobSystem != NULL) {
+      MeshProcessor processor(*jobSystem);
+      processor.computeVertices(indexedMesh, positionsData, normalsData, uvsData, tangentsData);
+    }
+    else {
+      MeshProcessor processor(1);
+      processor.computeVertices(indexedMesh, positionsData, normalsData, uvsData, tangentsData);
+    }
+  }
+  else {
+    mesh.computeVertices(positionsData, normalsData, uvsData);
+  }
 
-  mesh.computeVertices(positions, normals, uvs);
+  // Colors follow the positions
+  withColors = indexedMesh.hasColors() && indexedMesh.trianglesNumber() > 0;
+  if (withColors) {
+    colors.resize(trianglesNumber() * 3 * 3);
+    const int* indices = &indexedMesh.indices[0];
+    for (unsigned int i = 0 ; i < trianglesNumber() * 3 ; i++)
+      memcpy(&colors[i * 3], &indexedMesh.colors[indices[i * 3] * 3], 3 * sizeof (float));
+  }
+
+  computeBounds();
+}
+
+void Object::computeBounds() {
+  boundsMin = boundsMax = qm::Vec3f(0.f, 0.f, 0.f);
+  for (unsigned int i = 0 ; i < trianglesNumber() * 3 ; i++) {
+    for (int j = 0 ; j < 3 ; j++) {
+      float value = positions[i * 3 + j];
+      if (i == 0 || value < boundsMin[j])
+        boundsMin[j] = value;
+      if (i == 0 || value > boundsMax[j])
+        boundsMax[j] = value;
+    }
+  }
 }
 
 void Object::updateVAO() {
   updatePositionsVBO();
   updateNormalsVBO();
   updateUVsVBO();
+  updateTangentsVBO();
+  updateColorsVBO();
 }
 
 void Object::updatePositionsVBO() {
   glBindBuffer(GL_ARRAY_BUFFER, positionsVBO);
-  glBufferData(GL_ARRAY_BUFFER, mesh.trianglesNumber() * 3 * 3 * sizeof (float), positions, GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, trianglesNumber() * 3 * 3 * sizeof (float), arrayData(positions), GL_STATIC_DRAW);
 }
 
 void Object::updateNormalsVBO() {
   if (withNormals) {
     glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-    glBufferData(GL_ARRAY_BUFFER, mesh.trianglesNumber() * 3 * 3 * sizeof (float), normals, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, trianglesNumber() * 3 * 3 * sizeof (float), arrayData(normals), GL_STATIC_DRAW);
   }
 }
 
 void Object::updateUVsVBO() {
   if (withUVs) {
     glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
-    glBufferData(GL_ARRAY_BUFFER, mesh.trianglesNumber() * 3 * 2 * sizeof (float), uvs, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, trianglesNumber() * 3 * 2 * sizeof (float), arrayData(uvs), GL_STATIC_DRAW);
   }
 }
 
+void Object::updateTangentsVBO() {
+  if (withTangents) {
+    glBindBuffer(GL_ARRAY_BUFFER, tangentsVBO);
+    glBufferData(GL_ARRAY_BUFFER, trianglesNumber() * 3 * 4 * sizeof (float), arrayData(tangents), GL_STATIC_DRAW);
+  }
+}
+
+void Object::updateColorsVBO() {
+  if (withColors) {
+    glBindBuffer(GL_ARRAY_BUFFER, colorsVBO);
+    glBufferData(GL_ARRAY_BUFFER, trianglesNumber() * 3 * 3 * sizeof (float), arrayData(colors), GL_STATIC_DRAW);
+  }
+}
+
+void Object::releaseBuffers() {
+  VAO.reset();
+  positionsVBO.reset();
+  normalsVBO.reset();
+  uvsVBO.reset();
+  tangentsVBO.reset();
+  colorsVBO.reset();
+}
+
+unsigned long long Object::bufferBytes() const {
+  unsigned int floats = 3;
+  if (withNormals)
+    floats += 3;
+  if (withUVs)
+    floats += 2;
+  if (withTangents)
+    floats += 4;
+  if (withColors)
+    floats += 3;
+  return (unsigned long long) verticesNumber() * floats * sizeof (float);
+}
+
 void Object::createVAO() {
-  glGenBuffers(1, &positionsVBO);
+  createBuffers();
+  createVertexArray();
+}
+
+void Object::createBuffers() {
+  positionsVBO = GLBuffer::create();
   updatePositionsVBO();
 
   if (withNormals) {
-    glGenBuffers(1, &normalsVBO);
+    normalsVBO = GLBuffer::create();
     updateNormalsVBO();
   }
 
   if (withUVs) {
-    glGenBuffers(1, &uvsVBO);
+    uvsVBO = GLBuffer::create();
     updateUVsVBO();
   }
 
-  glGenVertexArrays(1, &VAO);
+  if (withTangents) {
+    tangentsVBO = GLBuffer::create();
+    updateTangentsVBO();
+  }
+
+  if (withColors) {
+    colorsVBO = GLBuffer::create();
+    updateColorsVBO();
+  }
+}
+
+void Object::createVertexArray() {
+  VAO = GLVertexArray::create();
   glBindVertexArray(VAO);
   glBindBuffer(GL_ARRAY_BUFFER, positionsVBO);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
@@ -128,56 +274,76 @@ void Object::createVAO() {
     glEnableVertexAttribArray(1);
   if (withNormals && withUVs)
     glEnableVertexAttribArray(2);
+  if (withTangents) {
+    glBindBuffer(GL_ARRAY_BUFFER, tangentsVBO);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(3);
+  }
+  if (withColors) {
+    glBindBuffer(GL_ARRAY_BUFFER, colorsVBO);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(4);
+  }
 }
 
 void Object::setPosition(qm::Vec3f& position) {
   this->position = position;
   modelMatrixChanged = true;
+  revision++;
 }
 
 void Object::translate(qm::Vec3f translation) {
   position += translation;
   modelMatrixChanged = true;
+  revision++;
 }
 
 void Object::translate(qm::Vec3f& translation) {
   position += translation;
   modelMatrixChanged = true;
+  revision++;
 }
 
 void Object::setRotation(qm::Quat& rotation) {
   this->rotation = rotation;
   modelMatrixChanged = true;
+  revision++;
 }
 
 void Object::setRotation(float a, float x, float y, float z) {
   this->rotation = qm::Quat(a, x, y, z);
   modelMatrixChanged = true;
+  revision++;
 }
 
 void Object::rotate(qm::Quat& rotation) {
   this->rotation = rotation * this->rotation;
   modelMatrixChanged = true;
+  revision++;
 }
 
 void Object::rotate(float a, float x, float y, float z) {
   this->rotation = qm::Quat(a, x, y, z) * this->rotation;
   modelMatrixChanged = true;
+  revision++;
 }
 
 void Object::setScale(qm::Vec3f& scale) {
   this->scale = scale;
   modelMatrixChanged = true;
+  revision++;
 }
 
 void Object::setScale(float x, float y, float z) {
   this->scale = qm::Vec3f(x, y, z);
   modelMatrixChanged = true;
+  revision++;
 }
 
 void Object::reScale(qm::Vec3f scale) {
   this->scale *= scale;
   modelMatrixChanged = true;
+  revision++;
 }
 
 void Object::reScale(float x, float y, float z) {
@@ -195,3 +361,11 @@ qm::Mat4f& Object::retrieveModelMatrix() {
   return modelMatrix;
 }
 
+unsigned int Object::getRevision() const {
+  // Mixed rather than summed, so that a material with a lower revision is still a change
+  unsigned int mixed = revision;
+  mixed = mixed * 31 + (unsigned int) ((size_t) material.get() >> 4);
+  mixed = mixed * 31 + material->getRevision();
+  return mixed;
+}
+
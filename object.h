@@ -4,43 +4,86 @@
 #include "shaderprogram.h"
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 #include <mesh.h>
 #include <vec4.h>
 #include <quat.h>
 
+#include "glresource.h"
 #include "material.h"
+#include "meshprocessor.h"
 
 
 namespace qgl {
 
+// Owns its vertices and GL buffers: it can be moved but not copied, so
+// loaders and containers move objects instead of duplicating their arrays.
 class Object {
 
   public:
     Object();
-    ~Object();
+    Object(Object&& other) = default;
+    Object& operator=(Object&& other) = default;
 
     bool loadOBJ(const std::string& geometryFile, const std::string& materialFile = "");
+    // Both take the content of newMesh. Normals are generated when it has none.
     void setMesh(Mesh& newMesh);
-    void setMaterial(Material& newMaterial);
-
-    Material& getMaterial() { return material; }
-
-    void computeVertices();
-
-    unsigned int verticesNumber() const { return mesh.trianglesNumber() * 3; }
-    unsigned int trianglesNumber() const { return mesh.trianglesNumber(); }
-
-    float* getPositions() const { return positions; }
-    float* getNormals() const { return normals; }
-    float* getUVs() const { return uvs; }
+    void setMesh(IndexedMesh& newMesh);
+    // Takes vertex arrays already expanded, 3 floats per triangle vertex for
+    // each one (2 for the uvs), as loaders of triangle soups produce them.
+    // Normals, uvs and colors can be empty. computeVertices keeps them.
+    void setVertices(std::vector<float>& newPositions, std::vector<float>& newNormals,
+                     std::vector<float>& newUVs, std::vector<float>& newColors);
+    // Objects using the same material share it
+    void setMaterial(const std::shared_ptr<Material>& newMaterial);
+    void setMaterial(Material&& newMaterial);
+
+    Material& getMaterial() { return *material; }
+    unsigned int shaderFeatures(unsigned int lightsNumber = 1) const;
+
+    // Tangents (attribute 3) need texture coordinates and an indexed mesh. Indexed
+    // meshes are expanded with jobs on jobSystem when given, on the calling thread
+    // otherwise.
+    void computeVertices(bool withTangents = false, JobSystem* jobSystem = NULL);
+
+    unsigned int verticesNumber() const { return trianglesNumber() * 3; }
+    unsigned int trianglesNumber() const {
+      if (indexedMesh.trianglesNumber() > 0)
+        return indexedMesh.trianglesNumber();
+      return mesh.trianglesNumber() > 0 ? mesh.trianglesNumber() : positions.size() / 9;
+    }
+
+    // NULL when the object has none
+    const float* getPositions() const { return arrayData(positions); }
+    const float* getNormals() const { return arrayData(normals); }
+    const float* getUVs() const { return arrayData(uvs); }
+    const float* getTangents() const { return arrayData(tangents); }
+    // Per-vertex colors (attribute 4)
+    const float* getColors() const { return arrayData(colors); }
+
+    // Axis aligned bounding box in object space, computed with the vertices
+    const qm::Vec3f& getBoundsMin() const { return boundsMin; }
+    const qm::Vec3f& getBoundsMax() const { return boundsMax; }
 
     void createVAO();
+    // createVAO in two steps: the buffers can be created in a context sharing
+    // its objects with the rendering one, the vertex array cannot
+    void createBuffers();
+    void createVertexArray();
     unsigned int getVAO() { return VAO; }
     void updateVAO();
     void updatePositionsVBO();
     void updateNormalsVBO();
     void updateUVsVBO();
+    void updateTangentsVBO();
+    void updateColorsVBO();
+    // Residency, see ResidencyManager: the buffers can be released and created
+    // again by createVAO, the vertex arrays stay in memory
+    void releaseBuffers();
+    // Size of the buffers once created
+    unsigned long long bufferBytes() const;
 
     void setPosition(qm::Vec3f& position);
     qm::Vec3f& getPosition() { return position; }
@@ -60,29 +103,49 @@ class Object {
     void computeModelMatrix();
     qm::Mat4f& retrieveModelMatrix();
 
+    // Changes with the transform, the mesh and the material
+    unsigned int getRevision() const;
+
 
   private:
+    Object(const Object&);
+    Object& operator=(const Object&);
+
+    static const float* arrayData(const std::vector<float>& array) { return array.empty() ? NULL : &array[0]; }
+
+    void computeBounds();
+
     q3ds::Mesh mesh;
+    IndexedMesh indexedMesh;
 
     bool withNormals;
     bool withUVs;
-
-    float* positions;
-    float* normals;
-    float* uvs;
-
-    unsigned int positionsVBO;
-    unsigned int normalsVBO;
-    unsigned int uvsVBO;
-    unsigned int VAO;
+    bool withTangents;
+    bool withColors;
+
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> uvs;
+    std::vector<float> tangents;
+    std::vector<float> colors;
+    qm::Vec3f boundsMin;
+    qm::Vec3f boundsMax;
+
+    GLBuffer positionsVBO;
+    GLBuffer normalsVBO;
+    GLBuffer uvsVBO;
+    GLBuffer tangentsVBO;
+    GLBuffer colorsVBO;
+    GLVertexArray VAO;
 
     qm::Vec3f position;
     qm::Quat rotation;
     qm::Vec3f scale;
     bool modelMatrixChanged;
     qm::Mat4f modelMatrix;
+    unsigned int revision;
 
-    Material material;
+    std::shared_ptr<Material> material;
 
 };
 
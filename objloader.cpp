@@ -1,4 +1,6 @@
 #include "objloader.h"
+#include <algorithm>
+#include <cstring>
 #include <map>
 
 using namespace qgl;
@@ -157,73 +159,102 @@ bool OBJLoader::loadGeometry(const string& filename, q3ds::Mesh& mesh) {
   return true;
 }
 
+// Parse the materials of a MTL file, textures are not loaded
+bool OBJLoader::loadMaterials(const string& materialFilename, map<string, Material>& materials) {
+  ifstream materialFile(materialFilename.c_str());
+  if (!materialFile) {
+    cerr << "Could not load the material file. " << endl;
+    return false;
+  }
+  cout << "Load model material ...";
+  string line, head, materialName = "", mapFile;
+  Material material;
+  // Texture paths are relative to the material file folder
+  size_t pos = materialFilename.find_last_of("/\\");
+  string fileFolder = pos == string::npos ? "" : materialFilename.substr(0, pos + 1);
+  int materialsNumber = 0;
+  while (getline(materialFile, line, '\n')) {
+    stringstream lineStream(line);
+    lineStream >> head;
+    if (head.compare("newmtl") == 0) {
+      if (materialsNumber != 0) {
+        materials[materialName] = move(material);
+        material.clear();
+      }
+      lineStream >> materialName;
+      materialsNumber++;
+    }
+    else if (head.compare("d") == 0) {
+      lineStream >> material.d;
+    }
+    else if (head.compare("Ns") == 0) {
+      lineStream >> material.ns;
+    }
+    else if (head.compare("Ni") == 0) {
+      lineStream >> material.ni;
+    }
+    else if (head.compare("Ka") == 0) {
+      lineStream >> material.ambientColor[0] >> material.ambientColor[1] >> material.ambientColor[2];
+    }
+    else if (head.compare("Kd") == 0) {
+      lineStream >> material.diffuseColor[0] >> material.diffuseColor[1] >> material.diffuseColor[2];
+    }
+    else if (head.compare("Ks") == 0) {
+      lineStream >> material.specularColor[0] >> material.specularColor[1] >> material.specularColor[2];
+    }
+    else if (head.compare("Km") == 0) {
+      lineStream >> material.km;
+    }
+    else if (head.compare("map_Kd") == 0) {
+      lineStream >> mapFile;
+      material.diffuseMap = fileFolder + mapFile;
+    }
+    else if (head.compare("map_Ks") == 0) {
+      lineStream >> mapFile;
+      material.specularMap = fileFolder + mapFile;
+    }
+  }
+  if (materialsNumber != 0) {
+    materials[materialName] = move(material);
+  }
+  cout << "Loaded materials: " << materialsNumber << endl;
+  return true;
+}
+
+static const char* skipSpaces(const char* c) {
+  while (*c == ' ' || *c == '\t')
+    c++;
+  return c;
+}
+
+// The line starts with keyword followed by a space or its end
+static bool isKeyword(const char* c, const char* keyword) {
+  size_t length = strlen(keyword);
+  return strncmp(c, keyword, length) == 0 && (c[length] == ' ' || c[length] == '\t' || c[length] == '\0' || c[length] == '\r');
+}
+
+// Appends an object taking the content of mesh, without copying its arrays
+static void addObject(vector<Object>& objects, IndexedMesh& mesh, const map<string, shared_ptr<Material> >& materials, const string& materialName) {
+  objects.emplace_back();
+  objects.back().setMesh(mesh);
+  map<string, shared_ptr<Material> >::const_iterator it = materials.find(materialName);
+  if (it != materials.end())
+    objects.back().setMaterial(it->second);
+}
+
 // Load the model in objects
 bool OBJLoader::loadObjects(const string& geometryFilename, vector<Object>& objects, const string& materialFilename) {
   bool loadMaterial = !materialFilename.empty();
-  map<string, Material> materials;
+  // Shared by the objects using them
+  map<string, shared_ptr<Material> > materials;
   if (loadMaterial) {
-    ifstream materialFile(materialFilename.c_str());
-    if (!materialFile) {
-      cerr << "Could not load the material file. " << endl;
-      loadMaterial = false;
-    }
-    else {
-      cout << "Load model material ...";
-      string line, head, materialName = "", mapFile;
-      Material material;
-      size_t pos = materialFilename.rfind("/");
-      if (pos == string::npos)
-        pos = materialFilename.rfind("\\");
-      string fileFolder = materialFilename.substr(0, pos);
-      int materialsNumber = 0;
-      while (getline(materialFile, line, '\n')) {
-        stringstream lineStream(line);
-        lineStream >> head;
-        if (head.compare("newmtl") == 0) {
-          if (materialsNumber != 0) {
-            materials.insert(pair<string, Material>(materialName, material));
-            material.clear();
-          }
-          lineStream >> materialName;
-          materialsNumber++;
-        }
-        else if (head.compare("d") == 0) {
-          lineStream >> material.d;
-        }
-        else if (head.compare("Ns") == 0) {
-          lineStream >> material.ns;
-        }
-        else if (head.compare("Ni") == 0) {
-          lineStream >> material.ni;
-        }
-        else if (head.compare("Ka") == 0) {
-          lineStream >> material.ambientColor[0] >> material.ambientColor[1] >> material.ambientColor[2];
-        }
-        else if (head.compare("Kd") == 0) {
-          lineStream >> material.diffuseColor[0] >> material.diffuseColor[1] >> material.diffuseColor[2];
-        }
-        else if (head.compare("Ks") == 0) {
-          lineStream >> material.specularColor[0] >> material.specularColor[1] >> material.specularColor[2];
-        }
-        else if (head.compare("Km") == 0) {
-          lineStream >> material.km;
-        }
-        else if (head.compare("map_Kd") == 0) {
-          lineStream >> mapFile;
-          material.diffuseMap = fileFolder + mapFile;
-        }
-        else if (head.compare("map_Ks") == 0) {
-          material.specularMap = fileFolder + mapFile;
-        }
-      }
-      if (materialsNumber != 0) {
-        materials.insert(pair<string, Material>(materialName, material));
-      }
-
-      for (map<string, Material>::iterator it = materials.begin() ; it != materials.end() ; it++) {
+    map<string, Material> parsedMaterials;
+    loadMaterial = loadMaterials(materialFilename, parsedMaterials);
+    if (loadMaterial) {
+      for (map<string, Material>::iterator it = parsedMaterials.begin() ; it != parsedMaterials.end() ; it++) {
         (it->second).loadTextures();
+        materials[it->first] = make_shared<Material>(move(it->second));
       }
-      cout << "Loaded materials: " << materialsNumber << endl;
     }
   }
 
@@ -234,89 +265,98 @@ bool OBJLoader::loadObjects(const string& geometryFilename, vector<Object>& obje
   }
   cout << "Load model geometry ...";
 
-  Object object;
-  q3ds::Mesh mesh;
-  q3ds::Triangle triangle;
+  // Indexed so that the vertices can be expanded on several threads
+  IndexedMesh mesh;
+  int triangle[9];
   string materialName = "";
-  qm::Vec3f position, normal;
-  qm::Vec2f uv;
   int currentObject = 0;
   int lastPIndex = 0, lastObjectLastPIndex = 0;
   int lastNIndex = 0, lastObjectLastNIndex = 0;
   int lastUVIndex = 0, lastObjectLastUVIndex = 0;
 
-  string o("o"), v("v"), vt("vt"), vn("vn"), f("f"), usemtl("usemtl");
-  string line, head;
+  // Parsed in place: the line keeps its capacity and nothing is allocated per line
+  string line;
+  char* end;
 
   while (getline(file, line, '\n')) {
-    stringstream lineStream(line);
-    lineStream >> head;
-    if (head.compare(o) == 0) { // new object
+    const char* c = skipSpaces(line.c_str());
+    if (isKeyword(c, "o")) { // new object
       if (currentObject != 0) {
         lastObjectLastPIndex = lastPIndex;
         lastObjectLastNIndex = lastNIndex;
         lastObjectLastUVIndex = lastUVIndex;
-        objects.push_back(object);
-        objects.back().setMesh(mesh);
-        if (loadMaterial && !materialName.empty())
-          objects.back().setMaterial(materials.find(materialName)->second);
+        addObject(objects, mesh, materials, materialName);
         mesh.clear();
         materialName.clear();
       }
       currentObject++;
     }
-    else if (head.compare(v) == 0) {
-      lineStream >> position[0] >> position[1] >> position[2];
-      mesh.addPosition(position);
+    else if (isKeyword(c, "v")) {
+      c++;
+      for (int j = 0 ; j < 3 ; j++, c = end)
+        mesh.positions.push_back(strtof(c, &end));
     }
-    else if (head.compare(vt) == 0) {
-      lineStream >> uv[0] >> uv[1];
-      mesh.addUV(uv);
+    else if (isKeyword(c, "vt")) {
+      c += 2;
+      for (int j = 0 ; j < 2 ; j++, c = end)
+        mesh.uvs.push_back(strtof(c, &end));
     }
-    else if (head.compare(vn) == 0) {
-      lineStream >> normal[0] >> normal[1] >> normal[2];
-      mesh.addNormal(normal);
+    else if (isKeyword(c, "vn")) {
+      c += 2;
+      for (int j = 0 ; j < 3 ; j++, c = end)
+        mesh.normals.push_back(strtof(c, &end));
     }
-    else if (head.compare(f) == 0) {
-      int index;
-      string currentVertex, indexString;
+    else if (isKeyword(c, "f")) {
+      c++;
       for (int i = 0 ; i < 3 ; i++) {
-        lineStream >> currentVertex;
-        stringstream stream(currentVertex);
-        int positionIndex = 0, normalIndex = 0, uvIndex = 0;
+        // position/uv/normal, missing or negative indices are 0
+        int vertex[3] = { 0, 0, 0 };
+        c = skipSpaces(c);
         for (int j = 0 ; j < 3 ; j++) {
-          getline(stream, indexString, '/');
-          stringstream stream2(indexString);
-          index = 0;
-          stream2 >> index;
-          if (index > 0) {
-            if (j == 0)
-              positionIndex = index;
-            else if (j == 1)
-              uvIndex = index;
-            else
-              normalIndex = index;
+          // strtol would skip the spaces after an empty field
+          if ((*c >= '0' && *c <= '9') || *c == '-' || *c == '+') {
+            vertex[j] = max((int) strtol(c, &end, 10), 0);
+            c = end;
           }
+          if (*c != '/')
+            break;
+          c++;
         }
+        while (*c != '\0' && *c != ' ' && *c != '\t' && *c != '\r')
+          c++;
+        int positionIndex = vertex[0], uvIndex = vertex[1], normalIndex = vertex[2];
         if (positionIndex > lastPIndex)
           lastPIndex = positionIndex;
         if (uvIndex > lastUVIndex)
           lastUVIndex = uvIndex;
         if (normalIndex > lastNIndex)
           lastNIndex = normalIndex;
-        triangle.setVertex(i, positionIndex-lastObjectLastPIndex-1, normalIndex-lastObjectLastNIndex-1, uvIndex-lastObjectLastUVIndex-1);
+        triangle[i * 3] = positionIndex-lastObjectLastPIndex-1;
+        triangle[i * 3 + 1] = normalIndex > 0 ? normalIndex-lastObjectLastNIndex-1 : -1;
+        triangle[i * 3 + 2] = uvIndex > 0 ? uvIndex-lastObjectLastUVIndex-1 : -1;
       }
-      mesh.addTriangle(triangle);
+      // Indices out of the object are dropped rather than read out of bounds
+      bool valid = true;
+      for (int i = 0 ; i < 3 ; i++) {
+        valid = valid && triangle[i * 3] >= 0 && triangle[i * 3] < (int) mesh.positionsNumber();
+        if (triangle[i * 3 + 1] >= (int) (mesh.normals.size() / 3))
+          triangle[i * 3 + 1] = -1;
+        if (triangle[i * 3 + 2] >= (int) (mesh.uvs.size() / 2))
+          triangle[i * 3 + 2] = -1;
+      }
+      if (valid)
+        mesh.indices.insert(mesh.indices.end(), triangle, triangle + 9);
+    }
+    else if (loadMaterial && isKeyword(c, "usemtl")) {
+      c = skipSpaces(c + 6);
+      const char* nameEnd = c;
+      while (*nameEnd != '\0' && *nameEnd != ' ' && *nameEnd != '\t' && *nameEnd != '\r')
+        nameEnd++;
+      materialName.assign(c, nameEnd - c);
     }
-    else if (loadMaterial && head.compare(usemtl) == 0)
-      lineStream >> materialName;
-  }
-  if (currentObject != 0) {
-    objects.push_back(object);
-    objects.back().setMesh(mesh);
-    if (loadMaterial && !materialName.empty())
-      objects.back().setMaterial(materials.find(materialName)->second);
   }
+  if (currentObject != 0)
+    addObject(objects, mesh, materials, materialName);
   file.close();
 
   cout << "loaded!" << endl;
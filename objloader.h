@@ -6,6 +6,7 @@
 #include <string>
 #include <sstream>
 #include <iterator>
+#include <map>
 #include <vector>
 #include <stdlib.h>
 
@@ -27,6 +28,7 @@ class OBJLoader {
     bool loadGeometry(const std::string& filename, std::vector<qm::Vec3f>& vertices, std::vector<qm::Vec2f>& uvs, std::vector<qm::Vec3f>& normals);
     bool loadGeometry(const std::string& filename, q3ds::Mesh& mesh);
 
+    bool loadMaterials(const std::string& materialFilename, std::map<std::string, Material>& materials);
     bool loadObjects(const std::string& geometryFilename, std::vector<Object>& objects, const std::string& materialFilename = "");
 
 };
@@ -0,0 +1,167 @@
+#include "occlusionculler.h"
+
+#include "transforms.h"
+
+using namespace qgl;
+using namespace std;
+using namespace qtools;
+
+OcclusionCuller::OcclusionCuller() : boxProgram() {
+  logger = NULL;
+  cubeVAO = cubeVBO = cubeIBO = 0;
+  enabled = true;
+  current = 0;
+}
+
+OcclusionCuller::OcclusionCuller(Logger* logger) : boxProgram(logger) {
+  this->logger = logger;
+  cubeVAO = cubeVBO = cubeIBO = 0;
+  enabled = true;
+  current = 0;
+}
+
+OcclusionCuller::~OcclusionCuller() {
+  destroy();
+}
+
+bool OcclusionCuller::create(const string& vertexShaderFile, const string& fragmentShaderFile) {
+  destroy();
+  if (!boxProgram.loadShader(GL_VERTEX_SHADER, vertexShaderFile)
+      || !boxProgram.loadShader(GL_FRAGMENT_SHADER, fragmentShaderFile)
+      || !boxProgram.link())
+    return false;
+  boxProgram.useUniform("view");
+  boxProgram.useUniform("proj");
+  boxProgram.useUniform("model");
+  boxProgram.useUniform("boxMin");
+  boxProgram.useUniform("boxMax");
+
+  // Unit cube, scaled to each box in the vertex shader
+  static const float corners[8 * 3] = {
+    0.f, 0.f, 0.f,  1.f, 0.f, 0.f,  0.f, 1.f, 0.f,  1.f, 1.f, 0.f,
+    0.f, 0.f, 1.f,  1.f, 0.f, 1.f,  0.f, 1.f, 1.f,  1.f, 1.f, 1.f
+  };
+  static const unsigned char faces[12 * 3] = {
+    0, 2, 1,  1, 2, 3, // z = 0
+    4, 5, 6,  5, 7, 6, // z = 1
+    0, 1, 4,  1, 5, 4, // y = 0
+    2, 6, 3,  3, 6, 7, // y = 1
+    0, 4, 2,  2, 4, 6, // x = 0
+    1, 3, 5,  3, 7, 5  // x = 1
+  };
+  glGenVertexArrays(1, &cubeVAO);
+  glBindVertexArray(cubeVAO);
+  glGenBuffers(1, &cubeVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof (corners), corners, GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+  glEnableVertexAttribArray(0);
+  glGenBuffers(1, &cubeIBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeIBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof (faces), faces, GL_STATIC_DRAW);
+  glBindVertexArray(0);
+  return true;
+}
+
+void OcclusionCuller::destroy() {
+  deleteQueries();
+  if (cubeVAO != 0)
+    glDeleteVertexArrays(1, &cubeVAO);
+  if (cubeVBO != 0)
+    glDeleteBuffers(1, &cubeVBO);
+  if (cubeIBO != 0)
+    glDeleteBuffers(1, &cubeIBO);
+  cubeVAO = cubeVBO = cubeIBO = 0;
+}
+
+void OcclusionCuller::deleteQueries() {
+  for (int i = 0 ; i < 2 ; i++) {
+    if (!queries[i].empty())
+      glDeleteQueries(queries[i].size(), &queries[i][0]);
+    queries[i].clear();
+    issued[i].clear();
+  }
+}
+
+void OcclusionCuller::resize(unsigned int objectsNumber) {
+  if (objectsNumber == queries[0].size())
+    return;
+  deleteQueries();
+  if (objectsNumber == 0)
+    return;
+  for (int i = 0 ; i < 2 ; i++) {
+    queries[i].resize(objectsNumber);
+    issued[i].assign(objectsNumber, false);
+    glGenQueries(objectsNumber, &queries[i][0]);
+  }
+}
+
+void OcclusionCuller::beginFrame() {
+  current = 1 - current;
+  issued[current].assign(issued[current].size(), false);
+  // Nothing to draw conditionally while disabled
+  if (!enabled)
+    issued[1 - current].assign(issued[1 - current].size(), false);
+}
+
+void OcclusionCuller::beginQueries(qm::Mat4f& view, qm::Mat4f& proj) {
+  viewMatrix = view;
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_FALSE);
+  // Box faces touching the geometry count as visible
+  glDepthFunc(GL_LEQUAL);
+  // The back faces keep the box visible when its front faces are clipped
+  glDisable(GL_CULL_FACE);
+  boxProgram.use();
+  boxProgram.setUniformMat4f("view", view);
+  boxProgram.setUniformMat4f("proj", proj);
+  glBindVertexArray(cubeVAO);
+}
+
+void OcclusionCuller::query(unsigned int object, qm::Mat4f& model, const qm::Vec3f& boundsMin, const qm::Vec3f& boundsMax, float near) {
+  if (!enabled || object >= queries[current].size())
+    return;
+
+  // The camera may be inside the box, whose faces would then be clipped away
+  qm::Mat4f modelView = viewMatrix * model;
+  for (int i = 0 ; i < 8 ; i++) {
+    qm::Vec3f corner((i & 1) ? boundsMax[0] : boundsMin[0], (i & 2) ? boundsMax[1] : boundsMin[1], (i & 4) ? boundsMax[2] : boundsMin[2]);
+    if (transformPoint(modelView, corner)[2] > -near)
+      return;
+  }
+
+  qm::Vec3f boxMin = boundsMin;
+  qm::Vec3f boxMax = boundsMax;
+  boxProgram.setUniformMat4f("model", model);
+  boxProgram.setUniformVec3f("boxMin", boxMin);
+  boxProgram.setUniformVec3f("boxMax", boxMax);
+  glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[current][object]);
+  glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, NULL);
+  glEndQuery(GL_ANY_SAMPLES_PASSED);
+  issued[current][object] = true;
+}
+
+void OcclusionCuller::endQueries() {
+  glBindVertexArray(0);
+  glEnable(GL_CULL_FACE);
+  glDepthFunc(GL_LESS);
+  glDepthMask(GL_TRUE);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+bool OcclusionCuller::hasCondition(unsigned int object) const {
+  int previous = 1 - current;
+  return enabled && object < issued[previous].size() && issued[previous][object];
+}
+
+void OcclusionCuller::beginConditionalRender(unsigned int object) const {
+  // The query was issued a whole frame earlier: waiting for it on the GPU costs nothing
+  // and keeps the depth pre-pass and the main pass consistent
+  if (hasCondition(object))
+    glBeginConditionalRender(queries[1 - current][object], GL_QUERY_WAIT);
+}
+
+void OcclusionCuller::endConditionalRender(unsigned int object) const {
+  if (hasCondition(object))
+    glEndConditionalRender();
+}
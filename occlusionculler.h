@@ -0,0 +1,74 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <string>
+#include <vector>
+
+#include <logger.h>
+#include <vec3.h>
+#include <mat4.h>
+
+#include "shaderprogram.h"
+
+
+namespace qgl {
+
+// Hardware occlusion culling: the bounding box of every object is rasterized
+// against the depth buffer inside a GL_ANY_SAMPLES_PASSED query, and the next
+// frame draws the object under conditional rendering with that query. The GPU
+// has finished the previous frame queries when it reaches the draws, so
+// neither the CPU nor the GPU waits for a result; an object appearing from
+// behind an occluder only shows one frame late.
+class OcclusionCuller {
+
+  public:
+    OcclusionCuller();
+    OcclusionCuller(qtools::Logger* logger);
+    ~OcclusionCuller();
+
+    // Loads the box program (box_vs.glsl and depth_fs.glsl) and creates the unit cube
+    bool create(const std::string& vertexShaderFile, const std::string& fragmentShaderFile);
+    void destroy();
+    void resize(unsigned int objectsNumber);
+
+    // Disabled, no queries are issued and every object is drawn
+    void setEnabled(bool enabled) { this->enabled = enabled; }
+    bool isEnabled() const { return enabled; }
+
+    // Swaps the query sets: the queries of the previous frame become the draw conditions
+    void beginFrame();
+    // Box rendering state: no color or depth writes, no face culling
+    void beginQueries(qm::Mat4f& view, qm::Mat4f& proj);
+    // Objects whose box crosses the near plane are always visible and get no query
+    void query(unsigned int object, qm::Mat4f& model, const qm::Vec3f& boundsMin, const qm::Vec3f& boundsMax, float near);
+    void endQueries();
+
+    // Draws between these calls are discarded by the GPU if the object was hidden the previous frame
+    void beginConditionalRender(unsigned int object) const;
+    void endConditionalRender(unsigned int object) const;
+
+  private:
+    OcclusionCuller(const OcclusionCuller&);
+    OcclusionCuller& operator=(const OcclusionCuller&);
+
+    void deleteQueries();
+    bool hasCondition(unsigned int object) const;
+
+    qtools::Logger* logger;
+    ShaderProgram boxProgram;
+    unsigned int cubeVAO;
+    unsigned int cubeVBO;
+    unsigned int cubeIBO;
+
+    bool enabled;
+    // Two query sets, written and read on alternate frames
+    std::vector<unsigned int> queries[2];
+    std::vector<bool> issued[2];
+    int current;
+    qm::Mat4f viewMatrix;
+
+};
+
+}
+
+#endif // OCCLUSIONCULLER_H
@@ -0,0 +1,166 @@
+#include "offscreencontext.h"
+
+#ifdef QGL_HEADLESS
+
+#include <cstring>
+#include <EGL/eglext.h>
+
+using namespace qgl;
+using namespace std;
+using namespace qtools;
+
+OffscreenContext::OffscreenContext() {
+  display = EGL_NO_DISPLAY;
+  config = NULL;
+  context = EGL_NO_CONTEXT;
+  surface = EGL_NO_SURFACE;
+  majorVersion = minorVersion = 0;
+  ownsDisplay = false;
+}
+
+OffscreenContext::~OffscreenContext() {
+  destroy();
+}
+
+bool OffscreenContext::initialize(EGLDisplay candidate) {
+  if (candidate == EGL_NO_DISPLAY)
+    return false;
+  EGLint major, minor;
+  if (!eglInitialize(candidate, &major, &minor))
+    return false;
+  display = candidate;
+  ownsDisplay = true;
+  return true;
+}
+
+bool OffscreenContext::create(int majorVersion, int minorVersion, qtools::Logger* logger) {
+  destroy();
+  this->majorVersion = majorVersion;
+  this->minorVersion = minorVersion;
+
+  // Mesa surfaceless platform: no X server nor GPU device needed
+  const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  bool surfaceless = false;
+  if (clientExtensions != NULL && strstr(clientExtensions, "EGL_MESA_platform_surfaceless") != NULL) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL)
+      surfaceless = initialize(getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL));
+  }
+  if (!surfaceless && !initialize(eglGetDisplay(EGL_DEFAULT_DISPLAY))) {
+    if (logger != NULL)
+      *logger << "ERROR: could not initialize an EGL display." << Logger::ERROR << Logger::FILE;
+    return false;
+  }
+
+  const EGLint configAttributes[] = {
+    EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_DEPTH_SIZE, 24,
+    EGL_NONE
+  };
+  EGLint configsNumber = 0;
+  if (!eglChooseConfig(display, configAttributes, &config, 1, &configsNumber) || configsNumber == 0) {
+    if (logger != NULL)
+      *logger << "ERROR: no EGL config for desktop OpenGL." << Logger::ERROR << Logger::FILE;
+    destroy();
+    return false;
+  }
+
+  eglBindAPI(EGL_OPENGL_API);
+  const EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, majorVersion,
+    EGL_CONTEXT_MINOR_VERSION, minorVersion,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+    EGL_NONE
+  };
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+  if (context == EGL_NO_CONTEXT) {
+    if (logger != NULL)
+      *logger << "ERROR: could not create an OpenGL " << majorVersion << "." << minorVersion << " EGL context." << Logger::ERROR << Logger::FILE;
+    destroy();
+    return false;
+  }
+
+  const char* displayExtensions = eglQueryString(display, EGL_EXTENSIONS);
+  bool surfacelessContext = displayExtensions != NULL && strstr(displayExtensions, "EGL_KHR_surfaceless_context") != NULL;
+  if (!surfacelessContext) {
+    const EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+  }
+
+  if (!makeCurrent()) {
+    if (logger != NULL)
+      *logger << "ERROR: could not make the EGL context current." << Logger::ERROR << Logger::FILE;
+    destroy();
+    return false;
+  }
+  if (logger != NULL)
+    *logger << "Offscreen EGL context created" << (surfaceless ? " on the surfaceless platform." : ".") << Logger::INFO << Logger::FILE;
+  return true;
+}
+
+bool OffscreenContext::createShared(const OffscreenContext& shared, qtools::Logger* logger) {
+  destroy();
+  if (!shared.isValid())
+    return false;
+  display = shared.display;
+  config = shared.config;
+  majorVersion = shared.majorVersion;
+  minorVersion = shared.minorVersion;
+  ownsDisplay = false;
+
+  eglBindAPI(EGL_OPENGL_API);
+  const EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, majorVersion,
+    EGL_CONTEXT_MINOR_VERSION, minorVersion,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+    EGL_NONE
+  };
+  context = eglCreateContext(display, config, shared.context, contextAttributes);
+  if (context == EGL_NO_CONTEXT) {
+    if (logger != NULL)
+      *logger << "ERROR: could not create a shared EGL context." << Logger::ERROR << Logger::FILE;
+    display = EGL_NO_DISPLAY;
+    return false;
+  }
+  // each context needs its own surface when there is one
+  if (shared.surface != EGL_NO_SURFACE) {
+    const EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+  }
+  return true;
+}
+
+bool OffscreenContext::makeCurrent() const {
+  // the bound API is per thread
+  eglBindAPI(EGL_OPENGL_API);
+  return eglMakeCurrent(display, surface, surface, context) == EGL_TRUE;
+}
+
+void OffscreenContext::releaseCurrent() const {
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+void OffscreenContext::destroy() {
+  if (display == EGL_NO_DISPLAY)
+    return;
+  // a shared context is released by its own thread, this one keeps its context
+  if (ownsDisplay)
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (surface != EGL_NO_SURFACE)
+    eglDestroySurface(display, surface);
+  if (context != EGL_NO_CONTEXT)
+    eglDestroyContext(display, context);
+  if (ownsDisplay)
+    eglTerminate(display);
+  display = EGL_NO_DISPLAY;
+  context = EGL_NO_CONTEXT;
+  surface = EGL_NO_SURFACE;
+  ownsDisplay = false;
+}
+
+#endif // QGL_HEADLESS
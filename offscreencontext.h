@@ -0,0 +1,52 @@
+#ifndef OFFSCREENCONTEXT_H
+#define OFFSCREENCONTEXT_H
+
+// Windowless OpenGL context through EGL, for headless rendering (e.g. Mesa
+// on a server). Only built when QGL_HEADLESS is defined, link with -lEGL.
+#ifdef QGL_HEADLESS
+
+#include <EGL/egl.h>
+
+#include <logger.h>
+
+
+namespace qgl {
+
+class OffscreenContext {
+
+  public:
+    OffscreenContext();
+    ~OffscreenContext();
+
+    // Tries a surfaceless display first, then a 1x1 pbuffer on the default display.
+    // Rendering is meant to go to a FrameBuffer, never to the context surface.
+    bool create(int majorVersion = 4, int minorVersion = 0, qtools::Logger* logger = NULL);
+    // Context sharing its objects with an existing one, to be made current in another thread
+    bool createShared(const OffscreenContext& shared, qtools::Logger* logger = NULL);
+    void destroy();
+    bool makeCurrent() const;
+    void releaseCurrent() const;
+    bool isValid() const { return context != EGL_NO_CONTEXT; }
+
+  private:
+    OffscreenContext(const OffscreenContext&);
+    OffscreenContext& operator=(const OffscreenContext&);
+
+    bool initialize(EGLDisplay candidate);
+
+    EGLDisplay display;
+    EGLConfig config;
+    EGLContext context;
+    EGLSurface surface;
+    int majorVersion;
+    int minorVersion;
+    // Shared contexts use the display of the context they share with
+    bool ownsDisplay;
+
+};
+
+}
+
+#endif // QGL_HEADLESS
+
+#endif // OFFSCREENCONTEXT_H
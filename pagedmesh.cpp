@@ -0,0 +1,322 @@
+#include "pagedmesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "transforms.h"
+
+using namespace qgl;
+using namespace std;
+
+// Buffers are allocated by powers of two from this size, so that they can be reused by other pages
+static const unsigned long long MIN_BUFFER_SIZE = 1 << 16;
+
+static unsigned long long sizeClass(unsigned long long bytes) {
+  unsigned long long capacity = MIN_BUFFER_SIZE;
+  while (capacity < bytes)
+    capacity *= 2;
+  return capacity;
+}
+
+PagedMesh::PagedMesh() {
+  budget = 256ull << 20;
+  maxUploadsPerFrame = 4;
+  framesInFlight = 1;
+  frameNumber = 0;
+  usedBytes = 0;
+  stopping = false;
+  frameAllocator = NULL;
+  memset(&header, 0, sizeof (header));
+  memset(&stats, 0, sizeof (stats));
+}
+
+PagedMesh::~PagedMesh() {
+  close();
+}
+
+bool PagedMesh::open(const string& pagedFile) {
+  close();
+  if (!file.open(pagedFile))
+    return false;
+  if (file.getSize() < sizeof (PagedMeshHeader)) {
+    cerr << "ERROR: " << pagedFile << " is not a paged mesh" << endl;
+    file.close();
+    return false;
+  }
+  memcpy(&header, file.getData(), sizeof (header));
+  if (memcmp(header.magic, "QGLPAGES", 8) != 0 || header.version != PAGED_MESH_VERSION
+      || header.vertexFloats != PAGED_MESH_VERTEX_FLOATS
+      || file.getSize() < sizeof (PagedMeshHeader) + (unsigned long long) header.pagesNumber * sizeof (PagedMeshPage)) {
+    cerr << "ERROR: " << pagedFile << " is not a supported paged mesh" << endl;
+    file.close();
+    return false;
+  }
+  entries.resize(header.pagesNumber);
+  if (header.pagesNumber > 0)
+    memcpy(&entries[0], file.getData() + sizeof (PagedMeshHeader), header.pagesNumber * sizeof (PagedMeshPage));
+  for (unsigned int p = 0 ; p < entries.size() ; p++) {
+    if (entries[p].offset + pageBytes(p) > file.getSize()) {
+      cerr << "ERROR: " << pagedFile << " is truncated" << endl;
+      close();
+      return false;
+    }
+  }
+
+  Page page;
+  page.state = UNLOADED;
+  page.visible = page.wanted = false;
+  page.distance = 0.f;
+  page.lastDrawn = 0;
+  page.buffer.VBO = page.buffer.VAO = 0;
+  page.buffer.capacity = 0;
+  pages.assign(entries.size(), page);
+  memset(&stats, 0, sizeof (stats));
+  stats.pages = pages.size();
+
+  stopping = false;
+  loader = thread(&PagedMesh::load, this);
+  return true;
+}
+
+void PagedMesh::close() {
+  if (loader.joinable()) {
+    {
+      lock_guard<mutex> lock(loaderMutex);
+      stopping = true;
+    }
+    loaderCondition.notify_all();
+    loader.join();
+  }
+  requests.clear();
+  for (unsigned int i = 0 ; i < loaded.size() ; i++)
+    loadedPagesPool.release(loaded[i]);
+  loaded.clear();
+  for (unsigned int i = 0 ; i < uploads.size() ; i++)
+    loadedPagesPool.release(uploads[i]);
+  uploads.clear();
+
+  for (unsigned int p = 0 ; p < pages.size() ; p++)
+    if (pages[p].state == RESIDENT)
+      deleteBuffer(pages[p].buffer);
+  for (unsigned int i = 0 ; i < pool.size() ; i++)
+    deleteBuffer(pool[i]);
+  pool.clear();
+  pages.clear();
+  entries.clear();
+  file.close();
+  usedBytes = 0;
+}
+
+unsigned long long PagedMesh::pageBytes(unsigned int page) const {
+  return (unsigned long long) entries[page].trianglesNumber * 3 * PAGED_MESH_VERTEX_FLOATS * sizeof (float);
+}
+
+void PagedMesh::load() {
+  while (true) {
+    unsigned int page;
+    {
+      unique_lock<mutex> lock(loaderMutex);
+      while (!stopping && requests.empty())
+        loaderCondition.wait(lock);
+      if (stopping)
+        return;
+      page = requests.front();
+      requests.pop_front();
+    }
+
+    // Touching the mapping reads the page from the disk, here and not in the render thread
+    LoadedPage* loadedPage = loadedPagesPool.acquire();
+    loadedPage->page = page;
+    loadedPage->vertices.resize(pageBytes(page) / sizeof (float));
+    if (!loadedPage->vertices.empty())
+      memcpy(&loadedPage->vertices[0], file.getData() + entries[page].offset, pageBytes(page));
+
+    lock_guard<mutex> lock(loaderMutex);
+    loaded.push_back(loadedPage);
+  }
+}
+
+void PagedMesh::update(const qm::Mat4f& model, const qm::Mat4f& view, const qm::Mat4f& proj) {
+  frameNumber++;
+  qm::Mat4f modelView = view * model;
+  float planes[6][4];
+  frustumPlanes(proj * modelView, planes);
+  qm::Vec3f camera = inverseTransformPoint(modelView, qm::Vec3f(0.f, 0.f, 0.f));
+
+  ArenaVector<pair<float, unsigned int> > visiblePages((ArenaAllocator<pair<float, unsigned int> >(frameAllocator)));
+  visiblePages.reserve(pages.size());
+  for (unsigned int p = 0 ; p < pages.size() ; p++) {
+    const PagedMeshPage& entry = entries[p];
+    bool inside = true;
+    for (int i = 0 ; i < 6 && inside ; i++) {
+      // Corner of the box the farthest along the plane normal
+      float distance = planes[i][3];
+      for (int j = 0 ; j < 3 ; j++)
+        distance += planes[i][j] * (planes[i][j] >= 0.f ? entry.boundsMax[j] : entry.boundsMin[j]);
+      inside = distance >= 0.f;
+    }
+    float squaredDistance = 0.f;
+    for (int j = 0 ; j < 3 ; j++) {
+      float outside = max(max(entry.boundsMin[j] - camera[j], camera[j] - entry.boundsMax[j]), 0.f);
+      squaredDistance += outside * outside;
+    }
+    pages[p].visible = inside;
+    pages[p].wanted = false;
+    pages[p].distance = sqrt(squaredDistance);
+    if (inside)
+      visiblePages.push_back(make_pair(pages[p].distance, p));
+  }
+
+  // The nearest pages first, as many as the budget holds
+  sort(visiblePages.begin(), visiblePages.end());
+  unsigned long long wantedBytes = 0;
+  for (unsigned int i = 0 ; i < visiblePages.size() ; i++) {
+    unsigned int p = visiblePages[i].second;
+    wantedBytes += sizeClass(pageBytes(p));
+    if (wantedBytes > budget)
+      break;
+    pages[p].wanted = true;
+  }
+
+  bool waiting;
+  {
+    // The queue is rebuilt in the new priority order, pages being read stay requested
+    lock_guard<mutex> lock(loaderMutex);
+    for (unsigned int i = 0 ; i < requests.size() ; i++)
+      pages[requests[i]].state = UNLOADED;
+    requests.clear();
+    for (unsigned int i = 0 ; i < visiblePages.size() ; i++) {
+      unsigned int p = visiblePages[i].second;
+      if (pages[p].wanted && pages[p].state == UNLOADED) {
+        pages[p].state = REQUESTED;
+        requests.push_back(p);
+      }
+    }
+    waiting = !requests.empty();
+  }
+  if (waiting)
+    loaderCondition.notify_one();
+
+  stats.visiblePages = visiblePages.size();
+  stats.residentPages = stats.pendingPages = 0;
+  for (unsigned int p = 0 ; p < pages.size() ; p++) {
+    if (pages[p].state == RESIDENT)
+      stats.residentPages++;
+    else if (pages[p].state == REQUESTED)
+      stats.pendingPages++;
+  }
+  stats.residentBytes = usedBytes;
+}
+
+void PagedMesh::uploadLoaded() {
+  {
+    lock_guard<mutex> lock(loaderMutex);
+    uploads.insert(uploads.end(), loaded.begin(), loaded.end());
+    loaded.clear();
+  }
+
+  for (unsigned int uploaded = 0 ; uploaded < maxUploadsPerFrame && !uploads.empty() ; ) {
+    LoadedPage* loadedPage = uploads.front();
+    uploads.pop_front();
+    Page& page = pages[loadedPage->page];
+    unsigned long long bytes = pageBytes(loadedPage->page);
+
+    // Pages that went out of view while being read are dropped, as are the ones that do not fit
+    if (!page.wanted || !makeRoom(bytes) || !acquireBuffer(bytes, page.buffer)) {
+      page.state = UNLOADED;
+      loadedPagesPool.release(loadedPage);
+      continue;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, page.buffer.VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &loadedPage->vertices[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    page.state = RESIDENT;
+    page.lastDrawn = frameNumber;
+    stats.loadedPages++;
+    uploaded++;
+    loadedPagesPool.release(loadedPage);
+  }
+  stats.residentBytes = usedBytes;
+}
+
+bool PagedMesh::makeRoom(unsigned long long bytes) {
+  unsigned long long capacity = sizeClass(bytes);
+  while (true) {
+    for (unsigned int i = 0 ; i < pool.size() ; i++)
+      if (pool[i].capacity == capacity)
+        return true;
+    if (usedBytes + capacity <= budget)
+      return true;
+
+    // Pooled buffers of other sizes go first
+    if (!pool.empty()) {
+      deleteBuffer(pool.back());
+      pool.pop_back();
+      continue;
+    }
+
+    // Then the least recently drawn page that is not wanted anymore, and not read by a frame in flight
+    int victim = -1;
+    for (unsigned int p = 0 ; p < pages.size() ; p++)
+      if (pages[p].state == RESIDENT && !pages[p].wanted && frameNumber - pages[p].lastDrawn >= (long) framesInFlight
+          && (victim < 0 || pages[p].lastDrawn < pages[victim].lastDrawn))
+        victim = p;
+    if (victim < 0)
+      return false;
+    releaseBuffer(pages[victim].buffer);
+    pages[victim].state = UNLOADED;
+    pages[victim].buffer.VBO = pages[victim].buffer.VAO = 0;
+    stats.evictedPages++;
+  }
+}
+
+bool PagedMesh::acquireBuffer(unsigned long long bytes, GPUBuffer& buffer) {
+  unsigned long long capacity = sizeClass(bytes);
+  for (unsigned int i = 0 ; i < pool.size() ; i++) {
+    if (pool[i].capacity == capacity) {
+      buffer = pool[i];
+      pool.erase(pool.begin() + i);
+      stats.poolHits++;
+      return true;
+    }
+  }
+
+  stats.poolMisses++;
+  buffer.capacity = capacity;
+  glGenBuffers(1, &buffer.VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer.VBO);
+  glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STATIC_DRAW);
+  glGenVertexArrays(1, &buffer.VAO);
+  glBindVertexArray(buffer.VAO);
+  GLsizei stride = PAGED_MESH_VERTEX_FLOATS * sizeof (float);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, NULL);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid*) (3 * sizeof (float)));
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  usedBytes += capacity;
+  return true;
+}
+
+void PagedMesh::releaseBuffer(const GPUBuffer& buffer) {
+  pool.push_back(buffer);
+}
+
+void PagedMesh::deleteBuffer(const GPUBuffer& buffer) {
+  glDeleteVertexArrays(1, &buffer.VAO);
+  glDeleteBuffers(1, &buffer.VBO);
+  usedBytes -= buffer.capacity;
+}
+
+void PagedMesh::draw() {
+  for (unsigned int p = 0 ; p < pages.size() ; p++) {
+    if (!pages[p].visible || pages[p].state != RESIDENT)
+      continue;
+    glBindVertexArray(pages[p].buffer.VAO);
+    glDrawArrays(GL_TRIANGLES, 0, entries[p].trianglesNumber * 3);
+    pages[p].lastDrawn = frameNumber;
+  }
+}
@@ -0,0 +1,136 @@
+#ifndef PAGEDMESH_H
+#define PAGEDMESH_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vec3.h>
+#include <mat4.h>
+
+#include "allocators.h"
+#include "shader.h"
+#include "mappedfile.h"
+#include "meshpager.h"
+
+
+namespace qgl {
+
+struct PagedMeshStats {
+  unsigned int pages;
+  unsigned int visiblePages;
+  unsigned int residentPages;
+  unsigned int pendingPages; // requested and not uploaded yet
+  unsigned long long residentBytes; // GPU buffers in use, pooled ones included
+  unsigned long long loadedPages; // uploads since the opening
+  unsigned long long evictedPages;
+  unsigned long long poolHits;
+  unsigned long long poolMisses;
+};
+
+// Out-of-core rendering of a file written by MeshPager. The file is memory
+// mapped and a loader thread copies the requested pages out of it, so the page
+// faults never hit the render thread. Every frame, the pages in the frustum are
+// requested from the nearest to the camera, as long as they fit in the memory
+// budget. Loaded pages are uploaded into GPU buffers recycled from a pool;
+// when the budget is exceeded, the least recently drawn pages are evicted.
+class PagedMesh {
+
+  public:
+    PagedMesh();
+    ~PagedMesh();
+
+    bool open(const std::string& pagedFile);
+    void close();
+
+    // GPU memory for the pages, 256 MB by default
+    void setMemoryBudget(unsigned long long bytes) { budget = bytes; }
+    // Limits the time spent uploading in a frame
+    void setMaxUploadsPerFrame(unsigned int uploads) { maxUploadsPerFrame = uploads; }
+    // Temporaries of update taken from the frame allocator rather than the heap
+    void setFrameAllocator(FrameAllocator* allocator) { frameAllocator = allocator; }
+    // Pages drawn by the frames the GPU may still be rendering are not evicted
+    void setFramesInFlight(unsigned int frames) { framesInFlight = frames; }
+
+    // Selects the visible pages and requests the missing ones from the loader thread
+    void update(const qm::Mat4f& model, const qm::Mat4f& view, const qm::Mat4f& proj);
+    // Uploads the pages the loader thread has read, must be called from the GL thread
+    void uploadLoaded();
+    // Draws the visible resident pages; attributes 0 and 1 are the position and the normal
+    void draw();
+
+    const PagedMeshStats& getStats() const { return stats; }
+    const float* getBoundsMin() const { return header.boundsMin; }
+    const float* getBoundsMax() const { return header.boundsMax; }
+
+  private:
+    PagedMesh(const PagedMesh&);
+    PagedMesh& operator=(const PagedMesh&);
+
+    enum PageState { UNLOADED, REQUESTED, RESIDENT };
+
+    struct GPUBuffer {
+      unsigned int VBO;
+      unsigned int VAO;
+      unsigned long long capacity;
+    };
+
+    struct Page {
+      PageState state;
+      bool visible;
+      bool wanted;
+      float distance;
+      long lastDrawn;
+      GPUBuffer buffer;
+    };
+
+    struct LoadedPage {
+      unsigned int page;
+      std::vector<float> vertices;
+    };
+
+    void load();
+    unsigned long long pageBytes(unsigned int page) const;
+    bool acquireBuffer(unsigned long long bytes, GPUBuffer& buffer);
+    void releaseBuffer(const GPUBuffer& buffer);
+    void deleteBuffer(const GPUBuffer& buffer);
+    bool makeRoom(unsigned long long bytes);
+
+    MappedFile file;
+    PagedMeshHeader header;
+    std::vector<PagedMeshPage> entries;
+    std::vector<Page> pages;
+
+    unsigned long long budget;
+    unsigned int maxUploadsPerFrame;
+    unsigned int framesInFlight;
+    long frameNumber;
+
+    // Free buffers, reused for pages of the same size class
+    std::vector<GPUBuffer> pool;
+    unsigned long long usedBytes; // buffers of resident pages and pooled buffers
+
+    // Loader thread
+    std::thread loader;
+    std::mutex loaderMutex;
+    std::condition_variable loaderCondition;
+    std::deque<unsigned int> requests;
+    std::vector<LoadedPage*> loaded;
+    bool stopping;
+    // Read pages waiting for their upload, owned by the GL thread
+    std::deque<LoadedPage*> uploads;
+    // Uploaded pages go back to the loader thread with the capacity of their vertices
+    Pool<LoadedPage> loadedPagesPool;
+
+    FrameAllocator* frameAllocator;
+
+    PagedMeshStats stats;
+
+};
+
+}
+
+#endif // PAGEDMESH_H
@@ -0,0 +1,442 @@
+#include "plyloader.h"
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+#include <vector>
+
+#include "mappedfile.h"
+
+using namespace qgl;
+using namespace std;
+
+namespace {
+
+enum PropertyType { TYPE_INT8, TYPE_UINT8, TYPE_INT16, TYPE_UINT16, TYPE_INT32, TYPE_UINT32, TYPE_FLOAT32, TYPE_FLOAT64, TYPE_NONE };
+
+const unsigned int typeSizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+
+PropertyType parseType(const string& name) {
+  if (name == "char" || name == "int8")
+    return TYPE_INT8;
+  if (name == "uchar" || name == "uint8")
+    return TYPE_UINT8;
+  if (name == "short" || name == "int16")
+    return TYPE_INT16;
+  if (name == "ushort" || name == "uint16")
+    return TYPE_UINT16;
+  if (name == "int" || name == "int32")
+    return TYPE_INT32;
+  if (name == "uint" || name == "uint32")
+    return TYPE_UINT32;
+  if (name == "float" || name == "float32")
+    return TYPE_FLOAT32;
+  if (name == "double" || name == "float64")
+    return TYPE_FLOAT64;
+  return TYPE_NONE;
+}
+
+struct Property {
+  string name;
+  PropertyType type; // of the values of a list
+  PropertyType countType; // TYPE_NONE when not a list
+  unsigned int offset; // in an item of an element without lists
+};
+
+struct Element {
+  string name;
+  unsigned long long count;
+  vector<Property> properties;
+  unsigned int stride; // 0 with lists, the items do not have the same size
+};
+
+bool hostBigEndian() {
+  const unsigned int one = 1;
+  return *reinterpret_cast<const unsigned char*>(&one) == 0;
+}
+
+void swapBytes(unsigned char* bytes, unsigned int size) {
+  for (unsigned int i = 0 ; i < size / 2 ; i++)
+    swap(bytes[i], bytes[size - 1 - i]);
+}
+
+double readValue(const unsigned char* data, PropertyType type, bool swapped) {
+  unsigned char bytes[8];
+  memcpy(bytes, data, typeSizes[type]);
+  if (swapped)
+    swapBytes(bytes, typeSizes[type]);
+  switch (type) {
+    case TYPE_INT8: { int8_t value; memcpy(&value, bytes, sizeof (value)); return value; }
+    case TYPE_UINT8: return bytes[0];
+    case TYPE_INT16: { int16_t value; memcpy(&value, bytes, sizeof (value)); return value; }
+    case TYPE_UINT16: { uint16_t value; memcpy(&value, bytes, sizeof (value)); return value; }
+    case TYPE_INT32: { int32_t value; memcpy(&value, bytes, sizeof (value)); return value; }
+    case TYPE_UINT32: { uint32_t value; memcpy(&value, bytes, sizeof (value)); return value; }
+    case TYPE_FLOAT32: { float value; memcpy(&value, bytes, sizeof (value)); return value; }
+    case TYPE_FLOAT64: { double value; memcpy(&value, bytes, sizeof (value)); return value; }
+    default: return 0.0;
+  }
+}
+
+// Integer colors go from 0 to the largest value of their type
+double colorRange(PropertyType type) {
+  switch (type) {
+    case TYPE_INT8: return 127.0;
+    case TYPE_UINT8: return 255.0;
+    case TYPE_INT16: return 32767.0;
+    case TYPE_UINT16: return 65535.0;
+    case TYPE_INT32: return 2147483647.0;
+    case TYPE_UINT32: return 4294967295.0;
+    default: return 1.0;
+  }
+}
+
+// Index of the first property with one of the names, -1 when there is none
+int findProperty(const Element& element, const char* const* names) {
+  for (unsigned int i = 0 ; names[i] != NULL ; i++)
+    for (unsigned int j = 0 ; j < element.properties.size() ; j++)
+      if (element.properties[j].name == names[i])
+        return j;
+  return -1;
+}
+
+bool parseHeader(const unsigned char* data, unsigned long long size, vector<Element>& elements,
+                 bool& bigEndian, unsigned long long& headerSize) {
+  unsigned long long position = 0;
+  bool withFormat = false;
+  for (unsigned int lineNumber = 0 ; ; lineNumber++) {
+    const unsigned char* lineEnd = (const unsigned char*) memchr(data + position, '\n', size - position);
+    if (lineEnd == NULL) {
+      cerr << "ERROR: PLY header without end_header" << endl;
+      return false;
+    }
+    string line((const char*) data + position, lineEnd - (data + position));
+    position = lineEnd - data + 1;
+    if (!line.empty() && line[line.size() - 1] == '\r')
+      line.erase(line.size() - 1);
+
+    stringstream lineStream(line);
+    string keyword;
+    lineStream >> keyword;
+    if (lineNumber == 0) {
+      if (keyword != "ply") {
+        cerr << "ERROR: not a PLY file" << endl;
+        return false;
+      }
+    }
+    else if (keyword == "format") {
+      string format;
+      lineStream >> format;
+      if (format == "binary_little_endian")
+        bigEndian = false;
+      else if (format == "binary_big_endian")
+        bigEndian = true;
+      else {
+        cerr << "ERROR: PLY format " << format << " is not supported, only the binary ones are" << endl;
+        return false;
+      }
+      withFormat = true;
+    }
+    else if (keyword == "element") {
+      Element element;
+      element.count = 0;
+      element.stride = 0;
+      lineStream >> element.name >> element.count;
+      elements.push_back(element);
+    }
+    else if (keyword == "property") {
+      if (elements.empty()) {
+        cerr << "ERROR: PLY property outside of an element" << endl;
+        return false;
+      }
+      Property property;
+      string type;
+      lineStream >> type;
+      if (type == "list") {
+        string countType;
+        lineStream >> countType >> type;
+        property.countType = parseType(countType);
+        if (property.countType == TYPE_NONE || property.countType == TYPE_FLOAT32 || property.countType == TYPE_FLOAT64) {
+          cerr << "ERROR: PLY list count of type " << countType << endl;
+          return false;
+        }
+      }
+      else
+        property.countType = TYPE_NONE;
+      property.type = parseType(type);
+      if (property.type == TYPE_NONE) {
+        cerr << "ERROR: unknown PLY property type " << type << endl;
+        return false;
+      }
+      lineStream >> property.name;
+      property.offset = 0;
+      elements.back().properties.push_back(property);
+    }
+    else if (keyword == "end_header")
+      break;
+    // comment, obj_info
+  }
+  if (!withFormat) {
+    cerr << "ERROR: PLY header without format" << endl;
+    return false;
+  }
+  headerSize = position;
+
+  for (unsigned int i = 0 ; i < elements.size() ; i++) {
+    Element& element = elements[i];
+    unsigned int offset = 0;
+    for (unsigned int j = 0 ; j < element.properties.size() && offset != ~0u ; j++) {
+      if (element.properties[j].countType != TYPE_NONE)
+        offset = ~0u;
+      else {
+        element.properties[j].offset = offset;
+        offset += typeSizes[element.properties[j].type];
+      }
+    }
+    element.stride = offset != ~0u ? offset : 0;
+  }
+  return true;
+}
+
+// Values in a list, read at item and moved past the count. -1 past the end or when negative.
+long long readCount(const Property& property, const unsigned char*& item, const unsigned char* end, bool swapped) {
+  if (property.countType == TYPE_NONE)
+    return (unsigned long long) (end - item) < typeSizes[property.type] ? -1 : 1;
+  if ((unsigned long long) (end - item) < typeSizes[property.countType])
+    return -1;
+  double count = readValue(item, property.countType, swapped);
+  item += typeSizes[property.countType];
+  if (count < 0.0 || (unsigned long long) (end - item) < (unsigned long long) count * typeSizes[property.type])
+    return -1;
+  return (long long) count;
+}
+
+// Moves item past one item of an element with lists, false when it goes past the end
+bool skipItem(const Element& element, const unsigned char*& item, const unsigned char* end, bool swapped) {
+  for (unsigned int i = 0 ; i < element.properties.size() ; i++) {
+    long long count = readCount(element.properties[i], item, end, swapped);
+    if (count < 0)
+      return false;
+    item += count * typeSizes[element.properties[i].type];
+  }
+  return true;
+}
+
+// Vertex attribute made of the given properties, components floats per vertex. Integer
+// values are divided by the range of their type when normalized.
+void readAttribute(const Element& element, const unsigned char* data, bool swapped,
+                   const int* properties, unsigned int components, bool normalized, vector<float>& values) {
+  values.resize(element.count * components);
+  if (values.empty())
+    return;
+  float* output = &values[0];
+  unsigned int first = element.properties[properties[0]].offset;
+
+  bool contiguous = true;
+  for (unsigned int c = 0 ; c < components ; c++) {
+    const Property& property = element.properties[properties[c]];
+    contiguous = contiguous && property.type == TYPE_FLOAT32 && property.offset == first + c * sizeof (float);
+  }
+  if (contiguous) {
+    unsigned int bytes = components * sizeof (float);
+    if (element.stride == bytes)
+      memcpy(output, data + first, element.count * bytes);
+    else {
+      for (unsigned long long v = 0 ; v < element.count ; v++)
+        memcpy(output + v * components, data + v * element.stride + first, bytes);
+    }
+    if (swapped) {
+      unsigned char* outputBytes = reinterpret_cast<unsigned char*>(output);
+      for (unsigned long long i = 0 ; i < values.size() ; i++)
+        swapBytes(outputBytes + i * sizeof (float), sizeof (float));
+    }
+    return;
+  }
+
+  for (unsigned int c = 0 ; c < components ; c++) {
+    const Property& property = element.properties[properties[c]];
+    double scale = normalized ? 1.0 / colorRange(property.type) : 1.0;
+    const unsigned char* input = data + property.offset;
+    for (unsigned long long v = 0 ; v < element.count ; v++)
+      output[v * components + c] = (float) (readValue(input + v * element.stride, property.type, swapped) * scale);
+  }
+}
+
+// Triangles of the faces, as IndexedMesh indices. Returns the end of the faces, NULL on error.
+const unsigned char* readFaces(const Element& element, int indicesProperty, const unsigned char* data,
+                               const unsigned char* end, bool swapped, unsigned long long verticesNumber,
+                               bool withNormals, bool withUVs, vector<int>& indices) {
+  // Each face takes at least its list counts and other values: a count the file cannot hold is rejected
+  unsigned long long minItemSize = 0;
+  for (unsigned int i = 0 ; i < element.properties.size() ; i++) {
+    const Property& property = element.properties[i];
+    minItemSize += typeSizes[property.countType != TYPE_NONE ? property.countType : property.type];
+  }
+  if (minItemSize > 0 && (unsigned long long) (end - data) / minItemSize < element.count)
+    return NULL;
+  // Scans are triangulated: reserve for triangles, as many as the faces of 3 indices the data can hold
+  const Property& indicesList = element.properties[indicesProperty];
+  unsigned long long triangleSize = typeSizes[indicesList.countType] + 3 * typeSizes[indicesList.type];
+  indices.reserve(min(element.count, (unsigned long long) (end - data) / triangleSize) * 9);
+  vector<unsigned int> polygon;
+  const unsigned char* item = data;
+  for (unsigned long long f = 0 ; f < element.count ; f++) {
+    for (unsigned int i = 0 ; i < element.properties.size() ; i++) {
+      const Property& property = element.properties[i];
+      unsigned int valueSize = typeSizes[property.type];
+      long long count = readCount(property, item, end, swapped);
+      if (count < 0)
+        return NULL;
+      if ((int) i != indicesProperty || count < 3) {
+        item += count * valueSize;
+        continue;
+      }
+
+      polygon.resize(count);
+      if (valueSize == sizeof (uint32_t) && (property.type == TYPE_INT32 || property.type == TYPE_UINT32)) {
+        // Copied as they are, negative ones become too large and are rejected below
+        memcpy(&polygon[0], item, count * valueSize);
+        if (swapped) {
+          for (unsigned int v = 0 ; v < count ; v++)
+            swapBytes(reinterpret_cast<unsigned char*>(&polygon[v]), sizeof (uint32_t));
+        }
+      }
+      else {
+        for (unsigned int v = 0 ; v < count ; v++) {
+          double value = readValue(item + v * valueSize, property.type, swapped);
+          polygon[v] = value < 0.0 ? ~0u : (unsigned int) value;
+        }
+      }
+      item += count * valueSize;
+
+      for (unsigned int v = 0 ; v < count ; v++) {
+        if (polygon[v] >= verticesNumber) {
+          cerr << "ERROR: PLY face " << f << " uses vertex " << (int) polygon[v] << " out of " << verticesNumber << endl;
+          return NULL;
+        }
+      }
+      // Fan around the first vertex
+      for (unsigned int v = 2 ; v < count ; v++) {
+        unsigned int triangle[3] = { polygon[0], polygon[v - 1], polygon[v] };
+        for (int k = 0 ; k < 3 ; k++) {
+          indices.push_back(triangle[k]);
+          indices.push_back(withNormals ? (int) triangle[k] : -1);
+          indices.push_back(withUVs ? (int) triangle[k] : -1);
+        }
+      }
+    }
+  }
+  return item;
+}
+
+}
+
+PLYLoader::PLYLoader() {}
+
+bool PLYLoader::load(const string& filename, IndexedMesh& mesh) {
+  MappedFile file;
+  if (!file.open(filename))
+    return false;
+  const unsigned char* data = file.getData();
+  const unsigned char* end = data + file.getSize();
+
+  vector<Element> elements;
+  bool bigEndian = false;
+  unsigned long long headerSize = 0;
+  if (!parseHeader(data, file.getSize(), elements, bigEndian, headerSize)) {
+    cerr << "ERROR: could not read the header of " << filename << endl;
+    return false;
+  }
+  bool swapped = bigEndian != hostBigEndian();
+
+  static const char* const xNames[] = { "x", NULL };
+  static const char* const yNames[] = { "y", NULL };
+  static const char* const zNames[] = { "z", NULL };
+  static const char* const nxNames[] = { "nx", NULL };
+  static const char* const nyNames[] = { "ny", NULL };
+  static const char* const nzNames[] = { "nz", NULL };
+  static const char* const uNames[] = { "u", "s", "texture_u", "texture_s", NULL };
+  static const char* const vNames[] = { "v", "t", "texture_v", "texture_t", NULL };
+  static const char* const redNames[] = { "red", "diffuse_red", NULL };
+  static const char* const greenNames[] = { "green", "diffuse_green", NULL };
+  static const char* const blueNames[] = { "blue", "diffuse_blue", NULL };
+  static const char* const indicesNames[] = { "vertex_indices", "vertex_index", NULL };
+
+  int vertexElement = -1, faceElement = -1;
+  for (unsigned int i = 0 ; i < elements.size() ; i++) {
+    if (elements[i].name == "vertex" && vertexElement < 0)
+      vertexElement = i;
+    else if (elements[i].name == "face" && faceElement < 0)
+      faceElement = i;
+  }
+  if (vertexElement < 0 || faceElement < 0) {
+    cerr << "ERROR: " << filename << " has no vertex or no face element" << endl;
+    return false;
+  }
+  const Element& vertices = elements[vertexElement];
+  int positionProperties[3] = { findProperty(vertices, xNames), findProperty(vertices, yNames), findProperty(vertices, zNames) };
+  int normalProperties[3] = { findProperty(vertices, nxNames), findProperty(vertices, nyNames), findProperty(vertices, nzNames) };
+  int uvProperties[2] = { findProperty(vertices, uNames), findProperty(vertices, vNames) };
+  int colorProperties[3] = { findProperty(vertices, redNames), findProperty(vertices, greenNames), findProperty(vertices, blueNames) };
+  int indicesProperty = findProperty(elements[faceElement], indicesNames);
+  if (positionProperties[0] < 0 || positionProperties[1] < 0 || positionProperties[2] < 0 || vertices.stride == 0) {
+    cerr << "ERROR: " << filename << " vertices need x, y and z and cannot have lists" << endl;
+    return false;
+  }
+  if (indicesProperty < 0 || elements[faceElement].properties[indicesProperty].countType == TYPE_NONE) {
+    cerr << "ERROR: " << filename << " faces have no vertex_indices list" << endl;
+    return false;
+  }
+  bool withNormals = normalProperties[0] >= 0 && normalProperties[1] >= 0 && normalProperties[2] >= 0;
+  bool withUVs = uvProperties[0] >= 0 && uvProperties[1] >= 0;
+  bool withColors = colorProperties[0] >= 0 && colorProperties[1] >= 0 && colorProperties[2] >= 0;
+
+  mesh.clear();
+  const unsigned char* item = data + headerSize;
+  for (unsigned int i = 0 ; i < elements.size() ; i++) {
+    const Element& element = elements[i];
+    if ((int) i == faceElement) {
+      item = readFaces(element, indicesProperty, item, end, swapped, vertices.count, withNormals, withUVs, mesh.indices);
+      if (item == NULL) {
+        cerr << "ERROR: could not read the faces of " << filename << endl;
+        mesh.clear();
+        return false;
+      }
+    }
+    else if (element.stride > 0) {
+      if ((unsigned long long) (end - item) / element.stride < element.count) {
+        cerr << "ERROR: " << filename << " is truncated" << endl;
+        mesh.clear();
+        return false;
+      }
+      if ((int) i == vertexElement) {
+        readAttribute(element, item, swapped, positionProperties, 3, false, mesh.positions);
+        if (withNormals)
+          readAttribute(element, item, swapped, normalProperties, 3, false, mesh.normals);
+        if (withUVs)
+          readAttribute(element, item, swapped, uvProperties, 2, false, mesh.uvs);
+        if (withColors)
+          readAttribute(element, item, swapped, colorProperties, 3, true, mesh.colors);
+      }
+      item += element.count * element.stride;
+    }
+    else {
+      // Other elements with lists are skipped item by item
+      for (unsigned long long j = 0 ; j < element.count ; j++) {
+        if (!skipItem(element, item, end, swapped)) {
+          cerr << "ERROR: " << filename << " is truncated" << endl;
+          mesh.clear();
+          return false;
+        }
+      }
+    }
+  }
+
+  if (mesh.trianglesNumber() == 0) {
+    cerr << "ERROR: " << filename << " has no triangles" << endl;
+    mesh.clear();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,30 @@
+#ifndef PLYLOADER_H
+#define PLYLOADER_H
+
+#include <string>
+
+#include "meshprocessor.h"
+
+
+namespace qgl {
+
+// Binary PLY files, little or big endian, as scanners write them. The vertex
+// element gives the positions, and when present the normals (nx, ny, nz),
+// texture coordinates (u, v or s, t) and colors (red, green, blue); faces
+// are lists of vertex indices, polygons are split in triangle fans. The file
+// is mapped: float attributes stored contiguously are copied in blocks, the
+// whole element at once when it holds nothing else, and triangle faces with
+// 32 bit indices are read without conversion. Bytes are swapped afterwards
+// when the file and the machine do not have the same endianness.
+class PLYLoader {
+
+  public:
+    PLYLoader();
+
+    bool load(const std::string& filename, IndexedMesh& mesh);
+
+};
+
+}
+
+#endif // PLYLOADER_H
@@ -5,12 +5,16 @@ using namespace qgl;
 PointLight::PointLight() {
   position = qm::Vec3f(0.0f, 0.0f, 0.0f);
   diffuse = specular = ambient = qm::Vec3f(0.0f, 0.0f, 0.0f);
+  radius = 10.0f;
+  revision = 0;
 }
 
 PointLight::PointLight(const qm::Vec3f& position, const qm::Vec3f& diffuse) {
   this->position = position;
   this->diffuse = diffuse;
   specular = ambient = qm::Vec3f(0.0f, 0.0f, 0.0f);
+  radius = 10.0f;
+  revision = 0;
 }
 
 PointLight::PointLight(const qm::Vec3f& position, const qm::Vec3f& diffuse, const qm::Vec3f& specular) {
@@ -18,6 +22,8 @@ PointLight::PointLight(const qm::Vec3f& position, const qm::Vec3f& diffuse, cons
   this->diffuse = diffuse;
   this->specular = specular;
   ambient = qm::Vec3f(0.0f, 0.0f, 0.0f);
+  radius = 10.0f;
+  revision = 0;
 }
 
 PointLight::PointLight(const qm::Vec3f& position, const qm::Vec3f& diffuse, const qm::Vec3f& specular, const qm::Vec3f& ambient) {
@@ -25,27 +31,34 @@ PointLight::PointLight(const qm::Vec3f& position, const qm::Vec3f& diffuse, cons
   this->diffuse = diffuse;
   this->specular = specular;
   this->ambient = ambient;
+  radius = 10.0f;
+  revision = 0;
 }
 
 void PointLight::setPosition(const qm::Vec3f& position) {
   this->position = position;
+  revision++;
 }
 
 void PointLight::setColors(const qm::Vec3f& diffuse, const qm::Vec3f& specular, const qm::Vec3f& ambient) {
   this->diffuse = diffuse;
   this->specular = specular;
   this->ambient = ambient;
+  revision++;
 }
 
 void PointLight::setDiffuseColor(const qm::Vec3f& diffuse) {
   this->diffuse = diffuse;
+  revision++;
 }
 
 void PointLight::setSpecularColor(const qm::Vec3f& specular) {
   this->specular = specular;
+  revision++;
 }
 
 void PointLight::setAmbientColor(const qm::Vec3f& ambient) {
   this->ambient = ambient;
+  revision++;
 }
 
@@ -21,17 +21,24 @@ class PointLight : public Light {
     void setDiffuseColor(const qm::Vec3f& diffuse);
     void setSpecularColor(const qm::Vec3f& specular);
     void setAmbientColor(const qm::Vec3f& ambient);
+    // Distance beyond which the light has no effect, used by clustered lighting
+    void setRadius(float radius) { this->radius = radius; revision++; }
+    // Changes with the setters, not with the references returned by the getters
+    unsigned int getRevision() const { return revision; }
 
     qm::Vec3f& getPosition() { return position; }
     qm::Vec3f& getDiffuseColor() { return diffuse; }
     qm::Vec3f& getSpecularColor() { return specular; }
     qm::Vec3f& getAmbientColor() { return ambient; }
+    float getRadius() const { return radius; }
 
   protected:
     qm::Vec3f position;
     qm::Vec3f diffuse;
     qm::Vec3f specular;
     qm::Vec3f ambient;
+    float radius;
+    unsigned int revision;
 
 };
 
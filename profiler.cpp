@@ -0,0 +1,296 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+using namespace qgl;
+using namespace std;
+
+Profiler::Profiler(bool gpuTiming) : samples(1 << 16) {
+  this->gpuTiming = gpuTiming;
+  origin = chrono::steady_clock::now();
+  gpuOrigin = 0.0;
+  if (gpuTiming) {
+    // GPU timestamps have their own origin: align them once on the CPU clock
+    GLint64 timestamp = 0;
+    glGetInteger64v(GL_TIMESTAMP, &timestamp);
+    gpuOrigin = timestamp / 1000.0;
+  }
+  for (unsigned int i = 0 ; i < FRAMES_IN_FLIGHT ; i++) {
+    frames[i].frameNumber = 0;
+    frames[i].open = false;
+    frames[i].pending = false;
+    frames[i].dump = false;
+  }
+  currentFrame = 0;
+  frameNumber = 0;
+  dumpRequested = false;
+  droppedSamples = 0;
+  droppedGPUFrames = 0;
+}
+
+Profiler::~Profiler() {
+  for (unsigned int i = 0 ; i < FRAMES_IN_FLIGHT ; i++) {
+    if (!frames[i].queries.empty())
+      glDeleteQueries(frames[i].queries.size(), &frames[i].queries[0]);
+  }
+}
+
+double Profiler::now() const {
+  return chrono::duration<double, micro>(chrono::steady_clock::now() - origin).count();
+}
+
+unsigned int Profiler::scopeIndex(const char* name) {
+  // Names are usually literals: compare the pointers before the strings
+  for (unsigned int i = 0 ; i < scopes.size() ; i++) {
+    if (scopes[i].name == name || strcmp(scopes[i].name, name) == 0)
+      return i;
+  }
+  Scope scope;
+  scope.name = name;
+  scope.count = 0;
+  scope.cpuHistory.reserve(HISTORY_SIZE);
+  scope.gpuHistory.reserve(HISTORY_SIZE);
+  scopes.push_back(scope);
+  return scopes.size() - 1;
+}
+
+void Profiler::beginFrame() {
+  FrameRecord& previous = frames[currentFrame];
+  if (previous.open)
+    close(previous);
+
+  // Read the results the GPU has finished, without waiting for the others
+  for (unsigned int i = 1 ; i <= FRAMES_IN_FLIGHT ; i++) {
+    FrameRecord& frame = frames[(currentFrame + i) % FRAMES_IN_FLIGHT];
+    if (frame.pending)
+      resolve(frame);
+  }
+
+  currentFrame = (currentFrame + 1) % FRAMES_IN_FLIGHT;
+  FrameRecord& frame = frames[currentFrame];
+  if (frame.pending) {
+    // The GPU is too far behind: keep the CPU timings only rather than stall
+    droppedGPUFrames++;
+    for (unsigned int i = 0 ; i < frame.scopes.size() ; i++)
+      frame.scopes[i].gpuStart = frame.scopes[i].gpuEnd = -1.0;
+    record(frame);
+    frame.pending = false;
+  }
+
+  frameNumber++;
+  frame.frameNumber = frameNumber;
+  frame.scopes.clear();
+  frame.open = true;
+  frame.dump = dumpRequested;
+  dumpRequested = false;
+  openScopes.clear();
+
+  begin("frame");
+}
+
+void Profiler::endFrame() {
+  end();
+  close(frames[currentFrame]);
+}
+
+void Profiler::discardFrame() {
+  FrameRecord& frame = frames[currentFrame];
+  frame.scopes.clear();
+  frame.open = false;
+  frame.pending = false;
+  frame.dump = false;
+  openScopes.clear();
+}
+
+void Profiler::close(FrameRecord& frame) {
+  frame.open = false;
+  if (frame.scopes.empty())
+    return;
+  if (gpuTiming)
+    frame.pending = true;
+  else {
+    for (unsigned int i = 0 ; i < frame.scopes.size() ; i++)
+      frame.scopes[i].gpuStart = frame.scopes[i].gpuEnd = -1.0;
+    record(frame);
+  }
+}
+
+void Profiler::begin(const char* name) {
+  FrameRecord& frame = frames[currentFrame];
+  frame.open = true;
+
+  ScopeRecord scope;
+  scope.scope = scopeIndex(name);
+  scope.depth = openScopes.size();
+  scope.cpuEnd = scope.gpuStart = scope.gpuEnd = 0.0;
+  if (gpuTiming) {
+    unsigned int needed = 2 * (frame.scopes.size() + 1);
+    if (frame.queries.size() < needed) {
+      unsigned int first = frame.queries.size();
+      frame.queries.resize(needed);
+      glGenQueries(needed - first, &frame.queries[first]);
+    }
+    glQueryCounter(frame.queries[2 * frame.scopes.size()], GL_TIMESTAMP);
+  }
+  openScopes.push_back(frame.scopes.size());
+  scope.cpuStart = now();
+  frame.scopes.push_back(scope);
+}
+
+void Profiler::end() {
+  if (openScopes.empty())
+    return;
+  double time = now();
+  FrameRecord& frame = frames[currentFrame];
+  unsigned int index = openScopes.back();
+  openScopes.pop_back();
+  frame.scopes[index].cpuEnd = time;
+  if (gpuTiming)
+    glQueryCounter(frame.queries[2 * index + 1], GL_TIMESTAMP);
+}
+
+bool Profiler::resolve(FrameRecord& frame) {
+  // Queries complete in order: the end of the frame scope, issued last by
+  // endFrame, tells for the whole frame
+  GLint available = 0;
+  glGetQueryObjectiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available)
+    return false;
+
+  for (unsigned int i = 0 ; i < frame.scopes.size() ; i++) {
+    GLuint64 start = 0, end = 0;
+    glGetQueryObjectui64v(frame.queries[2 * i], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(frame.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+    frame.scopes[i].gpuStart = start / 1000.0 - gpuOrigin;
+    frame.scopes[i].gpuEnd = end / 1000.0 - gpuOrigin;
+  }
+  record(frame);
+  frame.pending = false;
+  return true;
+}
+
+void Profiler::record(const FrameRecord& frame) {
+  for (unsigned int i = 0 ; i < frame.scopes.size() ; i++) {
+    const ScopeRecord& record = frame.scopes[i];
+    Scope& scope = scopes[record.scope];
+    bool withGPU = record.gpuStart >= 0.0;
+
+    float cpuDuration = (float) ((record.cpuEnd - record.cpuStart) / 1000.0);
+    float gpuDuration = withGPU ? (float) ((record.gpuEnd - record.gpuStart) / 1000.0) : 0.f;
+    unsigned int slot = scope.count % HISTORY_SIZE;
+    if (scope.cpuHistory.size() < HISTORY_SIZE) {
+      scope.cpuHistory.push_back(cpuDuration);
+      scope.gpuHistory.push_back(gpuDuration);
+    }
+    else {
+      scope.cpuHistory[slot] = cpuDuration;
+      scope.gpuHistory[slot] = gpuDuration;
+    }
+    scope.count++;
+
+    ProfileSample sample;
+    sample.name = scope.name;
+    sample.depth = record.depth;
+    sample.frameNumber = frame.frameNumber;
+    sample.gpu = false;
+    sample.start = record.cpuStart;
+    sample.duration = record.cpuEnd - record.cpuStart;
+    if (!samples.push(sample))
+      droppedSamples++;
+    if (withGPU) {
+      sample.gpu = true;
+      sample.start = record.gpuStart;
+      sample.duration = record.gpuEnd - record.gpuStart;
+      if (!samples.push(sample))
+        droppedSamples++;
+    }
+  }
+  if (frame.dump)
+    dump(frame);
+}
+
+void Profiler::dump(const FrameRecord& frame) const {
+  cout << "Frame " << frame.frameNumber << " (ms):" << endl;
+  cout << fixed << setprecision(3);
+  for (unsigned int i = 0 ; i < frame.scopes.size() ; i++) {
+    const ScopeRecord& record = frame.scopes[i];
+    cout << string(2 * (record.depth + 1), ' ') << scopes[record.scope].name;
+    cout << "  cpu " << (record.cpuEnd - record.cpuStart) / 1000.0;
+    if (record.gpuStart >= 0.0)
+      cout << "  gpu " << (record.gpuEnd - record.gpuStart) / 1000.0;
+    cout << endl;
+  }
+  cout.unsetf(ios::floatfield);
+}
+
+static void historyStats(vector<float> history, double& minimum, double& average, double& p99) {
+  minimum = average = p99 = 0.0;
+  if (history.empty())
+    return;
+  sort(history.begin(), history.end());
+  double sum = 0.0;
+  for (unsigned int i = 0 ; i < history.size() ; i++)
+    sum += history[i];
+  minimum = history.front();
+  average = sum / history.size();
+  unsigned int rank = (unsigned int) ceil(0.99 * history.size());
+  p99 = history[rank > 0 ? rank - 1 : 0];
+}
+
+vector<ProfileScopeStats> Profiler::getStats() const {
+  vector<ProfileScopeStats> stats;
+  for (unsigned int i = 0 ; i < scopes.size() ; i++) {
+    ProfileScopeStats scopeStats;
+    scopeStats.name = scopes[i].name;
+    scopeStats.count = scopes[i].count;
+    historyStats(scopes[i].cpuHistory, scopeStats.cpuMin, scopeStats.cpuAverage, scopeStats.cpuP99);
+    historyStats(scopes[i].gpuHistory, scopeStats.gpuMin, scopeStats.gpuAverage, scopeStats.gpuP99);
+    stats.push_back(scopeStats);
+  }
+  return stats;
+}
+
+void Profiler::printStats(ostream& stream) const {
+  vector<ProfileScopeStats> stats = getStats();
+  stream << left << setw(16) << "scope" << right << setw(8) << "count";
+  stream << setw(10) << "cpu min" << setw(10) << "cpu avg" << setw(10) << "cpu p99";
+  stream << setw(10) << "gpu min" << setw(10) << "gpu avg" << setw(10) << "gpu p99" << endl;
+  stream << fixed << setprecision(3);
+  for (unsigned int i = 0 ; i < stats.size() ; i++) {
+    stream << left << setw(16) << stats[i].name << right << setw(8) << stats[i].count;
+    stream << setw(10) << stats[i].cpuMin << setw(10) << stats[i].cpuAverage << setw(10) << stats[i].cpuP99;
+    stream << setw(10) << stats[i].gpuMin << setw(10) << stats[i].gpuAverage << setw(10) << stats[i].gpuP99 << endl;
+  }
+  stream.unsetf(ios::floatfield);
+}
+
+bool Profiler::exportChromeTrace(const string& filename) {
+  ofstream file(filename.c_str());
+  if (!file) {
+    cerr << "Could not write the trace file " << filename << endl;
+    return false;
+  }
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+  file << fixed << setprecision(3);
+  ProfileSample sample;
+  while (samples.pop(sample)) {
+    file << ",\n{\"name\":\"";
+    for (const char* c = sample.name ; *c != '\0' ; c++) {
+      if (*c == '"' || *c == '\\')
+        file << '\\';
+      file << *c;
+    }
+    file << "\",\"cat\":\"" << (sample.gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\"";
+    file << ",\"ts\":" << sample.start << ",\"dur\":" << sample.duration;
+    file << ",\"pid\":0,\"tid\":" << (sample.gpu ? 1 : 0);
+    file << ",\"args\":{\"frame\":" << sample.frameNumber << ",\"depth\":" << sample.depth << "}}";
+  }
+  file << "\n]}\n";
+  return true;
+}
@@ -0,0 +1,131 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+#include "spscqueue.h"
+
+
+namespace qgl {
+
+// One measured scope, pushed to the trace ring once its timings are known
+struct ProfileSample {
+  const char* name;
+  unsigned int depth;
+  long frameNumber;
+  bool gpu;
+  double start; // microseconds since the profiler creation
+  double duration; // microseconds
+};
+
+struct ProfileScopeStats {
+  std::string name;
+  unsigned long count;
+  double cpuMin, cpuAverage, cpuP99; // milliseconds
+  double gpuMin, gpuAverage, gpuP99; // milliseconds, 0 without GPU timing
+};
+
+// Nestable named scopes measured on the CPU with a steady clock and on the
+// GPU with timestamp queries. Query results are read a few frames later,
+// only once available, so the profiler never waits for the GPU.
+// Scopes must be opened and closed by the thread owning the GL context, and
+// their names must outlive the profiler (string literals); the trace can be
+// exported from another thread.
+class Profiler {
+
+  public:
+    Profiler(bool gpuTiming = true);
+    ~Profiler();
+
+    void beginFrame();
+    void endFrame();
+    // Drops the frame being recorded, for a frame that is not drawn after all
+    void discardFrame();
+    void begin(const char* name);
+    void end();
+
+    std::vector<ProfileScopeStats> getStats() const;
+    void printStats(std::ostream& stream) const;
+    // Prints the scopes of the next frame once its GPU timings are known
+    void requestFrameDump() { dumpRequested = true; }
+    // Writes the samples recorded since the last export in the Chrome trace format (chrome://tracing)
+    bool exportChromeTrace(const std::string& filename);
+
+    unsigned long getDroppedSamples() const { return droppedSamples; }
+    unsigned long getDroppedGPUFrames() const { return droppedGPUFrames; }
+
+  private:
+    Profiler(const Profiler&);
+    Profiler& operator=(const Profiler&);
+
+    static const unsigned int FRAMES_IN_FLIGHT = 4;
+    static const unsigned int HISTORY_SIZE = 256;
+
+    struct ScopeRecord {
+      unsigned int scope;
+      unsigned int depth;
+      double cpuStart;
+      double cpuEnd;
+      double gpuStart;
+      double gpuEnd;
+    };
+
+    struct FrameRecord {
+      long frameNumber;
+      std::vector<ScopeRecord> scopes;
+      std::vector<unsigned int> queries; // two per scope
+      bool open; // scopes are still being recorded
+      bool pending; // GPU results not read yet
+      bool dump;
+    };
+
+    struct Scope {
+      const char* name;
+      std::vector<float> cpuHistory;
+      std::vector<float> gpuHistory;
+      unsigned long count;
+    };
+
+    double now() const;
+    unsigned int scopeIndex(const char* name);
+    void close(FrameRecord& frame);
+    bool resolve(FrameRecord& frame);
+    void record(const FrameRecord& frame);
+    void dump(const FrameRecord& frame) const;
+
+    bool gpuTiming;
+    std::chrono::steady_clock::time_point origin;
+    double gpuOrigin; // GPU timestamp of the origin, in microseconds
+
+    std::vector<Scope> scopes;
+    FrameRecord frames[FRAMES_IN_FLIGHT];
+    unsigned int currentFrame;
+    long frameNumber;
+    std::vector<unsigned int> openScopes;
+    bool dumpRequested;
+
+    SPSCQueue<ProfileSample> samples;
+    unsigned long droppedSamples;
+    unsigned long droppedGPUFrames;
+
+};
+
+// Measures the enclosing block
+class ProfileScope {
+
+  public:
+    ProfileScope(Profiler& profiler, const char* name) : profiler(profiler) { profiler.begin(name); }
+    ~ProfileScope() { profiler.end(); }
+
+  private:
+    Profiler& profiler;
+
+};
+
+}
+
+#endif // PROFILER_H
@@ -0,0 +1,379 @@
+#include "progressiveloader.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+#include "objloader.h"
+#include "shaderfeatures.h"
+
+using namespace qgl;
+using namespace std;
+
+namespace {
+
+static const unsigned int LINE_SIZE = 1 << 16;
+// Chunks in flight between the threads, the parser waits when they are all used
+static const unsigned int QUEUE_CHUNKS = 32;
+
+// OBJ index, 1-based or negative from the end, to a 0-based index, -1 when invalid
+long long objIndex(const char*& c, unsigned long long count) {
+  char* end;
+  long long index = strtoll(c, &end, 10);
+  if (end == c)
+    return -1;
+  c = end;
+  index = index < 0 ? (long long) count + index : index - 1;
+  return index >= 0 && (unsigned long long) index < count ? index : -1;
+}
+
+void faceNormal(const float* p0, const float* p1, const float* p2, float* normal) {
+  float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+  float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+  normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+  normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+  normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+  float length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+  if (length > 0.f)
+    for (int i = 0 ; i < 3 ; i++)
+      normal[i] /= length;
+}
+
+// New buffer of the given capacity holding the used part of the previous one
+void growBuffer(unsigned int& buffer, unsigned int components, unsigned int used, unsigned int capacity) {
+  unsigned int newBuffer;
+  glGenBuffers(1, &newBuffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+  glBufferData(GL_COPY_WRITE_BUFFER, capacity * components * sizeof (float), NULL, GL_STATIC_DRAW);
+  if (buffer != 0) {
+    if (used > 0) {
+      glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used * components * sizeof (float));
+    }
+    glDeleteBuffers(1, &buffer);
+  }
+  buffer = newBuffer;
+}
+
+}
+
+ProgressiveLoader::ProgressiveLoader() : chunks(QUEUE_CHUNKS) {
+  chunkTriangles = 1 << 13;
+  stopping = false;
+  parsed = false;
+  failed = false;
+  memset(&stats, 0, sizeof (stats));
+}
+
+ProgressiveLoader::~ProgressiveLoader() {
+  stop();
+  for (unsigned int i = 0 ; i < parts.size() ; i++) {
+    glDeleteVertexArrays(1, &parts[i].VAO);
+    glDeleteBuffers(1, &parts[i].positionsVBO);
+    if (parts[i].withNormals)
+      glDeleteBuffers(1, &parts[i].normalsVBO);
+    if (parts[i].withUVs)
+      glDeleteBuffers(1, &parts[i].uvsVBO);
+  }
+}
+
+bool ProgressiveLoader::start(const string& geometryFilename, const string& materialFilename) {
+  if (parser.joinable())
+    return false;
+
+  // Materials are small, they are parsed here so that the thread never shares them while writing
+  if (!materialFilename.empty()) {
+    map<string, Material> materialsMap;
+    OBJLoader objLoader;
+    if (objLoader.loadMaterials(materialFilename, materialsMap)) {
+      materials.reserve(materialsMap.size());
+      for (map<string, Material>::iterator it = materialsMap.begin() ; it != materialsMap.end() ; it++) {
+        materialNames.push_back(it->first);
+        materials.push_back(move(it->second));
+      }
+      texturesLoaded.assign(materials.size(), false);
+    }
+  }
+
+  stopping = false;
+  parsed = false;
+  failed = false;
+  parser = thread(&ProgressiveLoader::parse, this, geometryFilename);
+  return true;
+}
+
+void ProgressiveLoader::stop() {
+  if (parser.joinable()) {
+    stopping = true;
+    parser.join();
+  }
+  MeshChunk* chunk;
+  while (chunks.pop(chunk))
+    chunksPool.release(chunk);
+}
+
+bool ProgressiveLoader::publish(MeshChunk* chunk) {
+  while (!chunks.push(chunk)) {
+    if (stopping) {
+      chunksPool.release(chunk);
+      return false;
+    }
+    // the render thread is behind, the chunks in flight are bounded
+    this_thread::sleep_for(chrono::milliseconds(1));
+  }
+  return true;
+}
+
+void ProgressiveLoader::parse(string geometryFilename) {
+  FILE* file = fopen(geometryFilename.c_str(), "r");
+  if (file == NULL) {
+    cerr << "Could not load the file " << geometryFilename << endl;
+    failed = true;
+    parsed = true;
+    return;
+  }
+
+  map<string, int> materialIndexes;
+  for (unsigned int i = 0 ; i < materialNames.size() ; i++)
+    materialIndexes[materialNames[i]] = i;
+
+  vector<float> positions, normals, uvs;
+  vector<long long> face;
+  vector<char> line(LINE_SIZE), materialName(LINE_SIZE);
+  MeshChunk* chunk = NULL;
+  unsigned int part = 0;
+  bool partUsed = false, partNormals = false, partUVs = false;
+  int material = -1;
+
+  while (!stopping && fgets(&line[0], LINE_SIZE, file) != NULL) {
+    const char* c = &line[0];
+    while (*c == ' ' || *c == '\t')
+      c++;
+    char* end;
+
+    if (c[0] == 'v' && (c[1] == ' ' || c[1] == 'n' || c[1] == 't')) {
+      vector<float>& values = c[1] == ' ' ? positions : (c[1] == 'n' ? normals : uvs);
+      int components = c[1] == 't' ? 2 : 3;
+      c += 2;
+      for (int i = 0 ; i < components ; i++) {
+        values.push_back(strtof(c, &end));
+        c = end;
+      }
+    }
+    else if ((c[0] == 'o' && c[1] == ' ') || strncmp(c, "usemtl ", 7) == 0) {
+      int newMaterial = material;
+      if (c[0] == 'u') {
+        map<string, int>::iterator it;
+        newMaterial = sscanf(c + 7, "%s", &materialName[0]) == 1
+                      && (it = materialIndexes.find(&materialName[0])) != materialIndexes.end() ? it->second : -1;
+      }
+      // new object, or new material within an object: the next faces go in a new part
+      if (partUsed && (c[0] == 'o' || newMaterial != material)) {
+        if (chunk != NULL && !publish(chunk))
+          break;
+        chunk = NULL;
+        part++;
+        partUsed = false;
+      }
+      material = newMaterial;
+    }
+    else if (c[0] == 'f' && c[1] == ' ') {
+      // position, uv and normal indices of each vertex
+      face.clear();
+      c += 2;
+      bool valid = true;
+      while (true) {
+        while (*c == ' ' || *c == '\t')
+          c++;
+        if (*c == '\0' || *c == '\n' || *c == '\r')
+          break;
+        long long p = objIndex(c, positions.size() / 3), t = -1, n = -1;
+        if (*c == '/') {
+          c++;
+          if (*c != '/')
+            t = objIndex(c, uvs.size() / 2);
+          if (*c == '/') {
+            c++;
+            n = objIndex(c, normals.size() / 3);
+          }
+        }
+        while (*c != '\0' && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r')
+          c++;
+        valid = valid && p >= 0;
+        face.push_back(p);
+        face.push_back(t);
+        face.push_back(n);
+      }
+      if (!valid || face.size() < 9)
+        continue;
+
+      if (!partUsed) {
+        partUsed = true;
+        partNormals = face[2] >= 0;
+        partUVs = face[1] >= 0;
+      }
+      if (chunk == NULL) {
+        chunk = chunksPool.acquire();
+        chunk->positions.clear();
+        chunk->normals.clear();
+        chunk->uvs.clear();
+        chunk->part = part;
+        chunk->material = material;
+        chunk->withNormals = partNormals;
+        chunk->withUVs = partUVs;
+        chunk->positions.reserve(chunkTriangles * 9);
+        if (partNormals)
+          chunk->normals.reserve(chunkTriangles * 9);
+        if (partUVs)
+          chunk->uvs.reserve(chunkTriangles * 6);
+      }
+
+      // polygons as triangle fans
+      for (unsigned int k = 1 ; k + 1 < face.size() / 3 ; k++) {
+        const long long* vertices[3] = { &face[0], &face[k * 3], &face[(k + 1) * 3] };
+        float normal[3] = { 0.f, 0.f, 0.f };
+        if (partNormals && (vertices[0][2] < 0 || vertices[1][2] < 0 || vertices[2][2] < 0))
+          faceNormal(&positions[vertices[0][0] * 3], &positions[vertices[1][0] * 3], &positions[vertices[2][0] * 3], normal);
+        for (int v = 0 ; v < 3 ; v++) {
+          chunk->positions.insert(chunk->positions.end(), &positions[vertices[v][0] * 3], &positions[vertices[v][0] * 3] + 3);
+          if (partNormals) {
+            const float* n = vertices[v][2] >= 0 ? &normals[vertices[v][2] * 3] : normal;
+            chunk->normals.insert(chunk->normals.end(), n, n + 3);
+          }
+          if (partUVs) {
+            float noUV[2] = { 0.f, 0.f };
+            const float* t = vertices[v][1] >= 0 ? &uvs[vertices[v][1] * 2] : noUV;
+            chunk->uvs.insert(chunk->uvs.end(), t, t + 2);
+          }
+        }
+      }
+      if (chunk->positions.size() >= chunkTriangles * 9) {
+        if (!publish(chunk)) {
+          chunk = NULL;
+          break;
+        }
+        chunk = NULL;
+      }
+    }
+  }
+  if (chunk != NULL) {
+    if (stopping)
+      chunksPool.release(chunk);
+    else
+      publish(chunk);
+  }
+  fclose(file);
+  parsed = true;
+}
+
+unsigned int ProgressiveLoader::uploadPending(unsigned int maxChunks) {
+  unsigned int uploaded = 0;
+  MeshChunk* chunk;
+  while ((maxChunks == 0 || uploaded < maxChunks) && chunks.pop(chunk)) {
+    while (parts.size() <= chunk->part) {
+      Part part;
+      part.positionsVBO = part.normalsVBO = part.uvsVBO = part.VAO = 0;
+      part.verticesNumber = part.capacity = 0;
+      part.material = chunk->material;
+      part.withNormals = chunk->withNormals;
+      part.withUVs = chunk->withUVs;
+      parts.push_back(part);
+      if (part.material >= 0 && !texturesLoaded[part.material]) {
+        materials[part.material].loadTextures();
+        texturesLoaded[part.material] = true;
+      }
+    }
+
+    Part& part = parts[chunk->part];
+    unsigned int vertices = chunk->positions.size() / 3;
+    if (part.verticesNumber + vertices > part.capacity)
+      grow(part, part.verticesNumber + vertices);
+
+    glBindBuffer(GL_ARRAY_BUFFER, part.positionsVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, part.verticesNumber * 3 * sizeof (float), vertices * 3 * sizeof (float), &chunk->positions[0]);
+    if (part.withNormals) {
+      glBindBuffer(GL_ARRAY_BUFFER, part.normalsVBO);
+      glBufferSubData(GL_ARRAY_BUFFER, part.verticesNumber * 3 * sizeof (float), vertices * 3 * sizeof (float), &chunk->normals[0]);
+    }
+    if (part.withUVs) {
+      glBindBuffer(GL_ARRAY_BUFFER, part.uvsVBO);
+      glBufferSubData(GL_ARRAY_BUFFER, part.verticesNumber * 2 * sizeof (float), vertices * 2 * sizeof (float), &chunk->uvs[0]);
+    }
+    part.verticesNumber += vertices;
+
+    stats.chunksUploaded++;
+    stats.trianglesUploaded += vertices / 3;
+    uploaded++;
+    chunksPool.release(chunk);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  stats.parts = parts.size();
+  return uploaded;
+}
+
+void ProgressiveLoader::grow(Part& part, unsigned int vertices) {
+  // Doubling keeps the copies linear in the total size
+  unsigned int capacity = part.capacity > 0 ? part.capacity : 4 * chunkTriangles * 3;
+  while (capacity < vertices)
+    capacity *= 2;
+  if (part.capacity > 0)
+    stats.bufferGrowths++;
+
+  growBuffer(part.positionsVBO, 3, part.verticesNumber, capacity);
+  if (part.withNormals)
+    growBuffer(part.normalsVBO, 3, part.verticesNumber, capacity);
+  if (part.withUVs)
+    growBuffer(part.uvsVBO, 2, part.verticesNumber, capacity);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  part.capacity = capacity;
+
+  if (part.VAO == 0)
+    glGenVertexArrays(1, &part.VAO);
+  setAttributes(part);
+}
+
+// Same layout as Object::createVAO
+void ProgressiveLoader::setAttributes(const Part& part) const {
+  glBindVertexArray(part.VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, part.positionsVBO);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+  if (part.withNormals) {
+    glBindBuffer(GL_ARRAY_BUFFER, part.normalsVBO);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+  }
+  if (part.withUVs) {
+    glBindBuffer(GL_ARRAY_BUFFER, part.uvsVBO);
+    glVertexAttribPointer(part.withNormals ? 2 : 1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+  }
+  glEnableVertexAttribArray(0);
+  if (part.withNormals || part.withUVs)
+    glEnableVertexAttribArray(1);
+  if (part.withNormals && part.withUVs)
+    glEnableVertexAttribArray(2);
+  glBindVertexArray(0);
+}
+
+unsigned int ProgressiveLoader::shaderFeatures(unsigned int part, unsigned int lightsNumber) const {
+  unsigned int features = lightsFeature(lightsNumber);
+  if (parts[part].withNormals)
+    features |= FEATURE_NORMALS;
+  if (parts[part].withUVs)
+    features |= FEATURE_UVS | (parts[part].material >= 0 ? materials[parts[part].material] : defaultMaterial).shaderFeatures();
+  return features;
+}
+
+Material& ProgressiveLoader::getMaterial(unsigned int part) {
+  return parts[part].material >= 0 ? materials[parts[part].material] : defaultMaterial;
+}
+
+void ProgressiveLoader::draw(unsigned int part) const {
+  if (parts[part].verticesNumber == 0)
+    return;
+  glBindVertexArray(parts[part].VAO);
+  glDrawArrays(GL_TRIANGLES, 0, parts[part].verticesNumber);
+}
@@ -0,0 +1,114 @@
+#ifndef PROGRESSIVELOADER_H
+#define PROGRESSIVELOADER_H
+
+#include <GL/glew.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vec3.h>
+
+#include "allocators.h"
+#include "material.h"
+#include "spscqueue.h"
+
+
+namespace qgl {
+
+// Triangles parsed by the loader thread, with the vertices expanded like
+// Object::computeVertices does
+struct MeshChunk {
+  unsigned int part;
+  int material; // -1 without material
+  bool withNormals;
+  bool withUVs;
+  std::vector<float> positions;
+  std::vector<float> normals;
+  std::vector<float> uvs;
+};
+
+struct ProgressiveLoaderStats {
+  unsigned int parts;
+  unsigned int chunksUploaded;
+  unsigned long long trianglesUploaded;
+  unsigned int bufferGrowths;
+};
+
+// Loads an OBJ file in a background thread and draws it while it loads.
+// The parser publishes chunks of triangles through a lock-free queue, the
+// render thread appends them to per part buffers with glBufferSubData. The
+// buffers double their capacity when they are full, the previous content
+// being copied on the GPU. A part is an object of the file with one material,
+// an object using several materials gives several parts.
+class ProgressiveLoader {
+
+  public:
+    ProgressiveLoader();
+    ~ProgressiveLoader();
+
+    // Triangles per published chunk
+    void setChunkTriangles(unsigned int triangles) { chunkTriangles = triangles; }
+
+    // Parses the materials and starts the loader thread
+    bool start(const std::string& geometryFilename, const std::string& materialFilename = "");
+    void stop();
+
+    // Render thread: uploads at most maxChunks published chunks, all of them with 0.
+    // Returns the number of uploaded chunks.
+    unsigned int uploadPending(unsigned int maxChunks = 0);
+    // Whole file parsed and uploaded
+    bool isFinished() const { return parsed.load() && chunks.empty(); }
+    bool hasFailed() const { return failed.load(); }
+
+    unsigned int partsNumber() const { return parts.size(); }
+    unsigned int shaderFeatures(unsigned int part, unsigned int lightsNumber = 1) const;
+    Material& getMaterial(unsigned int part);
+    void draw(unsigned int part) const;
+
+    const ProgressiveLoaderStats& getStats() const { return stats; }
+
+  private:
+    ProgressiveLoader(const ProgressiveLoader&);
+    ProgressiveLoader& operator=(const ProgressiveLoader&);
+
+    struct Part {
+      unsigned int positionsVBO;
+      unsigned int normalsVBO;
+      unsigned int uvsVBO;
+      unsigned int VAO;
+      unsigned int verticesNumber;
+      unsigned int capacity; // in vertices
+      int material;
+      bool withNormals;
+      bool withUVs;
+    };
+
+    void parse(std::string geometryFilename);
+    bool publish(MeshChunk* chunk);
+    void grow(Part& part, unsigned int vertices);
+    void setAttributes(const Part& part) const;
+
+    unsigned int chunkTriangles;
+    SPSCQueue<MeshChunk*> chunks;
+    // Uploaded chunks go back to the parser with the capacity of their arrays
+    Pool<MeshChunk> chunksPool;
+    std::thread parser;
+    std::atomic<bool> stopping;
+    std::atomic<bool> parsed;
+    std::atomic<bool> failed;
+
+    // Filled before the thread starts and not resized afterwards
+    std::vector<std::string> materialNames;
+    std::vector<Material> materials;
+    std::vector<bool> texturesLoaded;
+    Material defaultMaterial;
+
+    std::vector<Part> parts;
+    ProgressiveLoaderStats stats;
+
+};
+
+}
+
+#endif // PROGRESSIVELOADER_H
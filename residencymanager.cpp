@@ -0,0 +1,241 @@
+#include "residencymanager.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace qgl;
+using namespace std;
+
+namespace {
+
+// Vertex buffers of an object and of its meshlets, created again from the vertex arrays
+class ObjectResident : public Resident {
+
+  public:
+    ObjectResident(Object& object, MeshletMesh* meshlets) : object(object), meshlets(meshlets), evicted(false), bytes(0) {}
+
+    unsigned long long residentBytes() const {
+      if (evicted || object.getVAO() == 0)
+        return 0;
+      return object.bufferBytes() + (meshlets != NULL ? meshlets->bufferBytes() : 0);
+    }
+    unsigned long long fullBytes() const {
+      return evicted ? bytes : residentBytes();
+    }
+    bool evict() {
+      // nothing uploaded
+      if (evicted || object.getVAO() == 0)
+        return false;
+      bytes = residentBytes();
+      object.releaseBuffers();
+      if (meshlets != NULL)
+        meshlets->destroy();
+      evicted = true;
+      return true;
+    }
+    void restore() {
+      if (!evicted)
+        return;
+      object.createVAO();
+      if (meshlets != NULL)
+        meshlets->createVAO();
+      evicted = false;
+    }
+    bool isEvicted() const { return evicted; }
+
+  private:
+    Object& object;
+    MeshletMesh* meshlets;
+    bool evicted;
+    unsigned long long bytes; // when evicted
+};
+
+// Textures of a material, halved on the GPU and loaded again at full size
+class MaterialResident : public Resident {
+
+  public:
+    MaterialResident(Material& material) : material(material), evicted(false) {}
+
+    unsigned long long residentBytes() const { return evicted ? 0 : material.getTextureBytes(); }
+    unsigned long long fullBytes() const { return material.getFullTextureBytes(); }
+    bool reduce(int minTextureSize) {
+      return !evicted && material.canReloadTextures() && material.halveTextures(minTextureSize);
+    }
+    bool evict() {
+      if (evicted || material.getTextureBytes() == 0 || !material.canReloadTextures())
+        return false;
+      material.releaseTextures();
+      evicted = true;
+      return true;
+    }
+    void restore() {
+      material.loadTextures();
+      evicted = false;
+    }
+    bool isEvicted() const { return evicted; }
+    bool isReduced() const { return evicted || material.getTextureLevel() > 0; }
+
+  private:
+    Material& material;
+    bool evicted;
+};
+
+}
+
+ResidencyManager::ResidencyManager() {
+  budget = 0;
+  usedBytes = 0;
+  framesInFlight = 1;
+  minTextureSize = 64;
+  frameNumber = 0;
+  memset(&stats, 0, sizeof (stats));
+}
+
+ResidencyManager::~ResidencyManager() {
+  for (unsigned int i = 0 ; i < entries.size() ; i++)
+    delete entries[i].resident;
+}
+
+unsigned int ResidencyManager::add(Resident* resident, ResourceCategory category) {
+  Entry entry;
+  entry.resident = resident;
+  entry.category = category;
+  entry.bytes = 0;
+  entry.lastUsed = frameNumber;
+  entries.push_back(entry);
+  refresh(entries.back());
+  return entries.size() - 1;
+}
+
+unsigned int ResidencyManager::addObject(Object& object, MeshletMesh* meshlets) {
+  ManagedObject managed;
+  managed.buffers = add(new ObjectResident(object, meshlets), RESOURCE_VERTEX_BUFFERS);
+  managed.textures = -1;
+  Material& material = object.getMaterial();
+  if (material.getFullTextureBytes() > 0) {
+    unordered_map<const Material*, int>::iterator it = materials.find(&material);
+    if (it == materials.end())
+      it = materials.insert(make_pair(&material, (int) add(new MaterialResident(material), RESOURCE_TEXTURES))).first;
+    managed.textures = it->second;
+  }
+  objects.push_back(managed);
+  return objects.size() - 1;
+}
+
+unsigned int ResidencyManager::track(ResourceCategory category, unsigned long long bytes) {
+  unsigned int id = add(NULL, category);
+  update(id, bytes);
+  return id;
+}
+
+void ResidencyManager::update(unsigned int id, unsigned long long bytes) {
+  Entry& entry = entries[id];
+  usedBytes += bytes - entry.bytes;
+  entry.bytes = bytes;
+}
+
+void ResidencyManager::refresh(Entry& entry) {
+  if (entry.resident != NULL) {
+    unsigned long long bytes = entry.resident->residentBytes();
+    usedBytes += bytes - entry.bytes;
+    entry.bytes = bytes;
+  }
+}
+
+bool ResidencyManager::isStale(const Entry& entry) const {
+  return frameNumber - entry.lastUsed >= (long) framesInFlight;
+}
+
+bool ResidencyManager::use(unsigned int id) {
+  Entry& entry = entries[id];
+  entry.lastUsed = frameNumber;
+  Resident* resident = entry.resident;
+  if (resident == NULL || !resident->isReduced())
+    return false;
+  unsigned long long fullBytes = resident->fullBytes();
+  if (!resident->isEvicted() && budget > 0 && usedBytes - entry.bytes + fullBytes > budget)
+    return false;
+  resident->restore();
+  refresh(entry);
+  stats.restores++;
+  stats.restoredBytes += entry.bytes;
+  return true;
+}
+
+bool ResidencyManager::useObject(unsigned int object) {
+  bool restored = use(objects[object].buffers);
+  if (objects[object].textures >= 0)
+    restored = use(objects[object].textures) || restored;
+  return restored;
+}
+
+void ResidencyManager::collectVictims(vector<unsigned int>& victims) const {
+  vector<pair<long, unsigned int> > candidates;
+  for (unsigned int i = 0 ; i < entries.size() ; i++)
+    if (entries[i].resident != NULL && entries[i].bytes > 0)
+      candidates.push_back(make_pair(entries[i].lastUsed, i));
+  sort(candidates.begin(), candidates.end());
+  victims.clear();
+  for (unsigned int i = 0 ; i < candidates.size() ; i++)
+    victims.push_back(candidates[i].second);
+}
+
+void ResidencyManager::enforceBudget() {
+  // Buffers and textures created again outside of the manager since the last frame
+  for (unsigned int i = 0 ; i < entries.size() ; i++)
+    refresh(entries[i]);
+  if (budget == 0 || usedBytes <= budget)
+    return;
+
+  vector<unsigned int> victims;
+  collectVictims(victims);
+  // Halving first: the textures stay drawable and are only restored once their full
+  // size fits, by loading their files again with stbi_load on the GL thread or by
+  // uploading their kept pixels, as evicted textures are when drawn again
+  for (unsigned int i = 0 ; i < victims.size() && usedBytes > budget ; i++) {
+    Entry& entry = entries[victims[i]];
+    while (isStale(entry) && usedBytes > budget && entry.resident->reduce(minTextureSize)) {
+      refresh(entry);
+      stats.reductions++;
+    }
+  }
+  for (unsigned int i = 0 ; i < victims.size() && usedBytes > budget ; i++) {
+    Entry& entry = entries[victims[i]];
+    if (isStale(entry) && entry.resident->evict()) {
+      refresh(entry);
+      stats.evictions++;
+    }
+  }
+  // What is drawn does not fit: lower resolution rather than missing objects
+  for (unsigned int i = 0 ; i < victims.size() && usedBytes > budget ; i++) {
+    Entry& entry = entries[victims[i]];
+    while (usedBytes > budget && entry.resident->reduce(minTextureSize)) {
+      refresh(entry);
+      stats.reductions++;
+    }
+  }
+  if (usedBytes > budget)
+    stats.overBudgetFrames++;
+}
+
+void ResidencyManager::endFrame() {
+  stats.budget = budget;
+  stats.usedBytes = usedBytes;
+  stats.resources = 0;
+  stats.evictedResources = 0;
+  stats.reducedResources = 0;
+  for (int c = 0 ; c < RESOURCE_CATEGORIES ; c++)
+    stats.categoryBytes[c] = 0;
+  for (unsigned int i = 0 ; i < entries.size() ; i++) {
+    const Entry& entry = entries[i];
+    stats.categoryBytes[entry.category] += entry.bytes;
+    if (entry.resident == NULL)
+      continue;
+    stats.resources++;
+    if (entry.resident->isEvicted())
+      stats.evictedResources++;
+    else if (entry.resident->isReduced())
+      stats.reducedResources++;
+  }
+  frameNumber++;
+}
@@ -0,0 +1,141 @@
+#ifndef RESIDENCYMANAGER_H
+#define RESIDENCYMANAGER_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "material.h"
+#include "meshlets.h"
+#include "object.h"
+
+
+namespace qgl {
+
+enum ResourceCategory {
+  RESOURCE_VERTEX_BUFFERS,
+  RESOURCE_TEXTURES,
+  RESOURCE_RENDER_TARGETS,
+  RESOURCE_STREAMED, // under their own budget, e.g. the pages of PagedMesh
+  RESOURCE_CATEGORIES
+};
+
+struct ResidencyStats {
+  unsigned long long budget;
+  unsigned long long usedBytes;
+  unsigned long long categoryBytes[RESOURCE_CATEGORIES];
+  unsigned int resources;
+  unsigned int evictedResources;
+  unsigned int reducedResources; // resident at a lower resolution
+  unsigned long long evictions; // since the start
+  unsigned long long reductions;
+  unsigned long long restores;
+  unsigned long long restoredBytes;
+  unsigned long overBudgetFrames; // even halving what the frames in flight draw was not enough
+};
+
+// GPU memory the residency manager can take back and have restored
+class Resident {
+
+  public:
+    virtual ~Resident() {}
+
+    // GPU memory now, and once restored
+    virtual unsigned long long residentBytes() const = 0;
+    virtual unsigned long long fullBytes() const = 0;
+    // Frees part of the memory while staying drawable, false when it cannot
+    virtual bool reduce(int /* minTextureSize */) { return false; }
+    // Frees all of it, false when there is nothing to free
+    virtual bool evict() = 0;
+    // Back to the full resource, from a copy in memory or on the disk
+    virtual void restore() = 0;
+    virtual bool isEvicted() const = 0;
+    virtual bool isReduced() const { return isEvicted(); }
+
+};
+
+// Accounts the GPU memory by category and keeps it within a budget. Every
+// frame, the resources drawn are marked used and restored if they were
+// evicted. At the end of the frame, while over budget, the textures the
+// frames in flight do not draw are halved, from the least recently drawn,
+// then these resources are evicted, and when that is not enough the textures
+// in use are halved: they stay drawable, and come back to their full size
+// once it fits again. Objects keep their vertex arrays and materials their
+// texture files, or their pixels with Material::setKeepPixels, which is where
+// they are restored from; textures with neither are only accounted.
+// Everything runs on the GL thread.
+class ResidencyManager {
+
+  public:
+    ResidencyManager();
+    ~ResidencyManager();
+
+    // 0, the default, only accounts
+    void setBudget(unsigned long long bytes) { budget = bytes; }
+    unsigned long long getBudget() const { return budget; }
+    // Resources drawn by the frames the GPU may still be rendering are not evicted
+    void setFramesInFlight(unsigned int frames) { framesInFlight = frames; }
+    // Textures are not halved below it, 64 by default
+    void setMinTextureSize(int size) { minTextureSize = size; }
+
+    // Takes the ownership of resident, returns its id
+    unsigned int add(Resident* resident, ResourceCategory category);
+    // The buffers of the object, and of its meshlets if any, and the textures of its
+    // material, added once for the objects sharing it. The object, the meshlets and
+    // the material must stay at the same address while managed. The object must be
+    // uploaded, by the calling thread or returned by UploadWorker::collect, and its
+    // material textures loaded. Returns the index of the object for useObject.
+    unsigned int addObject(Object& object, MeshletMesh* meshlets = NULL);
+    // Memory only accounted, such as render targets, returns its id
+    unsigned int track(ResourceCategory category, unsigned long long bytes);
+    void update(unsigned int id, unsigned long long bytes);
+
+    // Marks the resource as drawn in this frame. Evicted, it is restored right away,
+    // reduced, once its full size fits in the budget. True when it was restored.
+    bool use(unsigned int id);
+    // Both resources of the object: when true, its shader features may have changed
+    bool useObject(unsigned int object);
+
+    // Frees memory down to the budget, see above
+    void enforceBudget();
+    void endFrame();
+
+    const ResidencyStats& getStats() const { return stats; }
+
+  private:
+    ResidencyManager(const ResidencyManager&);
+    ResidencyManager& operator=(const ResidencyManager&);
+
+    struct Entry {
+      Resident* resident; // NULL when only accounted
+      ResourceCategory category;
+      unsigned long long bytes; // accounted now
+      long lastUsed;
+    };
+
+    struct ManagedObject {
+      unsigned int buffers;
+      int textures; // -1 when the material has no textures
+    };
+
+    void refresh(Entry& entry);
+    bool isStale(const Entry& entry) const;
+    // Resources holding memory, from the least recently used
+    void collectVictims(std::vector<unsigned int>& victims) const;
+
+    std::vector<Entry> entries;
+    std::vector<ManagedObject> objects;
+    std::unordered_map<const Material*, int> materials;
+
+    unsigned long long budget;
+    unsigned long long usedBytes;
+    unsigned int framesInFlight;
+    int minTextureSize;
+    long frameNumber;
+
+    ResidencyStats stats;
+
+};
+
+}
+
+#endif // RESIDENCYMANAGER_H
@@ -22,10 +22,15 @@ Shader::Shader(GLenum shaderType, qtools::Logger* logger) {
 
 void Shader::setLogger(qtools::Logger* logger) {
   this->logger = logger;
-  logInfo = true;
+  logInfo = logger != NULL;
 }
 
 bool Shader::sourceFromFile(const string& filename) const {
+  return sourceFromFile(filename, "");
+}
+
+// The defines are injected right after the #version directive, which must stay first
+bool Shader::sourceFromFile(const string& filename, const string& defines) const {
   ifstream file;
   file.open(filename.c_str());
 
@@ -42,6 +47,14 @@ bool Shader::sourceFromFile(const string& filename) const {
   file.close();
 
   string shaderString = stream.str();
+  if (!defines.empty()) {
+    size_t pos = 0;
+    if (shaderString.compare(0, 8, "#version") == 0) {
+      pos = shaderString.find('\n');
+      pos = (pos == string::npos) ? shaderString.size() : pos + 1;
+    }
+    shaderString.insert(pos, defines);
+  }
 
   return setSource(shaderString.c_str());
 }
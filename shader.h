@@ -19,6 +19,7 @@ class Shader {
     Shader(GLenum shaderType, qtools::Logger* log);
 
     bool sourceFromFile(const std::string& filename) const;
+    bool sourceFromFile(const std::string& filename, const std::string& defines) const;
     bool setSource(const char* shader) const;
     unsigned int getIndex() const { return index; }
 
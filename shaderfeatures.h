@@ -0,0 +1,29 @@
+#ifndef SHADERFEATURES_H
+#define SHADERFEATURES_H
+
+namespace qgl {
+
+// Features a shader variant is specialized for, combined in a bitmask.
+// The lights number is stored in the upper bits.
+enum ShaderFeature {
+  FEATURE_DIFFUSE_MAP = 1 << 0,
+  FEATURE_SPECULAR_MAP = 1 << 1,
+  FEATURE_NORMALS = 1 << 2,
+  FEATURE_UVS = 1 << 3,
+  FEATURE_COLORS = 1 << 4
+};
+
+const unsigned int FEATURE_LIGHTS_SHIFT = 8;
+const unsigned int FEATURE_LIGHTS_MASK = 0xff << FEATURE_LIGHTS_SHIFT;
+
+inline unsigned int lightsFeature(unsigned int lightsNumber) {
+  return (lightsNumber << FEATURE_LIGHTS_SHIFT) & FEATURE_LIGHTS_MASK;
+}
+
+inline unsigned int featureLightsNumber(unsigned int features) {
+  return (features & FEATURE_LIGHTS_MASK) >> FEATURE_LIGHTS_SHIFT;
+}
+
+}
+
+#endif // SHADERFEATURES_H
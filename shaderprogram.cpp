@@ -49,7 +49,7 @@ ShaderProgram::ShaderProgram(qtools::Logger* logger) {
 
 void ShaderProgram::setLogger(qtools::Logger* logger) {
   this->logger = logger;
-  logInfo = true;
+  logInfo = logger != NULL;
 }
 
 void ShaderProgram::attachShader(const Shader& shader) const {
@@ -57,9 +57,16 @@ void ShaderProgram::attachShader(const Shader& shader) const {
 }
 
 bool ShaderProgram::loadShader(GLenum shaderType, const string& shaderFile) {
+  return loadShader(shaderType, shaderFile, "");
+}
+
+bool ShaderProgram::loadShader(GLenum shaderType, const string& shaderFile, const string& defines) {
   Shader shader(shaderType, logger);
-  if (!shader.sourceFromFile(shaderFile)) {
-    *logger << "Error when loading the shader." << Logger::ERROR << Logger::FILE;
+  if (!shader.sourceFromFile(shaderFile, defines)) {
+    if (logInfo)
+      *logger << "Error when loading the shader." << Logger::ERROR << Logger::FILE;
+    else
+      cerr << "Error when loading the shader." << endl;
     return false;
   }
   attachShader(shader);
@@ -187,44 +194,64 @@ void ShaderProgram::printAll() const {
   printInfoLog();
 }
 
-void ShaderProgram::useUniform(char* uniform) {
+void ShaderProgram::useUniform(const char* uniform) {
   uniformLocations.insert(pair<string, int>(string(uniform), glGetUniformLocation(index, uniform)));
 }
 
+bool ShaderProgram::hasUniform(const char* uniform) const {
+  map<string, int>::const_iterator it = uniformLocations.find(string(uniform));
+  return it != uniformLocations.end() && it->second != -1;
+}
+
 void ShaderProgram::use() {
   glUseProgram(index);
 }
 
-void ShaderProgram::setUniform1i(char* uniform, int i) {
+void ShaderProgram::setUniform1i(const char* uniform, int i) {
   int location = uniformLocations.find(string(uniform))->second;
   glUniform1i(location, i);
 }
 
-void ShaderProgram::setUniform1f(char* uniform, float f) {
+void ShaderProgram::setUniform1f(const char* uniform, float f) {
+  int location = uniformLocations.find(string(uniform))->second;
+  glUniform1f(location, f);
+}
+
+void ShaderProgram::setUniform2f(const char* uniform, float x, float y) {
+  int location = uniformLocations.find(string(uniform))->second;
+  glUniform2f(location, x, y);
+}
+
+void ShaderProgram::setUniform4f(const char* uniform, float x, float y, float z, float w) {
+  int location = uniformLocations.find(string(uniform))->second;
+  glUniform4f(location, x, y, z, w);
+}
+
+void ShaderProgram::setUniform3i(const char* uniform, int x, int y, int z) {
   int location = uniformLocations.find(string(uniform))->second;
-  glUniform1i(location, f);
+  glUniform3i(location, x, y, z);
 }
 
-void ShaderProgram::setUniformMat4f(char* uniform, qm::Mat4f& matrix) {
+void ShaderProgram::setUniformMat4f(const char* uniform, qm::Mat4f& matrix) {
   int location = uniformLocations.find(string(uniform))->second;
   glUniformMatrix4fv(location, 1, GL_FALSE, matrix.getArray());
 }
 
-void ShaderProgram::setUniformMat3f(char* uniform, qm::Mat3f& matrix) {
+void ShaderProgram::setUniformMat3f(const char* uniform, qm::Mat3f& matrix) {
   int location = uniformLocations.find(string(uniform))->second;
   glUniformMatrix3fv(location, 1, GL_FALSE, matrix.getArray());
 }
 
-void ShaderProgram::setUniformVec3f(char* uniform, qm::Vec3f& vec) {
+void ShaderProgram::setUniformVec3f(const char* uniform, qm::Vec3f& vec) {
   int location = uniformLocations.find(string(uniform))->second;
   glUniform3f(location, vec[0], vec[1], vec[2]);
 }
 
-void ShaderProgram::setUniformVec3f(char* uniform, float x, float y, float z) {
+void ShaderProgram::setUniformVec3f(const char* uniform, float x, float y, float z) {
   int location = uniformLocations.find(string(uniform))->second;
   glUniform3f(location, x, y, z);
 }
-void ShaderProgram::setUniformTextureIndex(char* uniform, int index) {
+void ShaderProgram::setUniformTextureIndex(const char* uniform, int index) {
   int location = uniformLocations.find(string(uniform))->second;
   textureIndexes.insert(pair<string, int>(string(uniform), index));
   glUniform1i(location, index);
@@ -244,8 +271,13 @@ void ShaderProgram::setUniformsFromMaterial(Material& material) {
     glUniform1f(it->second, material.d);
 
   // Textures
-  setUniform1i("useDiffuseMap", 0);
-  setUniform1i("useSpecularMap", 0);
+  // Shader variants compile the texture lookups in or out, so these flags only exist in older shaders
+  bool diffuseFlag = hasUniform("useDiffuseMap");
+  bool specularFlag = hasUniform("useSpecularMap");
+  if (diffuseFlag)
+    setUniform1i("useDiffuseMap", 0);
+  if (specularFlag)
+    setUniform1i("useSpecularMap", 0);
   if ((it = uniformLocations.find(string("diffuseMap"))) != uniformLocations.end()) {
     if (material.diffuseTexture != 0) {
       int textureIndex = -1;
@@ -260,7 +292,8 @@ void ShaderProgram::setUniformsFromMaterial(Material& material) {
         else if (textureIndex == 3)
           glActiveTexture(GL_TEXTURE3);
         glBindTexture(GL_TEXTURE_2D, material.diffuseTexture);
-        setUniform1i("useDiffuseMap", 1);
+        if (diffuseFlag)
+          setUniform1i("useDiffuseMap", 1);
       }
     }
   }
@@ -278,7 +311,8 @@ void ShaderProgram::setUniformsFromMaterial(Material& material) {
         else if (textureIndex == 3)
           glActiveTexture(GL_TEXTURE3);
         glBindTexture(GL_TEXTURE_2D, material.specularTexture);
-        setUniform1i("useSpecularMap", 1);
+        if (specularFlag)
+          setUniform1i("useSpecularMap", 1);
       }
     }
   }
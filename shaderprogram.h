@@ -22,6 +22,7 @@ class ShaderProgram {
 
     void attachShader(const Shader& shader) const;
     bool loadShader(GLenum shaderType, const std::string& shaderFile);
+    bool loadShader(GLenum shaderType, const std::string& shaderFile, const std::string& defines);
     bool link() const;
     unsigned int getIndex() const { return index; }
 
@@ -30,17 +31,21 @@ class ShaderProgram {
     void printAll() const;
     void printInfoLog() const;
 
-    void useUniform(char* uniform);
+    void useUniform(const char* uniform);
+    bool hasUniform(const char* uniform) const;
 
     void use();
 
-    void setUniform1i(char* uniform, int i);
-    void setUniform1f(char* uniform, float f);
-    void setUniformMat4f(char* uniform, qm::Mat4f& matrix);
-    void setUniformMat3f(char* uniform, qm::Mat3f& matrix);
-    void setUniformVec3f(char* uniform, qm::Vec3f& vec);
-    void setUniformVec3f(char* uniform, float x, float y, float z);
-    void setUniformTextureIndex(char* uniform, int index);
+    void setUniform1i(const char* uniform, int i);
+    void setUniform1f(const char* uniform, float f);
+    void setUniform2f(const char* uniform, float x, float y);
+    void setUniform4f(const char* uniform, float x, float y, float z, float w);
+    void setUniform3i(const char* uniform, int x, int y, int z);
+    void setUniformMat4f(const char* uniform, qm::Mat4f& matrix);
+    void setUniformMat3f(const char* uniform, qm::Mat3f& matrix);
+    void setUniformVec3f(const char* uniform, qm::Vec3f& vec);
+    void setUniformVec3f(const char* uniform, float x, float y, float z);
+    void setUniformTextureIndex(const char* uniform, int index);
 
     void setUniformsFromMaterial(Material& material);
 
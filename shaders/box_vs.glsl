@@ -0,0 +1,10 @@
+#version 400
+// Unit cube corner, scaled to the box
+layout(location = 0) in vec3 vertexPosition;
+
+uniform mat4 view, proj, model;
+uniform vec3 boxMin, boxMax;
+
+void main () {
+  gl_Position = proj * view * model * vec4(mix(boxMin, boxMax, vertexPosition), 1.0);
+}
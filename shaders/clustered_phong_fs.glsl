@@ -0,0 +1,103 @@
+#version 400
+
+// Variant defines: HAS_NORMALS, HAS_UVS, HAS_COLORS, USE_DIFFUSE_MAP, USE_SPECULAR_MAP
+// Lights come from LightManager: only the lights of the fragment cluster are shaded
+
+// Geometry
+in vec3 position_eye, normal_eye;
+in vec2 uv;
+in vec3 color;
+
+// Lights, already in eye space: (position, radius), (diffuse, 0), (specular, 0)
+uniform samplerBuffer lightData;
+// Offset and count in lightIndices per cluster
+uniform usamplerBuffer clusterData;
+uniform usamplerBuffer lightIndices;
+
+// Tiles in x and y, slices in depth
+uniform ivec3 clusterGrid;
+// Tile size in pixels
+uniform vec2 clusterTileSize;
+// slice = log(depth) * clusterDepthScale + clusterDepthBias
+uniform float clusterDepthScale;
+uniform float clusterDepthBias;
+// Sum of the ambient colors of all lights
+uniform vec3 ambientLight;
+
+// Object material
+uniform vec3 ambientColor;
+uniform vec3 diffuseColor;
+uniform vec3 specularColor;
+
+#ifdef USE_DIFFUSE_MAP
+uniform sampler2D diffuseMap;
+#endif
+#ifdef USE_SPECULAR_MAP
+uniform sampler2D specularMap;
+#endif
+
+float specularExponent = 100.0;
+
+out vec4 frag_colour;
+
+void main() {
+  vec2 flippedUV = vec2(uv.x, 1.0 - uv.y);
+
+  vec3 diffuse = diffuseColor;
+#ifdef HAS_COLORS
+  diffuse *= color;
+#endif
+#ifdef USE_DIFFUSE_MAP
+  diffuse *= texture(diffuseMap, flippedUV).rgb;
+#endif
+  vec3 specular = specularColor;
+#ifdef USE_SPECULAR_MAP
+  specular *= texture(specularMap, flippedUV).rgb;
+#endif
+
+  vec3 colour = ambientLight * ambientColor;
+
+  // Cluster of the fragment
+  ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), clusterGrid.xy - 1);
+  int slice = int(log(-position_eye.z) * clusterDepthScale + clusterDepthBias);
+  slice = clamp(slice, 0, clusterGrid.z - 1);
+  int cluster = (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x;
+  uvec2 range = texelFetch(clusterData, cluster).xy;
+
+#ifdef HAS_NORMALS
+  // because of scaling
+  vec3 normal = normalize(normal_eye);
+  vec3 surfaceToViewer_eye = normalize(-position_eye);
+#endif
+
+  for (uint i = 0u ; i < range.y ; i++) {
+    int light = int(texelFetch(lightIndices, int(range.x + i)).r);
+    vec4 positionRadius = texelFetch(lightData, 3 * light);
+    vec3 lightDiffuse = texelFetch(lightData, 3 * light + 1).rgb;
+
+    vec3 distanceToLight_eye = positionRadius.xyz - position_eye;
+    float distanceRatio = length(distanceToLight_eye) / positionRadius.w;
+    // smooth falloff reaching zero at the light radius
+    float attenuation = clamp(1.0 - distanceRatio * distanceRatio, 0.0, 1.0);
+    attenuation *= attenuation;
+
+#ifdef HAS_NORMALS
+    vec3 lightSpecular = texelFetch(lightData, 3 * light + 2).rgb;
+    vec3 directionToLight_eye = normalize(distanceToLight_eye);
+
+    float dotProduct = max(dot(directionToLight_eye, normal), 0.0);
+    colour += lightDiffuse * diffuse * dotProduct * attenuation;
+
+    // blinn-phong : do not use the expensive reflect method
+    vec3 halfWay_eye = normalize(surfaceToViewer_eye + directionToLight_eye);
+    float specularDotProduct = max(dot(halfWay_eye, normal), 0.0);
+    float specularFactor = pow(specularDotProduct, specularExponent);
+    colour += lightSpecular * specular * specularFactor * attenuation;
+#else
+    // no normals to shade with: unlit diffuse
+    colour += lightDiffuse * diffuse * attenuation;
+#endif
+  }
+
+  frag_colour = vec4(colour, 1.0);
+}
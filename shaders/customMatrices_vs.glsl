@@ -1,16 +1,41 @@
 #version 400
 layout(location = 0) in vec3 vertexPosition;
+#ifdef HAS_NORMALS
 layout(location = 1) in vec3 vertexNormal;
 layout(location = 2) in vec2 UV;
+#else
+layout(location = 1) in vec2 UV;
+#endif
+// Per-vertex colors of scanned meshes, after the tangents
+#ifdef HAS_COLORS
+layout(location = 4) in vec3 vertexColor;
+#endif
 
 uniform mat4 view, proj, model;
 
 out vec3 position_eye, normal_eye;
 out vec2 uv;
+out vec3 color;
+
+// Same position as depth_vs.glsl, for the GL_EQUAL depth test after the depth pre-pass
+invariant gl_Position;
 
 void main () {
+#ifdef HAS_UVS
   uv = UV;
+#else
+  uv = vec2(0.0, 0.0);
+#endif
+#ifdef HAS_COLORS
+  color = vertexColor;
+#else
+  color = vec3(1.0, 1.0, 1.0);
+#endif
   position_eye = vec3(view * model * vec4(vertexPosition, 1.0));
+#ifdef HAS_NORMALS
   normal_eye = vec3(view * model * vec4(vertexNormal, 0.0));
+#else
+  normal_eye = vec3(0.0, 0.0, 1.0);
+#endif
   gl_Position = proj * vec4(position_eye, 1.0);
 }
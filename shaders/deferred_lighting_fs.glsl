@@ -0,0 +1,93 @@
+#version 400
+
+// Lighting pass of deferred shading: adds the lights of each pixel cluster
+// to the light accumulation target, see GBuffer and LightManager
+
+in vec2 uv;
+
+// G-buffer
+uniform sampler2D albedoTexture;
+uniform sampler2D specularTexture;
+uniform sampler2D normalTexture;
+uniform sampler2D depthTexture;
+// 1 / proj[0][0], 1 / proj[1][1], proj[2][2], proj[3][2]
+uniform vec4 projectionParameters;
+
+// Lights, already in eye space: (position, radius), (diffuse, 0), (specular, 0)
+uniform samplerBuffer lightData;
+// Offset and count in lightIndices per cluster
+uniform usamplerBuffer clusterData;
+uniform usamplerBuffer lightIndices;
+
+uniform ivec3 clusterGrid;
+uniform vec2 clusterTileSize;
+uniform float clusterDepthScale;
+uniform float clusterDepthBias;
+
+float specularExponent = 100.0;
+
+out vec4 frag_colour;
+
+vec3 decodeNormal(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0)
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return normalize(n);
+}
+
+void main() {
+  ivec2 pixel = ivec2(gl_FragCoord.xy);
+  float depth = texelFetch(depthTexture, pixel, 0).r;
+  // background
+  if (depth == 1.0)
+    discard;
+
+  // eye space position from the depth
+  float ndcDepth = depth * 2.0 - 1.0;
+  float z = -projectionParameters.w / (ndcDepth + projectionParameters.z);
+  vec2 ndc = uv * 2.0 - 1.0;
+  vec3 position_eye = vec3(-z * ndc.x * projectionParameters.x, -z * ndc.y * projectionParameters.y, z);
+
+  vec4 albedo = texelFetch(albedoTexture, pixel, 0);
+  vec3 specular = texelFetch(specularTexture, pixel, 0).rgb;
+  bool lit = albedo.a > 0.5;
+  vec3 normal = decodeNormal(texelFetch(normalTexture, pixel, 0).xy);
+  vec3 surfaceToViewer_eye = normalize(-position_eye);
+
+  ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), clusterGrid.xy - 1);
+  int slice = int(log(-z) * clusterDepthScale + clusterDepthBias);
+  slice = clamp(slice, 0, clusterGrid.z - 1);
+  int cluster = (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x;
+  uvec2 range = texelFetch(clusterData, cluster).xy;
+
+  vec3 colour = vec3(0.0, 0.0, 0.0);
+  for (uint i = 0u ; i < range.y ; i++) {
+    int light = int(texelFetch(lightIndices, int(range.x + i)).r);
+    vec4 positionRadius = texelFetch(lightData, 3 * light);
+    vec3 lightDiffuse = texelFetch(lightData, 3 * light + 1).rgb;
+
+    vec3 distanceToLight_eye = positionRadius.xyz - position_eye;
+    float distanceRatio = length(distanceToLight_eye) / positionRadius.w;
+    float attenuation = clamp(1.0 - distanceRatio * distanceRatio, 0.0, 1.0);
+    attenuation *= attenuation;
+
+    if (!lit) {
+      colour += lightDiffuse * albedo.rgb * attenuation;
+      continue;
+    }
+
+    vec3 lightSpecular = texelFetch(lightData, 3 * light + 2).rgb;
+    vec3 directionToLight_eye = normalize(distanceToLight_eye);
+
+    float dotProduct = max(dot(directionToLight_eye, normal), 0.0);
+    colour += lightDiffuse * albedo.rgb * dotProduct * attenuation;
+
+    // blinn-phong : do not use the expensive reflect method
+    vec3 halfWay_eye = normalize(surfaceToViewer_eye + directionToLight_eye);
+    float specularDotProduct = max(dot(halfWay_eye, normal), 0.0);
+    colour += lightSpecular * specular * pow(specularDotProduct, specularExponent) * attenuation;
+  }
+
+  // added to the ambient term by blending
+  frag_colour = vec4(colour, 0.0);
+}
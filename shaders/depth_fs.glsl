@@ -0,0 +1,5 @@
+#version 400
+// Depth only rendering: nothing but the depth is written
+
+void main() {
+}
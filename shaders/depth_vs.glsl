@@ -0,0 +1,13 @@
+#version 400
+// Depth pre-pass: must compute gl_Position exactly as customMatrices_vs.glsl
+// for the GL_EQUAL depth test of the shading pass
+layout(location = 0) in vec3 vertexPosition;
+
+uniform mat4 view, proj, model;
+
+invariant gl_Position;
+
+void main () {
+  vec3 position_eye = vec3(view * model * vec4(vertexPosition, 1.0));
+  gl_Position = proj * vec4(position_eye, 1.0);
+}
@@ -0,0 +1,10 @@
+#version 400
+
+// One triangle covering the viewport, drawn without vertex attributes
+out vec2 uv;
+
+void main () {
+  vec2 position = vec2((gl_VertexID & 1) * 4.0 - 1.0, (gl_VertexID >> 1) * 4.0 - 1.0);
+  uv = position * 0.5 + 0.5;
+  gl_Position = vec4(position, 0.0, 1.0);
+}
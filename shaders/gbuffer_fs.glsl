@@ -0,0 +1,63 @@
+#version 400
+
+// Variant defines: HAS_NORMALS, HAS_UVS, HAS_COLORS, USE_DIFFUSE_MAP, USE_SPECULAR_MAP
+// Geometry pass of deferred shading, see GBuffer for the targets layout
+
+// Geometry
+in vec3 position_eye, normal_eye;
+in vec2 uv;
+in vec3 color;
+
+// Sum of the ambient colors of all lights
+uniform vec3 ambientLight;
+
+// Object material
+uniform vec3 ambientColor;
+uniform vec3 diffuseColor;
+uniform vec3 specularColor;
+
+#ifdef USE_DIFFUSE_MAP
+uniform sampler2D diffuseMap;
+#endif
+#ifdef USE_SPECULAR_MAP
+uniform sampler2D specularMap;
+#endif
+
+layout(location = 0) out vec4 albedo;
+layout(location = 1) out vec4 specularOut;
+layout(location = 2) out vec2 normalOut;
+layout(location = 3) out vec4 light;
+
+// Octahedron encoding: the unit sphere folded on a square
+vec2 encodeNormal(vec3 n) {
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return n.z >= 0.0 ? n.xy : folded;
+}
+
+void main() {
+  vec2 flippedUV = vec2(uv.x, 1.0 - uv.y);
+
+  vec3 diffuse = diffuseColor;
+#ifdef HAS_COLORS
+  diffuse *= color;
+#endif
+#ifdef USE_DIFFUSE_MAP
+  diffuse *= texture(diffuseMap, flippedUV).rgb;
+#endif
+  vec3 specular = specularColor;
+#ifdef USE_SPECULAR_MAP
+  specular *= texture(specularMap, flippedUV).rgb;
+#endif
+
+#ifdef HAS_NORMALS
+  albedo = vec4(diffuse, 1.0);
+  normalOut = encodeNormal(normalize(normal_eye));
+#else
+  // no normals to shade with: unlit diffuse
+  albedo = vec4(diffuse, 0.0);
+  normalOut = vec2(0.0, 0.0);
+#endif
+  specularOut = vec4(specular, 1.0);
+  light = vec4(ambientLight * ambientColor, 1.0);
+}
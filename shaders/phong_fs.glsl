@@ -1,26 +1,34 @@
 #version 400
 
+// Variant defines: HAS_NORMALS, HAS_UVS, HAS_COLORS, USE_DIFFUSE_MAP, USE_SPECULAR_MAP, LIGHTS_NUMBER
+#ifndef LIGHTS_NUMBER
+#define LIGHTS_NUMBER 1
+#endif
+
 // Geometry
 in vec3 position_eye, normal_eye;
 in vec2 uv;
+in vec3 color;
 
-// Lights
-uniform vec3 lightPosition_world;
-uniform vec3 lightDiffuse;
-uniform vec3 lightSpecular;
-uniform vec3 lightAmbient;
-
-uniform mat4 view;
+// Lights, already in eye space
+#if LIGHTS_NUMBER > 0
+uniform vec3 lightPosition_eye[LIGHTS_NUMBER];
+uniform vec3 lightDiffuse[LIGHTS_NUMBER];
+uniform vec3 lightSpecular[LIGHTS_NUMBER];
+uniform vec3 lightAmbient[LIGHTS_NUMBER];
+#endif
 
 // Object material
 uniform vec3 ambientColor;
 uniform vec3 diffuseColor;
 uniform vec3 specularColor;
 
-uniform bool useDiffuseMap;
-uniform bool useSpecularMap;
+#ifdef USE_DIFFUSE_MAP
 uniform sampler2D diffuseMap;
+#endif
+#ifdef USE_SPECULAR_MAP
 uniform sampler2D specularMap;
+#endif
 
 float specularExponent = 100.0;
 
@@ -28,36 +36,52 @@ out vec4 frag_colour;
 
 void main() {
   vec2 flippedUV = vec2(uv.x, 1.0 - uv.y);
-  vec3 ambientIntensity = lightAmbient * ambientColor;
 
-  vec3 lightPosition_eye = vec3(view * vec4(lightPosition_world, 1.0));
-  vec3 distanceToLight_eye = lightPosition_eye - position_eye;
-  vec3 directionToLight_eye = normalize(distanceToLight_eye);
+  vec3 diffuse = diffuseColor;
+#ifdef HAS_COLORS
+  diffuse *= color;
+#endif
+#ifdef USE_DIFFUSE_MAP
+  diffuse *= texture(diffuseMap, flippedUV).rgb;
+#endif
+  vec3 specular = specularColor;
+#ifdef USE_SPECULAR_MAP
+  specular *= texture(specularMap, flippedUV).rgb;
+#endif
+
+  vec3 colour = vec3(0.0, 0.0, 0.0);
 
+#if LIGHTS_NUMBER > 0
+#ifdef HAS_NORMALS
   // because of scaling
   vec3 normal = normalize(normal_eye);
+  vec3 surfaceToViewer_eye = normalize(-position_eye);
+#endif
 
-  float dotProduct = dot(directionToLight_eye, normal);
-  dotProduct = max(dotProduct, 0.0);
+  for (int i = 0 ; i < LIGHTS_NUMBER ; i++) {
+    colour += lightAmbient[i] * ambientColor;
+#ifdef HAS_NORMALS
+    vec3 distanceToLight_eye = lightPosition_eye[i] - position_eye;
+    vec3 directionToLight_eye = normalize(distanceToLight_eye);
 
-  vec3 diffuse = diffuseColor;
-  if (useDiffuseMap)
-    diffuse *= texture(diffuseMap, flippedUV).rgb;
-  vec3 diffuseIntensity = lightDiffuse * diffuse * dotProduct;
+    float dotProduct = dot(directionToLight_eye, normal);
+    dotProduct = max(dotProduct, 0.0);
+    colour += lightDiffuse[i] * diffuse * dotProduct;
 
-  vec3 surfaceToViewer_eye = normalize(-position_eye);
-  //vec3 reflection_eye = reflect(-directionToLight_eye, normal);
-  //float specularDotProduct = dot(reflection_eye, surfaceToViewer_eye);
-  // blinn-phong : do not use the expensive reflect method
-  vec3 halfWay_eye = normalize(surfaceToViewer_eye + directionToLight_eye);
-  float specularDotProduct = dot(halfWay_eye, normal);
-  specularDotProduct = max(specularDotProduct, 0.0);
-  float specularFactor = pow(specularDotProduct, specularExponent);
-
-  vec3 specular = specularColor;
-  if (useSpecularMap)
-    specular *= texture(specularMap, flippedUV).rgb;
-  vec3 specularIntensity = lightSpecular * specular * specularFactor;
+    // blinn-phong : do not use the expensive reflect method
+    vec3 halfWay_eye = normalize(surfaceToViewer_eye + directionToLight_eye);
+    float specularDotProduct = dot(halfWay_eye, normal);
+    specularDotProduct = max(specularDotProduct, 0.0);
+    float specularFactor = pow(specularDotProduct, specularExponent);
+    colour += lightSpecular[i] * specular * specularFactor;
+#else
+    // no normals to shade with: unlit diffuse
+    colour += lightDiffuse[i] * diffuse;
+#endif
+  }
+#else
+  colour = diffuse;
+#endif
 
-  frag_colour = vec4(ambientIntensity + diffuseIntensity + specularIntensity, 1.0);
+  frag_colour = vec4(colour, 1.0);
 }
@@ -0,0 +1,36 @@
+#version 400
+
+// Upscaling of a frame rendered at a lower resolution, see DynamicResolution:
+// bilinear filtering, then a sharpening that fades out where the local
+// contrast is already high, clamped to the neighbourhood so edges do not ring
+
+in vec2 uv;
+
+uniform sampler2D sourceTexture;
+// Part of the source texture holding the frame, in texture coordinates
+uniform vec2 sourceScale;
+// 0 for plain bilinear filtering, up to 1
+uniform float sharpness;
+
+out vec4 frag_colour;
+
+void main() {
+  vec2 texel = 1.0 / vec2(textureSize(sourceTexture, 0));
+  // The texels around the frame were not rendered: never filter them in
+  vec2 sourceUV = min(uv * sourceScale, sourceScale - 0.5 * texel);
+
+  vec3 center = texture(sourceTexture, sourceUV).rgb;
+  vec3 left = texture(sourceTexture, max(sourceUV - vec2(texel.x, 0.0), 0.5 * texel)).rgb;
+  vec3 right = texture(sourceTexture, min(sourceUV + vec2(texel.x, 0.0), sourceScale - 0.5 * texel)).rgb;
+  vec3 down = texture(sourceTexture, max(sourceUV - vec2(0.0, texel.y), 0.5 * texel)).rgb;
+  vec3 up = texture(sourceTexture, min(sourceUV + vec2(0.0, texel.y), sourceScale - 0.5 * texel)).rgb;
+
+  vec3 minimum = min(center, min(min(left, right), min(down, up)));
+  vec3 maximum = max(center, max(max(left, right), max(down, up)));
+  // Full strength in flat areas, none across strong edges
+  vec3 amount = sqrt(clamp(min(minimum, 1.0 - maximum) / max(maximum, vec3(0.0001)), 0.0, 1.0));
+  vec3 weight = -amount * mix(0.0, 0.2, sharpness);
+
+  vec3 colour = (center + (left + right + down + up) * weight) / (1.0 + 4.0 * weight);
+  frag_colour = vec4(clamp(colour, minimum, maximum), 1.0);
+}
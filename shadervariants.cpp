@@ -0,0 +1,94 @@
+#include "shadervariants.h"
+
+using namespace qgl;
+using namespace std;
+using namespace qtools;
+
+ShaderVariants::ShaderVariants() {
+  logger = NULL;
+}
+
+ShaderVariants::ShaderVariants(qtools::Logger* logger) {
+  this->logger = logger;
+}
+
+ShaderVariants::~ShaderVariants() {
+  clear();
+}
+
+void ShaderVariants::setLogger(qtools::Logger* logger) {
+  this->logger = logger;
+}
+
+void ShaderVariants::setSources(const string& vertexShaderFile, const string& fragmentShaderFile) {
+  this->vertexShaderFile = vertexShaderFile;
+  this->fragmentShaderFile = fragmentShaderFile;
+  clear();
+}
+
+void ShaderVariants::useUniform(const char* uniform) {
+  uniforms.push_back(string(uniform));
+  for (map<unsigned int, ShaderProgram*>::iterator it = programs.begin() ; it != programs.end() ; it++)
+    it->second->useUniform(uniform);
+}
+
+void ShaderVariants::setUniformTextureIndex(const char* uniform, int index) {
+  textureIndexes[string(uniform)] = index;
+  for (map<unsigned int, ShaderProgram*>::iterator it = programs.begin() ; it != programs.end() ; it++) {
+    it->second->use();
+    it->second->setUniformTextureIndex(uniform, index);
+  }
+}
+
+ShaderProgram& ShaderVariants::get(unsigned int features) {
+  map<unsigned int, ShaderProgram*>::iterator it = programs.find(features);
+  if (it != programs.end())
+    return *(it->second);
+  ShaderProgram* program = compile(features);
+  programs.insert(pair<unsigned int, ShaderProgram*>(features, program));
+  return *program;
+}
+
+void ShaderVariants::clear() {
+  for (map<unsigned int, ShaderProgram*>::iterator it = programs.begin() ; it != programs.end() ; it++) {
+    glDeleteProgram(it->second->getIndex());
+    delete it->second;
+  }
+  programs.clear();
+}
+
+string ShaderVariants::definesFromFeatures(unsigned int features) {
+  stringstream defines;
+  if (features & FEATURE_NORMALS)
+    defines << "#define HAS_NORMALS\n";
+  if (features & FEATURE_UVS)
+    defines << "#define HAS_UVS\n";
+  if (features & FEATURE_COLORS)
+    defines << "#define HAS_COLORS\n";
+  if (features & FEATURE_DIFFUSE_MAP)
+    defines << "#define USE_DIFFUSE_MAP\n";
+  if (features & FEATURE_SPECULAR_MAP)
+    defines << "#define USE_SPECULAR_MAP\n";
+  defines << "#define LIGHTS_NUMBER " << featureLightsNumber(features) << "\n";
+  return defines.str();
+}
+
+ShaderProgram* ShaderVariants::compile(unsigned int features) {
+  ShaderProgram* program = logger != NULL ? new ShaderProgram(logger) : new ShaderProgram();
+  string defines = definesFromFeatures(features);
+
+  if (logger != NULL)
+    *logger << "Compile shader variant " << features << Logger::INFO << Logger::FILE;
+  program->loadShader(GL_VERTEX_SHADER, vertexShaderFile, defines);
+  program->loadShader(GL_FRAGMENT_SHADER, fragmentShaderFile, defines);
+  program->link();
+
+  for (unsigned int i = 0 ; i < uniforms.size() ; i++)
+    program->useUniform(uniforms[i].c_str());
+
+  program->use();
+  for (map<string, int>::iterator it = textureIndexes.begin() ; it != textureIndexes.end() ; it++)
+    program->setUniformTextureIndex(it->first.c_str(), it->second);
+
+  return program;
+}
@@ -0,0 +1,55 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "shaderprogram.h"
+#include "shaderfeatures.h"
+
+
+namespace qgl {
+
+// Lazily compiled shader programs specialized with #define for a feature bitmask.
+// Each variant only contains the code the features need, so no runtime branches.
+class ShaderVariants {
+
+  public:
+    ShaderVariants();
+    ShaderVariants(qtools::Logger* logger);
+    ~ShaderVariants();
+
+    void setLogger(qtools::Logger* logger);
+    void setSources(const std::string& vertexShaderFile, const std::string& fragmentShaderFile);
+
+    // Applied to every variant, existing and future ones
+    void useUniform(const char* uniform);
+    void setUniformTextureIndex(const char* uniform, int index);
+
+    ShaderProgram& get(unsigned int features);
+    bool contains(unsigned int features) const { return programs.find(features) != programs.end(); }
+    unsigned int variantsNumber() const { return programs.size(); }
+    void clear();
+
+    static std::string definesFromFeatures(unsigned int features);
+
+  private:
+    ShaderVariants(const ShaderVariants&);
+    ShaderVariants& operator=(const ShaderVariants&);
+
+    ShaderProgram* compile(unsigned int features);
+
+    qtools::Logger *logger;
+    std::string vertexShaderFile;
+    std::string fragmentShaderFile;
+
+    std::vector<std::string> uniforms;
+    std::map<std::string, int> textureIndexes;
+    std::map<unsigned int, ShaderProgram*> programs;
+
+};
+
+}
+
+#endif // SHADERVARIANTS_H
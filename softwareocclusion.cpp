@@ -0,0 +1,348 @@
+#include "softwareocclusion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef __SSE__
+  #include <xmmintrin.h>
+#endif
+
+using namespace qgl;
+using namespace std;
+
+// Clip space w under which a vertex is considered behind the camera
+static const float NEAR_W = 1e-5f;
+// Objects are tested on the pyramid level where they span at most this many texels
+static const int TEST_TEXELS = 4;
+// Distance in pixels by which the triangle edges are pushed out
+static const float EDGE_BIAS = 1e-3f;
+
+SoftwareOcclusion::SoftwareOcclusion(int width, int height, unsigned int threadsNumber) {
+  this->width = (max(width, 4) + 3) & ~3;
+  this->height = max(height, 1);
+  if (threadsNumber == 0)
+    threadsNumber = thread::hardware_concurrency();
+  this->threadsNumber = max(threadsNumber, 1u);
+  jobs = ownedJobs = NULL;
+  objectsPerJob = 1;
+  running = false;
+
+  // Pyramid down to a single texel
+  int levelWidth = this->width;
+  int levelHeight = this->height;
+  while (true) {
+    levels.push_back(vector<float>(levelWidth * levelHeight, 1.f));
+    levelWidths.push_back(levelWidth);
+    levelHeights.push_back(levelHeight);
+    if (levelWidth == 1 && levelHeight == 1)
+      break;
+    levelWidth = max((levelWidth + 1) / 2, 1);
+    levelHeight = max((levelHeight + 1) / 2, 1);
+  }
+  stats.occluderTriangles = stats.rasterizedTriangles = 0;
+  stats.objects = stats.occluded = stats.outside = 0;
+}
+
+SoftwareOcclusion::~SoftwareOcclusion() {
+  wait();
+  delete ownedJobs;
+}
+
+void SoftwareOcclusion::setJobSystem(JobSystem* jobSystem) {
+  wait();
+  jobs = jobSystem != NULL ? jobSystem : ownedJobs;
+}
+
+void SoftwareOcclusion::clear() {
+  wait();
+  occluders.clear();
+  boxes.clear();
+}
+
+void SoftwareOcclusion::addOccluder(const float* positions, unsigned int verticesNumber, const qm::Mat4f& model) {
+  Occluder occluder;
+  occluder.positions = positions;
+  occluder.verticesNumber = verticesNumber;
+  occluder.model = model;
+  occluders.push_back(occluder);
+}
+
+unsigned int SoftwareOcclusion::addObject(const qm::Vec3f& boundsMin, const qm::Vec3f& boundsMax, const qm::Mat4f& model) {
+  Box box;
+  box.boundsMin = boundsMin;
+  box.boundsMax = boundsMax;
+  box.model = model;
+  boxes.push_back(box);
+  return boxes.size() - 1;
+}
+
+void SoftwareOcclusion::start(const qm::Mat4f& viewProjection) {
+  wait();
+  if (jobs == NULL) {
+    if (ownedJobs == NULL)
+      ownedJobs = new JobSystem(threadsNumber);
+    jobs = ownedJobs;
+  }
+  this->viewProjection = viewProjection;
+  visible.assign(boxes.size(), 1);
+  running = true;
+  jobs->submit(Job(&SoftwareOcclusion::transformStage, this), &done);
+}
+
+void SoftwareOcclusion::wait() {
+  if (!running)
+    return;
+  jobs->wait(done);
+  running = false;
+}
+
+void SoftwareOcclusion::transformStage(void* data, unsigned int, unsigned int) {
+  SoftwareOcclusion& occlusion = *static_cast<SoftwareOcclusion*>(data);
+  occlusion.transformOccluders();
+
+  // Each job owns a band of rows, the triangles are clipped to it
+  JobSystem& jobs = *occlusion.jobs;
+  int bands = jobs.getThreadsNumber();
+  int rowsPerBand = (occlusion.height + bands - 1) / bands;
+  for (int firstRow = 0 ; firstRow < occlusion.height ; firstRow += rowsPerBand)
+    jobs.submit(Job(&SoftwareOcclusion::rasterizeJob, data, firstRow, min(firstRow + rowsPerBand, occlusion.height)), &occlusion.rasterized);
+  jobs.submitAfter(occlusion.rasterized, Job(&SoftwareOcclusion::testStage, data), &occlusion.done);
+}
+
+void SoftwareOcclusion::rasterizeJob(void* data, unsigned int firstRow, unsigned int lastRow) {
+  static_cast<SoftwareOcclusion*>(data)->rasterize(firstRow, lastRow);
+}
+
+void SoftwareOcclusion::testStage(void* data, unsigned int, unsigned int) {
+  SoftwareOcclusion& occlusion = *static_cast<SoftwareOcclusion*>(data);
+  occlusion.buildPyramid();
+
+  JobSystem& jobs = *occlusion.jobs;
+  unsigned int objectsNumber = occlusion.boxes.size();
+  unsigned int ranges = jobs.getThreadsNumber();
+  occlusion.objectsPerJob = max((objectsNumber + ranges - 1) / ranges, 1u);
+  // One counter per range, summed by the last stage
+  occlusion.occludedCounts.assign(ranges, 0);
+  occlusion.outsideCounts.assign(ranges, 0);
+  for (unsigned int first = 0 ; first < objectsNumber ; first += occlusion.objectsPerJob)
+    jobs.submit(Job(&SoftwareOcclusion::testJob, data, first, min(first + occlusion.objectsPerJob, objectsNumber)), &occlusion.tested);
+  jobs.submitAfter(occlusion.tested, Job(&SoftwareOcclusion::statsStage, data), &occlusion.done);
+}
+
+void SoftwareOcclusion::testJob(void* data, unsigned int first, unsigned int last) {
+  SoftwareOcclusion& occlusion = *static_cast<SoftwareOcclusion*>(data);
+  occlusion.testObjects(first / occlusion.objectsPerJob, first, last);
+}
+
+void SoftwareOcclusion::statsStage(void* data, unsigned int, unsigned int) {
+  SoftwareOcclusion& occlusion = *static_cast<SoftwareOcclusion*>(data);
+  occlusion.stats.objects = occlusion.boxes.size();
+  occlusion.stats.occluded = occlusion.stats.outside = 0;
+  for (unsigned int r = 0 ; r < occlusion.occludedCounts.size() ; r++) {
+    occlusion.stats.occluded += occlusion.occludedCounts[r];
+    occlusion.stats.outside += occlusion.outsideCounts[r];
+  }
+}
+
+void SoftwareOcclusion::transformOccluders() {
+  triangles.clear();
+  stats.occluderTriangles = 0;
+  for (unsigned int o = 0 ; o < occluders.size() ; o++) {
+    const Occluder& occluder = occluders[o];
+    qm::Mat4f matrix = viewProjection * occluder.model;
+    const float* m = matrix.getArray();
+    stats.occluderTriangles += occluder.verticesNumber / 3;
+
+    for (unsigned int v = 0 ; v + 2 < occluder.verticesNumber ; v += 3) {
+      float clip[3][4];
+      for (int i = 0 ; i < 3 ; i++) {
+        const float* p = occluder.positions + (v + i) * 3;
+#ifdef __SSE__
+        // Column major: clip = column0 * x + column1 * y + column2 * z + column3
+        __m128 result = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(p[0])),
+                                              _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(p[1]))),
+                                   _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(p[2])),
+                                              _mm_loadu_ps(m + 12)));
+        _mm_storeu_ps(clip[i], result);
+#else
+        for (int j = 0 ; j < 4 ; j++)
+          clip[i][j] = m[j] * p[0] + m[4 + j] * p[1] + m[8 + j] * p[2] + m[12 + j];
+#endif
+      }
+
+      // Occluders are optional: triangles crossing the near plane are skipped instead of clipped
+      if (clip[0][3] < NEAR_W || clip[1][3] < NEAR_W || clip[2][3] < NEAR_W)
+        continue;
+
+      ScreenTriangle triangle;
+      for (int i = 0 ; i < 3 ; i++) {
+        float invW = 1.f / clip[i][3];
+        triangle.x[i] = (clip[i][0] * invW * 0.5f + 0.5f) * width;
+        triangle.y[i] = (clip[i][1] * invW * 0.5f + 0.5f) * height;
+        triangle.z[i] = clip[i][2] * invW * 0.5f + 0.5f;
+      }
+      // Counter clock-wise front faces, as in the GL pipeline
+      float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0])
+                 - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+      if (area <= 0.f)
+        continue;
+      float minX = min(min(triangle.x[0], triangle.x[1]), triangle.x[2]);
+      float maxX = max(max(triangle.x[0], triangle.x[1]), triangle.x[2]);
+      float minY = min(min(triangle.y[0], triangle.y[1]), triangle.y[2]);
+      float maxY = max(max(triangle.y[0], triangle.y[1]), triangle.y[2]);
+      if (maxX < 0.f || maxY < 0.f || minX >= width || minY >= height)
+        continue;
+      triangles.push_back(triangle);
+    }
+  }
+  stats.rasterizedTriangles = triangles.size();
+}
+
+void SoftwareOcclusion::rasterize(int firstRow, int lastRow) {
+  vector<float>& depth = levels[0];
+  fill(depth.begin() + firstRow * width, depth.begin() + lastRow * width, 1.f);
+
+  for (unsigned int t = 0 ; t < triangles.size() ; t++) {
+    const ScreenTriangle& tri = triangles[t];
+    int minX = max((int) floor(min(min(tri.x[0], tri.x[1]), tri.x[2])), 0);
+    int maxX = min((int) ceil(max(max(tri.x[0], tri.x[1]), tri.x[2])), width - 1);
+    int minY = max((int) floor(min(min(tri.y[0], tri.y[1]), tri.y[2])), firstRow);
+    int maxY = min((int) ceil(max(max(tri.y[0], tri.y[1]), tri.y[2])), lastRow - 1);
+    if (minY > maxY || minX > maxX)
+      continue;
+    // Rows are processed 4 pixels at a time from aligned columns
+    minX &= ~3;
+
+    // Edge functions, positive inside: E0 for (v0, v1), E1 for (v1, v2), E2 for (v2, v0)
+    float a0 = tri.y[0] - tri.y[1], b0 = tri.x[1] - tri.x[0];
+    float a1 = tri.y[1] - tri.y[2], b1 = tri.x[2] - tri.x[1];
+    float a2 = tri.y[2] - tri.y[0], b2 = tri.x[0] - tri.x[2];
+    float area = b0 * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+    // Pixel centers on an edge shared by two triangles would be missed by both with rounding
+    // errors, the edges are pushed out by a thousandth of a pixel to close these cracks
+    float bias0 = EDGE_BIAS * sqrt(a0 * a0 + b0 * b0);
+    float bias1 = EDGE_BIAS * sqrt(a1 * a1 + b1 * b1);
+    float bias2 = EDGE_BIAS * sqrt(a2 * a2 + b2 * b2);
+    // z = z0 + (E2 * (z1 - z0) + E0 * (z2 - z0)) / area
+    float dz1 = (tri.z[1] - tri.z[0]) / area;
+    float dz2 = (tri.z[2] - tri.z[0]) / area;
+
+    for (int y = minY ; y <= maxY ; y++) {
+      float py = y + 0.5f;
+      float px = minX + 0.5f;
+      float e0 = a0 * (px - tri.x[0]) + b0 * (py - tri.y[0]) + bias0;
+      float e1 = a1 * (px - tri.x[1]) + b1 * (py - tri.y[1]) + bias1;
+      float e2 = a2 * (px - tri.x[2]) + b2 * (py - tri.y[2]) + bias2;
+      float* row = &depth[y * width];
+#ifdef __SSE__
+      __m128 offsets = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+      __m128 edge0 = _mm_add_ps(_mm_set1_ps(e0), _mm_mul_ps(_mm_set1_ps(a0), offsets));
+      __m128 edge1 = _mm_add_ps(_mm_set1_ps(e1), _mm_mul_ps(_mm_set1_ps(a1), offsets));
+      __m128 edge2 = _mm_add_ps(_mm_set1_ps(e2), _mm_mul_ps(_mm_set1_ps(a2), offsets));
+      __m128 step0 = _mm_set1_ps(a0 * 4.f), step1 = _mm_set1_ps(a1 * 4.f), step2 = _mm_set1_ps(a2 * 4.f);
+      __m128 z0 = _mm_set1_ps(tri.z[0]), slope1 = _mm_set1_ps(dz1), slope2 = _mm_set1_ps(dz2);
+      __m128 zero = _mm_setzero_ps();
+      for (int x = minX ; x <= maxX ; x += 4) {
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, zero), _mm_cmpge_ps(edge1, zero)), _mm_cmpge_ps(edge2, zero));
+        if (_mm_movemask_ps(inside) != 0) {
+          __m128 z = _mm_add_ps(z0, _mm_add_ps(_mm_mul_ps(edge2, slope1), _mm_mul_ps(edge0, slope2)));
+          __m128 previous = _mm_loadu_ps(row + x);
+          __m128 nearest = _mm_min_ps(previous, z);
+          _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+        }
+        edge0 = _mm_add_ps(edge0, step0);
+        edge1 = _mm_add_ps(edge1, step1);
+        edge2 = _mm_add_ps(edge2, step2);
+      }
+#else
+      for (int x = minX ; x <= maxX ; x++) {
+        if (e0 >= 0.f && e1 >= 0.f && e2 >= 0.f) {
+          float z = tri.z[0] + e2 * dz1 + e0 * dz2;
+          if (z < row[x])
+            row[x] = z;
+        }
+        e0 += a0;
+        e1 += a1;
+        e2 += a2;
+      }
+#endif
+    }
+  }
+}
+
+void SoftwareOcclusion::buildPyramid() {
+  // Each texel keeps the farthest depth of the texels it covers
+  for (unsigned int l = 1 ; l < levels.size() ; l++) {
+    const vector<float>& source = levels[l - 1];
+    vector<float>& target = levels[l];
+    int sourceWidth = levelWidths[l - 1], sourceHeight = levelHeights[l - 1];
+    for (int y = 0 ; y < levelHeights[l] ; y++) {
+      int y0 = 2 * y, y1 = min(2 * y + 1, sourceHeight - 1);
+      for (int x = 0 ; x < levelWidths[l] ; x++) {
+        int x0 = 2 * x, x1 = min(2 * x + 1, sourceWidth - 1);
+        target[y * levelWidths[l] + x] = max(max(source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1]),
+                                             max(source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1]));
+      }
+    }
+  }
+}
+
+void SoftwareOcclusion::testObjects(unsigned int thread, unsigned int first, unsigned int last) {
+  for (unsigned int i = first ; i < last ; i++) {
+    Result result = testObject(boxes[i]);
+    visible[i] = result == VISIBLE;
+    if (result == OCCLUDED)
+      occludedCounts[thread]++;
+    else if (result == OUTSIDE)
+      outsideCounts[thread]++;
+  }
+}
+
+SoftwareOcclusion::Result SoftwareOcclusion::testObject(const Box& box) {
+  qm::Mat4f matrix = viewProjection * box.model;
+  const float* m = matrix.getArray();
+
+  float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, minZ = 1e30f;
+  for (int i = 0 ; i < 8 ; i++) {
+    float p[3] = {
+      (i & 1) ? box.boundsMax[0] : box.boundsMin[0],
+      (i & 2) ? box.boundsMax[1] : box.boundsMin[1],
+      (i & 4) ? box.boundsMax[2] : box.boundsMin[2]
+    };
+    float clip[4];
+    for (int j = 0 ; j < 4 ; j++)
+      clip[j] = m[j] * p[0] + m[4 + j] * p[1] + m[8 + j] * p[2] + m[12 + j];
+    // The camera may be inside the box
+    if (clip[3] < NEAR_W)
+      return VISIBLE;
+    float invW = 1.f / clip[3];
+    float x = (clip[0] * invW * 0.5f + 0.5f) * width;
+    float y = (clip[1] * invW * 0.5f + 0.5f) * height;
+    minX = min(minX, x);
+    maxX = max(maxX, x);
+    minY = min(minY, y);
+    maxY = max(maxY, y);
+    minZ = min(minZ, clip[2] * invW * 0.5f + 0.5f);
+  }
+  if (maxX < 0.f || maxY < 0.f || minX >= width || minY >= height || minZ > 1.f)
+    return OUTSIDE;
+
+  int x0 = max((int) floor(minX), 0), x1 = min((int) floor(maxX), width - 1);
+  int y0 = max((int) floor(minY), 0), y1 = min((int) floor(maxY), height - 1);
+  unsigned int level = 0;
+  while (level + 1 < levels.size() && max(x1 - x0, y1 - y0) >= TEST_TEXELS) {
+    level++;
+    x0 >>= 1; x1 >>= 1;
+    y0 >>= 1; y1 >>= 1;
+  }
+
+  // Visible as soon as one texel has an occluder behind the nearest box depth
+  const vector<float>& depth = levels[level];
+  int levelWidth = levelWidths[level];
+  for (int y = y0 ; y <= y1 ; y++)
+    for (int x = x0 ; x <= x1 ; x++)
+      if (depth[y * levelWidth + x] >= minZ)
+        return VISIBLE;
+  return OCCLUDED;
+}
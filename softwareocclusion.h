@@ -0,0 +1,119 @@
+#ifndef SOFTWAREOCCLUSION_H
+#define SOFTWAREOCCLUSION_H
+
+#include <vector>
+
+#include <vec3.h>
+#include <mat4.h>
+
+#include "jobsystem.h"
+
+
+namespace qgl {
+
+struct SoftwareOcclusionStats {
+  unsigned int occluderTriangles; // triangles sent to the rasterizer
+  unsigned int rasterizedTriangles; // front facing, in front of the camera and on screen
+  unsigned int objects;
+  unsigned int occluded; // objects hidden by the occluders
+  unsigned int outside; // objects out of the view frustum
+};
+
+// CPU occlusion culling: a few large occluders are rasterized with SSE into a
+// low resolution depth buffer, reduced into a hierarchical-Z pyramid holding
+// the farthest depth of each texel. The screen rectangle of every object
+// bounding box is then tested against the level where it covers a few texels.
+// The work runs as jobs, screen bands for the rasterization and object
+// ranges for the tests, each stage queued by a continuation of the previous
+// one while the render thread goes on. Occluders
+// only write depth where they cover pixel centers, so silhouettes may hide a
+// sliver of an object.
+class SoftwareOcclusion {
+
+  public:
+    // The width is rounded up to a multiple of 4. Without a shared job system
+    // it creates its own with threadsNumber threads, 0 uses the hardware concurrency.
+    SoftwareOcclusion(int width = 256, int height = 128, unsigned int threadsNumber = 0);
+    ~SoftwareOcclusion();
+
+    void setJobSystem(JobSystem* jobSystem);
+
+    // Occluders and objects cannot change between start() and wait()
+    void clear();
+    // Triangle soup with 3 floats per vertex, not copied: it must live until wait()
+    void addOccluder(const float* positions, unsigned int verticesNumber, const qm::Mat4f& model);
+    unsigned int addObject(const qm::Vec3f& boundsMin, const qm::Vec3f& boundsMax, const qm::Mat4f& model);
+
+    // Rasterizes the occluders and tests the objects asynchronously
+    void start(const qm::Mat4f& viewProjection);
+    void wait();
+    bool isRunning() const { return running; }
+
+    // Valid after wait()
+    bool isVisible(unsigned int object) const { return visible[object] != 0; }
+    const SoftwareOcclusionStats& getStats() const { return stats; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // Depth in [0, 1] of a pyramid level, level 0 is the full resolution
+    const std::vector<float>& getDepth(unsigned int level) const { return levels[level]; }
+    unsigned int levelsNumber() const { return levels.size(); }
+
+  private:
+    SoftwareOcclusion(const SoftwareOcclusion&);
+    SoftwareOcclusion& operator=(const SoftwareOcclusion&);
+
+    struct Occluder {
+      const float* positions;
+      unsigned int verticesNumber;
+      qm::Mat4f model;
+    };
+    struct Box {
+      qm::Vec3f boundsMin;
+      qm::Vec3f boundsMax;
+      qm::Mat4f model;
+    };
+    // Screen space triangle: pixel coordinates and depth in [0, 1]
+    struct ScreenTriangle {
+      float x[3], y[3], z[3];
+    };
+
+    // Stages chained by the job counters
+    static void transformStage(void* data, unsigned int, unsigned int);
+    static void rasterizeJob(void* data, unsigned int firstRow, unsigned int lastRow);
+    static void testStage(void* data, unsigned int, unsigned int);
+    static void testJob(void* data, unsigned int first, unsigned int last);
+    static void statsStage(void* data, unsigned int, unsigned int);
+
+    void transformOccluders();
+    void rasterize(int firstRow, int lastRow);
+    void buildPyramid();
+    enum Result { VISIBLE, OCCLUDED, OUTSIDE };
+
+    void testObjects(unsigned int thread, unsigned int first, unsigned int last);
+    Result testObject(const Box& box);
+
+    int width, height;
+    unsigned int threadsNumber;
+
+    std::vector<Occluder> occluders;
+    std::vector<Box> boxes;
+    qm::Mat4f viewProjection;
+
+    std::vector<ScreenTriangle> triangles;
+    std::vector<std::vector<float> > levels;
+    std::vector<int> levelWidths, levelHeights;
+    std::vector<char> visible;
+    std::vector<unsigned int> occludedCounts, outsideCounts;
+    SoftwareOcclusionStats stats;
+
+    JobSystem* jobs;
+    JobSystem* ownedJobs;
+    unsigned int objectsPerJob;
+    JobCounter rasterized, tested, done;
+    bool running;
+
+};
+
+}
+
+#endif // SOFTWAREOCCLUSION_H
@@ -0,0 +1,62 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <vector>
+
+
+namespace qgl {
+
+// Bounded lock-free queue for one producer thread and one consumer thread.
+// The capacity is rounded up to a power of two.
+template <typename T>
+class SPSCQueue {
+
+  public:
+    SPSCQueue(unsigned int capacity = 1024) : head(0), tail(0) {
+      unsigned int size = 1;
+      while (size < capacity)
+        size <<= 1;
+      items.resize(size);
+      mask = size - 1;
+    }
+
+    // Producer side, fails when the queue is full
+    bool push(const T& item) {
+      size_t currentTail = tail.load(std::memory_order_relaxed);
+      if (currentTail - head.load(std::memory_order_acquire) > mask)
+        return false;
+      items[currentTail & mask] = item;
+      tail.store(currentTail + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Consumer side, fails when the queue is empty
+    bool pop(T& item) {
+      size_t currentHead = head.load(std::memory_order_relaxed);
+      if (currentHead == tail.load(std::memory_order_acquire))
+        return false;
+      item = items[currentHead & mask];
+      head.store(currentHead + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+    size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+    size_t capacity() const { return mask + 1; }
+
+  private:
+    SPSCQueue(const SPSCQueue&);
+    SPSCQueue& operator=(const SPSCQueue&);
+
+    std::vector<T> items;
+    size_t mask;
+    // On separate cache lines so that both threads do not fight over them
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+
+};
+
+}
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,100 @@
+#include "stlloader.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+
+#include "mappedfile.h"
+
+using namespace qgl;
+using namespace std;
+
+namespace {
+
+const unsigned int HEADER_SIZE = 80;
+const unsigned int TRIANGLE_SIZE = 50;
+
+bool hostBigEndian() {
+  const unsigned int one = 1;
+  return *reinterpret_cast<const unsigned char*>(&one) == 0;
+}
+
+// Byte order of count 4 byte values
+void swapWords(void* values, unsigned int count) {
+  unsigned char* bytes = reinterpret_cast<unsigned char*>(values);
+  for (unsigned int i = 0 ; i < count ; i++) {
+    swap(bytes[i * 4], bytes[i * 4 + 3]);
+    swap(bytes[i * 4 + 1], bytes[i * 4 + 2]);
+  }
+}
+
+}
+
+STLLoader::STLLoader() {}
+
+bool STLLoader::load(const string& filename, vector<float>& positions, vector<float>& normals) {
+  MappedFile file;
+  if (!file.open(filename))
+    return false;
+  const unsigned char* data = file.getData();
+  unsigned long long size = file.getSize();
+
+  // ASCII files start with "solid", but so do the headers of some binary ones:
+  // the size tells them apart. Some exporters pad binary files.
+  uint32_t trianglesNumber = 0;
+  if (size >= HEADER_SIZE + sizeof (trianglesNumber)) {
+    memcpy(&trianglesNumber, data + HEADER_SIZE, sizeof (trianglesNumber));
+    if (hostBigEndian())
+      swapWords(&trianglesNumber, 1);
+  }
+  if (size < HEADER_SIZE + sizeof (trianglesNumber)
+      || size < HEADER_SIZE + sizeof (trianglesNumber) + (unsigned long long) trianglesNumber * TRIANGLE_SIZE) {
+    if (size >= 5 && memcmp(data, "solid", 5) == 0)
+      cerr << "ERROR: " << filename << " is an ASCII STL file, only the binary ones are supported" << endl;
+    else
+      cerr << "ERROR: " << filename << " is not a binary STL file" << endl;
+    return false;
+  }
+  if (trianglesNumber == 0) {
+    cerr << "ERROR: " << filename << " has no triangles" << endl;
+    return false;
+  }
+
+  // Released rather than cleared, like Object does
+  vector<float>().swap(positions);
+  vector<float>().swap(normals);
+  positions.resize((size_t) trianglesNumber * 9);
+  normals.resize((size_t) trianglesNumber * 9);
+  bool swapped = hostBigEndian();
+  const unsigned char* triangle = data + HEADER_SIZE + sizeof (trianglesNumber);
+  for (uint32_t t = 0 ; t < trianglesNumber ; t++, triangle += TRIANGLE_SIZE) {
+    float* position = &positions[(size_t) t * 9];
+    float* normal = &normals[(size_t) t * 9];
+    memcpy(normal, triangle, 3 * sizeof (float));
+    memcpy(position, triangle + 3 * sizeof (float), 9 * sizeof (float));
+    if (swapped) {
+      swapWords(normal, 3);
+      swapWords(position, 9);
+    }
+
+    if (normal[0] == 0.f && normal[1] == 0.f && normal[2] == 0.f) {
+      float e1[3], e2[3];
+      for (int j = 0 ; j < 3 ; j++) {
+        e1[j] = position[3 + j] - position[j];
+        e2[j] = position[6 + j] - position[j];
+      }
+      normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+      normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+      normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+      float length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+      if (length > 0.f) {
+        for (int j = 0 ; j < 3 ; j++)
+          normal[j] /= length;
+      }
+    }
+    memcpy(normal + 3, normal, 3 * sizeof (float));
+    memcpy(normal + 6, normal, 3 * sizeof (float));
+  }
+  return true;
+}
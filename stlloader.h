@@ -0,0 +1,27 @@
+#ifndef STLLOADER_H
+#define STLLOADER_H
+
+#include <string>
+#include <vector>
+
+
+namespace qgl {
+
+// Binary STL files: an 80 byte header, the triangles number, then 50 bytes
+// per triangle, its normal and its 3 positions as little endian floats.
+// The file is mapped and each triangle copied with one memcpy straight into
+// vertex arrays of 3 floats per triangle vertex, the layout of
+// Object::setVertices. The face normal is given to the 3 vertices, computed
+// from the positions when the file leaves it null.
+class STLLoader {
+
+  public:
+    STLLoader();
+
+    bool load(const std::string& filename, std::vector<float>& positions, std::vector<float>& normals);
+
+};
+
+}
+
+#endif // STLLOADER_H
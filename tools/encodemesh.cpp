@@ -0,0 +1,48 @@
+// Encodes a binary PLY mesh into a .qmesh file for MeshCodec.
+// Build: g++ -O2 -std=c++11 -I.. encodemesh.cpp ../meshcodec.cpp ../plyloader.cpp ../mappedfile.cpp
+// Usage: encodemesh input.ply output.qmesh [position bits] [normal bits] [uv bits]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "meshcodec.h"
+#include "plyloader.h"
+
+using namespace qgl;
+using namespace std;
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s input.ply output.qmesh [position bits] [normal bits] [uv bits]\n", argv[0]);
+    return 1;
+  }
+
+  IndexedMesh mesh;
+  PLYLoader plyLoader;
+  if (!plyLoader.load(argv[1], mesh))
+    return 1;
+
+  MeshCodec meshCodec;
+  if (argc > 3)
+    meshCodec.setPositionBits(atoi(argv[3]));
+  if (argc > 4)
+    meshCodec.setNormalBits(atoi(argv[4]));
+  if (argc > 5)
+    meshCodec.setUVBits(atoi(argv[5]));
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<unsigned char> data;
+  if (!meshCodec.encode(mesh, data))
+    return 1;
+  FILE* file = fopen(argv[2], "wb");
+  if (file == NULL || fwrite(&data[0], 1, data.size(), file) != data.size()) {
+    fprintf(stderr, "Could not write %s\n", argv[2]);
+    return 1;
+  }
+  fclose(file);
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  printf("%u triangles, %zu bytes (%.2f per triangle), %.2f s\n", mesh.trianglesNumber(), data.size(),
+         (double) data.size() / mesh.trianglesNumber(), seconds);
+  return 0;
+}
@@ -0,0 +1,37 @@
+// Converts an OBJ mesh, possibly larger than the memory, into a paged mesh for PagedMesh.
+// Build: g++ -O2 -std=c++11 -I.. pagemesh.cpp ../meshpager.cpp ../mappedfile.cpp
+// Usage: pagemesh input.obj output.pages [max triangles per page]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "meshpager.h"
+
+using namespace qgl;
+using namespace std;
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s input.obj output.pages [max triangles per page]\n", argv[0]);
+    return 1;
+  }
+
+  MeshPager pager;
+  if (argc > 3) {
+    int maxTriangles = atoi(argv[3]);
+    if (maxTriangles <= 0) {
+      fprintf(stderr, "ERROR: the max triangles per page must be a positive number\n");
+      return 1;
+    }
+    pager.setMaxTrianglesPerPage(maxTriangles);
+  }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  if (!pager.build(argv[1], argv[2]))
+    return 1;
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  printf("%llu triangles in %u pages (grid %u^3), %.2f s\n", pager.getTrianglesNumber(),
+         pager.getPagesNumber(), pager.getGridResolution(), seconds);
+  return 0;
+}
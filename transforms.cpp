@@ -0,0 +1,86 @@
+#include "transforms.h"
+
+using namespace qgl;
+
+qm::Mat4f qgl::lookAt(const qm::Vec3f& cameraPos, const qm::Vec3f& targetPos, qm::Vec3f& up, qm::Vec3f& forward, qm::Vec3f& right) {
+  qm::Mat4f translationMatrix = qm::Mat4f::translationMatrix(-cameraPos);
+
+  forward = targetPos - cameraPos;
+  forward.normalize();
+  right = qm::Vec3f::crossProduct(forward, up);
+  right.normalize();
+  up = qm::Vec3f::crossProduct(right, forward);
+  up.normalize();
+
+   qm::Mat4f rotationMatrix(
+    right[0], up[0], -forward[0], 0.0f,
+    right[1], up[1], -forward[1], 0.0f,
+    right[2], up[2], -forward[2], 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f
+  );
+
+  return rotationMatrix * translationMatrix;
+}
+
+qm::Mat4f qgl::lookAt(const qm::Vec3f& cameraPos, const qm::Vec3f& targetPos, const qm::Vec3f& cameraUp) {
+  qm::Vec3f forward, right, up = cameraUp;
+  return lookAt(cameraPos, targetPos, up, forward, right);
+}
+
+qm::Mat4f qgl::perspective(float fovY, float aspect, float near, float far) {
+  float fovRad = fovY * ONE_DEG_IN_RAD;
+  float range = tan(fovRad / 2.0f) * near;
+  float sx = (2.0f * near) / (range * aspect + range * aspect);
+  float sy = near / range;
+  float sz = -(far + near) / (far - near);
+  float pz = -(2.0f * far * near) / (far - near);
+  qm::Mat4f matrix = qm::Mat4f::zeroMatrix();
+  matrix[0] = sx;
+  matrix[5] = sy;
+  matrix[10] = sz;
+  matrix[14] = pz;
+  matrix[11] = -1.0f;
+
+  return matrix;
+}
+
+qm::Vec3f qgl::transformPoint(const qm::Mat4f& matrix, const qm::Vec3f& point) {
+  return qm::Vec3f(
+    matrix[0] * point[0] + matrix[4] * point[1] + matrix[8] * point[2] + matrix[12],
+    matrix[1] * point[0] + matrix[5] * point[1] + matrix[9] * point[2] + matrix[13],
+    matrix[2] * point[0] + matrix[6] * point[1] + matrix[10] * point[2] + matrix[14]
+  );
+}
+
+qm::Vec3f qgl::inverseTransformPoint(const qm::Mat4f& matrix, const qm::Vec3f& point) {
+  // Upper 3x3 block columns and translation
+  float a = matrix[0], b = matrix[4], c = matrix[8];
+  float d = matrix[1], e = matrix[5], f = matrix[9];
+  float g = matrix[2], h = matrix[6], i = matrix[10];
+  float x = point[0] - matrix[12], y = point[1] - matrix[13], z = point[2] - matrix[14];
+
+  // Cofactors
+  float A = e * i - f * h, B = -(d * i - f * g), C = d * h - e * g;
+  float determinant = a * A + b * B + c * C;
+  if (determinant == 0.f)
+    return qm::Vec3f(0.f, 0.f, 0.f);
+  float invDeterminant = 1.f / determinant;
+  return qm::Vec3f(
+    (A * x - (b * i - c * h) * y + (b * f - c * e) * z) * invDeterminant,
+    (B * x + (a * i - c * g) * y - (a * f - c * d) * z) * invDeterminant,
+    (C * x - (a * h - b * g) * y + (a * e - b * d) * z) * invDeterminant
+  );
+}
+
+void qgl::frustumPlanes(const qm::Mat4f& matrix, float planes[6][4]) {
+  for (int p = 0 ; p < 6 ; p++) {
+    // Row 3 plus or minus row 0, 1 or 2
+    int row = p / 2;
+    float sign = (p % 2 == 0) ? 1.f : -1.f;
+    for (int j = 0 ; j < 4 ; j++)
+      planes[p][j] = matrix[j * 4 + 3] + sign * matrix[j * 4 + row];
+    float length = sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+    for (int j = 0 ; j < 4 ; j++)
+      planes[p][j] /= length;
+  }
+}
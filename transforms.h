@@ -0,0 +1,33 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <cmath>
+
+#include <vec3.h>
+#include <mat4.h>
+
+#define ONE_DEG_IN_RAD (2.0 * M_PI) / 360.0 // 0.017444444
+
+
+namespace qgl {
+
+// View matrix, up is orthonormalized and forward/right are returned
+qm::Mat4f lookAt(const qm::Vec3f& cameraPos, const qm::Vec3f& targetPos, qm::Vec3f& up, qm::Vec3f& forward, qm::Vec3f& right);
+qm::Mat4f lookAt(const qm::Vec3f& cameraPos, const qm::Vec3f& targetPos, const qm::Vec3f& cameraUp);
+
+// fovY in degrees
+qm::Mat4f perspective(float fovY, float aspect, float near, float far);
+
+// Column-major matrix times point
+qm::Vec3f transformPoint(const qm::Mat4f& matrix, const qm::Vec3f& point);
+// Point transformed by the inverse of an affine matrix, without inverting the whole matrix
+qm::Vec3f inverseTransformPoint(const qm::Mat4f& matrix, const qm::Vec3f& point);
+
+// Frustum planes (a, b, c, d) of a projection matrix, in the space the matrix
+// transforms from: left, right, bottom, top, near, far. Normals are unit and
+// point inside, so a * x + b * y + c * z + d is a signed distance.
+void frustumPlanes(const qm::Mat4f& matrix, float planes[6][4]);
+
+}
+
+#endif // TRANSFORMS_H
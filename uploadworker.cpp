@@ -0,0 +1,215 @@
+#include "uploadworker.h"
+
+#include <iostream>
+
+using namespace qgl;
+using namespace std;
+using namespace qtools;
+
+UploadWorker::UploadWorker(Logger* logger) {
+  this->logger = logger;
+  sharedWindow = NULL;
+  inFlight = 0;
+  running = false;
+  stopping = false;
+}
+
+UploadWorker::~UploadWorker() {
+  stop();
+}
+
+bool UploadWorker::start(GLFWwindow* mainWindow) {
+  if (worker.joinable() || mainWindow == NULL)
+    return false;
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  sharedWindow = glfwCreateWindow(1, 1, "", NULL, mainWindow);
+  glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+  if (sharedWindow == NULL) {
+    if (logger != NULL)
+      *logger << "ERROR: could not create the upload context." << Logger::ERROR << Logger::FILE;
+    return false;
+  }
+  running = true;
+  stopping = false;
+  worker = thread(&UploadWorker::run, this);
+  return true;
+}
+
+#ifdef QGL_HEADLESS
+bool UploadWorker::start(const OffscreenContext& mainContext) {
+  if (worker.joinable() || !sharedContext.createShared(mainContext, logger))
+    return false;
+  running = true;
+  stopping = false;
+  worker = thread(&UploadWorker::run, this);
+  return true;
+}
+#endif
+
+void UploadWorker::stop() {
+  if (worker.joinable()) {
+    {
+      lock_guard<mutex> lock(uploadMutex);
+      stopping = true;
+    }
+    uploadCondition.notify_all();
+    worker.join();
+  }
+  // the fences belong to the share group, the rendering context can delete them
+  for (unsigned int i = 0 ; i < uploaded.size() ; i++)
+    if (uploaded[i].fence != NULL)
+      glDeleteSync(uploaded[i].fence);
+  uploaded.clear();
+  requests.clear();
+  inFlight = 0;
+  running = false;
+  if (sharedWindow != NULL) {
+    glfwDestroyWindow(sharedWindow);
+    sharedWindow = NULL;
+  }
+#ifdef QGL_HEADLESS
+  sharedContext.destroy();
+#endif
+}
+
+bool UploadWorker::makeCurrent() {
+  if (sharedWindow != NULL) {
+    glfwMakeContextCurrent(sharedWindow);
+    return true;
+  }
+#ifdef QGL_HEADLESS
+  return sharedContext.makeCurrent();
+#else
+  return false;
+#endif
+}
+
+void UploadWorker::releaseCurrent() {
+  if (sharedWindow != NULL)
+    glfwMakeContextCurrent(NULL);
+#ifdef QGL_HEADLESS
+  else
+    sharedContext.releaseCurrent();
+#endif
+}
+
+bool UploadWorker::isRunning() const {
+  lock_guard<mutex> lock(uploadMutex);
+  return running;
+}
+
+bool UploadWorker::queue(const Upload& request) {
+  {
+    lock_guard<mutex> lock(uploadMutex);
+    if (!running)
+      return false;
+    requests.push_back(request);
+    inFlight++;
+  }
+  uploadCondition.notify_one();
+  return true;
+}
+
+bool UploadWorker::upload(Object* object) {
+  Upload request = { object, NULL, NULL };
+  if (queue(request))
+    return false;
+  object->createVAO();
+  return true;
+}
+
+bool UploadWorker::upload(Material* material) {
+  Upload request = { NULL, material, NULL };
+  if (queue(request))
+    return false;
+  material->loadTextures();
+  return true;
+}
+
+void UploadWorker::run() {
+  if (!makeCurrent()) {
+    if (logger != NULL)
+      *logger << "ERROR: could not make the upload context current, uploading synchronously." << Logger::ERROR << Logger::FILE;
+    // The next uploads are done right away, the queued ones by collect
+    lock_guard<mutex> lock(uploadMutex);
+    running = false;
+    uploaded.insert(uploaded.end(), requests.begin(), requests.end());
+    requests.clear();
+    return;
+  }
+
+  while (true) {
+    Upload request;
+    {
+      unique_lock<mutex> lock(uploadMutex);
+      while (!stopping && requests.empty())
+        uploadCondition.wait(lock);
+      if (stopping)
+        break;
+      request = requests.front();
+      requests.pop_front();
+    }
+
+    if (request.object != NULL)
+      request.object->createBuffers();
+    if (request.material != NULL)
+      request.material->loadTextures();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    // The fence must reach the server before another context can wait on it
+    request.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    lock_guard<mutex> lock(uploadMutex);
+    uploaded.push_back(request);
+  }
+  releaseCurrent();
+}
+
+unsigned int UploadWorker::collect(vector<Object*>* objects) {
+  vector<Upload> candidates;
+  {
+    lock_guard<mutex> lock(uploadMutex);
+    candidates.swap(uploaded);
+  }
+
+  unsigned int completed = 0;
+  vector<Upload> waiting;
+  for (unsigned int i = 0 ; i < candidates.size() ; i++) {
+    if (candidates[i].fence == NULL) {
+      if (candidates[i].object != NULL)
+        candidates[i].object->createVAO();
+      if (candidates[i].material != NULL)
+        candidates[i].material->loadTextures();
+      if (objects != NULL && candidates[i].object != NULL)
+        objects->push_back(candidates[i].object);
+      completed++;
+      continue;
+    }
+    // Polls without waiting, the frame must not stall on an upload
+    GLenum status = glClientWaitSync(candidates[i].fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+      waiting.push_back(candidates[i]);
+      continue;
+    }
+    if (status == GL_WAIT_FAILED && logger != NULL)
+      *logger << "ERROR: upload fence wait failed." << Logger::ERROR << Logger::FILE;
+    glDeleteSync(candidates[i].fence);
+    if (candidates[i].object != NULL) {
+      candidates[i].object->createVertexArray();
+      if (objects != NULL)
+        objects->push_back(candidates[i].object);
+    }
+    completed++;
+  }
+
+  lock_guard<mutex> lock(uploadMutex);
+  uploaded.insert(uploaded.begin(), waiting.begin(), waiting.end());
+  inFlight -= completed;
+  return completed;
+}
+
+unsigned int UploadWorker::pendingUploads() const {
+  lock_guard<mutex> lock(uploadMutex);
+  return inFlight;
+}
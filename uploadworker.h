@@ -0,0 +1,88 @@
+#ifndef UPLOADWORKER_H
+#define UPLOADWORKER_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <logger.h>
+
+#include "object.h"
+#include "material.h"
+#include "offscreencontext.h"
+
+
+namespace qgl {
+
+// Creates buffers and textures in a loader thread owning a second GL context
+// that shares its objects with the rendering one. Each upload is followed by
+// a fence, the rendering thread only builds the vertex array, which cannot
+// be shared, once the fence has signaled. Objects and materials must not be
+// used for rendering until collect has returned them.
+class UploadWorker {
+
+  public:
+    UploadWorker(qtools::Logger* logger = NULL);
+    ~UploadWorker();
+
+    // A hidden window shares the objects of the main window. Must be called from
+    // the main thread, like all GLFW window functions.
+    bool start(GLFWwindow* mainWindow);
+#ifdef QGL_HEADLESS
+    bool start(const OffscreenContext& mainContext);
+#endif
+    void stop();
+    // False again when the worker could not make its context current
+    bool isRunning() const;
+
+    // The object vertices must be computed. Without a running worker the
+    // uploads are done right away in the calling thread and true is returned;
+    // the ones the worker could not do are done by collect.
+    bool upload(Object* object);
+    bool upload(Material* material);
+
+    // Rendering thread, each frame: creates the vertex arrays of the uploads
+    // that have completed and returns how many completed. The objects, when
+    // given, receives the uploaded objects, which the worker no longer uses.
+    unsigned int collect(std::vector<Object*>* objects = NULL);
+    unsigned int pendingUploads() const;
+
+  private:
+    UploadWorker(const UploadWorker&);
+    UploadWorker& operator=(const UploadWorker&);
+
+    struct Upload {
+      Object* object;
+      Material* material;
+      GLsync fence; // NULL when the worker gave up, see run
+    };
+
+    void run();
+    // False when the worker is not running and the upload must be done right away
+    bool queue(const Upload& request);
+    bool makeCurrent();
+    void releaseCurrent();
+
+    qtools::Logger* logger;
+    GLFWwindow* sharedWindow;
+#ifdef QGL_HEADLESS
+    OffscreenContext sharedContext;
+#endif
+    std::thread worker;
+    mutable std::mutex uploadMutex;
+    std::condition_variable uploadCondition;
+    std::deque<Upload> requests;
+    std::vector<Upload> uploaded;
+    unsigned int inFlight;
+    bool running;
+    bool stopping;
+
+};
+
+}
+
+#endif // UPLOADWORKER_H